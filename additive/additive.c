@@ -0,0 +1,187 @@
+#include "additive.h"
+#include <math.h>
+#include <string.h>
+
+/**
+ * Four-term Blackman-Harris coefficients (92 dB sidelobes, main lobe of +-4 bins).
+ */
+static const double bhCoeffs[4] = {0.35875, 0.48829, 0.14128, 0.01168};
+
+/**
+ * Periodic Blackman-Harris window over nfft samples.
+ * @param n - the sample index
+ * @param nfft - the window length
+ * @return the window value
+ */
+static double bhWindow(unsigned long n, unsigned long nfft);
+
+/**
+ * Tabulate the zero-phase transform of the window (centred on nfft / 2) over +-ADD_KERNELBINS bins, scaled
+ * by 1 / nfft for kiss_fftri.
+ * @param synth - pointer to an ADDITIVE object with nfft and kernel set up
+ */
+static void buildKernel(ADDITIVE * synth);
+
+/**
+ * Allocate an inverse real FFT configuration with its memory taken from an allocator.
+ * @param nfft - the FFT length
+ * @param alloc - the allocator, or NULL for the heap
+ * @return the configuration, or NULL if unsuccessful
+ */
+static kiss_fftr_cfg allocateInverseConfig(unsigned long nfft, const DSPALLOC * alloc);
+
+static double bhWindow(unsigned long n, unsigned long nfft) {
+    double x = 2.0 * M_PI * (double) n / (double) nfft;
+    return bhCoeffs[0] - bhCoeffs[1] * cos(x) + bhCoeffs[2] * cos(2.0 * x) - bhCoeffs[3] * cos(3.0 * x);
+}
+
+static void buildKernel(ADDITIVE * synth) {
+    unsigned long len = 2 * ADD_KERNELBINS * ADD_KERNELOS + 1, k, n;
+    double nu, sum, half = 0.5 * (double) synth->nfft;
+
+    for(k = 0; k < len; k++) {
+        nu = (double) k / ADD_KERNELOS - ADD_KERNELBINS;
+        sum = 0.0;
+        /* The window is symmetric about nfft / 2, so its transform about the centre is real */
+        for(n = 0; n < synth->nfft; n++) {
+            sum += bhWindow(n, synth->nfft) * cos(2.0 * M_PI * nu * ((double) n - half) / (double) synth->nfft);
+        }
+        synth->kernel[k] = sum / (double) synth->nfft;
+    }
+}
+
+static kiss_fftr_cfg allocateInverseConfig(unsigned long nfft, const DSPALLOC * alloc) {
+    size_t len = 0;
+    void * mem;
+    kiss_fftr_alloc((int) nfft, 1, NULL, &len);
+    if(!len || !(mem = dsp_alloc(alloc, len))) {
+        return NULL;
+    }
+    return kiss_fftr_alloc((int) nfft, 1, mem, &len);
+}
+
+ADDITIVE * new_ADDITIVE(double fs, unsigned long hop, unsigned long maxpartials) {
+    return new_ADDITIVE_a(fs, hop, maxpartials, NULL);
+}
+
+ADDITIVE * new_ADDITIVE_a(double fs, unsigned long hop, unsigned long maxpartials, const DSPALLOC * alloc) {
+    ADDITIVE * synth;
+    unsigned long n, quarter;
+    double tri;
+
+    if(fs <= 0.0 || hop < 16 || !maxpartials) {
+        return NULL;
+    }
+    if(!(synth = (ADDITIVE *) dsp_calloc(alloc, 1, sizeof(ADDITIVE)))) {
+        return NULL;
+    }
+    synth->fs = fs;
+    synth->hop = hop;
+    synth->nfft = 4 * hop;
+    synth->maxpartials = maxpartials;
+    synth->kernel = (double *) dsp_alloc(alloc, (2 * ADD_KERNELBINS * ADD_KERNELOS + 1) * sizeof(double));
+    synth->gain = (double *) dsp_alloc(alloc, 2 * hop * sizeof(double));
+    synth->phases = (double *) dsp_calloc(alloc, maxpartials, sizeof(double));
+    synth->accum = (double *) dsp_calloc(alloc, 2 * hop, sizeof(double));
+    synth->cfg = allocateInverseConfig(synth->nfft, alloc);
+    synth->spectrum = (kiss_fft_cpx *) dsp_alloc(alloc, (synth->nfft / 2 + 1) * sizeof(kiss_fft_cpx));
+    synth->frame = (kiss_fft_scalar *) dsp_alloc(alloc, synth->nfft * sizeof(kiss_fft_scalar));
+    if(!synth->kernel || !synth->gain || !synth->phases || !synth->accum || !synth->cfg || !synth->spectrum ||
+       !synth->frame) {
+        clear_ADDITIVE_a(&synth, alloc);
+        return NULL;
+    }
+    buildKernel(synth);
+    /* The centre half of the frame, from nfft / 4 to 3 * nfft / 4, where the window is at least 0.22 */
+    quarter = hop;
+    for(n = 0; n < 2 * hop; n++) {
+        tri = 1.0 - fabs((double) n - (double) quarter) / (double) quarter;
+        synth->gain[n] = tri / bhWindow(n + quarter, synth->nfft);
+    }
+    return synth;
+}
+
+int additive_frame(ADDITIVE * synth, const double * freqs, const double * amps, const double * phases,
+                   unsigned long npartials, double * output) {
+    unsigned long i, nbins = synth->nfft / 2, half = synth->nfft / 2, hop = synth->hop;
+    long j, first, last;
+    double binwidth = synth->fs / (double) synth->nfft, centre, pos, frac, w, re, im, vr, vi, phase;
+    double advance = 2.0 * M_PI * (double) hop / synth->fs;
+    const double * kernel = synth->kernel;
+    kiss_fft_cpx * spectrum = synth->spectrum;
+
+    if(npartials > synth->maxpartials) {
+        return 0;
+    }
+    memset(spectrum, 0, (nbins + 1) * sizeof(kiss_fft_cpx));
+    for(i = 0; i < npartials; i++) {
+        phase = phases ? phases[i] : synth->phases[i];
+        synth->phases[i] = fmod(phase + advance * freqs[i], 2.0 * M_PI);
+        if(amps[i] == 0.0 || freqs[i] <= 0.0 || freqs[i] >= 0.5 * synth->fs) {
+            continue;
+        }
+        centre = freqs[i] / binwidth;
+        /* Half of the amplitude goes to the positive frequency; the (-1)^j of the centred window is folded in below */
+        re = 0.5 * amps[i] * cos(phase);
+        im = 0.5 * amps[i] * sin(phase);
+        first = (long) ceil(centre - ADD_KERNELBINS);
+        last = (long) floor(centre + ADD_KERNELBINS);
+        for(j = first; j <= last; j++) {
+            pos = ((double) j - centre + ADD_KERNELBINS) * ADD_KERNELOS;
+            frac = pos - floor(pos);
+            w = (long) pos >= 2 * ADD_KERNELBINS * ADD_KERNELOS ? kernel[2 * ADD_KERNELBINS * ADD_KERNELOS] :
+                kernel[(long) pos] + frac * (kernel[(long) pos + 1] - kernel[(long) pos]);
+            if(j & 1) {
+                w = -w;
+            }
+            vr = re * w;
+            vi = im * w;
+            /* Bins past either end of the half spectrum are the conjugate of a bin inside it */
+            if(j >= 0 && j <= (long) nbins) {
+                spectrum[j].r += vr;
+                spectrum[j].i += vi;
+            }
+            if(j <= 0) {
+                spectrum[-j].r += vr;
+                spectrum[-j].i -= vi;
+            }
+            if(j >= (long) nbins) {
+                spectrum[synth->nfft - j].r += vr;
+                spectrum[synth->nfft - j].i -= vi;
+            }
+        }
+    }
+    kiss_fftri(synth->cfg, spectrum, synth->frame);
+
+    /* Swap the window for the triangle over the centre half and overlap-add */
+    for(i = 0; i < 2 * hop; i++) {
+        synth->accum[i] += synth->frame[i + half / 2] * synth->gain[i];
+    }
+    memcpy(output, synth->accum, hop * sizeof(double));
+    memmove(synth->accum, synth->accum + hop, hop * sizeof(double));
+    memset(synth->accum + hop, 0, hop * sizeof(double));
+    return 1;
+}
+
+void additive_reset(ADDITIVE * synth) {
+    memset(synth->accum, 0, 2 * synth->hop * sizeof(double));
+    memset(synth->phases, 0, synth->maxpartials * sizeof(double));
+}
+
+void clear_ADDITIVE(ADDITIVE ** synth) {
+    clear_ADDITIVE_a(synth, NULL);
+}
+
+void clear_ADDITIVE_a(ADDITIVE ** synth, const DSPALLOC * alloc) {
+    if(synth && *synth) {
+        dsp_free(alloc, (*synth)->kernel);
+        dsp_free(alloc, (*synth)->gain);
+        dsp_free(alloc, (*synth)->phases);
+        dsp_free(alloc, (*synth)->accum);
+        dsp_free(alloc, (*synth)->cfg);
+        dsp_free(alloc, (*synth)->spectrum);
+        dsp_free(alloc, (*synth)->frame);
+        dsp_free(alloc, *synth);
+        *synth = NULL;
+    }
+}
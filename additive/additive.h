@@ -0,0 +1,109 @@
+#ifndef _ADDITIVE_H_
+#define _ADDITIVE_H_
+
+#include <kiss_fft.h>
+#include <kiss_fftr.h>
+#include "dspalloc.h"
+
+/**
+ * Half-width in bins of the spectral kernel each partial is drawn with (the Blackman-Harris main lobe).
+ */
+#define ADD_KERNELBINS 4
+
+/**
+ * Kernel table entries per bin.
+ */
+#define ADD_KERNELOS 64
+
+/**
+ * Defines the schema for an inverse-FFT additive synthesiser.
+ *
+ * Each frame, every partial is drawn into a spectrum as the 2 * ADD_KERNELBINS + 1 bins of a Blackman-Harris
+ * window's transform around its frequency, so the cost per partial is a handful of bins whatever the block
+ * size, and one inverse real FFT of nfft = 4 * hop points renders all of them. The window is divided back out
+ * over the centre half of the frame and replaced by a triangle, and the triangles of successive frames
+ * overlap-add to one, crossfading each partial's amplitude and frequency from frame to frame.
+ *
+ * A frame's parameters are reached hop samples after the start of the block it is rendered in.
+ *
+ * @param fs - the sample rate
+ * @param nfft - the frame length (4 * hop)
+ * @param hop - the number of samples rendered per frame
+ * @param maxpartials - the number of partials whose phase the synthesiser keeps track of
+ * @param kernel - the window transform over +-ADD_KERNELBINS bins, ADD_KERNELOS entries per bin, scaled for the inverse FFT
+ * @param gain - the triangle divided by the window, over the centre half of the frame
+ * @param phases - the running phase of each partial at the centre of the next frame (radians)
+ * @param accum - the overlap-add buffer, 2 * hop samples
+ * @param cfg - the inverse real FFT configuration
+ * @param spectrum - the frame spectrum, nfft / 2 + 1 bins
+ * @param frame - the frame samples
+ */
+typedef struct additive {
+    double fs;
+    unsigned long nfft;
+    unsigned long hop;
+    unsigned long maxpartials;
+    double * kernel;
+    double * gain;
+    double * phases;
+    double * accum;
+    kiss_fftr_cfg cfg;
+    kiss_fft_cpx * spectrum;
+    kiss_fft_scalar * frame;
+} ADDITIVE;
+
+/**
+ * Create an additive synthesiser.
+ * @param fs - the sample rate
+ * @param hop - the number of samples rendered per frame (at least 16; a power of 2 is fastest). Shorter hops
+ * follow fast parameter changes more closely, longer ones cost less per sample.
+ * @param maxpartials - the largest number of partials rendered per frame
+ * @return pointer to a dynamically allocated ADDITIVE object, or NULL if unsuccessful
+ */
+ADDITIVE * new_ADDITIVE(double fs, unsigned long hop, unsigned long maxpartials);
+
+/**
+ * Create an additive synthesiser with the object and its buffers taken from an allocator.
+ * @param fs - the sample rate
+ * @param hop - the number of samples rendered per frame (at least 16)
+ * @param maxpartials - the largest number of partials rendered per frame
+ * @param alloc - the allocator, or NULL for the heap
+ * @return pointer to an ADDITIVE object, or NULL if unsuccessful
+ */
+ADDITIVE * new_ADDITIVE_a(double fs, unsigned long hop, unsigned long maxpartials, const DSPALLOC * alloc);
+
+/**
+ * Render one frame of hop samples. Partials at or above fs / 2, or with zero amplitude, are silent.
+ * Performs no allocation.
+ * @param synth - pointer to an ADDITIVE object
+ * @param freqs - the frequency of each partial (Hz)
+ * @param amps - the amplitude of each partial
+ * @param phases - the phase of each partial at the centre of the frame (radians), or NULL to continue each
+ * partial's phase from the previous frame
+ * @param npartials - the number of partials (at most maxpartials)
+ * @param output - the output, hop samples
+ * @return boolean integer specifying whether the frame was rendered
+ */
+int additive_frame(ADDITIVE * synth, const double * freqs, const double * amps, const double * phases,
+                   unsigned long npartials, double * output);
+
+/**
+ * Silence the synthesiser and reset every partial's phase to 0.
+ * @param synth - pointer to an ADDITIVE object
+ */
+void additive_reset(ADDITIVE * synth);
+
+/**
+ * Destroy an additive synthesiser.
+ * @param synth - pointer to a pointer for the ADDITIVE object, set to NULL on return
+ */
+void clear_ADDITIVE(ADDITIVE ** synth);
+
+/**
+ * Destroy an additive synthesiser created by new_ADDITIVE_a.
+ * @param synth - pointer to a pointer for the ADDITIVE object, set to NULL on return
+ * @param alloc - the allocator the synthesiser was created with
+ */
+void clear_ADDITIVE_a(ADDITIVE ** synth, const DSPALLOC * alloc);
+
+#endif
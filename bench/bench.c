@@ -0,0 +1,1276 @@
+/*
+ dspbench - throughput benchmarks for the DSP modules, reported as JSON.
+
+ usage: dspbench [-r reps] [-f filter] [-o outfile] [-q]
+
+ Every case runs a fixed, deterministic workload (fixed sizes, parameters and noise seed) once to warm up
+ and then reps times, reporting the best and median wall time and the best-case throughput in items per
+ second. Only cases whose name contains the filter string are run. -q scales every workload down 16 times
+ for a quick smoke run. Results go to stdout unless an output file is given.
+ */
+#include "bench.h"
+#include "wave.h"
+#include "gtable.h"
+#include "breakpoint.h"
+#include "pan.h"
+#include "sweep.h"
+#include "helpers.h"
+#include "instrument.h"
+#include "ringbuf.h"
+#include "fir.h"
+#include "resample.h"
+#include "render.h"
+#ifdef DSP_HAVE_KISSFFT
+#include "fftproc.h"
+#include "tabextract.h"
+#include "additive.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+#ifndef DSP_BENCH_FLAGS
+#define DSP_BENCH_FLAGS ""
+#endif
+#ifndef DSP_BENCH_BUILD_TYPE
+#define DSP_BENCH_BUILD_TYPE ""
+#endif
+
+/* Results are accumulated here so the compiler cannot discard the work being timed */
+volatile double sink;
+
+/**
+ * Returns the monotonic clock in seconds.
+ */
+static double now(void);
+
+/**
+ * Returns a deterministic pseudo-random value in [-1, 1) from a linear congruential generator.
+ * @param seed - pointer to the generator state
+ */
+static double noise(unsigned long * seed);
+
+/**
+ * Writes a JSON string literal, escaping quotes, backslashes and control characters.
+ * @param out - the output stream
+ * @param str - the string
+ */
+static void jsonString(FILE * out, const char * str);
+
+static void benchOscillators(BENCHCTX * ctx);
+static void benchBreakpoints(BENCHCTX * ctx);
+static void benchPan(BENCHCTX * ctx);
+static void benchSweep(BENCHCTX * ctx);
+static void benchRing(BENCHCTX * ctx);
+static void benchFIR(BENCHCTX * ctx);
+static void benchResample(BENCHCTX * ctx);
+static void benchRender(BENCHCTX * ctx);
+#ifdef DSP_HAVE_KISSFFT
+static void benchUPOLS(BENCHCTX * ctx);
+static void benchSTFT(BENCHCTX * ctx);
+static void benchTabExtract(BENCHCTX * ctx);
+static void benchAdditive(BENCHCTX * ctx);
+#endif
+#ifdef DSP_INSTRUMENT
+static void writeProbes(BENCHCTX * ctx);
+#endif
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static double noise(unsigned long * seed) {
+    *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return (double) *seed / 1073741824.0 - 1.0;
+}
+
+static void jsonString(FILE * out, const char * str) {
+    fputc('"', out);
+    for(; *str; str++) {
+        if(*str == '"' || *str == '\\') {
+            fprintf(out, "\\%c", *str);
+        }
+        else if((unsigned char) *str < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char) *str);
+        }
+        else {
+            fputc(*str, out);
+        }
+    }
+    fputc('"', out);
+}
+
+int wanted(const BENCHCTX * ctx, const char * name) {
+    return !ctx->filter || strstr(name, ctx->filter);
+}
+
+static int compareDouble(const void * a, const void * b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+void timeCase(BENCHCTX * ctx, const char * name, const char * params, const char * unit,
+              unsigned long items, BENCHFUNC func, void * state) {
+    double times[BENCH_MAXREPS];
+    double start, best, median;
+    int rep;
+
+    func(state);
+    for(rep = 0; rep < ctx->reps; rep++) {
+        start = now();
+        func(state);
+        times[rep] = now() - start;
+    }
+    qsort(times, ctx->reps, sizeof(double), compareDouble);
+    best = times[0];
+    median = ctx->reps % 2 ? times[ctx->reps / 2] : 0.5 * (times[ctx->reps / 2 - 1] + times[ctx->reps / 2]);
+
+    fprintf(ctx->out, "%s\n    {\"name\": ", ctx->ncases ? "," : "");
+    jsonString(ctx->out, name);
+    fprintf(ctx->out, ", \"params\": %s, \"unit\": \"%s\", \"items\": %lu, \"best_s\": %.9f, "
+            "\"median_s\": %.9f, \"items_per_sec\": %.1f}",
+            params, unit, items, best, median, best > 0.0 ? items / best : 0.0);
+    fflush(ctx->out);
+    fprintf(stderr, "%-32s %14.0f %s/s\n", name, best > 0.0 ? items / best : 0.0, unit);
+    ctx->ncases++;
+}
+
+/*
+ Oscillators
+ */
+
+typedef struct oscilcase {
+    OSCIL * osc;
+    tickfunc tick;
+    TOSCIL * tosc;
+    TABFUNC tabtick;
+    unsigned long n;
+} OSCILCASE;
+
+static void runOscil(void * state) {
+    OSCILCASE * c = state;
+    double sum = 0.0;
+    unsigned long i;
+    for(i = 0; i < c->n; i++) {
+        sum += c->tick(c->osc, 440.0);
+    }
+    sink += sum;
+}
+
+static void runTableOscil(void * state) {
+    OSCILCASE * c = state;
+    double sum = 0.0;
+    unsigned long i;
+    for(i = 0; i < c->n; i++) {
+        sum += c->tabtick(c->tosc, 440.0);
+    }
+    sink += sum;
+}
+
+static void benchOscillators(BENCHCTX * ctx) {
+    static const char * names[] = {"oscil/sine", "oscil/square", "oscil/sawdown", "oscil/sawup", "oscil/tri"};
+    tickfunc ticks[] = {sinetick, squaretick, sawdtick, sawutick, tritick};
+    OSCILCASE c;
+    GTABLE * tables[2];
+    const char * tablenames[2][2] = {{"oscil/table/sine/truncate", "oscil/table/sine/interp"},
+                                     {"oscil/table/saw/truncate", "oscil/table/saw/interp"}};
+    unsigned long i;
+
+    memset(&c, 0, sizeof(c));
+    c.n = (1UL << 22) / ctx->scale;
+    for(i = 0; i < sizeof(ticks) / sizeof(ticks[0]); i++) {
+        if(!wanted(ctx, names[i])) {
+            continue;
+        }
+        if(!(c.osc = oscil(BENCH_FS, 0.0))) {
+            continue;
+        }
+        c.tick = ticks[i];
+        timeCase(ctx, names[i], "{\"freq\": 440, \"fs\": 48000}", "samples", c.n, runOscil, &c);
+        freeOscil_a(&c.osc, NULL);
+    }
+
+    tables[0] = sinetable(1024);
+    tables[1] = sawtable(1024, 40, SAW_UP);
+    for(i = 0; i < 2; i++) {
+        if(!tables[i]) {
+            continue;
+        }
+        if(wanted(ctx, tablenames[i][0]) && (c.tosc = oscil_t(BENCH_FS, 0.0, tables[i]))) {
+            c.tabtick = tabtick;
+            timeCase(ctx, tablenames[i][0], "{\"freq\": 440, \"fs\": 48000, \"tablen\": 1024}", "samples",
+                     c.n, runTableOscil, &c);
+            freeTOscil_a(&c.tosc, NULL);
+        }
+        if(wanted(ctx, tablenames[i][1]) && (c.tosc = oscil_t(BENCH_FS, 0.0, tables[i]))) {
+            c.tabtick = tabitick;
+            timeCase(ctx, tablenames[i][1], "{\"freq\": 440, \"fs\": 48000, \"tablen\": 1024}", "samples",
+                     c.n, runTableOscil, &c);
+            freeTOscil_a(&c.tosc, NULL);
+        }
+        freeTable(&tables[i]);
+    }
+}
+
+/*
+ Breakpoints
+ */
+
+typedef struct brkcase {
+    char * text;
+    size_t len;
+    unsigned long npoints;
+    BRKSTREAM * stream;
+    double * buffer;
+    unsigned long n;
+} BRKCASE;
+
+static void runParse(void * state) {
+    BRKCASE * c = state;
+    unsigned long size = 0;
+    BREAKPOINT * points = parseBreakpoints(c->text, c->len, &size);
+    if(points) {
+        sink += points[size - 1].value;
+        free(points);
+    }
+}
+
+static void runBrkTick(void * state) {
+    BRKCASE * c = state;
+    double sum = 0.0;
+    unsigned long i;
+    bps_seeksample(c->stream, 0);
+    for(i = 0; i < c->n; i++) {
+        sum += bps_tick(c->stream);
+    }
+    sink += sum;
+}
+
+static void runBrkRender(void * state) {
+    BRKCASE * c = state;
+    unsigned long done;
+    bps_seeksample(c->stream, 0);
+    for(done = 0; done < c->n; done += BENCH_BLOCK) {
+        bps_render(c->stream, c->buffer, BENCH_BLOCK);
+    }
+    sink += c->buffer[BENCH_BLOCK - 1];
+}
+
+static void benchBreakpoints(BENCHCTX * ctx) {
+    BRKCASE c;
+    BREAKPOINT * points;
+    BRKTABLE * table;
+    unsigned long i, size = 0, seed = 1;
+    size_t cap;
+    char params[128];
+
+    memset(&c, 0, sizeof(c));
+    c.npoints = 200000 / ctx->scale;
+    /* Random-walk envelope, one point per millisecond, in the text format */
+    cap = c.npoints * 48;
+    if(!(c.text = malloc(cap))) {
+        return;
+    }
+    for(i = 0; i < c.npoints; i++) {
+        c.len += snprintf(c.text + c.len, cap - c.len, "%.6f\t%.9f\n", i * 0.001, noise(&seed));
+    }
+    snprintf(params, sizeof(params), "{\"points\": %lu, \"bytes\": %lu}", c.npoints, (unsigned long) c.len);
+    if(wanted(ctx, "breakpoint/parse")) {
+        timeCase(ctx, "breakpoint/parse", params, "points", c.npoints, runParse, &c);
+    }
+
+    if((wanted(ctx, "breakpoint/tick") || wanted(ctx, "breakpoint/render")) &&
+       (points = parseBreakpoints(c.text, c.len, &size))) {
+        if(!(table = bpt_new(points, NULL, size))) {
+            free(points);
+        }
+        else {
+            c.stream = bps_new_a(table, (unsigned long) BENCH_FS, NULL);
+            c.buffer = malloc(BENCH_BLOCK * sizeof(double));
+            /* Ticking over the whole table crosses a segment every 48 samples */
+            c.n = (unsigned long) (BENCH_FS * 0.001 * (size - 1)) / BENCH_BLOCK * BENCH_BLOCK;
+            snprintf(params, sizeof(params), "{\"points\": %lu, \"fs\": 48000}", size);
+            if(c.stream && wanted(ctx, "breakpoint/tick")) {
+                timeCase(ctx, "breakpoint/tick", params, "samples", c.n, runBrkTick, &c);
+            }
+            if(c.stream && c.buffer && wanted(ctx, "breakpoint/render")) {
+                timeCase(ctx, "breakpoint/render", params, "samples", c.n, runBrkRender, &c);
+            }
+            free(c.buffer);
+            bps_free_a(&c.stream, NULL);
+            bpt_release(&table);
+        }
+    }
+    free(c.text);
+}
+
+/*
+ Pan kernels
+ */
+
+typedef struct pancase {
+    float * in;
+    float * out;
+    float * right;
+    double * positions;
+    unsigned long n;
+    PANMODE mode;
+    PANLAW law;
+} PANCASE;
+
+static void runStereoPan(void * state) {
+    PANCASE * c = state;
+    unsigned long done;
+    for(done = 0; done < c->n; done += BENCH_BLOCK) {
+        stereoPan(c->in, c->out, BENCH_BLOCK, constPower(0.25));
+    }
+    sink += c->out[1];
+}
+
+static void runPanInterleaved(void * state) {
+    PANCASE * c = state;
+    PANPOS start = constPower(-0.5), end = constPower(0.5);
+    unsigned long done;
+    for(done = 0; done < c->n; done += BENCH_BLOCK) {
+        stereoPanInterleaved(c->in, c->out, BENCH_BLOCK, start, end, c->mode);
+    }
+    sink += c->out[1];
+}
+
+static void runPanPlanar(void * state) {
+    PANCASE * c = state;
+    PANPOS start = constPower(-0.5), end = constPower(0.5);
+    unsigned long done;
+    for(done = 0; done < c->n; done += BENCH_BLOCK) {
+        stereoPanPlanar(c->in, c->out, c->right, BENCH_BLOCK, start, end, c->mode);
+    }
+    sink += c->right[0];
+}
+
+static void runPanDynamic(void * state) {
+    PANCASE * c = state;
+    unsigned long done;
+    for(done = 0; done < c->n; done += BENCH_BLOCK) {
+        stereoPanDynamic(c->in, c->out, c->positions, BENCH_BLOCK, c->law, PAN_REPLACE);
+    }
+    sink += c->out[1];
+}
+
+static void benchPan(BENCHCTX * ctx) {
+    PANCASE c;
+    unsigned long i, seed = 2;
+    const char * params = "{\"block\": 256}";
+
+    memset(&c, 0, sizeof(c));
+    c.n = (1UL << 22) / ctx->scale;
+    c.in = malloc(BENCH_BLOCK * sizeof(float));
+    c.out = malloc(2 * BENCH_BLOCK * sizeof(float));
+    c.right = malloc(BENCH_BLOCK * sizeof(float));
+    c.positions = malloc(BENCH_BLOCK * sizeof(double));
+    if(c.in && c.out && c.right && c.positions) {
+        for(i = 0; i < BENCH_BLOCK; i++) {
+            c.in[i] = (float) noise(&seed);
+            c.positions[i] = noise(&seed);
+            c.out[2 * i] = c.out[2 * i + 1] = c.right[i] = 0.0f;
+        }
+        if(wanted(ctx, "pan/stereoPan")) {
+            timeCase(ctx, "pan/stereoPan", params, "samples", c.n, runStereoPan, &c);
+        }
+        c.mode = PAN_REPLACE;
+        if(wanted(ctx, "pan/interleaved/replace")) {
+            timeCase(ctx, "pan/interleaved/replace", params, "samples", c.n, runPanInterleaved, &c);
+        }
+        if(wanted(ctx, "pan/planar/replace")) {
+            timeCase(ctx, "pan/planar/replace", params, "samples", c.n, runPanPlanar, &c);
+        }
+        c.mode = PAN_MIX;
+        if(wanted(ctx, "pan/interleaved/mix")) {
+            timeCase(ctx, "pan/interleaved/mix", params, "samples", c.n, runPanInterleaved, &c);
+        }
+        if(wanted(ctx, "pan/planar/mix")) {
+            timeCase(ctx, "pan/planar/mix", params, "samples", c.n, runPanPlanar, &c);
+        }
+        c.law = PAN_LINEAR;
+        if(wanted(ctx, "pan/dynamic/linear")) {
+            timeCase(ctx, "pan/dynamic/linear", params, "samples", c.n, runPanDynamic, &c);
+        }
+        c.law = PAN_CONSTPOWER;
+        if(wanted(ctx, "pan/dynamic/constpower")) {
+            timeCase(ctx, "pan/dynamic/constpower", params, "samples", c.n, runPanDynamic, &c);
+        }
+    }
+    free(c.in);
+    free(c.out);
+    free(c.right);
+    free(c.positions);
+}
+
+/*
+ Sweeps
+ */
+
+typedef struct sweepcase {
+    double T;
+    ESSGEN * gen;
+    double * buffer;
+    unsigned long n;
+} SWEEPCASE;
+
+static void runNewSweep(void * state) {
+    SWEEPCASE * c = state;
+    ESS * sweep = newSweep(c->T, BENCH_FS, 20.0, 20000.0);
+    if(sweep) {
+        sink += sweep->forward[sweep->size / 2];
+        clearSweep(&sweep);
+    }
+}
+
+static void runSweepGen(void * state) {
+    SWEEPCASE * c = state;
+    unsigned long done;
+    essgen_reset(c->gen);
+    for(done = 0; done < c->n; done += BENCH_BLOCK) {
+        essgen_forward(c->gen, c->buffer, BENCH_BLOCK);
+    }
+    sink += c->buffer[0];
+}
+
+static void benchSweep(BENCHCTX * ctx) {
+    SWEEPCASE c;
+    char params[128];
+
+    memset(&c, 0, sizeof(c));
+    c.T = 16.0 / ctx->scale;
+    c.n = (unsigned long) (c.T * BENCH_FS) / BENCH_BLOCK * BENCH_BLOCK;
+    snprintf(params, sizeof(params), "{\"T\": %g, \"fs\": 48000, \"f1\": 20, \"f2\": 20000}", c.T);
+    if(wanted(ctx, "sweep/newSweep")) {
+        timeCase(ctx, "sweep/newSweep", params, "samples", c.n, runNewSweep, &c);
+    }
+    if(wanted(ctx, "sweep/generator")) {
+        c.gen = newSweepGen(c.T, BENCH_FS, 20.0, 20000.0);
+        c.buffer = malloc(BENCH_BLOCK * sizeof(double));
+        if(c.gen && c.buffer) {
+            timeCase(ctx, "sweep/generator", params, "samples", c.n, runSweepGen, &c);
+        }
+        free(c.buffer);
+        clearSweepGen(&c.gen);
+    }
+}
+
+/*
+ SPSC ring buffer. Each pass streams a counter through the ring from this thread to a consumer thread, which
+ reads every element. Ordering and wraparound are checked by tests/test_ringbuf.c, not here.
+ */
+
+enum {RING_COPY, RING_ZEROCOPY, RING_SINGLE};
+
+typedef struct ringcase {
+    RINGBUF * ring;
+    unsigned long n;
+    size_t chunk;
+    int mode;
+    uint64_t sum;
+} RINGCASE;
+
+static void * ringConsumer(void * arg) {
+    RINGCASE * c = arg;
+    uint64_t buffer[BENCH_BLOCK];
+    const void * region;
+    const uint64_t * items;
+    uint64_t received = 0;
+    size_t got, i;
+
+    while(received < c->n) {
+        if(c->mode == RING_ZEROCOPY) {
+            got = ring_peek(c->ring, &region, c->chunk);
+            items = region;
+        }
+        else {
+            got = ring_pop(c->ring, buffer, c->mode == RING_SINGLE ? 1 : c->chunk);
+            items = buffer;
+        }
+        if(!got) {
+            /* Empty: let the producer run (matters on machines with fewer cores than threads) */
+            sched_yield();
+            continue;
+        }
+        for(i = 0; i < got; i++) {
+            c->sum += items[i];
+        }
+        received += got;
+        if(c->mode == RING_ZEROCOPY) {
+            ring_release(c->ring, got);
+        }
+    }
+    return NULL;
+}
+
+static void runRing(void * state) {
+    RINGCASE * c = state;
+    pthread_t consumer;
+    uint64_t buffer[BENCH_BLOCK];
+    uint64_t next = 0;
+    void * region;
+    size_t want, got, i;
+
+    if(pthread_create(&consumer, NULL, ringConsumer, c)) {
+        quit("Could not start ring consumer thread");
+    }
+    while(next < c->n) {
+        want = c->n - next < c->chunk ? c->n - next : c->chunk;
+        if(c->mode == RING_ZEROCOPY) {
+            got = ring_reserve(c->ring, &region, want);
+            for(i = 0; i < got; i++) {
+                ((uint64_t *) region)[i] = next + i;
+            }
+            ring_commit(c->ring, got);
+        }
+        else {
+            if(c->mode == RING_SINGLE) {
+                want = 1;
+            }
+            for(i = 0; i < want; i++) {
+                buffer[i] = next + i;
+            }
+            got = ring_push(c->ring, buffer, want);
+        }
+        if(!got) {
+            sched_yield();
+        }
+        next += got;
+    }
+    pthread_join(consumer, NULL);
+    sink += (double) c->sum;
+}
+
+static void benchRing(BENCHCTX * ctx) {
+    static const char * names[] = {"ringbuf/copy", "ringbuf/zerocopy", "ringbuf/single"};
+    RINGCASE c;
+    int mode;
+
+    memset(&c, 0, sizeof(c));
+    c.n = (1UL << 24) / ctx->scale;
+    c.chunk = 64;
+    for(mode = RING_COPY; mode <= RING_SINGLE; mode++) {
+        if(!wanted(ctx, names[mode])) {
+            continue;
+        }
+        /* 8-byte elements: the size of a stereo float frame or a message pointer */
+        if(!(c.ring = ring_new(1024, sizeof(uint64_t)))) {
+            continue;
+        }
+        c.mode = mode;
+        timeCase(ctx, names[mode], "{\"capacity\": 1024, \"elemsize\": 8, \"chunk\": 64}", "items", c.n,
+                 runRing, &c);
+        ring_free(&c.ring);
+    }
+}
+
+/*
+ Direct-form FIR, for comparison with the upols cases when tuning the FFTPROC_FIR_MAXTAPS crossovers
+ */
+
+typedef struct fircase {
+    FIRFILTER * fir;
+    double * buffer;
+    unsigned long blocksize;
+    unsigned long n;
+} FIRCASE;
+
+static void runFIR(void * state) {
+    FIRCASE * c = state;
+    unsigned long done;
+    for(done = 0; done < c->n; done += c->blocksize) {
+        fir_process(c->fir, c->buffer, c->buffer, c->blocksize);
+    }
+    sink += c->buffer[0];
+}
+
+static void benchFIR(BENCHCTX * ctx) {
+    static const unsigned long ntaps[] = {16, 64, 256, 1024};
+    static const unsigned long blocksizes[] = {64, 256};
+    FIRCASE c;
+    double * taps;
+    char name[64], params[128];
+    unsigned long i, j, k, seed = 4;
+
+    memset(&c, 0, sizeof(c));
+    c.n = (1UL << 20) / ctx->scale;
+    for(i = 0; i < sizeof(ntaps) / sizeof(ntaps[0]); i++) {
+        if(!(taps = malloc(ntaps[i] * sizeof(double)))) {
+            return;
+        }
+        for(k = 0; k < ntaps[i]; k++) {
+            taps[k] = noise(&seed) / ntaps[i];
+        }
+        for(j = 0; j < sizeof(blocksizes) / sizeof(blocksizes[0]); j++) {
+            snprintf(name, sizeof(name), "fir/taps%lu/block%lu", ntaps[i], blocksizes[j]);
+            if(!wanted(ctx, name)) {
+                continue;
+            }
+            c.blocksize = blocksizes[j];
+            c.fir = new_FIR(taps, ntaps[i], c.blocksize);
+            c.buffer = malloc(c.blocksize * sizeof(double));
+            if(c.fir && c.buffer) {
+                for(k = 0; k < c.blocksize; k++) {
+                    c.buffer[k] = noise(&seed);
+                }
+                snprintf(params, sizeof(params), "{\"taps\": %lu, \"block\": %lu, \"kernel\": \"%s\"}",
+                         ntaps[i], c.blocksize, c.fir->kernelname);
+                timeCase(ctx, name, params, "samples", c.n / c.blocksize * c.blocksize, runFIR, &c);
+            }
+            free(c.buffer);
+            clear_FIR(&c.fir);
+        }
+        free(taps);
+    }
+}
+
+/*
+ Polyphase resampling: rate conversion, and oscillators rendered 4x oversampled and decimated
+ */
+
+/**
+ * Input samples per resample_process call.
+ */
+#define RESAMPLE_BENCHBLOCK 256
+
+typedef struct resamplecase {
+    RESAMPLER * rs;
+    OSCIL * osc;
+    double * in;
+    double * out;
+    unsigned long n;
+} RESAMPLECASE;
+
+static void runResample(void * state) {
+    RESAMPLECASE * c = state;
+    unsigned long done;
+    for(done = 0; done + RESAMPLE_BENCHBLOCK <= c->n; done += RESAMPLE_BENCHBLOCK) {
+        resample_process(c->rs, c->in + done, RESAMPLE_BENCHBLOCK, c->out);
+    }
+    sink += c->out[0];
+}
+
+static void runOversampled(void * state) {
+    RESAMPLECASE * c = state;
+    unsigned long done;
+    for(done = 0; done + RESAMPLE_BENCHBLOCK <= c->n; done += RESAMPLE_BENCHBLOCK) {
+        resample_oscil(c->rs, c->osc, sawdtick, 3520.0, RESAMPLE_BENCHBLOCK, c->out);
+    }
+    sink += c->out[0];
+}
+
+static void benchResample(BENCHCTX * ctx) {
+    static const unsigned long rates[][2] = {{44100, 48000}, {48000, 44100}, {44100, 96000}, {1, 4}, {4, 1}};
+    static const char * qualities[] = {"fast", "medium", "best"};
+    RESAMPLECASE c;
+    char name[64], params[160];
+    unsigned long i, k, seed = 6;
+    int q;
+
+    memset(&c, 0, sizeof(c));
+    c.n = (1UL << 19) / ctx->scale;
+    c.in = malloc(c.n * sizeof(double));
+    /* Room for the largest ratio's output per block */
+    c.out = malloc(8 * RESAMPLE_BENCHBLOCK * sizeof(double));
+    if(!c.in || !c.out) {
+        free(c.in);
+        free(c.out);
+        return;
+    }
+    for(k = 0; k < c.n; k++) {
+        c.in[k] = noise(&seed);
+    }
+    for(i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        for(q = RESAMPLE_FAST; q <= RESAMPLE_BEST; q++) {
+            snprintf(name, sizeof(name), "resample/%luto%lu/%s", rates[i][0], rates[i][1], qualities[q]);
+            if(!wanted(ctx, name) || !(c.rs = new_RESAMPLER(rates[i][0], rates[i][1], q, 0))) {
+                continue;
+            }
+            snprintf(params, sizeof(params), "{\"up\": %lu, \"down\": %lu, \"taps\": %lu, \"kernel\": \"%s\"}",
+                     c.rs->up, c.rs->down, c.rs->ntaps, c.rs->kernelname);
+            timeCase(ctx, name, params, "samples", c.n / RESAMPLE_BENCHBLOCK * RESAMPLE_BENCHBLOCK, runResample, &c);
+            clear_RESAMPLER(&c.rs);
+        }
+    }
+    /* Items are output samples at BENCH_FS, to compare with the plain sawdtick in the oscillator cases */
+    for(q = RESAMPLE_FAST; q <= RESAMPLE_BEST; q++) {
+        snprintf(name, sizeof(name), "resample/saw4x/%s", qualities[q]);
+        if(!wanted(ctx, name)) {
+            continue;
+        }
+        c.rs = new_RESAMPLER(4, 1, q, 0);
+        c.osc = oscil(4 * BENCH_FS, 0.0);
+        if(c.rs && c.osc) {
+            snprintf(params, sizeof(params), "{\"factor\": 4, \"taps\": %lu, \"kernel\": \"%s\"}",
+                     c.rs->ntaps, c.rs->kernelname);
+            timeCase(ctx, name, params, "samples", c.n / RESAMPLE_BENCHBLOCK * RESAMPLE_BENCHBLOCK / 4,
+                     runOversampled, &c);
+        }
+        clear_RESAMPLER(&c.rs);
+        freeOscil_a(&c.osc, NULL);
+    }
+    free(c.in);
+    free(c.out);
+}
+
+/*
+ Offline render
+ */
+
+/**
+ * Breakpoints per envelope in the render cases, spread evenly over the render.
+ */
+#define RENDER_BENCHPOINTS 4096
+
+typedef struct rendercase {
+    RENDERSPEC spec;
+    double * out;
+    unsigned long n;
+    unsigned int nthreads;
+} RENDERCASE;
+
+static void runRenderSequential(void * state) {
+    RENDERCASE * c = state;
+    char * errMsg = NULL;
+    render_sequential(&c->spec, c->out, c->n, &errMsg);
+    sink += c->out[c->n - 1];
+}
+
+static void runRenderOffline(void * state) {
+    RENDERCASE * c = state;
+    char * errMsg = NULL;
+    render_offline(&c->spec, c->out, c->n, 0, c->nthreads, &errMsg);
+    sink += c->out[c->n - 1];
+}
+
+static void benchRender(BENCHCTX * ctx) {
+    static const unsigned int threads[] = {1, 0};
+    RENDERCASE c;
+    BREAKPOINT * freqs, * amps;
+    BRKCURVE * curves;
+    char name[64], params[128];
+    double seconds;
+    unsigned long i, seed = 5;
+    unsigned int j;
+
+    memset(&c, 0, sizeof(c));
+    c.n = (1UL << 23) / ctx->scale;
+    seconds = (double) c.n / BENCH_FS;
+    freqs = malloc(RENDER_BENCHPOINTS * sizeof(BREAKPOINT));
+    amps = malloc(RENDER_BENCHPOINTS * sizeof(BREAKPOINT));
+    curves = calloc(RENDER_BENCHPOINTS, sizeof(BRKCURVE));
+    c.out = malloc(c.n * sizeof(double));
+    c.spec.table = sawtable(2048, 40, SAW_UP);
+    if(!freqs || !amps || !curves || !c.out || !c.spec.table) {
+        free(freqs);
+        free(amps);
+        free(curves);
+        free(c.out);
+        freeTable(&c.spec.table);
+        return;
+    }
+    /* Random glides with exponential segments, and a linear amplitude envelope */
+    for(i = 0; i < RENDER_BENCHPOINTS; i++) {
+        freqs[i].time = amps[i].time = seconds * i / (RENDER_BENCHPOINTS - 1);
+        freqs[i].value = 55.0 * pow(2.0, 3.0 + 3.0 * noise(&seed));
+        amps[i].value = 0.5 + 0.5 * noise(&seed);
+        curves[i].type = BRK_EXP;
+        curves[i].shape = 2.0 * noise(&seed);
+    }
+    c.spec.tick = tabitick;
+    c.spec.fs = (unsigned long) BENCH_FS;
+    c.spec.freq = bpt_new(freqs, curves, RENDER_BENCHPOINTS);
+    c.spec.amp = bpt_new(amps, NULL, RENDER_BENCHPOINTS);
+    if(!c.spec.freq || !c.spec.amp) {
+        if(!c.spec.freq) {
+            free(freqs);
+            free(curves);
+        }
+        if(!c.spec.amp) {
+            free(amps);
+        }
+        bpt_release(&c.spec.freq);
+        bpt_release(&c.spec.amp);
+        free(c.out);
+        freeTable(&c.spec.table);
+        return;
+    }
+
+    if(wanted(ctx, "render/sequential")) {
+        timeCase(ctx, "render/sequential", "{\"tablen\": 2048, \"points\": 4096}", "samples", c.n,
+                 runRenderSequential, &c);
+    }
+    for(j = 0; j < sizeof(threads) / sizeof(threads[0]); j++) {
+        snprintf(name, sizeof(name), "render/offline/threads%u", threads[j]);
+        if(!wanted(ctx, name)) {
+            continue;
+        }
+        c.nthreads = threads[j];
+        snprintf(params, sizeof(params), "{\"tablen\": 2048, \"points\": 4096, \"chunk\": %d, \"threads\": %u}",
+                 RENDER_DEFAULTCHUNK, threads[j]);
+        timeCase(ctx, name, params, "samples", c.n, runRenderOffline, &c);
+    }
+    bpt_release(&c.spec.freq);
+    bpt_release(&c.spec.amp);
+    free(c.out);
+    freeTable(&c.spec.table);
+}
+
+/*
+ Uniformly partitioned convolution
+ */
+
+#ifdef DSP_HAVE_KISSFFT
+typedef struct upolscase {
+    UPOLS * network;
+    double * in;
+    double * out;
+    unsigned long blocksize;
+    unsigned long n;
+} UPOLSCASE;
+
+static void runUPOLS(void * state) {
+    UPOLSCASE * c = state;
+    char * errMsg = "";
+    unsigned long done;
+    for(done = 0; done < c->n; done += c->blocksize) {
+        fft_convolve(c->in, c->out, c->network, c->blocksize, &errMsg);
+    }
+    sink += c->out[0];
+}
+
+static void benchUPOLS(BENCHCTX * ctx) {
+    static const unsigned long irlengths[] = {1024, 16384, 131072};
+    static const unsigned long blocksizes[] = {64, 256, 1024};
+    UPOLSCASE c;
+    double * ir;
+    char name[64], params[128];
+    char * errMsg = "";
+    unsigned long i, j, k, seed = 3;
+
+    memset(&c, 0, sizeof(c));
+    c.n = (1UL << 17) / ctx->scale;
+    for(i = 0; i < sizeof(irlengths) / sizeof(irlengths[0]); i++) {
+        /* Exponentially decaying noise, like a room response */
+        if(!(ir = malloc(irlengths[i] * sizeof(double)))) {
+            return;
+        }
+        for(k = 0; k < irlengths[i]; k++) {
+            ir[k] = noise(&seed) * exp(-6.9 * k / irlengths[i]);
+        }
+        for(j = 0; j < sizeof(blocksizes) / sizeof(blocksizes[0]); j++) {
+            snprintf(name, sizeof(name), "upols/ir%lu/block%lu", irlengths[i], blocksizes[j]);
+            if(!wanted(ctx, name)) {
+                continue;
+            }
+            c.blocksize = blocksizes[j];
+            c.in = malloc(c.blocksize * sizeof(double));
+            c.out = malloc(c.blocksize * sizeof(double));
+            c.network = new_UPOLS(ir, irlengths[i], c.blocksize, &errMsg);
+            if(c.in && c.out && c.network) {
+                for(k = 0; k < c.blocksize; k++) {
+                    c.in[k] = noise(&seed);
+                }
+                snprintf(params, sizeof(params), "{\"irlength\": %lu, \"block\": %lu}", irlengths[i], c.blocksize);
+                timeCase(ctx, name, params, "samples", c.n / c.blocksize * c.blocksize, runUPOLS, &c);
+            }
+            else if(!c.network) {
+                fprintf(stderr, "%s: %s\n", name, errMsg);
+            }
+            clear_UPOLS(&c.network);
+            free(c.in);
+            free(c.out);
+        }
+        free(ir);
+    }
+}
+
+/**
+ * Number of channels in the streaming STFT cases, each pushed in blocks of STFT_BENCHBLOCK samples.
+ */
+#define STFT_BENCHCHANS 32
+#define STFT_BENCHBLOCK 64
+
+typedef struct stftcase {
+    const STFTPLAN * plan;
+    STFT * chans[STFT_BENCHCHANS];
+    double * in;
+    double * frames;
+    unsigned long n;
+    unsigned int nthreads;
+} STFTCASE;
+
+static void runSTFTStream(void * state) {
+    STFTCASE * c = state;
+    unsigned long done;
+    unsigned int ch;
+    for(done = 0; done + STFT_BENCHBLOCK <= c->n; done += STFT_BENCHBLOCK) {
+        for(ch = 0; ch < STFT_BENCHCHANS; ch++) {
+            stft_push(c->chans[ch], c->in + done, STFT_BENCHBLOCK, c->frames);
+        }
+    }
+    sink += c->frames[1];
+}
+
+static void runSTFTBatch(void * state) {
+    STFTCASE * c = state;
+    char * errMsg = "";
+    stft_batch(c->plan, c->in, c->n, STFT_MAGNITUDE, c->frames, c->nthreads, &errMsg);
+    sink += c->frames[1];
+}
+
+static void benchSTFT(BENCHCTX * ctx) {
+    static const unsigned long sizes[] = {512, 2048};
+    static const unsigned int threads[] = {1, 0};
+    STFTCASE c;
+    STFTPLAN * plan;
+    char name[64], params[128];
+    char * errMsg = "";
+    unsigned long i, j, k, seed = 5;
+    unsigned int ch, made;
+
+    memset(&c, 0, sizeof(c));
+    c.n = (1UL << 18) / ctx->scale;
+    if(!(c.in = malloc(c.n * sizeof(double)))) {
+        return;
+    }
+    for(k = 0; k < c.n; k++) {
+        c.in[k] = noise(&seed);
+    }
+    for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if(!(plan = new_STFTPLAN(sizes[i], sizes[i] / 4, STFT_HANN, &errMsg))) {
+            fprintf(stderr, "stft: %s\n", errMsg);
+            continue;
+        }
+        c.plan = plan;
+        /* Enough for a whole batch; a streaming push completes at most one frame per channel */
+        c.frames = malloc((stft_batchframes(plan, c.n) + 1) * stft_framesize(plan, STFT_COMPLEX) * sizeof(double));
+
+        snprintf(name, sizeof(name), "stft/stream/nfft%lu/chans%d", sizes[i], STFT_BENCHCHANS);
+        if(c.frames && wanted(ctx, name)) {
+            made = 0;
+            for(ch = 0; ch < STFT_BENCHCHANS; ch++) {
+                if((c.chans[ch] = new_STFT(plan, STFT_MAGNITUDE, &errMsg))) {
+                    made++;
+                }
+            }
+            if(made == STFT_BENCHCHANS) {
+                snprintf(params, sizeof(params), "{\"nfft\": %lu, \"hop\": %lu, \"channels\": %d, \"block\": %d}",
+                         sizes[i], plan->hop, STFT_BENCHCHANS, STFT_BENCHBLOCK);
+                timeCase(ctx, name, params, "samples", c.n / STFT_BENCHBLOCK * STFT_BENCHBLOCK * STFT_BENCHCHANS,
+                         runSTFTStream, &c);
+            }
+            for(ch = 0; ch < STFT_BENCHCHANS; ch++) {
+                clear_STFT(&c.chans[ch]);
+            }
+        }
+        for(j = 0; j < sizeof(threads) / sizeof(threads[0]); j++) {
+            snprintf(name, sizeof(name), "stft/batch/nfft%lu/threads%u", sizes[i], threads[j]);
+            if(!c.frames || !wanted(ctx, name)) {
+                continue;
+            }
+            c.nthreads = threads[j];
+            snprintf(params, sizeof(params), "{\"nfft\": %lu, \"hop\": %lu, \"threads\": %u}",
+                     sizes[i], plan->hop, threads[j]);
+            timeCase(ctx, name, params, "frames", stft_batchframes(plan, c.n), runSTFTBatch, &c);
+        }
+        free(c.frames);
+        clear_STFTPLAN(&plan);
+    }
+    free(c.in);
+}
+
+/*
+ Wavetable extraction: one mipmap set, and a small library of recordings split between threads
+ */
+
+/**
+ * Number of recordings in the batch case.
+ */
+#define TAB_BENCHJOBS 8
+
+typedef struct tabcase {
+    TABJOB jobs[TAB_BENCHJOBS];
+    TABSPEC spec;
+    unsigned int njobs;
+    unsigned int nthreads;
+} TABCASE;
+
+static void runTabExtract(void * state) {
+    TABCASE * c = state;
+    unsigned int i;
+    tab_batch(c->jobs, c->njobs, c->nthreads);
+    for(i = 0; i < c->njobs; i++) {
+        if(c->jobs[i].mipmap) {
+            sink += c->jobs[i].mipmap->period;
+        }
+        clear_TABMIPMAP(&c->jobs[i].mipmap);
+    }
+}
+
+static void benchTabExtract(BENCHCTX * ctx) {
+    static const unsigned int threads[] = {1, 0};
+    TABCASE c;
+    double * recordings[TAB_BENCHJOBS], freq, sum;
+    char name[64], params[160];
+    unsigned long length = 1UL << 15, k, h, seed = 7;
+    unsigned int i, j;
+
+    memset(&c, 0, sizeof(c));
+    c.spec.tablen = 2048;
+    c.spec.fs = BENCH_FS;
+    c.spec.minfreq = 50.0;
+    c.spec.maxfreq = 2000.0;
+    c.spec.offset = 1024;
+    c.spec.ncycles = 4;
+    /* Band-limited sawtooths a few semitones apart, with a little noise */
+    for(i = 0; i < TAB_BENCHJOBS; i++) {
+        if(!(recordings[i] = malloc(length * sizeof(double)))) {
+            while(i--) {
+                free(recordings[i]);
+            }
+            return;
+        }
+        freq = 110.0 * pow(2.0, i * 5 / 12.0);
+        for(k = 0; k < length; k++) {
+            sum = 0.0;
+            for(h = 1; h * freq < 0.5 * BENCH_FS; h++) {
+                sum += sin(2.0 * M_PI * freq * h * k / BENCH_FS) / h;
+            }
+            recordings[i][k] = 0.5 * sum + 0.01 * noise(&seed);
+        }
+        c.jobs[i].samples = recordings[i];
+        c.jobs[i].length = length;
+        c.jobs[i].spec = &c.spec;
+    }
+
+    if(wanted(ctx, "tabextract/mipmap")) {
+        c.njobs = 1;
+        c.nthreads = 1;
+        timeCase(ctx, "tabextract/mipmap", "{\"tablen\": 2048, \"cycles\": 4}", "recordings", 1, runTabExtract, &c);
+    }
+    c.njobs = TAB_BENCHJOBS;
+    for(j = 0; j < sizeof(threads) / sizeof(threads[0]); j++) {
+        snprintf(name, sizeof(name), "tabextract/batch/threads%u", threads[j]);
+        if(!wanted(ctx, name)) {
+            continue;
+        }
+        c.nthreads = threads[j];
+        snprintf(params, sizeof(params), "{\"tablen\": 2048, \"cycles\": 4, \"recordings\": %d, \"threads\": %u}",
+                 TAB_BENCHJOBS, threads[j]);
+        timeCase(ctx, name, params, "recordings", TAB_BENCHJOBS, runTabExtract, &c);
+    }
+    for(i = 0; i < TAB_BENCHJOBS; i++) {
+        free(recordings[i]);
+    }
+}
+/*
+ Additive synthesis
+ */
+
+/**
+ * Samples per frame of the FFT synthesiser, and per block of the oscillator bank it is compared against.
+ */
+#define ADD_BENCHHOP 128
+
+typedef struct addcase {
+    ADDITIVE * synth;
+    double * freqs;
+    double * amps;
+    double * phases;
+    double output[ADD_BENCHHOP];
+    unsigned long npartials;
+    unsigned long nframes;
+} ADDCASE;
+
+static void runAdditive(void * state) {
+    ADDCASE * c = state;
+    unsigned long f;
+    for(f = 0; f < c->nframes; f++) {
+        additive_frame(c->synth, c->freqs, c->amps, NULL, c->npartials, c->output);
+        sink += c->output[0];
+    }
+}
+
+static void runSineBank(void * state) {
+    ADDCASE * c = state;
+    unsigned long f, i, k;
+    double incr;
+    for(f = 0; f < c->nframes; f++) {
+        memset(c->output, 0, sizeof(c->output));
+        for(i = 0; i < c->npartials; i++) {
+            incr = 2.0 * M_PI * c->freqs[i] / BENCH_FS;
+            for(k = 0; k < ADD_BENCHHOP; k++) {
+                c->output[k] += c->amps[i] * sin(c->phases[i] + incr * k);
+            }
+            c->phases[i] = fmod(c->phases[i] + incr * ADD_BENCHHOP, 2.0 * M_PI);
+        }
+        sink += c->output[0];
+    }
+}
+
+static void benchAdditive(BENCHCTX * ctx) {
+    static const unsigned long partials[] = {100, 1000, 5000};
+    ADDCASE c;
+    char name[64], params[128];
+    unsigned long i, j, maxpartials = partials[sizeof(partials) / sizeof(partials[0]) - 1], seed = 11;
+
+    memset(&c, 0, sizeof(c));
+    c.freqs = malloc(maxpartials * sizeof(double));
+    c.amps = malloc(maxpartials * sizeof(double));
+    c.phases = calloc(maxpartials, sizeof(double));
+    if(!c.freqs || !c.amps || !c.phases || !(c.synth = new_ADDITIVE(BENCH_FS, ADD_BENCHHOP, maxpartials))) {
+        free(c.freqs);
+        free(c.amps);
+        free(c.phases);
+        return;
+    }
+    /* Inharmonic partials spread over the audio band */
+    for(i = 0; i < maxpartials; i++) {
+        c.freqs[i] = 20.0 + 20000.0 * (0.5 + 0.5 * noise(&seed));
+        c.amps[i] = 1.0 / (double) maxpartials;
+    }
+    for(j = 0; j < sizeof(partials) / sizeof(partials[0]); j++) {
+        c.npartials = partials[j];
+        snprintf(params, sizeof(params), "{\"partials\": %lu, \"hop\": %d, \"fs\": 48000}", partials[j],
+                 ADD_BENCHHOP);
+        snprintf(name, sizeof(name), "additive/fft/partials%lu", partials[j]);
+        if(wanted(ctx, name)) {
+            c.nframes = 1024 / ctx->scale;
+            timeCase(ctx, name, params, "samples", c.nframes * ADD_BENCHHOP, runAdditive, &c);
+        }
+        snprintf(name, sizeof(name), "additive/sinebank/partials%lu", partials[j]);
+        if(wanted(ctx, name)) {
+            c.nframes = ((1UL << 22) / ctx->scale) / (ADD_BENCHHOP * partials[j]) + 1;
+            timeCase(ctx, name, params, "samples", c.nframes * ADD_BENCHHOP, runSineBank, &c);
+        }
+    }
+    clear_ADDITIVE(&c.synth);
+    free(c.freqs);
+    free(c.amps);
+    free(c.phases);
+}
+#endif
+
+#ifdef DSP_INSTRUMENT
+static void writeProbes(BENCHCTX * ctx) {
+    DSPPROBESTATS stats;
+    int probe, n = 0;
+
+    fprintf(ctx->out, ",\n  \"probes\": [");
+    for(probe = 0; probe < DSP_NPROBES; probe++) {
+        if(!dsp_probe_snapshot(probe, &stats) || !stats.count) {
+            continue;
+        }
+        fprintf(ctx->out, "%s\n    {\"name\": \"%s\", \"count\": %llu, \"items\": %llu, \"mean\": %.1f, "
+                "\"min\": %llu, \"p50\": %llu, \"p99\": %llu, \"max\": %llu, \"dropped\": %llu}",
+                n++ ? "," : "", dsp_probe_name(probe), (unsigned long long) stats.count,
+                (unsigned long long) stats.items, (double) stats.total / stats.count,
+                (unsigned long long) stats.min, (unsigned long long) dsp_probe_percentile(&stats, 50.0),
+                (unsigned long long) dsp_probe_percentile(&stats, 99.0), (unsigned long long) stats.max,
+                (unsigned long long) stats.dropped);
+    }
+    fprintf(ctx->out, "\n  ]");
+}
+#endif
+
+int main(int argc, char ** argv) {
+    char ** argend = argv + argc - 1;
+    char key, * value;
+    char * outpath = NULL;
+    float reps;
+    BENCHCTX ctx;
+
+    ctx.out = stdout;
+    ctx.filter = NULL;
+    ctx.reps = 5;
+    ctx.scale = 1;
+    ctx.ncases = 0;
+
+    argv++;
+    while(argParse(&argv, argend, &key, &value)) {
+        switch(key) {
+            case 'r':
+                argCheck(value, key);
+                if(!is_num(value, &reps) || reps < 1.0f || reps > BENCH_MAXREPS) {
+                    quit("Repetitions must be a number from 1 to 100");
+                }
+                ctx.reps = (int) reps;
+                break;
+            case 'f':
+                argCheck(value, key);
+                ctx.filter = value;
+                break;
+            case 'o':
+                argCheck(value, key);
+                outpath = value;
+                break;
+            case 'q':
+                ctx.scale = 16;
+                break;
+            default:
+                quit("usage: dspbench [-r reps] [-f filter] [-o outfile] [-q]");
+        }
+    }
+    if(argv <= argend) {
+        quit("usage: dspbench [-r reps] [-f filter] [-o outfile] [-q]");
+    }
+    if(outpath && !(ctx.out = fopen(outpath, "w"))) {
+        quit("Could not open output file");
+    }
+
+    fprintf(ctx.out, "{\n  \"suite\": \"dspbench\",\n  \"format\": 1,\n  \"compiler\": ");
+#ifdef __VERSION__
+    jsonString(ctx.out, __VERSION__);
+#else
+    jsonString(ctx.out, "unknown");
+#endif
+    fprintf(ctx.out, ",\n  \"build_type\": ");
+    jsonString(ctx.out, DSP_BENCH_BUILD_TYPE);
+    fprintf(ctx.out, ",\n  \"flags\": ");
+    jsonString(ctx.out, DSP_BENCH_FLAGS);
+#ifdef DSP_INSTRUMENT
+    /* Probe overhead is included in the timings, so instrumented results are not comparable */
+    fprintf(ctx.out, ",\n  \"instrumented\": true");
+#else
+    fprintf(ctx.out, ",\n  \"instrumented\": false");
+#endif
+    fprintf(ctx.out, ",\n  \"reps\": %d,\n  \"scale\": %lu,\n  \"results\": [", ctx.reps, ctx.scale);
+
+    benchOscillators(&ctx);
+    benchBreakpoints(&ctx);
+    benchPan(&ctx);
+    benchSweep(&ctx);
+    benchRing(&ctx);
+    benchFIR(&ctx);
+    benchResample(&ctx);
+    benchRender(&ctx);
+#ifdef DSP_HAVE_KISSFFT
+    benchUPOLS(&ctx);
+    benchSTFT(&ctx);
+    benchTabExtract(&ctx);
+    benchAdditive(&ctx);
+#endif
+#ifdef DSP_HAVE_CXX
+    benchTemplates(&ctx);
+#endif
+
+    fprintf(ctx.out, "\n  ]");
+#ifdef DSP_INSTRUMENT
+    writeProbes(&ctx);
+#endif
+    fprintf(ctx.out, "\n}\n");
+    if(outpath && fclose(ctx.out)) {
+        quit("Could not write output file");
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdio.h>
+
+#define BENCH_FS 48000.0
+#define BENCH_BLOCK 256
+#define BENCH_MAXREPS 100
+
+/**
+ * Define a function pointer for one timed pass of a benchmark case.
+ * @param state - the case state
+ */
+typedef void (*BENCHFUNC) (void * state);
+
+/**
+ * Define the schema for a benchmark run.
+ * @param out - the JSON output stream
+ * @param filter - only cases whose name contains this string are run (NULL for all)
+ * @param reps - the number of timed passes per case
+ * @param scale - the workload divisor (1, or 16 for a quick run)
+ * @param ncases - the number of cases reported so far
+ */
+typedef struct benchctx {
+    FILE * out;
+    const char * filter;
+    int reps;
+    unsigned long scale;
+    unsigned long ncases;
+} BENCHCTX;
+
+/* Results are accumulated here so the compiler cannot discard the work being timed */
+extern volatile double sink;
+
+/**
+ * Checks whether a case should run.
+ * @param ctx - the benchmark run
+ * @param name - the case name
+ * @return boolean integer
+ */
+int wanted(const BENCHCTX * ctx, const char * name);
+
+/**
+ * Times a case and writes its JSON result.
+ * @param ctx - the benchmark run
+ * @param name - the case name
+ * @param params - a JSON object with the case parameters
+ * @param unit - the name of the items processed (eg. "samples")
+ * @param items - the number of items processed per pass
+ * @param func - the function running one pass
+ * @param state - the case state passed to func
+ */
+void timeCase(BENCHCTX * ctx, const char * name, const char * params, const char * unit,
+              unsigned long items, BENCHFUNC func, void * state);
+
+#ifdef DSP_HAVE_CXX
+/**
+ * Runs the C++ template layer cases (benchxx.cpp), next to the function pointer cases they compare with.
+ * @param ctx - the benchmark run
+ */
+void benchTemplates(BENCHCTX * ctx);
+#endif
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ C++ template layer cases for dspbench.
+
+ Each case renders the same workload as a function pointer case in bench.c (oscil/..., oscil/table/...), so the
+ two can be compared directly, or runs its own function pointer baseline alongside (cxx/modulated/...).
+ */
+#include "dspcxx.hpp"
+
+extern "C" {
+#include "bench.h"
+}
+
+namespace {
+
+/**
+ * Frequency of the constant frequency cases, as in bench.c.
+ */
+constexpr double benchFreq = 440.0;
+
+/**
+ * Breakpoints in the modulated cases' frequency envelope.
+ */
+constexpr unsigned long modPoints = 1024;
+
+template<class Osc, class T>
+struct OscCase {
+    Osc * osc;
+    unsigned long n;
+};
+
+template<class Osc, class T>
+void runBlocks(void * state) {
+    auto * c = static_cast<OscCase<Osc, T> *>(state);
+    T block[BENCH_BLOCK];
+    double sum = 0.0;
+    unsigned long done, i, m;
+
+    for(done = 0; done < c->n; done += m) {
+        m = c->n - done < BENCH_BLOCK ? c->n - done : BENCH_BLOCK;
+        c->osc->render(block, m, benchFreq);
+        for(i = 0; i < m; i++) {
+            sum += block[i];
+        }
+    }
+    sink += sum;
+}
+
+/**
+ * Time a waveform through Oscillator, on a fresh OSCIL.
+ */
+template<class Wave, class T = double, class Wrap = typename Wave::DefaultWrap>
+void timeOscillator(BENCHCTX * ctx, const char * name, unsigned long n) {
+    using Osc = dsp::Oscillator<Wave, T, Wrap>;
+    OSCIL * state;
+
+    if(!wanted(ctx, name) || !(state = oscil(BENCH_FS, 0.0))) {
+        return;
+    }
+    Osc osc(*state);
+    OscCase<Osc, T> c = {&osc, n};
+    timeCase(ctx, name, "{\"freq\": 440, \"fs\": 48000}", "samples", n, runBlocks<Osc, T>, &c);
+    freeOscil_a(&state, NULL);
+}
+
+/**
+ * Time a table lookup through TableOscillator, on a fresh TOSCIL.
+ */
+template<int Order, class T = double, class Wrap = dsp::WrapLoop>
+void timeTable(BENCHCTX * ctx, const char * name, GTABLE * table, unsigned long n) {
+    using Osc = dsp::TableOscillator<Order, T, Wrap>;
+    TOSCIL * state;
+
+    if(!wanted(ctx, name) || !(state = oscil_t(BENCH_FS, 0.0, table))) {
+        return;
+    }
+    Osc osc(*state);
+    OscCase<Osc, T> c = {&osc, n};
+    timeCase(ctx, name, "{\"freq\": 440, \"fs\": 48000, \"tablen\": 1024}", "samples", n, runBlocks<Osc, T>, &c);
+    freeTOscil_a(&state, NULL);
+}
+
+struct ModCase {
+    TOSCIL * osc;
+    BRKSTREAM * freq;
+    unsigned long n;
+};
+
+void runModulatedPointers(void * state) {
+    auto * c = static_cast<ModCase *>(state);
+    TABFUNC tick = tabitick;
+    double sum = 0.0;
+    unsigned long i;
+
+    bps_seeksample(c->freq, 0);
+    for(i = 0; i < c->n; i++) {
+        sum += tick(c->osc, bps_tick(c->freq));
+    }
+    sink += sum;
+}
+
+void runModulatedTemplate(void * state) {
+    auto * c = static_cast<ModCase *>(state);
+    dsp::TableOscillator<1> osc(*c->osc);
+    dsp::Envelope<> freq(*c->freq);
+    double block[BENCH_BLOCK], sum = 0.0;
+    unsigned long done, i, m;
+
+    freq.seek(0);
+    for(done = 0; done < c->n; done += m) {
+        m = c->n - done < BENCH_BLOCK ? c->n - done : BENCH_BLOCK;
+        dsp::renderModulated(osc, freq, block, m);
+        for(i = 0; i < m; i++) {
+            sum += block[i];
+        }
+    }
+    sink += sum;
+}
+
+void benchModulated(BENCHCTX * ctx, GTABLE * table, unsigned long n) {
+    BREAKPOINT * points;
+    BRKTABLE * envelope;
+    ModCase c;
+    unsigned long i, seed = 9;
+    const char * params = "{\"fs\": 48000, \"tablen\": 1024, \"points\": 1024}";
+
+    if(!wanted(ctx, "cxx/modulated/")) {
+        return;
+    }
+    if(!(points = static_cast<BREAKPOINT *>(malloc(modPoints * sizeof(BREAKPOINT))))) {
+        return;
+    }
+    /* A random linear glide over the whole render */
+    for(i = 0; i < modPoints; i++) {
+        seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+        points[i].time = (double) n / BENCH_FS * i / (modPoints - 1);
+        points[i].value = 110.0 + 880.0 * (double) seed / 2147483648.0;
+    }
+    if(!(envelope = bpt_new(points, NULL, modPoints))) {
+        free(points);
+        return;
+    }
+    c.osc = oscil_t(BENCH_FS, 0.0, table);
+    c.freq = bps_new_a(envelope, (unsigned long) BENCH_FS, NULL);
+    c.n = n;
+    if(c.osc && c.freq) {
+        if(wanted(ctx, "cxx/modulated/funcptr")) {
+            timeCase(ctx, "cxx/modulated/funcptr", params, "samples", n, runModulatedPointers, &c);
+        }
+        if(wanted(ctx, "cxx/modulated/template")) {
+            timeCase(ctx, "cxx/modulated/template", params, "samples", n, runModulatedTemplate, &c);
+        }
+    }
+    freeTOscil_a(&c.osc, NULL);
+    bps_free_a(&c.freq, NULL);
+    bpt_release(&envelope);
+}
+
+}
+
+void benchTemplates(BENCHCTX * ctx) {
+    unsigned long n = (1UL << 22) / ctx->scale;
+    GTABLE * saw;
+
+    timeOscillator<dsp::wave::Sine>(ctx, "cxx/oscil/sine", n);
+    timeOscillator<dsp::wave::Square>(ctx, "cxx/oscil/square", n);
+    timeOscillator<dsp::wave::SawDown>(ctx, "cxx/oscil/sawdown", n);
+    timeOscillator<dsp::wave::SawUp>(ctx, "cxx/oscil/sawup", n);
+    timeOscillator<dsp::wave::Triangle>(ctx, "cxx/oscil/tri", n);
+
+    if(!(saw = sawtable(1024, 40, SAW_UP))) {
+        return;
+    }
+    timeTable<0>(ctx, "cxx/oscil/table/saw/truncate", saw, n);
+    timeTable<1>(ctx, "cxx/oscil/table/saw/interp", saw, n);
+    timeTable<1, float>(ctx, "cxx/oscil/table/saw/interp/float", saw, n);
+    timeTable<1, double, dsp::WrapFloor>(ctx, "cxx/oscil/table/saw/interp/floorwrap", saw, n);
+    timeTable<3>(ctx, "cxx/oscil/table/saw/cubic", saw, n);
+    benchModulated(ctx, saw, n);
+    freeTable(&saw);
+}
@@ -1,41 +1,223 @@
 #include "breakpoint.h"
+#include "instrument.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
-BREAKPOINT * getBreakpoints(FILE *fp, unsigned long *psize) {
-    int got;
-    unsigned long npoints = 0, size=64; /* Line counter (0-indexed), Blocksize for each malloc call */
+/**
+ * Parse a decimal floating point number, advancing the cursor past it.
+ *
+ * Mantissas of up to 19 digits with small exponents are converted exactly using a single multiply or divide
+ * by an exact power of ten; anything else (long mantissas, large exponents, inf/nan) falls back to strtod.
+ *
+ * @param pp - pointer to the text cursor, advanced past the number on success
+ * @param end - end of the text
+ * @param val - pointer to a double which is populated by the parsed value
+ * @return boolean integer specifying whether a number was parsed
+ */
+static int parseDouble(const char ** pp, const char * end, double * val);
+
+/**
+ * Parse breakpoints and, optionally, segment curves from a text buffer. See parseBreakpoints.
+ * @param pcurves - populated by a dynamically allocated BRKCURVE array, or NULL if every segment is linear.
+ * Pass NULL to ignore curve columns.
+ */
+static BREAKPOINT * parseText(const char * text, size_t len, unsigned long * psize, BRKCURVE ** pcurves);
+
+/**
+ * Read a whole stream into a dynamically allocated buffer.
+ * @param fp - the stream
+ * @param plen - populated by the number of bytes read
+ * @return the buffer, or NULL if unsuccessful
+ */
+static char * readStream(FILE * fp, size_t * plen);
+
+/**
+ * Map a file read-only into memory.
+ * @param path - path to the file
+ * @param plen - populated by the length of the mapping
+ * @return the base address of the mapping, or NULL if unsuccessful (including empty files)
+ */
+static void * mapFile(const char * path, size_t * plen);
+
+/**
+ * Advance a breakpoint stream to its next span, clearing more_points once the final point is reached.
+ * @param stream - pointer to an initialised BRKSTREAM object
+ */
+static void nextSpan(BRKSTREAM * stream);
+
+/**
+ * Load the span variables (points, width, height and curve state) for the stream's current ileft/iright
+ * at its current sample index.
+ * @param stream - pointer to an initialised BRKSTREAM object
+ */
+static void setupSpan(BRKSTREAM * stream);
+
+/**
+ * Find the first sample index whose time lies beyond the right point of the current span - the same test
+ * bps_tick applies before moving to the next span.
+ * @param stream - pointer to an initialised BRKSTREAM object
+ * @return the sample index
+ */
+static unsigned long spanEnd(const BRKSTREAM * stream);
+
+/**
+ * Wrap a BREAKPOINT array in a new table with a reference count of one, caching its value range.
+ * @param points - pointer to the BREAKPOINT array
+ * @param npoints - the size of the array (at least two points)
+ * @param curves - pointer to the BRKCURVE array, or NULL if every segment is linear
+ * @param file - the BRKFILE backing the arrays, or NULL if the table owns the arrays
+ * @return pointer to a dynamically allocated BRKTABLE, or NULL if unsuccessful
+ */
+static BRKTABLE * newTable(BREAKPOINT * points, BRKCURVE * curves, unsigned long npoints, BRKFILE * file);
+
+/**
+ * Emit a breakpoint from a simplifier and make it the new anchor.
+ */
+static int simplifyEmit(BRKSIMPLIFY * simp, const BREAKPOINT * point);
+
+/**
+ * Close the simplifier's current segment at its last input time, emitting the end point.
+ */
+static int simplifyClose(BRKSIMPLIFY * simp);
+
+/**
+ * BRKSINK appending to an array; userdata is a pointer to the write cursor.
+ */
+static int arraySink(const BREAKPOINT * point, void * userdata);
+
+static const double pow10tab[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int parseDouble(const char ** pp, const char * end, double * val) {
+    const char * p = *pp;
+    uint64_t mant = 0;
+    int ndigits = 0, exp10 = 0, neg = 0, any = 0;
+
+    if(p < end && (*p == '-' || *p == '+')) {
+        neg = (*p++ == '-');
+    }
+    for(; p < end && *p >= '0' && *p <= '9'; p++, any = 1) {
+        if(ndigits < 19) {
+            mant = mant * 10 + (uint64_t) (*p - '0');
+            ndigits += (mant != 0);
+        }
+        else {
+            ndigits = 20;
+        }
+    }
+    if(p < end && *p == '.') {
+        for(p++; p < end && *p >= '0' && *p <= '9'; p++, any = 1) {
+            if(ndigits < 19) {
+                mant = mant * 10 + (uint64_t) (*p - '0');
+                ndigits += (mant != 0);
+                exp10--;
+            }
+            else {
+                ndigits = 20;
+            }
+        }
+    }
+    if(!any) {
+        goto slow;
+    }
+    if(p < end && (*p == 'e' || *p == 'E')) {
+        const char * q = p + 1;
+        int eneg = 0, e = 0, edigits = 0;
+        if(q < end && (*q == '-' || *q == '+')) {
+            eneg = (*q++ == '-');
+        }
+        for(; q < end && *q >= '0' && *q <= '9'; q++, edigits++) {
+            if(e < 10000) {
+                e = e * 10 + (*q - '0');
+            }
+        }
+        if(edigits) {
+            exp10 += eneg ? -e : e;
+            p = q;
+        }
+    }
+    if(ndigits > 19 || exp10 > 22 || exp10 < -22 || mant > ((uint64_t) 1 << 53)) {
+        goto slow;
+    }
+    /* Both the mantissa and the power of ten are exact doubles, so one operation rounds correctly */
+    *val = exp10 < 0 ? (double) mant / pow10tab[-exp10] : (double) mant * pow10tab[exp10];
+    if(neg) {
+        *val = -*val;
+    }
+    *pp = p;
+    return 1;
+
+slow:
+    {
+        /* strtod needs a terminated string - numbers in breakpoint files are short */
+        char token[64];
+        char * cont;
+        size_t n = 0;
+        p = *pp;
+        while(p + n < end && n < sizeof(token) - 1 && p[n] != ' ' && p[n] != '\t' &&
+              p[n] != '\n' && p[n] != '\r') {
+            token[n] = p[n];
+            n++;
+        }
+        token[n] = '\0';
+        *val = strtod(token, &cont);
+        if(cont == token) {
+            return 0;
+        }
+        *pp = p + (cont - token);
+        return 1;
+    }
+}
+
+static BREAKPOINT * parseText(const char * text, size_t len, unsigned long * psize, BRKCURVE ** pcurves) {
+    const char * p = text, * end = text + len, * eol;
+    unsigned long npoints = 0, size = 1;
     double lasttime = 0.0;
-    /* The breakpoint array that will be returned */
-    BREAKPOINT *points = NULL;
-    char line[80]; /* maximum string characters per line (sufficient to read data) */
-    
-    /* Check if file pointer is valid ie check for NULL - return NULL pointer if so */
-    if(!fp) {
-        return NULL;
+    BREAKPOINT * points, * tmp;
+    BRKCURVE * curves = NULL;
+
+    /* Count lines up front so the array is allocated exactly once */
+    for(eol = text; (eol = memchr(eol, '\n', (size_t) (end - eol))); eol++) {
+        size++;
     }
-    
-    /* Allocate first block of memory on the heap */
     points = (BREAKPOINT *) malloc(sizeof(BREAKPOINT) * size);
-    /* Check for NULL */
     if(!points) {
         return NULL;
     }
-    
-    /* Run loop for getting data - fgets returns NULL at EOF */
-    while(fgets(line, sizeof(line), fp)) {
-        /* long float (double) needed in string format */
-        got = sscanf(line, "%lf %lf", &points[npoints].time, &points[npoints].value);
-        if(got < 0) { /* Line is empty - go to next line -- eof returned which is = -1 */
+
+    while(p < end) {
+        const char * q;
+        eol = memchr(p, '\n', (size_t) (end - p));
+        if(!eol) {
+            eol = end;
+        }
+        /* Skip leading whitespace - an empty line is not an error */
+        while(p < eol && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\v' || *p == '\f')) {
+            p++;
+        }
+        if(p == eol) {
+            p = eol + 1;
             continue;
         }
-        else if(got == 0) {
+        if(!parseDouble(&p, eol, &points[npoints].time)) {
             printf("Line %lu has non-numeric data\n", npoints + 1);
             break;
         }
-        else if(got == 1) {
+        q = p;
+        while(q < eol && (*q == ' ' || *q == '\t')) {
+            q++;
+        }
+        if(!parseDouble(&q, eol, &points[npoints].value)) {
             printf("Incomplete breakpoint found at line %lu\n", npoints + 1);
             break;
         }
@@ -43,81 +225,403 @@ BREAKPOINT * getBreakpoints(FILE *fp, unsigned long *psize) {
             printf("Data error at line %lu: time not increasing\n", npoints + 1);
             break;
         }
-        lasttime = points[npoints].time;
-        /* Check if the next line goes over the size of the current array */
-        if(++npoints == size) {
-            BREAKPOINT * tmp;
-            size += npoints;
-            /* Fill newly allocated memory with previous array and space for another block */
-            /* NOTE: realloc frees the old block if necessary!! */
-            tmp = (BREAKPOINT * ) realloc(points, sizeof(BREAKPOINT) * size);
-            /* check for null */
-            if(!tmp) {
-                /* Release memory and return null to the caller */
-                npoints = 0;
-                free(points);
-                points = NULL;
-                /* Break from while loop */
-                break;
+        if(pcurves) {
+            /* Optional curve for the segment starting here: "exp k" or "pow p" */
+            int type = BRK_LINEAR;
+            while(q < eol && (*q == ' ' || *q == '\t')) {
+                q++;
+            }
+            if(eol - q > 3 && (q[3] == ' ' || q[3] == '\t')) {
+                type = !memcmp(q, "exp", 3) ? BRK_EXP : !memcmp(q, "pow", 3) ? BRK_POW : BRK_LINEAR;
+            }
+            if(type != BRK_LINEAR) {
+                double shape;
+                for(q += 3; q < eol && (*q == ' ' || *q == '\t'); q++)
+                    ;
+                if(!parseDouble(&q, eol, &shape)) {
+                    printf("Line %lu has an invalid curve shape\n", npoints + 1);
+                    break;
+                }
+                /* Curves are rare - only pay for the array once one appears */
+                if(!curves && !(curves = (BRKCURVE *) calloc(size, sizeof(BRKCURVE)))) {
+                    break;
+                }
+                curves[npoints].type = type;
+                curves[npoints].shape = shape;
             }
-            points = tmp;
         }
+        lasttime = points[npoints].time;
+        npoints++;
+        p = eol + 1;
+    }
+
+    /* Give back the unused tail of the array */
+    if(npoints && npoints < size && (tmp = (BREAKPOINT *) realloc(points, sizeof(BREAKPOINT) * npoints))) {
+        points = tmp;
     }
     if(npoints) {
         /* Update array size returned */
         *psize = npoints;
     }
-    /* Return BREAKPOINT array address */
+    if(pcurves) {
+        *pcurves = curves;
+    }
     return points;
 }
 
+BREAKPOINT * parseBreakpoints(const char * text, size_t len, unsigned long * psize) {
+    return parseText(text, len, psize, NULL);
+}
+
+static char * readStream(FILE * fp, size_t * plen) {
+    size_t len = 0, size = 65536, got;
+    char * text, * tmp;
+
+    text = (char *) malloc(size);
+    if(!text) {
+        return NULL;
+    }
+    while((got = fread(text + len, 1, size - len, fp)) > 0) {
+        len += got;
+        if(len == size) {
+            size *= 2;
+            tmp = (char *) realloc(text, size);
+            if(!tmp) {
+                free(text);
+                return NULL;
+            }
+            text = tmp;
+        }
+    }
+    *plen = len;
+    return text;
+}
+
+BREAKPOINT * getBreakpoints(FILE *fp, unsigned long *psize) {
+    size_t len;
+    char * text;
+    BREAKPOINT * points;
+
+    /* Check if file pointer is valid ie check for NULL - return NULL pointer if so */
+    if(!fp) {
+        return NULL;
+    }
+    /* Slurp the stream in large reads (it may be a pipe, so its size is not known) and parse it in one pass */
+    if(!(text = readStream(fp, &len))) {
+        return NULL;
+    }
+    points = parseBreakpoints(text, len, psize);
+    free(text);
+    return points;
+}
+
+static void * mapFile(const char * path, size_t * plen) {
+    int fd;
+    struct stat st;
+    void * map;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return NULL;
+    }
+    if(fstat(fd, &st) < 0 || st.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+    *plen = (size_t) st.st_size;
+    map = mmap(NULL, *plen, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        return NULL;
+    }
+    return map;
+}
+
+BRKFILE * bps_load(const char * path) {
+    BRKFILE * file;
+    const unsigned char * base;
+
+    file = (BRKFILE *) malloc(sizeof(BRKFILE));
+    if(!file) {
+        fprintf(stderr, "Cannot allocate memory for breakpoint file object\n");
+        return NULL;
+    }
+    file->npoints = 0;
+    file->points = NULL;
+    file->curves = NULL;
+    if(!(file->map = mapFile(path, &file->maplen))) {
+        fprintf(stderr, "Cannot map breakpoint file %s\n", path);
+        free(file);
+        return NULL;
+    }
+    base = (const unsigned char *) file->map;
+
+    if(file->maplen >= 16 && !memcmp(base, BRK_MAGIC, 4)) {
+        uint32_t version;
+        uint64_t npoints;
+        memcpy(&version, base + 4, sizeof(version));
+        memcpy(&npoints, base + 8, sizeof(npoints));
+        if((version != BRK_VERSION && version != BRK_VERSION_CURVES) ||
+           npoints > (file->maplen - 16) / (sizeof(BREAKPOINT) + (version == BRK_VERSION_CURVES ? sizeof(BRKCURVE) : 0))) {
+            fprintf(stderr, "Corrupt binary breakpoint file %s\n", path);
+            bps_unload(&file);
+            return NULL;
+        }
+        /* The header keeps the array 16-byte aligned within the page-aligned mapping */
+        file->points = (BREAKPOINT *) (base + 16);
+        file->npoints = (unsigned long) npoints;
+        if(version == BRK_VERSION_CURVES) {
+            file->curves = (BRKCURVE *) (file->points + npoints);
+        }
+        return file;
+    }
+
+    /* Text file - parse straight out of the mapping, which is not needed afterwards */
+    madvise(file->map, file->maplen, MADV_SEQUENTIAL);
+    file->points = parseText((const char *) base, file->maplen, &file->npoints, &file->curves);
+    munmap(file->map, file->maplen);
+    file->map = NULL;
+    if(!file->points || !file->npoints) {
+        fprintf(stderr, "Cannot read breakpoints from file!\n");
+        bps_unload(&file);
+        return NULL;
+    }
+    return file;
+}
+
+void bps_unload(BRKFILE ** file) {
+    if(file && *file) {
+        if((*file)->map) {
+            munmap((*file)->map, (*file)->maplen);
+        }
+        else {
+            free((*file)->points);
+            free((*file)->curves);
+        }
+        free(*file);
+        *file = NULL;
+    }
+}
+
+int bps_writebinary(const char * path, const BREAKPOINT * points, const BRKCURVE * curves, unsigned long npoints) {
+    FILE * fp;
+    uint32_t version = curves ? BRK_VERSION_CURVES : BRK_VERSION;
+    uint64_t count = npoints;
+    int ok;
+
+    if(!(fp = fopen(path, "wb"))) {
+        return 0;
+    }
+    ok = fwrite(BRK_MAGIC, 1, 4, fp) == 4 &&
+         fwrite(&version, sizeof(version), 1, fp) == 1 &&
+         fwrite(&count, sizeof(count), 1, fp) == 1 &&
+         fwrite(points, sizeof(BREAKPOINT), npoints, fp) == npoints &&
+         (!curves || fwrite(curves, sizeof(BRKCURVE), npoints, fp) == npoints);
+    if(fclose(fp)) {
+        ok = 0;
+    }
+    return ok;
+}
+
+int bps_convert(const char * srcpath, const char * dstpath) {
+    BRKFILE * file;
+    int ok;
+    if(!(file = bps_load(srcpath))) {
+        return 0;
+    }
+    ok = bps_writebinary(dstpath, file->points, file->curves, file->npoints);
+    bps_unload(&file);
+    return ok;
+}
+
+
+static BRKTABLE * newTable(BREAKPOINT * points, BRKCURVE * curves, unsigned long npoints, BRKFILE * file) {
+    BRKTABLE * table;
+    unsigned long i;
+
+    if(npoints < 2) {
+        fprintf(stderr, "Breakpoint file is too small - at least two points required\n");
+        return NULL;
+    }
+    table = (BRKTABLE *) malloc(sizeof(BRKTABLE));
+    if(!table) {
+        fprintf(stderr, "Cannot allocate memory for breakpoint table\n");
+        return NULL;
+    }
+    table->points = points;
+    table->curves = curves;
+    table->npoints = npoints;
+    table->file = file;
+    table->index = NULL;
+    table->indexstride = table->nindex = 0;
+    table->refcount = 1;
+    /* The table is immutable, so the value range only ever needs computing once */
+    table->minval = table->maxval = points[0].value;
+    for(i = 1; i < npoints; i++) {
+        if(points[i].value > table->maxval) {
+            table->maxval = points[i].value;
+        }
+        if(points[i].value < table->minval) {
+            table->minval = points[i].value;
+        }
+    }
+    return table;
+}
+
+BRKTABLE * bpt_new(BREAKPOINT * points, BRKCURVE * curves, unsigned long npoints) {
+    if(!points) {
+        return NULL;
+    }
+    return newTable(points, curves, npoints, NULL);
+}
+
+BRKTABLE * bpt_load(const char * path) {
+    BRKFILE * file;
+    BRKTABLE * table;
+    if(!(file = bps_load(path))) {
+        return NULL;
+    }
+    if(!(table = newTable(file->points, file->curves, file->npoints, file))) {
+        bps_unload(&file);
+    }
+    return table;
+}
+
+BRKTABLE * bpt_read(FILE * fp) {
+    BREAKPOINT * points = NULL;
+    BRKCURVE * curves = NULL;
+    BRKTABLE * table;
+    unsigned long npoints = 0;
+    size_t len;
+    char * text;
+
+    /* Read breakpoints */
+    if(fp && (text = readStream(fp, &len))) {
+        points = parseText(text, len, &npoints, &curves);
+        free(text);
+    }
+    if(!points) {
+        fprintf(stderr, "Cannot read breakpoints from file!\n");
+        return NULL;
+    }
+    if(!(table = newTable(points, curves, npoints, NULL))) {
+        free(points);
+        free(curves);
+    }
+    return table;
+}
+
+BRKTABLE * bpt_retain(BRKTABLE * table) {
+    __atomic_add_fetch(&table->refcount, 1, __ATOMIC_RELAXED);
+    return table;
+}
+
+void bpt_release(BRKTABLE ** table) {
+    if(!table || !*table) {
+        return;
+    }
+    if(__atomic_sub_fetch(&(*table)->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        if((*table)->file) {
+            bps_unload(&(*table)->file);
+        }
+        else {
+            free((*table)->points);
+            free((*table)->curves);
+        }
+        if((*table)->index) {
+            free((*table)->index);
+        }
+        free(*table);
+    }
+    *table = NULL;
+}
+
+int bpt_buildindex(BRKTABLE * table, unsigned long stride) {
+    unsigned long i;
+    double * index;
+    if(!stride) {
+        return 0;
+    }
+    index = (double *) malloc(sizeof(double) * (table->npoints / stride + 1));
+    if(!index) {
+        return 0;
+    }
+    if(table->index) {
+        free(table->index);
+    }
+    table->index = index;
+    table->indexstride = stride;
+    for(i = 0, table->nindex = 0; i < table->npoints; i += stride) {
+        table->index[table->nindex++] = table->points[i].time;
+    }
+    return 1;
+}
+
+int bpt_inrange(const BRKTABLE * table, double minVal, double maxVal) {
+    return table->minval >= minVal && table->maxval <= maxVal;
+}
+
+int bps_attach(BRKSTREAM * stream, BRKTABLE * table, unsigned long fs) {
+    if(fs <= 0 || !table) {
+        return 0;
+    }
+    stream->table = bpt_retain(table);
+    stream->points = table->points;
+    stream->npoints = table->npoints;
+    stream->incr = 1.0/fs;  /* time increment per breakpoint time */
+    /* initialise the streaming object at the first span */
+    bps_seeksample(stream, 0);
+    return 1;
+}
 
 BRKSTREAM * bps_init(FILE * fp, unsigned long fs) {
+    return bps_init_a(fp, fs, NULL);
+}
+
+BRKSTREAM * bps_init_a(FILE * fp, unsigned long fs, const DSPALLOC * alloc) {
     BRKSTREAM * brkstream;
-    BREAKPOINT * points;
+    BRKTABLE * table;
     
     if(fs <= 0) {
         fprintf(stderr, "Sample rate must be positive\n");
         return NULL;
     }
-    /* Allocate HEAP memory for breakstream object */
-    brkstream = (BRKSTREAM *) malloc(sizeof(BRKSTREAM));
-    if(!brkstream) {
-        fprintf(stderr, "Cannot allocate memory for breakstream object\n");
+    /* The stream holds the only reference to a private table */
+    if(!(table = bpt_read(fp))) {
         return NULL;
     }
+    brkstream = bps_new_a(table, fs, alloc);
+    bpt_release(&table);
+    return brkstream;
+}
 
-    /* Read breakpoints */
-    if(!(points = getBreakpoints(fp, &brkstream->npoints))) {
-        free(brkstream);
-        fprintf(stderr, "Cannot read breakpoints from file!\n");
+BRKSTREAM * bps_new_a(BRKTABLE * table, unsigned long fs, const DSPALLOC * alloc) {
+    BRKSTREAM * brkstream;
+
+    if(fs <= 0 || !table) {
         return NULL;
     }
-
-    if(brkstream->npoints < 2) {
-        fprintf(stderr, "Breakpoint file is too small - at least two points required");
-        free(brkstream);
+    /* Allocate memory for breakstream object */
+    brkstream = (BRKSTREAM *) dsp_alloc(alloc, sizeof(BRKSTREAM));
+    if(!brkstream) {
+        fprintf(stderr, "Cannot allocate memory for breakstream object\n");
         return NULL;
     }
-    
-    /* initialise the streaming object */
-    brkstream->curpos = 0;
-    brkstream->ileft = 0;
-    brkstream->iright = 1;
-    brkstream->more_points = brkstream->npoints > 2;
-    brkstream->leftPoint = points[brkstream->ileft];
-    brkstream->rightPoint = points[brkstream->iright];
-    brkstream->width = brkstream->rightPoint.time - brkstream->leftPoint.time;
-    brkstream->height = brkstream->rightPoint.value - brkstream->leftPoint.value;
-    brkstream->incr = 1.0/fs;  /* time increment per breakpoint time */
-    brkstream->points = points;
-    
+    bps_attach(brkstream, table, fs);
     return brkstream;
 }
 
+void bps_free_a(BRKSTREAM ** stream, const DSPALLOC * alloc) {
+    if(stream && *stream) {
+        bps_freepoints(*stream);
+        dsp_free(alloc, *stream);
+        *stream = NULL;
+    }
+}
+
 void bps_freepoints(BRKSTREAM * stream) {
-    if(stream && stream->points) {
-        free(stream->points);
+    if(stream && stream->table) {
+        bpt_release(&stream->table);
         /* Must now reassign pointer to NULL since reference to it still exists
          This prevents the function from crashing if it is called repeatedly on the same
          BRKSTREAM object. */
@@ -125,6 +629,118 @@ void bps_freepoints(BRKSTREAM * stream) {
     }
 }
 
+BRKPOOL * bps_newpool(unsigned long size) {
+    BRKPOOL * pool;
+    unsigned long i;
+
+    pool = (BRKPOOL *) malloc(sizeof(BRKPOOL));
+    if(!pool) {
+        return NULL;
+    }
+    pool->streams = (BRKSTREAM *) malloc(sizeof(BRKSTREAM) * size);
+    pool->freelist = (BRKSTREAM **) malloc(sizeof(BRKSTREAM *) * size);
+    pool->acquired = (unsigned char *) calloc(size ? size : 1, 1);
+    if(!pool->streams || !pool->freelist || !pool->acquired) {
+        free(pool->streams);
+        free(pool->freelist);
+        free(pool->acquired);
+        free(pool);
+        return NULL;
+    }
+    pool->size = pool->nfree = size;
+    for(i = 0; i < size; i++) {
+        pool->streams[i].table = NULL;
+        pool->streams[i].points = NULL;
+        pool->freelist[i] = &pool->streams[size - 1 - i];
+    }
+    return pool;
+}
+
+unsigned long bps_acquire(BRKPOOL * pool, BRKTABLE * table, unsigned long fs, BRKSTREAM ** streams, unsigned long n) {
+    unsigned long i;
+    if(fs <= 0 || !table) {
+        return 0;
+    }
+    if(n > pool->nfree) {
+        n = pool->nfree;
+    }
+    for(i = 0; i < n; i++) {
+        streams[i] = pool->freelist[--pool->nfree];
+        pool->acquired[streams[i] - pool->streams] = 1;
+        bps_attach(streams[i], table, fs);
+    }
+    return n;
+}
+
+int bps_giveback(BRKPOOL * pool, BRKSTREAM * stream) {
+    unsigned long idx;
+    /* Compare addresses as integers: the cursor may not point into the pool at all */
+    if((uintptr_t) stream < (uintptr_t) pool->streams ||
+       (uintptr_t) stream >= (uintptr_t) (pool->streams + pool->size)) {
+        return 0;
+    }
+    idx = (unsigned long) (stream - pool->streams);
+    if(&pool->streams[idx] != stream || !pool->acquired[idx] || pool->nfree >= pool->size) {
+        return 0;
+    }
+    bps_freepoints(stream);
+    pool->acquired[idx] = 0;
+    pool->freelist[pool->nfree++] = stream;
+    return 1;
+}
+
+void bps_freepool(BRKPOOL ** pool) {
+    unsigned long i;
+    if(pool && *pool) {
+        for(i = 0; i < (*pool)->size; i++) {
+            bps_freepoints(&(*pool)->streams[i]);
+        }
+        free((*pool)->streams);
+        free((*pool)->freelist);
+        free((*pool)->acquired);
+        free(*pool);
+        *pool = NULL;
+    }
+}
+
+static void setupSpan(BRKSTREAM * stream) {
+    const BRKTABLE * table = stream->table;
+    stream->leftPoint = stream->points[stream->ileft];
+    stream->rightPoint = stream->points[stream->iright];
+    stream->width = stream->rightPoint.time - stream->leftPoint.time;
+    stream->height = stream->rightPoint.value - stream->leftPoint.value;
+    stream->curve.type = BRK_LINEAR;
+    stream->curve.shape = 0.0;
+    if(table->curves && stream->width) {
+        stream->curve = table->curves[stream->ileft];
+    }
+    if(stream->curve.type == BRK_EXP) {
+        if(!stream->curve.shape) {
+            stream->curve.type = BRK_LINEAR;
+        }
+        else {
+            /* exp(k * x) advances geometrically with time, so one exp() per span sets up the recursion */
+            double k = stream->curve.shape;
+            double x = (stream->sampleidx * stream->incr - stream->leftPoint.time) / stream->width;
+            stream->curvemul = exp(k * stream->incr / stream->width);
+            stream->curvenorm = stream->height / (1.0 - exp(k));
+            stream->curvestate = exp(k * x);
+        }
+    }
+}
+
+static void nextSpan(BRKSTREAM * stream) {
+    stream->ileft++;
+    stream->iright++;
+    if(stream->iright < stream->npoints) {
+        /* Update span variables */
+        setupSpan(stream);
+    }
+    else {
+        stream->more_points = 0;
+    }
+}
+
 double bps_tick(BRKSTREAM * stream) {
     /* Returns a tick from a breakpoint stream, linearly interpolating between points where necessary */
     double thisval, frac;
@@ -132,52 +748,379 @@ double bps_tick(BRKSTREAM * stream) {
     if(!stream->more_points) {
         return stream->rightPoint.value;
     }
+    DSP_PROBE_BEGIN(start);
     /* For discontinuities at the same time point, return the leftmost value */
     if(!stream->width) {
         thisval = stream->leftPoint.value;
     }
+    else if(stream->curve.type == BRK_EXP) {
+        thisval = stream->leftPoint.value + stream->curvenorm * (1.0 - stream->curvestate);
+        stream->curvestate *= stream->curvemul;
+    }
     else {
         /* get value from the current span using linear interpolation) - y = mx + c
          The gradient here is stream->height/stream->width, whereas the difference is
          the offset (x)
          */
         frac = (stream->curpos - stream->leftPoint.time)/stream->width;
+        if(stream->curve.type == BRK_POW) {
+            frac = frac > 0.0 ? pow(frac, stream->curve.shape) : 0.0;
+        }
         thisval = stream->leftPoint.value + (stream->height * frac);
     }
-    /* Go to next time point */
-    stream->curpos += stream->incr;
-    /* Do we need to move to the next span? */
-    if(stream->curpos > stream->rightPoint.time) {
-        stream->ileft++;
-        stream->iright++;
-        if(stream->iright < stream->npoints) {
-            /* Update span variables */
-            stream->leftPoint = stream->rightPoint;
-            stream->rightPoint = stream->points[stream->iright];
-            stream->height = stream->rightPoint.value - stream->leftPoint.value;
-            stream->width = stream->rightPoint.time - stream->leftPoint.time;
+    /* Go to next time point - derived from the sample count so that long streams do not drift */
+    stream->sampleidx++;
+    stream->curpos = stream->sampleidx * stream->incr;
+    /* Do we need to move to the next span? Skip any spans shorter than a sample, so the
+     stream is always in the span bps_seek would choose for this time */
+    while(stream->more_points && stream->curpos > stream->rightPoint.time) {
+        nextSpan(stream);
+    }
+    DSP_PROBE_END(DSP_PROBE_BPSTICK, start, 1);
+    return thisval;
+}
+
+static unsigned long spanEnd(const BRKSTREAM * stream) {
+    double rtime = stream->rightPoint.time;
+    unsigned long spanend = (unsigned long) (rtime / stream->incr) + 1;
+    while(spanend > 0 && (spanend - 1) * stream->incr > rtime) {
+        spanend--;
+    }
+    while(!(spanend * stream->incr > rtime)) {
+        spanend++;
+    }
+    return spanend;
+}
+
+void bps_render(BRKSTREAM * stream, double * out, unsigned long n) {
+    unsigned long i = 0, j, count, spanend;
+    double base, step;
+    DSP_PROBE_BEGIN(start);
+
+    while(i < n) {
+        if(!stream->more_points) {
+            /* Hold the final value */
+            for(j = i; j < n; j++) {
+                out[j] = stream->rightPoint.value;
+            }
+            stream->sampleidx += n - i;
+            break;
+        }
+        spanend = spanEnd(stream);
+        if(spanend <= stream->sampleidx) {
+            /* Span is shorter than a sample */
+            nextSpan(stream);
+            continue;
+        }
+        count = spanend - stream->sampleidx;
+        if(count > n - i) {
+            count = n - i;
+        }
+
+        if(!stream->width) {
+            for(j = 0; j < count; j++) {
+                out[i + j] = stream->leftPoint.value;
+            }
+        }
+        else if(stream->curve.type == BRK_EXP) {
+            /* One multiply per sample */
+            double state = stream->curvestate;
+            for(j = 0; j < count; j++) {
+                out[i + j] = stream->leftPoint.value + stream->curvenorm * (1.0 - state);
+                state *= stream->curvemul;
+            }
+            stream->curvestate = state;
+        }
+        else if(stream->curve.type == BRK_POW) {
+            double x;
+            for(j = 0; j < count; j++) {
+                x = ((stream->sampleidx + j) * stream->incr - stream->leftPoint.time) / stream->width;
+                out[i + j] = stream->leftPoint.value + stream->height * (x > 0.0 ? pow(x, stream->curve.shape) : 0.0);
+            }
         }
         else {
-            stream->more_points = 0;
+            /* Straight ramp: one slope per span, sample times taken from the sample index */
+            step = stream->height / stream->width;
+            base = stream->leftPoint.value + step * (stream->sampleidx * stream->incr - stream->leftPoint.time);
+            step *= stream->incr;
+            for(j = 0; j < count; j++) {
+                out[i + j] = base + step * (double) j;
+            }
+        }
+        i += count;
+        stream->sampleidx += count;
+        /* Leave the stream where bps_tick would, past any zero-width spans at the block boundary */
+        while(stream->more_points && stream->sampleidx * stream->incr > stream->rightPoint.time) {
+            nextSpan(stream);
         }
     }
-    return thisval;
+    stream->curpos = stream->sampleidx * stream->incr;
+    DSP_PROBE_END(DSP_PROBE_BPSRENDER, start, n);
 }
 
-void bps_getminmax(BRKSTREAM * stream, double *minval, double *maxval) {
-    double min, max;
-    min = max = stream->points[0].value;
-    int i = 1;
-    for (; i < stream->npoints; i++) {
-        if(stream->points[i].value > max) {
-            max = stream->points[i].value;
+double bps_sum(BRKSTREAM * stream, unsigned long n) {
+    unsigned long i = 0, j, count, spanend;
+    double sum = 0.0, base, step, x, geom;
+
+    while(i < n) {
+        if(!stream->more_points) {
+            sum += stream->rightPoint.value * (double) (n - i);
+            stream->sampleidx += n - i;
+            break;
+        }
+        spanend = spanEnd(stream);
+        if(spanend <= stream->sampleidx) {
+            nextSpan(stream);
+            continue;
         }
-        if(stream->points[i].value < min) {
-            min = stream->points[i].value;
+        count = spanend - stream->sampleidx;
+        if(count > n - i) {
+            count = n - i;
         }
+
+        if(!stream->width) {
+            sum += stream->leftPoint.value * (double) count;
+        }
+        else if(stream->curve.type == BRK_EXP) {
+            /* The recursion is a geometric series: sum of state * mul^j for j < count */
+            geom = stream->curvemul == 1.0 ? (double) count :
+                   (1.0 - pow(stream->curvemul, (double) count)) / (1.0 - stream->curvemul);
+            sum += (stream->leftPoint.value + stream->curvenorm) * (double) count -
+                   stream->curvenorm * stream->curvestate * geom;
+            stream->curvestate *= pow(stream->curvemul, (double) count);
+        }
+        else if(stream->curve.type == BRK_POW) {
+            for(j = 0; j < count; j++) {
+                x = ((stream->sampleidx + j) * stream->incr - stream->leftPoint.time) / stream->width;
+                sum += stream->leftPoint.value + stream->height * (x > 0.0 ? pow(x, stream->curve.shape) : 0.0);
+            }
+        }
+        else {
+            /* Arithmetic series over the same ramp bps_render fills */
+            step = stream->height / stream->width;
+            base = stream->leftPoint.value + step * (stream->sampleidx * stream->incr - stream->leftPoint.time);
+            sum += (double) count * (base + 0.5 * step * stream->incr * (double) (count - 1));
+        }
+        i += count;
+        stream->sampleidx += count;
+        /* As in bps_render, step past any zero-width spans at the end of the run */
+        while(stream->more_points && stream->sampleidx * stream->incr > stream->rightPoint.time) {
+            nextSpan(stream);
+        }
+    }
+    stream->curpos = stream->sampleidx * stream->incr;
+    return sum;
+}
+
+void bps_seek(BRKSTREAM * stream, double time) {
+    if(time <= 0.0) {
+        bps_seeksample(stream, 0);
+        return;
+    }
+    bps_seeksample(stream, (unsigned long) (time / stream->incr + 0.5));
+}
+
+void bps_seeksample(BRKSTREAM * stream, unsigned long sampleidx) {
+    unsigned long lo = 1, hi = stream->npoints, mid;
+    double t = sampleidx * stream->incr;
+    const BRKTABLE * table = stream->table;
+
+    /* Narrow the search to one index block first */
+    if(table->index) {
+        unsigned long ilo = 0, ihi = table->nindex;
+        /* Last index entry with time < t */
+        while(ihi - ilo > 1) {
+            mid = ilo + (ihi - ilo) / 2;
+            if(table->index[mid] < t) {
+                ilo = mid;
+            }
+            else {
+                ihi = mid;
+            }
+        }
+        if(ilo * table->indexstride + 1 > lo) {
+            lo = ilo * table->indexstride + 1;
+        }
+        if(ihi < table->nindex && ihi * table->indexstride + 1 < hi) {
+            hi = ihi * table->indexstride + 1;
+        }
+    }
+    /* The right point is the first breakpoint (after the first) at or beyond t - the span bps_tick would be in */
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(stream->points[mid].time < t) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    stream->sampleidx = sampleidx;
+    stream->curpos = t;
+    if(lo < stream->npoints) {
+        stream->iright = lo;
+        stream->more_points = 1;
+    }
+    else {
+        /* Past the end - hold the final value */
+        stream->iright = stream->npoints - 1;
+        stream->more_points = 0;
+    }
+    stream->ileft = stream->iright - 1;
+    setupSpan(stream);
+}
+
+int bps_buildindex(BRKSTREAM * stream, unsigned long stride) {
+    return bpt_buildindex(stream->table, stride);
+}
+
+void bps_getminmax(BRKSTREAM * stream, double *minval, double *maxval) {
+    *minval = stream->table->minval;
+    *maxval = stream->table->maxval;
+}
+
+static int simplifyEmit(BRKSIMPLIFY * simp, const BREAKPOINT * point) {
+    if(simp->ok && !simp->sink(point, simp->userdata)) {
+        simp->ok = 0;
+    }
+    simp->nout++;
+    simp->anchor = *point;
+    simp->slopelo = -HUGE_VAL;
+    simp->slopehi = HUGE_VAL;
+    simp->nseg = 0;
+    return simp->ok;
+}
+
+static int simplifyClose(BRKSIMPLIFY * simp) {
+    BREAKPOINT end;
+    double slope, exact;
+    if(!simp->nseg) {
+        return simp->ok;
+    }
+    /* Finish the segment at the last input time, as close to its true value as the fan allows */
+    end.time = simp->last.time;
+    slope = exact = (simp->last.value - simp->anchor.value) / (end.time - simp->anchor.time);
+    if(slope < simp->slopelo) {
+        slope = simp->slopelo;
+    }
+    if(slope > simp->slopehi) {
+        slope = simp->slopehi;
+    }
+    end.value = simp->anchor.value + slope * (end.time - simp->anchor.time);
+    if(simp->input) {
+        /* The segment covers the next nseg inputs; measure them against the line as it will be read back. This
+         runs before the end point is emitted, so an in-place output has not yet overwritten any of them */
+        const BREAKPOINT * point = simp->input + simp->measured;
+        const BREAKPOINT * stop = point + simp->nseg;
+        double span = end.time - simp->anchor.time, error;
+        for(; point < stop; point++) {
+            error = fabs(point->value - (simp->anchor.value + (end.value - simp->anchor.value) *
+                                         ((point->time - simp->anchor.time) / span)));
+            if(error > simp->maxerror) {
+                simp->maxerror = error;
+            }
+        }
+        simp->measured += simp->nseg;
+    } else if((simp->nseg > 1 || slope != exact) && simp->tolerance > simp->maxerror) {
+        /* Every point since the anchor lies within the tolerance of any slope left in the fan; a segment that
+         dropped no points and kept the true slope is exact */
+        simp->maxerror = simp->tolerance;
+    }
+    return simplifyEmit(simp, &end);
+}
+
+BRKSIMPLIFY * bps_simplify_new(double tolerance, BRKSINK sink, void * userdata) {
+    BRKSIMPLIFY * simp = (BRKSIMPLIFY *) malloc(sizeof(BRKSIMPLIFY));
+    if(!simp) {
+        return NULL;
+    }
+    simp->tolerance = tolerance < 0.0 ? 0.0 : tolerance;
+    simp->nseg = simp->nin = simp->nout = 0;
+    simp->maxerror = 0.0;
+    simp->input = NULL;
+    simp->measured = 0;
+    simp->sink = sink;
+    simp->userdata = userdata;
+    simp->ok = 1;
+    return simp;
+}
+
+int bps_simplify_push(BRKSIMPLIFY * simp, BREAKPOINT point) {
+    double dt, lo, hi;
+
+    if(!simp->nin++) {
+        simp->last = point;
+        simp->measured++;
+        return simplifyEmit(simp, &point);
+    }
+    if(point.time <= simp->last.time || point.time <= simp->anchor.time) {
+        /* A repeated time is a discontinuity - keep both sides exactly */
+        simplifyClose(simp);
+        simp->last = point;
+        simp->measured++;
+        return simplifyEmit(simp, &point);
+    }
+
+    dt = point.time - simp->anchor.time;
+    lo = (point.value - simp->tolerance - simp->anchor.value) / dt;
+    hi = (point.value + simp->tolerance - simp->anchor.value) / dt;
+    if(lo > simp->slopehi || hi < simp->slopelo) {
+        /* The fan has closed - no single line covers this point as well, so end the segment before it */
+        simplifyClose(simp);
+        dt = point.time - simp->anchor.time;
+        lo = (point.value - simp->tolerance - simp->anchor.value) / dt;
+        hi = (point.value + simp->tolerance - simp->anchor.value) / dt;
+    }
+    if(lo > simp->slopelo) {
+        simp->slopelo = lo;
+    }
+    if(hi < simp->slopehi) {
+        simp->slopehi = hi;
+    }
+    simp->nseg++;
+    simp->last = point;
+    return simp->ok;
+}
+
+int bps_simplify_finish(BRKSIMPLIFY * simp) {
+    return simplifyClose(simp);
+}
+
+void bps_simplify_free(BRKSIMPLIFY ** simp) {
+    if(simp && *simp) {
+        free(*simp);
+        *simp = NULL;
+    }
+}
+
+static int arraySink(const BREAKPOINT * point, void * userdata) {
+    BREAKPOINT ** out = (BREAKPOINT **) userdata;
+    *(*out)++ = *point;
+    return 1;
+}
+
+unsigned long bps_simplify(const BREAKPOINT * points, unsigned long npoints, BREAKPOINT * out,
+                           double tolerance, double * maxerror) {
+    BRKSIMPLIFY * simp;
+    unsigned long i, nout;
+    /* The output never overtakes the input, so simplifying in place is safe */
+    BREAKPOINT * cursor = out;
+
+    if(!(simp = bps_simplify_new(tolerance, arraySink, &cursor))) {
+        return 0;
+    }
+    simp->input = points;
+    for(i = 0; i < npoints; i++) {
+        bps_simplify_push(simp, points[i]);
+    }
+    bps_simplify_finish(simp);
+    nout = simp->ok ? simp->nout : 0;
+    if(maxerror) {
+        *maxerror = simp->maxerror;
     }
-    *minval = min;
-    *maxval = max;
+    bps_simplify_free(&simp);
+    return nout;
 }
 
 int inRange(const BREAKPOINT * points,
@@ -2,6 +2,8 @@
 #define _BREAKPOINT_H_
 
 #include <stdio.h>
+#include <stddef.h>
+#include "dspalloc.h"
 
 /**
  * Define the schema for a breakpoint object.
@@ -14,29 +16,186 @@ typedef struct breakpoint {
 } BREAKPOINT;
 
 /**
- * Define the schema for a breakpoint stream object
- * @param points - pointer to hold a BREAKPOINT array.
+ * Segment curve enumeration. A curve shapes the segment starting at its breakpoint.
+ *
+ * BRK_EXP follows v = v0 + dv * (1 - exp(k * x)) / (1 - exp(k)) for x from 0 to 1, where the shape k
+ * sets the curvature (negative k is fast-then-slow, positive slow-then-fast, 0 is linear).
+ * BRK_POW follows v = v0 + dv * pow(x, p) for a shape exponent p.
+ */
+enum {BRK_LINEAR, BRK_EXP, BRK_POW};
+
+/**
+ * Define the schema for a segment curve.
+ * @param shape - the curvature (BRK_EXP) or exponent (BRK_POW)
+ * @param type - the curve type (BRK_LINEAR, BRK_EXP, BRK_POW)
+ */
+typedef struct breakpoint_curve {
+    double shape;
+    int type;
+} BRKCURVE;
+
+/**
+ * Magic number and version identifying a binary breakpoint file.
+ *
+ * A binary file is a 16-byte header (magic, 32-bit version, 64-bit point count) followed by the raw
+ * BREAKPOINT array in host byte order, so it can be memory-mapped and used without parsing.
+ * Version 2 files append a BRKCURVE array with one curve per breakpoint.
+ */
+#define BRK_MAGIC "BRKB"
+#define BRK_VERSION 1
+#define BRK_VERSION_CURVES 2
+
+/**
+ * Define the schema for a loaded breakpoint file.
+ * @param points - pointer to the BREAKPOINT array
+ * @param npoints - the number of breakpoints
+ * @param curves - pointer to the BRKCURVE array (one per breakpoint), or NULL if every segment is linear
+ * @param map - base address of the file mapping if points reference a mapped binary file, otherwise NULL
+ * @param maplen - the length of the mapping in bytes
+ */
+typedef struct breakpoint_file {
+    BREAKPOINT * points;
+    unsigned long npoints;
+    BRKCURVE * curves;
+    void * map;
+    size_t maplen;
+} BRKFILE;
+
+/**
+ * Define the schema for a shared, immutable breakpoint table.
+ *
+ * A table is created once per breakpoint file and referenced by any number of BRKSTREAM cursors. It is
+ * reference counted; the points are released with the last reference. The value range is computed once
+ * at creation.
+ *
+ * @param points - pointer to the BREAKPOINT array
+ * @param npoints - the number of breakpoints
+ * @param curves - pointer to the BRKCURVE array (one per breakpoint), or NULL if every segment is linear
+ * @param file - the backing BRKFILE if the points were loaded with bps_load, otherwise NULL (points are owned)
+ * @param minval,maxval - the cached minimum and maximum breakpoint values
+ * @param index - optional coarse seek index holding the time of every indexstride-th breakpoint (NULL if not built)
+ * @param indexstride - the number of breakpoints between index entries
+ * @param nindex - the number of index entries
+ * @param refcount - the number of live references (updated atomically)
+ */
+typedef struct breakpoint_table {
+    BREAKPOINT * points;
+    unsigned long npoints;
+    BRKCURVE * curves;
+    BRKFILE * file;
+    double minval, maxval;
+    double * index;
+    unsigned long indexstride, nindex;
+    long refcount;
+} BRKTABLE;
+
+/**
+ * Define the schema for a breakpoint stream object - a lightweight cursor over a BRKTABLE
+ * @param table - the shared breakpoint table the stream reads from
+ * @param points - pointer to the table's BREAKPOINT array.
  * @param leftPoint,rightPoint - current and previous breakpoint (span variables)
  * @param npoints - the number of breakpoints within the stream
  * @param curpos - the current position (index) within the breakpoitn stream
+ * @param sampleidx - the number of samples elapsed; curpos is derived from it to avoid drift
  * @param incr - time increment - equal to sampling period
  * @param width - time difference dT between adjacent breakpoints
  * @param height - value difference dX between adjacent breakpoints
  * @param ileft,right - indices for the current (right) and previous breakpoint
  * @param more_points - boolean integer indicating whether the end of the breakpoint stream has been reached.
+ * @param curve - the curve of the current span
+ * @param curvestate - recursive curve term: exp(k * x) for BRK_EXP spans, updated once per tick
+ * @param curvemul - per-tick multiplier for curvestate
+ * @param curvenorm - span scale factor: dv / (1 - exp(k)) for BRK_EXP spans
  */
 typedef struct breakpoint_stream {
+    BRKTABLE * table;
     BREAKPOINT * points;
     BREAKPOINT leftPoint, rightPoint;
     unsigned long npoints;
     double curpos;
+    unsigned long sampleidx;
     double incr;
     double width;
     double height;
     unsigned long ileft, iright;
     int more_points;
+    BRKCURVE curve;
+    double curvestate, curvemul, curvenorm;
 } BRKSTREAM;
 
+/**
+ * Define the schema for a pool of preallocated breakpoint stream cursors.
+ * @param streams - the cursor storage
+ * @param freelist - stack of available cursors
+ * @param acquired - per cursor flag, set while the cursor is out of the pool
+ * @param size - the number of cursors in the pool
+ * @param nfree - the number of cursors currently available
+ */
+typedef struct breakpoint_pool {
+    BRKSTREAM * streams;
+    BRKSTREAM ** freelist;
+    unsigned char * acquired;
+    unsigned long size;
+    unsigned long nfree;
+} BRKPOOL;
+
+/**
+ * Parse breakpoints from a text buffer of "time value" lines. Returns NULL if unsuccessful.
+ *
+ * Applies the same validation as getBreakpoints, stopping at the first line with non-numeric data,
+ * an incomplete breakpoint or a decreasing time. Curve columns are ignored (see bps_load).
+ *
+ * @param text - pointer to the text (need not be NUL terminated)
+ * @param len - the length of the text in bytes
+ * @param psize - pointer of type unsigned long which is populated by the breakpoint length
+ * @return pointer to a dynamically allocated BREAKPOINT array.
+ */
+BREAKPOINT * parseBreakpoints(const char * text, size_t len, unsigned long * psize);
+
+/**
+ * Define a function pointer receiving the breakpoints emitted by a simplifier.
+ * @param point - pointer to the emitted breakpoint
+ * @param userdata - the pointer supplied to bps_simplify_new
+ * @return boolean integer, 0 to report an output error
+ */
+typedef int (*BRKSINK) (const BREAKPOINT * point, void * userdata);
+
+/**
+ * Define the schema for a streaming breakpoint simplifier.
+ *
+ * Implements a "swing filter": a fan of slopes from the last emitted point (the anchor) is narrowed by each new
+ * point's tolerance band, and a point is only emitted once the fan closes. Each input is handled once, so the
+ * pass is O(n) and runs in constant memory however long a run of points one segment covers.
+ *
+ * @param tolerance - the maximum absolute value error allowed
+ * @param anchor - the last emitted breakpoint
+ * @param last - the most recent input breakpoint
+ * @param slopelo,slopehi - the feasible slope range from the anchor
+ * @param nseg - the number of input points since the anchor
+ * @param nin,nout - the number of breakpoints read and emitted
+ * @param maxerror - the worst-case absolute error of the emitted breakpoints so far, measured at the input times
+ * when input is set. A pure stream keeps only the fan, not the points in it, so without input this is the bound
+ * instead: the tolerance (up to rounding) once any point has been dropped, 0 while the output is exact.
+ * @param input - the whole input array when it is in memory (bps_simplify sets it), or NULL while streaming
+ * @param measured - the number of input points measured against the output so far
+ * @param sink - the function receiving emitted breakpoints
+ * @param userdata - pointer passed through to the sink
+ * @param ok - boolean integer, cleared once the sink fails
+ */
+typedef struct breakpoint_simplifier {
+    double tolerance;
+    BREAKPOINT anchor, last;
+    double slopelo, slopehi;
+    unsigned long nseg;
+    unsigned long nin, nout;
+    double maxerror;
+    const BREAKPOINT * input;
+    unsigned long measured;
+    BRKSINK sink;
+    void * userdata;
+    int ok;
+} BRKSIMPLIFY;
+
 /**
  * Obtain a breakpoint array from a given breakpoint file. Returns NULL if unsuccessful.
  * @param file - pointer to the breakpoint file.
@@ -45,6 +204,141 @@ typedef struct breakpoint_stream {
  */
 BREAKPOINT * getBreakpoints(FILE * file, unsigned long *psize);
 
+/**
+ * Load a text or binary breakpoint file by memory-mapping it. Returns NULL if unsuccessful.
+ *
+ * Binary files (see BRK_MAGIC) are used in place; text files are parsed straight out of the mapping.
+ * Text lines may carry an optional curve for the segment they start: "time value exp k" or "time value pow p".
+ *
+ * @param path - path to the breakpoint file
+ * @return pointer to a dynamically allocated BRKFILE object
+ */
+BRKFILE * bps_load(const char * path);
+
+/**
+ * Release a BRKFILE object, unmapping or freeing its breakpoints.
+ * @param file - pointer to a pointer for the BRKFILE object, set to NULL on return
+ */
+void bps_unload(BRKFILE ** file);
+
+/**
+ * Write a BREAKPOINT array as a binary breakpoint file.
+ * @param path - path to the output file
+ * @param points - pointer to a BREAKPOINT array
+ * @param curves - pointer to a BRKCURVE array of the same size, or NULL if every segment is linear
+ * @param npoints - the size of the BREAKPOINT array
+ * @return boolean integer specifying whether the file was written successfully
+ */
+int bps_writebinary(const char * path, const BREAKPOINT * points, const BRKCURVE * curves, unsigned long npoints);
+
+/**
+ * Convert a text breakpoint file into a binary breakpoint file.
+ * @param srcpath - path to the text breakpoint file
+ * @param dstpath - path to the binary file to create
+ * @return boolean integer specifying whether the conversion succeeded
+ */
+int bps_convert(const char * srcpath, const char * dstpath);
+
+/**
+ * Create a shared breakpoint table which takes ownership of dynamically allocated BREAKPOINT and BRKCURVE arrays.
+ * Returns NULL if unsuccessful (the arrays are then left to the caller).
+ * @param points - pointer to a dynamically allocated BREAKPOINT array
+ * @param curves - pointer to a dynamically allocated BRKCURVE array of the same size, or NULL if every segment is linear
+ * @param npoints - the size of the BREAKPOINT array (at least two points)
+ * @return pointer to a BRKTABLE with a reference count of one
+ */
+BRKTABLE * bpt_new(BREAKPOINT * points, BRKCURVE * curves, unsigned long npoints);
+
+/**
+ * Create a shared breakpoint table from a text or binary breakpoint file. See bps_load.
+ * @param path - path to the breakpoint file
+ * @return pointer to a BRKTABLE with a reference count of one, or NULL if unsuccessful
+ */
+BRKTABLE * bpt_load(const char * path);
+
+/**
+ * Create a shared breakpoint table from an open breakpoint file. See getBreakpoints.
+ * @param fp - pointer to the breakpoint file
+ * @return pointer to a BRKTABLE with a reference count of one, or NULL if unsuccessful
+ */
+BRKTABLE * bpt_read(FILE * fp);
+
+/**
+ * Take an additional reference to a breakpoint table. Safe to call from any thread.
+ * @param table - pointer to a BRKTABLE object
+ * @return the table
+ */
+BRKTABLE * bpt_retain(BRKTABLE * table);
+
+/**
+ * Drop a reference to a breakpoint table, destroying it when the last reference goes.
+ * @param table - pointer to a pointer for the BRKTABLE object, set to NULL on return
+ */
+void bpt_release(BRKTABLE ** table);
+
+/**
+ * Build a coarse seek index over a breakpoint table, recording the time of every stride-th breakpoint.
+ *
+ * Only worthwhile for very large tables, where it keeps the first stage of each seek within cache.
+ * Must be called before the table is shared with streams on other threads.
+ *
+ * @param table - pointer to a BRKTABLE object
+ * @param stride - the number of breakpoints per index entry
+ * @return boolean integer specifying whether the index was built
+ */
+int bpt_buildindex(BRKTABLE * table, unsigned long stride);
+
+/**
+ * Checks whether a breakpoint table is within defined limits, using the cached value range.
+ * @param table - pointer to a BRKTABLE object
+ * @param minVal - the lower bound
+ * @param maxVal - the upper bound
+ * @return a boolean integer, 1 if the table is within bounds, 0 otherwise.
+ */
+int bpt_inrange(const BRKTABLE * table, double minVal, double maxVal);
+
+/**
+ * Initialise caller-provided stream storage as a cursor over a shared table. Performs no allocation or file I/O.
+ * @param stream - pointer to the BRKSTREAM storage
+ * @param table - pointer to the BRKTABLE to reference (retained)
+ * @param fs - the system sample rate
+ * @return boolean integer specifying whether the stream was initialised
+ */
+int bps_attach(BRKSTREAM * stream, BRKTABLE * table, unsigned long fs);
+
+/**
+ * Create a pool of breakpoint stream cursors, allocated once up front.
+ * @param size - the number of cursors
+ * @return pointer to a dynamically allocated BRKPOOL object, or NULL if unsuccessful
+ */
+BRKPOOL * bps_newpool(unsigned long size);
+
+/**
+ * Take cursors from a pool and attach them to a shared table. Performs no allocation or file I/O.
+ * @param pool - pointer to a BRKPOOL object
+ * @param table - pointer to the BRKTABLE the cursors reference
+ * @param fs - the system sample rate
+ * @param streams - array which is filled with the acquired cursors
+ * @param n - the number of cursors requested
+ * @return the number of cursors acquired (fewer than n if the pool runs dry)
+ */
+unsigned long bps_acquire(BRKPOOL * pool, BRKTABLE * table, unsigned long fs, BRKSTREAM ** streams, unsigned long n);
+
+/**
+ * Detach a cursor from its table and return it to its pool. Cursors that do not belong to the pool or are
+ * already back in it are rejected, so a double giveback cannot corrupt the free list.
+ * @param pool - pointer to the BRKPOOL the cursor was acquired from
+ * @param stream - pointer to the cursor
+ * @return boolean integer specifying whether the cursor was returned
+ */
+int bps_giveback(BRKPOOL * pool, BRKSTREAM * stream);
+
+/**
+ * Destroy a pool of cursors, releasing any table references still held by acquired cursors.
+ * @param pool - pointer to a pointer for the BRKPOOL object, set to NULL on return
+ */
+void bps_freepool(BRKPOOL ** pool);
+
 /**
  * Initialise and return a given breakpoint stream object for a given breakpoint file and sample rate.
  * @param fp - pointer to the breakpoitn file
@@ -54,7 +348,34 @@ BREAKPOINT * getBreakpoints(FILE * file, unsigned long *psize);
 BRKSTREAM * bps_init(FILE * fp, unsigned long fs);
 
 /**
- * Free dynamically allocated memory for the BREAKPOINT array within a BRKSTREAM object.
+ * Initialise a breakpoint stream object for a given breakpoint file, allocating the stream with a given allocator.
+ * The breakpoint table itself is parsed onto the heap; use bps_new_a with a preloaded table on an audio thread.
+ * @param fp - pointer to the breakpoint file
+ * @param fs - the system sample rate
+ * @param alloc - the allocator for the stream, or NULL for the heap
+ * @return pointer to a BRKSTREAM object, or NULL if unsuccessful
+ */
+BRKSTREAM * bps_init_a(FILE * fp, unsigned long fs, const DSPALLOC * alloc);
+
+/**
+ * Create a stream cursor over a shared breakpoint table with a given allocator. Only the cursor is allocated,
+ * so with an arena or pool allocator this is safe on an audio thread.
+ * @param table - pointer to the BRKTABLE to reference (retained)
+ * @param fs - the system sample rate
+ * @param alloc - the allocator for the stream, or NULL for the heap
+ * @return pointer to a BRKSTREAM object, or NULL if unsuccessful
+ */
+BRKSTREAM * bps_new_a(BRKTABLE * table, unsigned long fs, const DSPALLOC * alloc);
+
+/**
+ * Release a stream's table reference and free a stream created by bps_init_a or bps_new_a.
+ * @param stream - pointer to a pointer for the BRKSTREAM object, set to NULL on return
+ * @param alloc - the allocator the stream was created with
+ */
+void bps_free_a(BRKSTREAM ** stream, const DSPALLOC * alloc);
+
+/**
+ * Release the BRKSTREAM object's reference to its breakpoint table (freeing the BREAKPOINT array with the last reference).
  * @param stream - pointer to an initialised BRKSTREAM object
  */
 void bps_freepoints(BRKSTREAM * stream);
@@ -62,7 +383,7 @@ void bps_freepoints(BRKSTREAM * stream);
 /**
  * Advance through to the next tick within the breakpoint stream.
  *
- * Either returns a breakpoint's value or a linearly interpolated value between adjacent breakpoints.
+ * Either returns a breakpoint's value or a value interpolated along the segment curve between adjacent breakpoints.
  * Holds the final value if the end of the breakpoint stream is reached.
  *
  * @param stream - pointer to an initialised BRKSTREAM object
@@ -71,7 +392,63 @@ void bps_freepoints(BRKSTREAM * stream);
 double bps_tick(BRKSTREAM * stream);
 
 /**
- * Get the minimum and maximum value within an initialised BRKSTREAM object.
+ * Render a block of ticks from a breakpoint stream.
+ *
+ * Produces the values n successive calls to bps_tick would, but walks whole spans at once: each span's
+ * slope is computed once and its samples are filled with a vectorisable ramp. BRK_EXP spans cost one
+ * multiply per sample; BRK_POW spans call pow per sample. Held values, BRK_EXP and BRK_POW spans are
+ * bit-identical to bps_tick; linear spans are equal to within rounding, as the ramp computes
+ * base + step * j where bps_tick computes left + height * frac.
+ *
+ * @param stream - pointer to an initialised BRKSTREAM object
+ * @param out - output buffer of at least n samples
+ * @param n - the number of ticks to render
+ */
+void bps_render(BRKSTREAM * stream, double * out, unsigned long n);
+
+/**
+ * Advance a breakpoint stream by n ticks and return the sum of the values they would produce.
+ *
+ * This is the running (discrete) integral of the envelope, eg. the phase an oscillator accumulates over n
+ * samples is its phase increment per unit frequency times the sum of a frequency envelope. Walks whole spans
+ * like bps_render, with linear and BRK_EXP spans summed in closed form, so the cost is proportional to the
+ * number of spans crossed rather than to n. BRK_POW spans are summed sample by sample.
+ *
+ * @param stream - pointer to an initialised BRKSTREAM object
+ * @param n - the number of ticks to advance by
+ * @return the sum of the n tick values
+ */
+double bps_sum(BRKSTREAM * stream, unsigned long n);
+
+/**
+ * Reposition a breakpoint stream at a given time, so that the next tick is the one for that time.
+ *
+ * The span is located by binary search over the breakpoints (via the coarse index, if built), so the
+ * cost is logarithmic in the number of points rather than linear in the elapsed time.
+ *
+ * @param stream - pointer to an initialised BRKSTREAM object
+ * @param time - the time in seconds (rounded to the nearest sample)
+ */
+void bps_seek(BRKSTREAM * stream, double time);
+
+/**
+ * Reposition a breakpoint stream at a given sample index. See bps_seek.
+ * @param stream - pointer to an initialised BRKSTREAM object
+ * @param sampleidx - the sample index of the next tick
+ */
+void bps_seeksample(BRKSTREAM * stream, unsigned long sampleidx);
+
+/**
+ * Build a coarse seek index over the breakpoint table of a stream. See bpt_buildindex.
+ *
+ * @param stream - pointer to an initialised BRKSTREAM object
+ * @param stride - the number of breakpoints per index entry
+ * @return boolean integer specifying whether the index was built
+ */
+int bps_buildindex(BRKSTREAM * stream, unsigned long stride);
+
+/**
+ * Get the minimum and maximum value within an initialised BRKSTREAM object (cached by its table).
  *
  *  @param stream - pointer to an initialised BRKSTREAM object
  *  @param minval - pointer to a double which is filled with the minimum value
@@ -79,6 +456,48 @@ double bps_tick(BRKSTREAM * stream);
  */
 void bps_getminmax(BRKSTREAM * stream, double *minval, double *maxval);
 
+/**
+ * Create a streaming breakpoint simplifier.
+ * @param tolerance - the maximum absolute value error allowed
+ * @param sink - function receiving each emitted breakpoint
+ * @param userdata - pointer passed through to the sink
+ * @return pointer to a dynamically allocated BRKSIMPLIFY object, or NULL if unsuccessful
+ */
+BRKSIMPLIFY * bps_simplify_new(double tolerance, BRKSINK sink, void * userdata);
+
+/**
+ * Feed the next breakpoint (in increasing time order) to a simplifier. Repeated times (discontinuities) are preserved.
+ * @param simp - pointer to a BRKSIMPLIFY object
+ * @param point - the next breakpoint
+ * @return boolean integer specifying whether processing succeeded
+ */
+int bps_simplify_push(BRKSIMPLIFY * simp, BREAKPOINT point);
+
+/**
+ * Emit the final pending breakpoint of a simplifier.
+ * @param simp - pointer to a BRKSIMPLIFY object
+ * @return boolean integer specifying whether processing succeeded
+ */
+int bps_simplify_finish(BRKSIMPLIFY * simp);
+
+/**
+ * Destroy a streaming breakpoint simplifier.
+ * @param simp - pointer to a pointer for the BRKSIMPLIFY object, set to NULL on return
+ */
+void bps_simplify_free(BRKSIMPLIFY ** simp);
+
+/**
+ * Simplify a BREAKPOINT array in memory. See BRKSIMPLIFY.
+ * @param points - pointer to the input BREAKPOINT array
+ * @param npoints - the size of the input array
+ * @param out - output array with room for npoints breakpoints (may equal points)
+ * @param tolerance - the maximum absolute value error allowed
+ * @param maxerror - populated by the worst-case absolute error of the output at the input times (may be NULL)
+ * @return the number of breakpoints written to out, or 0 if unsuccessful
+ */
+unsigned long bps_simplify(const BREAKPOINT * points, unsigned long npoints, BREAKPOINT * out,
+                           double tolerance, double * maxerror);
+
 /**
  * Checks whether a BREAKPOINT array is within defined limits.
  *
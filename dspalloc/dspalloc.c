@@ -0,0 +1,216 @@
+#include "dspalloc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/**
+ * Round a size up to a multiple of DSP_ALIGN.
+ */
+static size_t alignUp(size_t size);
+
+/**
+ * DSPALLOC callbacks for the bump arena.
+ */
+static void * arenaAlloc(void * ctx, size_t size);
+static void arenaRelease(void * ctx, void * ptr);
+
+/**
+ * Header placed DSP_ALIGN bytes before each fallback block handed out by a pool, linking the outstanding blocks.
+ * @param prev,next - the neighbouring outstanding blocks' headers
+ */
+typedef struct poolspill {
+    struct poolspill * prev;
+    struct poolspill * next;
+} POOLSPILL;
+
+/**
+ * DSPALLOC callbacks for the fixed-size pool.
+ */
+static void * poolAlloc(void * ctx, size_t size);
+static void poolRelease(void * ctx, void * ptr);
+
+static size_t alignUp(size_t size) {
+    return (size + DSP_ALIGN - 1) & ~((size_t) DSP_ALIGN - 1);
+}
+
+void * dsp_alloc(const DSPALLOC * allocator, size_t size) {
+    if(!allocator) {
+        return malloc(size);
+    }
+    return allocator->alloc(allocator->ctx, size);
+}
+
+void * dsp_calloc(const DSPALLOC * allocator, size_t n, size_t size) {
+    void * ptr;
+    if(size && n > SIZE_MAX / size) {
+        return NULL;
+    }
+    if(!allocator) {
+        return calloc(n, size);
+    }
+    ptr = allocator->alloc(allocator->ctx, n * size);
+    if(ptr) {
+        memset(ptr, 0, n * size);
+    }
+    return ptr;
+}
+
+void dsp_free(const DSPALLOC * allocator, void * ptr) {
+    if(!ptr) {
+        return;
+    }
+    if(!allocator) {
+        free(ptr);
+    }
+    else {
+        allocator->release(allocator->ctx, ptr);
+    }
+}
+
+static void * arenaAlloc(void * ctx, size_t size) {
+    DSPARENA * arena = (DSPARENA *) ctx;
+    void * ptr;
+    size = alignUp(size ? size : 1);
+    if(size > arena->size - arena->used) {
+        return NULL;
+    }
+    ptr = arena->base + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+static void arenaRelease(void * ctx, void * ptr) {
+    /* Arena memory is only recycled as a whole */
+    (void) ctx;
+    (void) ptr;
+}
+
+DSPARENA * dsp_arena_new(size_t size) {
+    DSPARENA * arena = (DSPARENA *) malloc(sizeof(DSPARENA));
+    if(!arena) {
+        return NULL;
+    }
+    arena->size = alignUp(size);
+    if(posix_memalign((void **) &arena->base, DSP_ALIGN, arena->size ? arena->size : DSP_ALIGN)) {
+        free(arena);
+        return NULL;
+    }
+    arena->used = 0;
+    arena->allocator.alloc = arenaAlloc;
+    arena->allocator.release = arenaRelease;
+    arena->allocator.ctx = arena;
+    return arena;
+}
+
+void dsp_arena_reset(DSPARENA * arena) {
+    arena->used = 0;
+}
+
+void dsp_arena_free(DSPARENA ** arena) {
+    if(arena && *arena) {
+        free((*arena)->base);
+        free(*arena);
+        *arena = NULL;
+    }
+}
+
+static void * poolAlloc(void * ctx, size_t size) {
+    DSPPOOL * pool = (DSPPOOL *) ctx;
+    POOLSPILL * spill;
+    void * ptr;
+    if(size > pool->blocksize || !pool->freelist) {
+        if(!pool->fallback || size > SIZE_MAX - DSP_ALIGN ||
+           !(spill = (POOLSPILL *) dsp_alloc(pool->fallback, size + DSP_ALIGN))) {
+            return NULL;
+        }
+        /* Link the block in ahead of the caller's memory, keeping the fallback's alignment */
+        spill->prev = NULL;
+        spill->next = (POOLSPILL *) pool->fallbacklist;
+        if(spill->next) {
+            spill->next->prev = spill;
+        }
+        pool->fallbacklist = spill;
+        pool->nfallback++;
+        return (unsigned char *) spill + DSP_ALIGN;
+    }
+    ptr = pool->freelist;
+    pool->freelist = *(void **) ptr;
+    pool->nfree--;
+    return ptr;
+}
+
+static void poolRelease(void * ctx, void * ptr) {
+    DSPPOOL * pool = (DSPPOOL *) ctx;
+    unsigned char * p = (unsigned char *) ptr;
+    POOLSPILL * spill;
+    /* Blocks outside the slab came from the fallback */
+    if(p < pool->slab || p >= pool->slab + pool->blocksize * pool->nblocks) {
+        if(pool->fallback) {
+            spill = (POOLSPILL *) (p - DSP_ALIGN);
+            if(spill->prev) {
+                spill->prev->next = spill->next;
+            }
+            else {
+                pool->fallbacklist = spill->next;
+            }
+            if(spill->next) {
+                spill->next->prev = spill->prev;
+            }
+            pool->nfallback--;
+            dsp_free(pool->fallback, spill);
+        }
+        return;
+    }
+    *(void **) ptr = pool->freelist;
+    pool->freelist = ptr;
+    pool->nfree++;
+}
+
+DSPPOOL * dsp_pool_new(size_t blocksize, size_t nblocks, const DSPALLOC * fallback) {
+    DSPPOOL * pool;
+    size_t i;
+
+    if(!nblocks) {
+        return NULL;
+    }
+    blocksize = alignUp(blocksize < sizeof(void *) ? sizeof(void *) : blocksize);
+    if(nblocks > SIZE_MAX / blocksize) {
+        return NULL;
+    }
+    pool = (DSPPOOL *) malloc(sizeof(DSPPOOL));
+    if(!pool) {
+        return NULL;
+    }
+    if(posix_memalign((void **) &pool->slab, DSP_ALIGN, blocksize * nblocks)) {
+        free(pool);
+        return NULL;
+    }
+    pool->blocksize = blocksize;
+    pool->nblocks = nblocks;
+    pool->fallback = fallback;
+    pool->fallbacklist = NULL;
+    pool->nfallback = 0;
+    /* Thread the free list through the blocks in address order */
+    for(i = 0; i < nblocks; i++) {
+        *(void **) (pool->slab + i * blocksize) = i + 1 < nblocks ? pool->slab + (i + 1) * blocksize : NULL;
+    }
+    pool->freelist = pool->slab;
+    pool->nfree = nblocks;
+    pool->allocator.alloc = poolAlloc;
+    pool->allocator.release = poolRelease;
+    pool->allocator.ctx = pool;
+    return pool;
+}
+
+void dsp_pool_free(DSPPOOL ** pool) {
+    POOLSPILL * spill, * next;
+    if(pool && *pool) {
+        for(spill = (POOLSPILL *) (*pool)->fallbacklist; spill; spill = next) {
+            next = spill->next;
+            dsp_free((*pool)->fallback, spill);
+        }
+        free((*pool)->slab);
+        free(*pool);
+        *pool = NULL;
+    }
+}
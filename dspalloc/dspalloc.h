@@ -0,0 +1,130 @@
+#ifndef _DSPALLOC_H_
+#define _DSPALLOC_H_
+
+#include <stddef.h>
+
+/**
+ * Alignment (bytes) of every block handed out by the arena and pools - one cache line, enough for any SIMD load.
+ */
+#define DSP_ALIGN 64
+
+/**
+ * Defines a pluggable allocator. Every library constructor with an _a suffix takes a pointer to one of these;
+ * passing NULL selects the system heap (malloc/free).
+ *
+ * @param alloc - returns a block of at least size bytes, or NULL
+ * @param release - returns a block obtained from alloc (may be a no-op, eg. for an arena)
+ * @param ctx - the allocator's context, passed to both functions
+ */
+typedef struct dspalloc {
+    void * (*alloc) (void * ctx, size_t size);
+    void (*release) (void * ctx, void * ptr);
+    void * ctx;
+} DSPALLOC;
+
+/**
+ * Defines the schema for a bump arena: allocation advances an offset within one preallocated block and
+ * individual releases are ignored. The whole arena is recycled at once with dsp_arena_reset, eg. when a voice
+ * or a patch is torn down.
+ *
+ * @param base - the arena storage
+ * @param size - the capacity in bytes
+ * @param used - the number of bytes handed out
+ * @param allocator - DSPALLOC interface drawing from this arena
+ */
+typedef struct dsparena {
+    unsigned char * base;
+    size_t size;
+    size_t used;
+    DSPALLOC allocator;
+} DSPARENA;
+
+/**
+ * Defines the schema for a fixed-size object pool: a preallocated slab of equal blocks threaded on an intrusive
+ * free list, so allocation and release are O(1) and never fragment. Requests larger than the block size, or made
+ * while the pool is empty, go to the fallback allocator (if any). Fallback blocks carry a DSP_ALIGN byte header
+ * linking them into a list of outstanding blocks, so release stays O(1) and dsp_pool_free can return any still
+ * held. Not thread-safe: use one pool per thread.
+ *
+ * @param slab - the pool storage
+ * @param blocksize - the size of each block in bytes (a multiple of DSP_ALIGN)
+ * @param nblocks - the number of blocks in the slab
+ * @param freelist - the first free block (each free block stores the address of the next)
+ * @param nfree - the number of free blocks
+ * @param fallback - allocator for requests the pool cannot serve, or NULL to fail them
+ * @param fallbacklist - the header of the most recent outstanding fallback block
+ * @param nfallback - the number of outstanding fallback blocks
+ * @param allocator - DSPALLOC interface drawing from this pool
+ */
+typedef struct dsppool {
+    unsigned char * slab;
+    size_t blocksize;
+    size_t nblocks;
+    void * freelist;
+    size_t nfree;
+    const DSPALLOC * fallback;
+    void * fallbacklist;
+    size_t nfallback;
+    DSPALLOC allocator;
+} DSPPOOL;
+
+/**
+ * Allocate memory from an allocator.
+ * @param allocator - pointer to a DSPALLOC object, or NULL for the system heap
+ * @param size - the number of bytes
+ * @return pointer to the memory, or NULL if unsuccessful
+ */
+void * dsp_alloc(const DSPALLOC * allocator, size_t size);
+
+/**
+ * Allocate zeroed memory for an array from an allocator.
+ * @param allocator - pointer to a DSPALLOC object, or NULL for the system heap
+ * @param n - the number of elements
+ * @param size - the size of each element
+ * @return pointer to the memory, or NULL if unsuccessful (including on overflow)
+ */
+void * dsp_calloc(const DSPALLOC * allocator, size_t n, size_t size);
+
+/**
+ * Return memory to the allocator it came from. NULL pointers are ignored.
+ * @param allocator - pointer to the DSPALLOC object used for the allocation, or NULL for the system heap
+ * @param ptr - the memory to release
+ */
+void dsp_free(const DSPALLOC * allocator, void * ptr);
+
+/**
+ * Create a bump arena, taking its storage from the system heap (call before entering the audio thread).
+ * @param size - the capacity in bytes
+ * @return pointer to a dynamically allocated DSPARENA object, or NULL if unsuccessful
+ */
+DSPARENA * dsp_arena_new(size_t size);
+
+/**
+ * Recycle the whole arena. Every object allocated from it becomes invalid.
+ * @param arena - pointer to a DSPARENA object
+ */
+void dsp_arena_reset(DSPARENA * arena);
+
+/**
+ * Destroy a DSPARENA object and its storage.
+ * @param arena - pointer to a pointer for the DSPARENA object, set to NULL on return
+ */
+void dsp_arena_free(DSPARENA ** arena);
+
+/**
+ * Create a fixed-size object pool, taking its slab from the system heap.
+ * @param blocksize - the largest object the pool serves (rounded up to a multiple of DSP_ALIGN)
+ * @param nblocks - the number of blocks
+ * @param fallback - allocator for oversized requests or an exhausted pool, or NULL to fail them
+ * @return pointer to a dynamically allocated DSPPOOL object, or NULL if unsuccessful
+ */
+DSPPOOL * dsp_pool_new(size_t blocksize, size_t nblocks, const DSPALLOC * fallback);
+
+/**
+ * Destroy a DSPPOOL object and its slab, returning any outstanding fallback blocks to the fallback allocator.
+ * Every object allocated from the pool becomes invalid.
+ * @param pool - pointer to a pointer for the DSPPOOL object, set to NULL on return
+ */
+void dsp_pool_free(DSPPOOL ** pool);
+
+#endif
@@ -0,0 +1,579 @@
+#ifndef _DSPCXX_HPP_
+#define _DSPCXX_HPP_
+
+/*
+ Header-only C++17 layer over the C modules.
+
+ The classes here are non-owning views of the C structs (OSCIL, TOSCIL, BRKSTREAM, UPOLS): objects are still
+ created and destroyed with the C API, and C and C++ calls can be mixed on the same object. What the layer adds
+ is compile-time selection of what the C API picks at run time through tickfunc and TABFUNC pointers -
+ waveform, interpolation order, wrap policy and output sample type are template parameters, so a block render
+ compiles to one loop with the tick inlined, and the choices that do not apply are removed by if constexpr.
+
+ With the default policies every render is sample-exact with the corresponding C tick function: each waveform
+ names the wrap policy of its C tick as its DefaultWrap.
+
+ The C++ standard headers the C headers rely on are included first, so the C headers can be wrapped in
+ extern "C" without pulling templates into C linkage.
+ */
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+extern "C" {
+#include "wave.h"
+#include "gtable.h"
+#include "breakpoint.h"
+#ifdef DSP_HAVE_KISSFFT
+#include "fftproc.h"
+#endif
+}
+
+namespace dsp {
+
+/**
+ * Samples staged per pass when a render needs an intermediate buffer (envelopes, type conversion).
+ */
+constexpr std::size_t blockSize = 256;
+
+/**
+ * 2 * PI as the C modules compute it.
+ */
+constexpr double twoPi = 2.0 * 3.14159265358979323846;
+
+/**
+ * Wrap policy: leave the phase alone. Matches the C sine tick, whose phase grows without bound.
+ */
+struct WrapNone {
+    static double apply(double phase, double) {
+        return phase;
+    }
+};
+
+/**
+ * Wrap policy: one conditional correction either way, as the C waveform ticks do. Valid while the increment
+ * is smaller than a cycle.
+ */
+struct WrapOnce {
+    static double apply(double phase, double cycle) {
+        if(phase >= cycle) {
+            phase -= cycle;
+        }
+        if(phase < 0.0) {
+            phase += cycle;
+        }
+        return phase;
+    }
+};
+
+/**
+ * Wrap policy: correct until in range, as the C table ticks do. Valid for any increment.
+ */
+struct WrapLoop {
+    static double apply(double phase, double cycle) {
+        while(phase >= cycle) {
+            phase -= cycle;
+        }
+        while(phase < 0.0) {
+            phase += cycle;
+        }
+        return phase;
+    }
+};
+
+/**
+ * Wrap policy: subtract the whole cycles, valid for any increment (below 2^63 cycles). Truncates through an
+ * integer conversion rather than calling floor, so it compiles to straight-line code with no branches or
+ * library calls, and its cost does not depend on the increment. The conversion sits in the phase's
+ * dependency chain, though, so for increments below a cycle (where WrapLoop's branches are almost never
+ * taken) it is several times slower: use it for audio-rate frequency modulation, where the increment can
+ * be anything. Not bit-exact with the C ticks, as a phase that wraps rounds differently.
+ */
+struct WrapFloor {
+    static double apply(double phase, double cycle) {
+        phase -= cycle * static_cast<double>(static_cast<long long>(phase * (1.0 / cycle)));
+        phase += phase < 0.0 ? cycle : 0.0;
+        return phase < cycle ? phase : 0.0;
+    }
+};
+
+/**
+ * Waveform policies for Oscillator. Each step returns the value at the current phase (radians) and advances
+ * it, with the same arithmetic as the C tick of the same name. freqScale is the factor the C tick applies to
+ * the requested frequency before computing its increment, and DefaultWrap the wrap policy the C tick uses.
+ */
+namespace wave {
+
+/**
+ * sinetick
+ */
+struct Sine {
+    static constexpr double freqScale = 1.0;
+    using DefaultWrap = WrapNone;
+    template<class Wrap>
+    static double step(double & phase, double incr, double) {
+        double val;
+        phase = Wrap::apply(phase, twoPi);
+        val = std::sin(phase);
+        phase += incr;
+        return val;
+    }
+};
+
+/**
+ * squaretick (the pulse width is the OSCIL mod field)
+ */
+struct Square {
+    static constexpr double freqScale = 1.0;
+    using DefaultWrap = WrapOnce;
+    template<class Wrap>
+    static double step(double & phase, double incr, double mod) {
+        double val;
+        phase = Wrap::apply(phase, twoPi);
+        val = phase <= twoPi * mod ? 1.0 : -1.0;
+        phase += incr;
+        return val;
+    }
+};
+
+/**
+ * sawdtick
+ */
+struct SawDown {
+    static constexpr double freqScale = 1.0;
+    using DefaultWrap = WrapOnce;
+    template<class Wrap>
+    static double step(double & phase, double incr, double) {
+        double val;
+        phase = Wrap::apply(phase, twoPi);
+        val = 1.0 - 2.0 * (phase * (1.0 / twoPi));
+        phase += incr;
+        return val;
+    }
+};
+
+/**
+ * sawutick
+ */
+struct SawUp {
+    static constexpr double freqScale = 1.0;
+    using DefaultWrap = WrapOnce;
+    template<class Wrap>
+    static double step(double & phase, double incr, double mod) {
+        return -1.0 * SawDown::step<Wrap>(phase, incr, mod);
+    }
+};
+
+/**
+ * tritick: a rectified upward saw at half the frequency, advanced twice per sample
+ */
+struct Triangle {
+    static constexpr double freqScale = 0.5;
+    using DefaultWrap = WrapOnce;
+    template<class Wrap>
+    static double step(double & phase, double incr, double mod) {
+        double val = -1.0 * SawDown::step<Wrap>(phase, incr, mod);
+        if(val < 0.0) {
+            val *= -1;
+        }
+        phase += incr;
+        return 2.0 * (val - 0.5);
+    }
+};
+
+}
+
+/**
+ * A view of an OSCIL with the waveform, output sample type and wrap policy fixed at compile time.
+ *
+ * @tparam Wave - the waveform policy (wave::Sine, wave::Square, wave::SawDown, wave::SawUp, wave::Triangle)
+ * @tparam T - the output sample type
+ * @tparam Wrap - the wrap policy (by default the waveform's DefaultWrap, which matches its C tick)
+ */
+template<class Wave, class T = double, class Wrap = typename Wave::DefaultWrap>
+class Oscillator {
+public:
+    /**
+     * @param osc - the oscillator state, created with oscil or oscil_a
+     */
+    explicit Oscillator(OSCIL & osc) : osc_(osc) {}
+
+    /**
+     * Get the underlying C oscillator.
+     * @return the OSCIL object
+     */
+    OSCIL & state() {
+        return osc_;
+    }
+
+    /**
+     * Produce one sample, as the C tick function does.
+     * @param freq - the instantaneous frequency
+     * @return the sample
+     */
+    T tick(double freq) {
+        setFreq(freq);
+        return static_cast<T>(Wave::template step<Wrap>(osc_.curPhase, osc_.incr, osc_.mod));
+    }
+
+    /**
+     * Render a block at a constant frequency. The phase, increment and pulse width are held in registers for
+     * the whole block.
+     * @param out - the output, n samples
+     * @param n - the number of samples
+     * @param freq - the frequency
+     */
+    void render(T * out, std::size_t n, double freq) {
+        double phase = osc_.curPhase, incr, mod = osc_.mod;
+        std::size_t i;
+
+        setFreq(freq);
+        incr = osc_.incr;
+        for(i = 0; i < n; i++) {
+            out[i] = static_cast<T>(Wave::template step<Wrap>(phase, incr, mod));
+        }
+        osc_.curPhase = phase;
+    }
+
+    /**
+     * Render a block with a frequency per sample.
+     * @param out - the output, n samples
+     * @param freqs - the frequency of each sample
+     * @param n - the number of samples
+     */
+    void render(T * out, const double * freqs, std::size_t n) {
+        double phase = osc_.curPhase, mod = osc_.mod, scaled = osc_.curFreq;
+        std::size_t i;
+
+        for(i = 0; i < n; i++) {
+            /* The C ticks only recompute the increment on a change, which gives the same product */
+            scaled = freqs[i] * Wave::freqScale;
+            out[i] = static_cast<T>(Wave::template step<Wrap>(phase, osc_.twopiovrsr * scaled, mod));
+        }
+        osc_.curPhase = phase;
+        if(n) {
+            osc_.curFreq = scaled;
+            osc_.incr = osc_.twopiovrsr * scaled;
+        }
+    }
+
+private:
+    void setFreq(double freq) {
+        freq *= Wave::freqScale;
+        if(freq != osc_.curFreq) {
+            osc_.incr = osc_.twopiovrsr * freq;
+            osc_.curFreq = freq;
+        }
+    }
+
+    OSCIL & osc_;
+};
+
+/**
+ * A view of a TOSCIL with the interpolation order, output sample type and wrap policy fixed at compile time.
+ *
+ * Order 0 is tabtick (truncated lookup) and order 1 is tabitick (linear interpolation), sample for sample with
+ * the default wrap policy. Order 3 is 4-point cubic Hermite interpolation, which has no C counterpart.
+ *
+ * @tparam Order - the interpolation order (0, 1 or 3)
+ * @tparam T - the output sample type
+ * @tparam Wrap - the wrap policy (WrapLoop matches the C ticks)
+ */
+template<int Order, class T = double, class Wrap = WrapLoop>
+class TableOscillator {
+    static_assert(Order == 0 || Order == 1 || Order == 3, "Interpolation order must be 0, 1 or 3");
+
+public:
+    /**
+     * @param osc - the oscillator state, created with oscil_t or oscil_t_a
+     */
+    explicit TableOscillator(TOSCIL & osc) : osc_(osc) {}
+
+    /**
+     * Get the underlying C oscillator.
+     * @return the TOSCIL object
+     */
+    TOSCIL & state() {
+        return osc_;
+    }
+
+    /**
+     * Look up a table at a phase in table length units (0 <= phase < length).
+     * @param samples - the table samples, with the guard point
+     * @param length - the table length, not including the guard point
+     * @param phase - the phase
+     * @return the interpolated value
+     */
+    static double lookup(const double * samples, unsigned long length, double phase) {
+        unsigned long idx = static_cast<unsigned long>(phase);
+        double frac, val;
+
+        if constexpr(Order == 0) {
+            (void) length;
+            return samples[idx];
+        }
+        else if constexpr(Order == 1) {
+            (void) length;
+            val = samples[idx];
+            frac = phase - static_cast<double>(idx);
+            return val + frac * (samples[idx + 1] - val);
+        }
+        else {
+            /* The guard point covers idx + 1; the outer two points wrap around the table */
+            double ym1 = samples[idx ? idx - 1 : length - 1], y0 = samples[idx], y1 = samples[idx + 1];
+            double y2 = samples[idx + 2 <= length ? idx + 2 : idx + 2 - length];
+            double c1 = 0.5 * (y1 - ym1), c2 = ym1 - 2.5 * y0 + 2.0 * y1 - 0.5 * y2;
+            double c3 = 0.5 * (y2 - ym1) + 1.5 * (y0 - y1);
+            frac = phase - static_cast<double>(idx);
+            return ((c3 * frac + c2) * frac + c1) * frac + y0;
+        }
+    }
+
+    /**
+     * Produce one sample, as the C tick function does.
+     * @param freq - the instantaneous frequency
+     * @return the sample
+     */
+    T tick(double freq) {
+        double val;
+        if(osc_.osc.curFreq != freq) {
+            osc_.osc.curFreq = freq;
+            osc_.osc.incr = osc_.sizeovrsr * freq;
+        }
+        val = lookup(osc_.table->samples, osc_.table->length, osc_.osc.curPhase);
+        osc_.osc.curPhase = Wrap::apply(osc_.osc.curPhase + osc_.osc.incr, osc_.tablen);
+        return static_cast<T>(val);
+    }
+
+    /**
+     * Render a block at a constant frequency.
+     * @param out - the output, n samples
+     * @param n - the number of samples
+     * @param freq - the frequency
+     */
+    void render(T * out, std::size_t n, double freq) {
+        const double * samples = osc_.table->samples;
+        const unsigned long length = osc_.table->length;
+        const double tablen = osc_.tablen;
+        double phase = osc_.osc.curPhase, incr;
+        std::size_t i;
+
+        if(osc_.osc.curFreq != freq) {
+            osc_.osc.curFreq = freq;
+            osc_.osc.incr = osc_.sizeovrsr * freq;
+        }
+        incr = osc_.osc.incr;
+        for(i = 0; i < n; i++) {
+            out[i] = static_cast<T>(lookup(samples, length, phase));
+            phase = Wrap::apply(phase + incr, tablen);
+        }
+        osc_.osc.curPhase = phase;
+    }
+
+    /**
+     * Render a block with a frequency per sample.
+     * @param out - the output, n samples
+     * @param freqs - the frequency of each sample
+     * @param n - the number of samples
+     */
+    void render(T * out, const double * freqs, std::size_t n) {
+        const double * samples = osc_.table->samples;
+        const unsigned long length = osc_.table->length;
+        const double tablen = osc_.tablen, sizeovrsr = osc_.sizeovrsr;
+        double phase = osc_.osc.curPhase;
+        std::size_t i;
+
+        for(i = 0; i < n; i++) {
+            out[i] = static_cast<T>(lookup(samples, length, phase));
+            phase = Wrap::apply(phase + sizeovrsr * freqs[i], tablen);
+        }
+        osc_.osc.curPhase = phase;
+        if(n) {
+            osc_.osc.curFreq = freqs[n - 1];
+            osc_.osc.incr = sizeovrsr * freqs[n - 1];
+        }
+    }
+
+private:
+    TOSCIL & osc_;
+};
+
+/**
+ * A view of a BRKSTREAM producing samples of a given type.
+ *
+ * @tparam T - the output sample type
+ */
+template<class T = double>
+class Envelope {
+public:
+    /**
+     * @param stream - the breakpoint stream, created with bps_init, bps_new_a or bps_acquire
+     */
+    explicit Envelope(BRKSTREAM & stream) : stream_(stream) {}
+
+    /**
+     * Get the underlying C stream.
+     * @return the BRKSTREAM object
+     */
+    BRKSTREAM & state() {
+        return stream_;
+    }
+
+    /**
+     * Produce one value (bps_tick).
+     * @return the value
+     */
+    T tick() {
+        return static_cast<T>(bps_tick(&stream_));
+    }
+
+    /**
+     * Render a block of values (bps_render), converting through a staging block for types other than double.
+     * @param out - the output, n values
+     * @param n - the number of values
+     */
+    void render(T * out, std::size_t n) {
+        if constexpr(std::is_same_v<T, double>) {
+            bps_render(&stream_, out, n);
+        }
+        else {
+            double staged[blockSize];
+            std::size_t m, i;
+            while(n) {
+                m = n < blockSize ? n : blockSize;
+                bps_render(&stream_, staged, m);
+                for(i = 0; i < m; i++) {
+                    out[i] = static_cast<T>(staged[i]);
+                }
+                out += m;
+                n -= m;
+            }
+        }
+    }
+
+    /**
+     * Reposition the stream (bps_seeksample).
+     * @param sampleidx - the sample index of the next value
+     */
+    void seek(unsigned long sampleidx) {
+        bps_seeksample(&stream_, sampleidx);
+    }
+
+    /**
+     * Advance the stream, returning the sum of the skipped values (bps_sum).
+     * @param n - the number of values
+     * @return the sum
+     */
+    double sum(unsigned long n) {
+        return bps_sum(&stream_, n);
+    }
+
+private:
+    BRKSTREAM & stream_;
+};
+
+/**
+ * Render a table oscillator whose frequency follows an envelope. The envelope is rendered a block at a time
+ * and the oscillator runs over the block with its lookup inlined: what a loop of bps_tick and a TABFUNC call
+ * per sample does, without either call.
+ * @param osc - the oscillator
+ * @param freq - the frequency envelope
+ * @param out - the output, n samples
+ * @param n - the number of samples
+ */
+template<int Order, class T, class Wrap>
+void renderModulated(TableOscillator<Order, T, Wrap> & osc, Envelope<double> & freq, T * out, std::size_t n) {
+    double freqs[blockSize];
+    std::size_t m;
+
+    while(n) {
+        m = n < blockSize ? n : blockSize;
+        freq.render(freqs, m);
+        osc.render(out, freqs, m);
+        out += m;
+        n -= m;
+    }
+}
+
+#ifdef DSP_HAVE_KISSFFT
+/**
+ * A view of a UPOLS convolution network processing samples of a given type.
+ *
+ * fft_convolve works on double blocks, so other sample types are converted through staging buffers
+ * allocated when the view is created.
+ *
+ * @tparam T - the sample type
+ */
+template<class T = double>
+class Convolver {
+public:
+    /**
+     * @param network - the network, created with new_UPOLS or new_UPOLS_a
+     */
+    explicit Convolver(UPOLS & network) : network_(network), block_(network.NFFT / 2) {
+        if constexpr(!std::is_same_v<T, double>) {
+            input_.resize(block_);
+            output_.resize(block_);
+        }
+    }
+
+    /**
+     * Get the underlying C network.
+     * @return the UPOLS object
+     */
+    UPOLS & state() {
+        return network_;
+    }
+
+    /**
+     * Get the number of samples per block.
+     * @return the block size (NFFT / 2)
+     */
+    std::size_t blocksize() const {
+        return block_;
+    }
+
+    /**
+     * Filter one block (fft_convolve).
+     * @param input - the input block
+     * @param output - the output block
+     * @param errMsg - pointer to a string which is set to an error description on failure
+     * @return whether the block was processed
+     */
+    bool process(const T * input, T * output, char ** errMsg) {
+        std::size_t i;
+
+        if constexpr(std::is_same_v<T, double>) {
+            /* fft_convolve only reads its input */
+            return fft_convolve(const_cast<double *>(input), output, &network_, block_, errMsg) != 0;
+        }
+        else {
+            for(i = 0; i < block_; i++) {
+                input_[i] = static_cast<double>(input[i]);
+            }
+            if(!fft_convolve(input_.data(), output_.data(), &network_, block_, errMsg)) {
+                return false;
+            }
+            for(i = 0; i < block_; i++) {
+                output[i] = static_cast<T>(output_[i]);
+            }
+            return true;
+        }
+    }
+
+private:
+    UPOLS & network_;
+    std::size_t block_;
+    std::vector<double> input_;
+    std::vector<double> output_;
+};
+#endif
+
+}
+
+#endif
@@ -1,8 +1,28 @@
 #include "fftproc.h"
+#include "instrument.h"
+#include "parallel.h"
 #include <kiss_fft.h>
 #include <stdlib.h>
 #include <string.h>
 
+/**
+ * Number of frames a stft_batch worker claims at a time.
+ */
+#define STFT_BATCHCHUNK 16
+
+/**
+ * Shared state for the stft_batch workers.
+ */
+typedef struct stftjob {
+    const STFTPLAN * plan;
+    const double * signal;
+    int output;
+    double * frames;
+    unsigned long nframes;
+    unsigned long next;
+    unsigned long done;
+} STFTJOB;
+
 /*
  Three steps:
  
@@ -40,15 +60,51 @@
  
  */
 
-static int allocateFFTBuffer(kiss_fft_cpx ** buffer, unsigned long size);
+static int allocateFFTBuffer(kiss_fft_cpx ** buffer, unsigned long size, const DSPALLOC * alloc);
 static int resetFFTBuffer(kiss_fft_cpx ** buffer, unsigned long size);
-static int init_UPOLS(UPOLS * process, unsigned long size, unsigned long blocksize, char **errMsg);
+static int init_UPOLS(UPOLS * process, unsigned long size, unsigned long blocksize, const DSPALLOC * alloc, char **errMsg);
+static kiss_fft_cfg allocateFFTConfig(unsigned long nfft, int inverse, const DSPALLOC * alloc);
 static kiss_fft_cpx complexMultiply(kiss_fft_cpx a, kiss_fft_cpx b);
 
+/**
+ * Evaluate a periodic analysis window.
+ * @param window - the window type
+ * @param n - the sample index
+ * @param nfft - the window length
+ * @return the window value
+ */
+static double windowValue(int window, unsigned long n, unsigned long nfft);
+
+/**
+ * Window, transform and write out one frame.
+ * @param plan - pointer to an STFTPLAN object
+ * @param cfg - a real FFT configuration for plan->nfft used by this thread only
+ * @param samples - nfft input samples
+ * @param frame - nfft work samples
+ * @param spectrum - nbins work bins
+ * @param output - the output type
+ * @param out - the output frame
+ */
+static void analyseFrame(const STFTPLAN * plan, kiss_fftr_cfg cfg, const double * samples, kiss_fft_scalar * frame,
+                         kiss_fft_cpx * spectrum, int output, double * out);
+
+/**
+ * Create a real FFT configuration in an allocator's memory.
+ * @param nfft - the FFT length
+ * @param alloc - the allocator, or NULL for the heap
+ * @return the configuration, or NULL if unsuccessful
+ */
+static kiss_fftr_cfg allocateRealFFTConfig(unsigned long nfft, const DSPALLOC * alloc);
+
+/**
+ * Analyse chunks of frames until none are left.
+ * @param arg - pointer to the STFTJOB
+ */
+static void stftWorker(void * arg);
+
 
 int fft_convolve(double * input, double * output, UPOLS * network, unsigned long blocksize, char ** errMsg) {
     unsigned long idx;
-    kiss_fft_cfg cfg;
     if(ceil(log2(blocksize)) != floor(log2(blocksize))) {
         *errMsg = "Blocksize must be of power 2";
         return 0;
@@ -57,6 +113,7 @@ int fft_convolve(double * input, double * output, UPOLS * network, unsigned long
         *errMsg = "Blocksize must be half of the UPOLS NFFT";
         return 0;
     }
+    DSP_PROBE_BEGIN(start);
     /* Shift previous input samples to the LHS */
     memcpy(network->input, network->input + blocksize, blocksize * sizeof(kiss_fft_cpx));
     
@@ -67,9 +124,7 @@ int fft_convolve(double * input, double * output, UPOLS * network, unsigned long
     }
     
     /* Take FFT of input block, insert into FDL at the correct index */
-    cfg = kiss_fft_alloc(network->NFFT, 0, 0, 0);
-    kiss_fft(cfg, network->input, network->fdelayline[network->idx_FDL]);
-    kiss_fft_free(cfg);
+    kiss_fft(network->forward, network->input, network->fdelayline[network->idx_FDL]);
     
     /* Complex multiply FDL with sub filters, push results into accumulator */
     for (idx = 0; idx < network->nSubs; idx++) {
@@ -87,9 +142,7 @@ int fft_convolve(double * input, double * output, UPOLS * network, unsigned long
     }
     
     /* Take IFFT of accumulator, populate output buffer */
-    cfg = kiss_fft_alloc(network->NFFT, 1, 0, 0);
-    kiss_fft(cfg, network->accum, network->output);
-    kiss_fft_free(cfg);
+    kiss_fft(network->inverse, network->accum, network->output);
 
     /* Populate output block with RHS of output buffer */
     for(idx = 0; idx < blocksize; idx++) {
@@ -105,140 +158,146 @@ int fft_convolve(double * input, double * output, UPOLS * network, unsigned long
     }
     network->idx_FDL = (network->idx_FDL - 1) % network->nSubs;
 
+    DSP_PROBE_END(DSP_PROBE_CONVOLVE, start, blocksize);
     return 1;
 }
 
 UPOLS * new_UPOLS(double * buffer, unsigned long size, unsigned long blocksize, char ** errMsg) {
+    return new_UPOLS_a(buffer, size, blocksize, NULL, errMsg);
+}
+
+UPOLS * new_UPOLS_a(double * buffer, unsigned long size, unsigned long blocksize, const DSPALLOC * alloc, char ** errMsg) {
     unsigned int i;
-    kiss_fft_cfg cfg;
     unsigned long remainder = size % blocksize;
     UPOLS * process;
 
-    /* Allocate memory for UPOLS network */
-    process = (UPOLS *) malloc(sizeof(UPOLS));
+    /* Allocate memory for UPOLS network (zeroed, so a partial initialisation can be cleared) */
+    process = (UPOLS *) dsp_calloc(alloc, 1, sizeof(UPOLS));
     if(!process) {
         *errMsg = "Could not allocate memory for UPOLS structure.";
         return NULL;
     }
     
-    /* Initialise all UPOLS buffers to zero */
-    if(!init_UPOLS(process, size, blocksize, errMsg)) {
-        *errMsg = "Could not initialise UPOLS";
+    /* Initialise all UPOLS buffers to zero and create the FFT configurations */
+    if(!init_UPOLS(process, size, blocksize, alloc, errMsg)) {
+        clear_UPOLS_a(&process, alloc);
         return NULL;
     }
 
-    /* Create forward FFT configuration */
-    cfg = kiss_fft_alloc(process->NFFT, 0, 0, 0);
-
     /* Dissect the FIR filter */
     for(i = 0; i < process->nSubs; i++) {
         unsigned int j;
         if(remainder && i == process->nSubs - 1) {
             blocksize = remainder;
         }
-        /* Populate temporary input buffer for FFT, normalise by scaling factor */
+        /* Populate temporary input buffer for FFT. The 1/NFFT scaling of the unnormalised inverse FFT is
+         applied once, to the input blocks in fft_convolve, so the filter is left unscaled */
         for(j = 0; j < blocksize; j++) {
-            process->input[j].r = buffer[i * process->NFFT/2 + j] / process->normalisation;
+            process->input[j].r = buffer[i * process->NFFT/2 + j];
             process->input[j].i = 0;
         }
 
         /* Compute FFT of padded filter blocks */
-        kiss_fft(cfg, process->input, process->subfilters[i]);
+        kiss_fft(process->forward, process->input, process->subfilters[i]);
 
         /* Reset the temporary input buffer */
-        if(!resetFFTBuffer(&process->input, process->NFFT)) {
-            /* Clear current buffer */
-            clear_UPOLS(&process);
-            *errMsg = "Could not reset temporary input buffer";
-            return NULL;
-        }
+        resetFFTBuffer(&process->input, process->NFFT);
     }
 
-    /* Free the configuration */
-    kiss_fft_free(cfg);
-
     return process;
 }
 
-int init_UPOLS(UPOLS * process, unsigned long size, unsigned long blocksize, char **errMsg) {
+int init_UPOLS(UPOLS * process, unsigned long size, unsigned long blocksize, const DSPALLOC * alloc, char **errMsg) {
     unsigned long i;
     process->nSubs = (size/blocksize) + ((size % blocksize) ? 1 : 0);
     process->idx_FDL = 0;
     process->NFFT = 2 * blocksize;
     process->normalisation = (double) process->NFFT;
 
-    /* Allocate accumulator HEAP memory */
-    if(!allocateFFTBuffer(&process->accum, process->NFFT)) {
+    /* FFT configurations are created once here, so fft_convolve never allocates */
+    process->forward = allocateFFTConfig(process->NFFT, 0, alloc);
+    process->inverse = allocateFFTConfig(process->NFFT, 1, alloc);
+    if(!process->forward || !process->inverse) {
+        *errMsg = "Could not allocate FFT configurations";
+        return 0;
+    }
+    /* Allocate accumulator memory */
+    if(!allocateFFTBuffer(&process->accum, process->NFFT, alloc)) {
         *errMsg = "Could not allocate storage for accumulator";
         return 0;
     }
-    /* Allocate IO buffer HEAP memory */
-    if(!allocateFFTBuffer(&process->input, process->NFFT) ||
-       !allocateFFTBuffer(&process->output, process->NFFT)) {
-        clear_UPOLS(&process);
+    /* Allocate IO buffer memory */
+    if(!allocateFFTBuffer(&process->input, process->NFFT, alloc) ||
+       !allocateFFTBuffer(&process->output, process->NFFT, alloc)) {
         *errMsg = "Could not allocate IO buffers";
         return 0;
     }
     /* Allocate frequency delay line buffer */
-    process->fdelayline = (kiss_fft_cpx **) malloc(sizeof(kiss_fft_cpx *) * process->nSubs);
+    process->fdelayline = (kiss_fft_cpx **) dsp_calloc(alloc, process->nSubs, sizeof(kiss_fft_cpx *));
     if(!process->fdelayline) {
-        clear_UPOLS(&process);
         *errMsg = "Could not allocate storage for delay line array";
         return 0;
     }
-    /* Allocate subfilter bank HEAP memory */
-    process->subfilters = (kiss_fft_cpx **) malloc(sizeof(kiss_fft_cpx *) * process->nSubs);
+    /* Allocate subfilter bank memory */
+    process->subfilters = (kiss_fft_cpx **) dsp_calloc(alloc, process->nSubs, sizeof(kiss_fft_cpx *));
     if(!process->subfilters) {
-        clear_UPOLS(&process);
         *errMsg = "Could not allocate storage for sub filter array";
         return 0;
     }
     for(i = 0; i < process->nSubs; i++) {
         /* allocate buffers */
-        if(!allocateFFTBuffer(&process->fdelayline[i], process->NFFT) ||
-           !allocateFFTBuffer(&process->subfilters[i], process->NFFT)) {
-            clear_UPOLS(&process);
+        if(!allocateFFTBuffer(&process->fdelayline[i], process->NFFT, alloc) ||
+           !allocateFFTBuffer(&process->subfilters[i], process->NFFT, alloc)) {
             *errMsg = "Could not allocate storage for FFT arrays";
             return 0;
-            break;
         }
     }
     return 1;
 }
 
 void clear_UPOLS(UPOLS ** process) {
-    int i;
-    if((*process)->accum) {
-        free((*process)->accum);
-    }
-    if((*process)->input) {
-        free((*process)->input);
-    }
-    if((*process)->output) {
-        free((*process)->output);
+    clear_UPOLS_a(process, NULL);
+}
+
+void clear_UPOLS_a(UPOLS ** process, const DSPALLOC * alloc) {
+    unsigned long i;
+    if(!process || !*process) {
+        return;
     }
+    dsp_free(alloc, (*process)->accum);
+    dsp_free(alloc, (*process)->input);
+    dsp_free(alloc, (*process)->output);
     if((*process)->fdelayline) {
         for(i = 0; i < (*process)->nSubs; i++) {
-            if((*process)->fdelayline[i]) {
-                free((*process)->fdelayline[i]);
-            }
+            dsp_free(alloc, (*process)->fdelayline[i]);
         }
-        free((*process)->fdelayline);
+        dsp_free(alloc, (*process)->fdelayline);
     }
     if((*process)->subfilters) {
         for(i = 0; i < (*process)->nSubs; i++) {
-            if((*process)->subfilters[i]) {
-                free((*process)->subfilters[i]);
-            }
+            dsp_free(alloc, (*process)->subfilters[i]);
         }
-        free((*process)->subfilters);
+        dsp_free(alloc, (*process)->subfilters);
     }
-    free(*process);
-    process = NULL;
+    dsp_free(alloc, (*process)->forward);
+    dsp_free(alloc, (*process)->inverse);
+    dsp_free(alloc, *process);
+    *process = NULL;
 }
 
-static int allocateFFTBuffer(kiss_fft_cpx ** buffer, unsigned long size) {
-    *buffer = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * size);
+static kiss_fft_cfg allocateFFTConfig(unsigned long nfft, int inverse, const DSPALLOC * alloc) {
+    size_t len = 0;
+    void * mem;
+    /* Query the configuration size, then let kiss_fft build it in the allocator's memory */
+    kiss_fft_alloc((int) nfft, inverse, NULL, &len);
+    if(!len || !(mem = dsp_alloc(alloc, len))) {
+        return NULL;
+    }
+    return kiss_fft_alloc((int) nfft, inverse, mem, &len);
+}
+
+static int allocateFFTBuffer(kiss_fft_cpx ** buffer, unsigned long size, const DSPALLOC * alloc) {
+    *buffer = (kiss_fft_cpx *) dsp_alloc(alloc, sizeof(kiss_fft_cpx) * size);
     if(!(*buffer)) {
         *buffer = NULL;
         return 0;
@@ -264,3 +323,326 @@ static kiss_fft_cpx complexMultiply(kiss_fft_cpx x, kiss_fft_cpx y) {
     res.i = (x.r * y.i) + (x.i * y.r);
     return res;
 }
+
+int convolver_usefir(unsigned long size, unsigned long blocksize) {
+    const char * kernel = fir_kernelname();
+    unsigned long maxtaps = FFTPROC_FIR_MAXTAPS_SCALAR;
+    if(!blocksize || (blocksize & (blocksize - 1))) {
+        return 1;
+    }
+    if(!strcmp(kernel, "avx512")) {
+        maxtaps = FFTPROC_FIR_MAXTAPS_AVX512;
+    }
+    else if(!strcmp(kernel, "avx2")) {
+        maxtaps = FFTPROC_FIR_MAXTAPS_AVX2;
+    }
+    return size <= maxtaps;
+}
+
+CONVOLVER * new_CONVOLVER(double * buffer, unsigned long size, unsigned long blocksize, int engine, char ** errMsg) {
+    return new_CONVOLVER_a(buffer, size, blocksize, engine, NULL, errMsg);
+}
+
+CONVOLVER * new_CONVOLVER_a(double * buffer, unsigned long size, unsigned long blocksize, int engine,
+                            const DSPALLOC * alloc, char ** errMsg) {
+    CONVOLVER * conv;
+
+    if(!buffer || !size || !blocksize) {
+        *errMsg = "Convolver needs a filter and a blocksize";
+        return NULL;
+    }
+    if(engine == CONV_AUTO) {
+        engine = convolver_usefir(size, blocksize) ? CONV_FIR : CONV_UPOLS;
+    }
+    if(!(conv = (CONVOLVER *) dsp_calloc(alloc, 1, sizeof(CONVOLVER)))) {
+        *errMsg = "Could not allocate memory for convolver";
+        return NULL;
+    }
+    conv->engine = engine;
+    conv->blocksize = blocksize;
+    if(engine == CONV_FIR) {
+        if(!(conv->fir = new_FIR_a(buffer, size, blocksize, alloc))) {
+            *errMsg = "Could not allocate FIR filter";
+            clear_CONVOLVER_a(&conv, alloc);
+        }
+        return conv;
+    }
+    if(blocksize & (blocksize - 1)) {
+        *errMsg = "Blocksize must be of power 2";
+        clear_CONVOLVER_a(&conv, alloc);
+        return NULL;
+    }
+    if(!(conv->input = (double *) dsp_alloc(alloc, blocksize * sizeof(double))) ||
+       !(conv->upols = new_UPOLS_a(buffer, size, blocksize, alloc, errMsg))) {
+        if(!conv->input) {
+            *errMsg = "Could not allocate convolver input buffer";
+        }
+        clear_CONVOLVER_a(&conv, alloc);
+    }
+    return conv;
+}
+
+int convolver_process(CONVOLVER * conv, const double * input, double * output, char ** errMsg) {
+    if(conv->engine == CONV_FIR) {
+        fir_process(conv->fir, input, output, conv->blocksize);
+        return 1;
+    }
+    memcpy(conv->input, input, conv->blocksize * sizeof(double));
+    return fft_convolve(conv->input, output, conv->upols, conv->blocksize, errMsg);
+}
+
+void clear_CONVOLVER(CONVOLVER ** conv) {
+    clear_CONVOLVER_a(conv, NULL);
+}
+
+void clear_CONVOLVER_a(CONVOLVER ** conv, const DSPALLOC * alloc) {
+    if(conv && *conv) {
+        clear_FIR_a(&(*conv)->fir, alloc);
+        clear_UPOLS_a(&(*conv)->upols, alloc);
+        dsp_free(alloc, (*conv)->input);
+        dsp_free(alloc, *conv);
+        *conv = NULL;
+    }
+}
+
+static double windowValue(int window, unsigned long n, unsigned long nfft) {
+    double x = 2.0 * M_PI * (double) n / (double) nfft;
+    switch(window) {
+        case STFT_HANN:
+            return 0.5 - 0.5 * cos(x);
+        case STFT_HAMMING:
+            return 0.54 - 0.46 * cos(x);
+        case STFT_BLACKMAN:
+            return 0.42 - 0.5 * cos(x) + 0.08 * cos(2.0 * x);
+        case STFT_BLACKMANHARRIS:
+            return 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2.0 * x) - 0.01168 * cos(3.0 * x);
+        default:
+            return 1.0;
+    }
+}
+
+static void analyseFrame(const STFTPLAN * plan, kiss_fftr_cfg cfg, const double * samples, kiss_fft_scalar * frame,
+                         kiss_fft_cpx * spectrum, int output, double * out) {
+    unsigned long k;
+    double re, im;
+
+    for(k = 0; k < plan->nfft; k++) {
+        frame[k] = (kiss_fft_scalar) (samples[k] * plan->windowfn[k]);
+    }
+    kiss_fftr(cfg, frame, spectrum);
+    for(k = 0; k < plan->nbins; k++) {
+        re = spectrum[k].r;
+        im = spectrum[k].i;
+        if(output == STFT_COMPLEX) {
+            out[2 * k] = re;
+            out[2 * k + 1] = im;
+        }
+        else if(output == STFT_POWER) {
+            out[k] = re * re + im * im;
+        }
+        else {
+            out[k] = sqrt(re * re + im * im);
+        }
+    }
+}
+
+static kiss_fftr_cfg allocateRealFFTConfig(unsigned long nfft, const DSPALLOC * alloc) {
+    size_t len = 0;
+    void * mem;
+    kiss_fftr_alloc((int) nfft, 0, NULL, &len);
+    if(!len || !(mem = dsp_alloc(alloc, len))) {
+        return NULL;
+    }
+    return kiss_fftr_alloc((int) nfft, 0, mem, &len);
+}
+
+STFTPLAN * new_STFTPLAN(unsigned long nfft, unsigned long hop, int window, char ** errMsg) {
+    return new_STFTPLAN_a(nfft, hop, window, NULL, errMsg);
+}
+
+STFTPLAN * new_STFTPLAN_a(unsigned long nfft, unsigned long hop, int window, const DSPALLOC * alloc, char ** errMsg) {
+    STFTPLAN * plan;
+    unsigned long n;
+
+    if(nfft < 2 || (nfft & 1)) {
+        *errMsg = "STFT length must be even";
+        return NULL;
+    }
+    if(!hop || hop > nfft) {
+        *errMsg = "STFT hop must be between 1 and the STFT length";
+        return NULL;
+    }
+    if(window < STFT_RECT || window > STFT_BLACKMANHARRIS) {
+        *errMsg = "Unknown STFT window";
+        return NULL;
+    }
+    if(!(plan = (STFTPLAN *) dsp_calloc(alloc, 1, sizeof(STFTPLAN))) ||
+       !(plan->windowfn = (double *) dsp_alloc(alloc, nfft * sizeof(double)))) {
+        dsp_free(alloc, plan);
+        *errMsg = "Could not allocate memory for STFT plan";
+        return NULL;
+    }
+    plan->nfft = nfft;
+    plan->hop = hop;
+    plan->nbins = nfft / 2 + 1;
+    plan->window = window;
+    for(n = 0; n < nfft; n++) {
+        plan->windowfn[n] = windowValue(window, n, nfft);
+        plan->wsum += plan->windowfn[n];
+        plan->wsumsq += plan->windowfn[n] * plan->windowfn[n];
+    }
+    return plan;
+}
+
+unsigned long stft_framesize(const STFTPLAN * plan, int output) {
+    return output == STFT_COMPLEX ? 2 * plan->nbins : plan->nbins;
+}
+
+unsigned long stft_batchframes(const STFTPLAN * plan, unsigned long length) {
+    return length < plan->nfft ? 0 : (length - plan->nfft) / plan->hop + 1;
+}
+
+static void stftWorker(void * arg) {
+    STFTJOB * job = (STFTJOB *) arg;
+    const STFTPLAN * plan = job->plan;
+    kiss_fftr_cfg cfg = kiss_fftr_alloc((int) plan->nfft, 0, NULL, NULL);
+    kiss_fft_scalar * frame = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * plan->nfft);
+    kiss_fft_cpx * spectrum = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * plan->nbins);
+    unsigned long first, last, k, framesize = stft_framesize(plan, job->output);
+
+    /* A thread that cannot allocate claims nothing, leaving its frames to the threads that could */
+    if(cfg && frame && spectrum) {
+        while((first = __atomic_fetch_add(&job->next, STFT_BATCHCHUNK, __ATOMIC_RELAXED)) < job->nframes) {
+            last = first + STFT_BATCHCHUNK < job->nframes ? first + STFT_BATCHCHUNK : job->nframes;
+            for(k = first; k < last; k++) {
+                analyseFrame(plan, cfg, job->signal + k * plan->hop, frame, spectrum, job->output,
+                             job->frames + k * framesize);
+            }
+            __atomic_fetch_add(&job->done, last - first, __ATOMIC_RELAXED);
+        }
+    }
+    kiss_fftr_free(cfg);
+    free(frame);
+    free(spectrum);
+}
+
+long stft_batch(const STFTPLAN * plan, const double * signal, unsigned long length, int output, double * frames,
+                unsigned int nthreads, char ** errMsg) {
+    STFTJOB job;
+
+    if(output < STFT_MAGNITUDE || output > STFT_COMPLEX) {
+        *errMsg = "Unknown STFT output";
+        return -1;
+    }
+    memset(&job, 0, sizeof(STFTJOB));
+    job.plan = plan;
+    job.signal = signal;
+    job.output = output;
+    job.frames = frames;
+    job.nframes = stft_batchframes(plan, length);
+    if(!job.nframes) {
+        return 0;
+    }
+
+    /* Workers claim STFT_BATCHCHUNK frames at a time */
+    dsp_parallel_for(stftWorker, &job, (job.nframes + STFT_BATCHCHUNK - 1) / STFT_BATCHCHUNK, nthreads);
+
+    if(job.done < job.nframes) {
+        *errMsg = "Could not allocate STFT work buffers";
+        return -1;
+    }
+    return (long) job.nframes;
+}
+
+void clear_STFTPLAN(STFTPLAN ** plan) {
+    clear_STFTPLAN_a(plan, NULL);
+}
+
+void clear_STFTPLAN_a(STFTPLAN ** plan, const DSPALLOC * alloc) {
+    if(plan && *plan) {
+        dsp_free(alloc, (*plan)->windowfn);
+        dsp_free(alloc, *plan);
+        *plan = NULL;
+    }
+}
+
+STFT * new_STFT(const STFTPLAN * plan, int output, char ** errMsg) {
+    return new_STFT_a(plan, output, NULL, errMsg);
+}
+
+STFT * new_STFT_a(const STFTPLAN * plan, int output, const DSPALLOC * alloc, char ** errMsg) {
+    STFT * stft;
+
+    if(!plan) {
+        *errMsg = "STFT needs a plan";
+        return NULL;
+    }
+    if(output < STFT_MAGNITUDE || output > STFT_COMPLEX) {
+        *errMsg = "Unknown STFT output";
+        return NULL;
+    }
+    if(!(stft = (STFT *) dsp_calloc(alloc, 1, sizeof(STFT)))) {
+        *errMsg = "Could not allocate memory for STFT";
+        return NULL;
+    }
+    stft->plan = plan;
+    stft->output = output;
+    stft->cfg = allocateRealFFTConfig(plan->nfft, alloc);
+    stft->history = (double *) dsp_calloc(alloc, plan->nfft, sizeof(double));
+    stft->frame = (kiss_fft_scalar *) dsp_alloc(alloc, plan->nfft * sizeof(kiss_fft_scalar));
+    stft->spectrum = (kiss_fft_cpx *) dsp_alloc(alloc, plan->nbins * sizeof(kiss_fft_cpx));
+    if(!stft->cfg || !stft->history || !stft->frame || !stft->spectrum) {
+        *errMsg = "Could not allocate STFT buffers";
+        clear_STFT_a(&stft, alloc);
+    }
+    return stft;
+}
+
+unsigned long stft_pending(const STFT * stft, unsigned long n) {
+    unsigned long need = stft->plan->nfft - stft->fill;
+    return n < need ? 0 : (n - need) / stft->plan->hop + 1;
+}
+
+unsigned long stft_push(STFT * stft, const double * input, unsigned long n, double * frames) {
+    const STFTPLAN * plan = stft->plan;
+    unsigned long m, written = 0, framesize = stft_framesize(plan, stft->output);
+
+    while(n) {
+        m = plan->nfft - stft->fill;
+        if(m > n) {
+            m = n;
+        }
+        memcpy(stft->history + stft->fill, input, m * sizeof(double));
+        stft->fill += m;
+        input += m;
+        n -= m;
+        if(stft->fill == plan->nfft) {
+            analyseFrame(plan, stft->cfg, stft->history, stft->frame, stft->spectrum, stft->output,
+                         frames + written * framesize);
+            written++;
+            /* Keep the overlap with the next frame */
+            stft->fill = plan->nfft - plan->hop;
+            memmove(stft->history, stft->history + plan->hop, stft->fill * sizeof(double));
+        }
+    }
+    return written;
+}
+
+void stft_reset(STFT * stft) {
+    stft->fill = 0;
+}
+
+void clear_STFT(STFT ** stft) {
+    clear_STFT_a(stft, NULL);
+}
+
+void clear_STFT_a(STFT ** stft, const DSPALLOC * alloc) {
+    if(stft && *stft) {
+        dsp_free(alloc, (*stft)->cfg);
+        dsp_free(alloc, (*stft)->history);
+        dsp_free(alloc, (*stft)->frame);
+        dsp_free(alloc, (*stft)->spectrum);
+        dsp_free(alloc, *stft);
+        *stft = NULL;
+    }
+}
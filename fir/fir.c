@@ -0,0 +1,243 @@
+#include "fir.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(FIR_NO_SIMD)
+#define FIR_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Samples filtered per kernel call when no maximum block size is given.
+ */
+#define FIR_DEFAULTBLOCK 256
+
+/**
+ * Portable kernel: four outputs per pass so the accumulators are independent.
+ */
+static void firScalar(const double * taps, unsigned long ntaps, const double * history, double * out,
+                      unsigned long n);
+
+#ifdef FIR_X86
+/**
+ * AVX2/FMA kernel: sixteen outputs per pass in four 4-wide accumulators, then four at a time, then masked.
+ */
+static void firAVX2(const double * taps, unsigned long ntaps, const double * history, double * out,
+                    unsigned long n);
+
+/**
+ * AVX-512F kernel: thirty-two outputs per pass in four 8-wide accumulators, then eight at a time, then masked.
+ */
+static void firAVX512(const double * taps, unsigned long ntaps, const double * history, double * out,
+                      unsigned long n);
+#endif
+
+/**
+ * Pick the fastest kernel the CPU supports.
+ * @param name - pointer populated with the kernel name
+ * @return the kernel
+ */
+static FIRKERNEL selectKernel(const char ** name);
+
+static void firScalar(const double * taps, unsigned long ntaps, const double * history, double * out,
+                      unsigned long n) {
+    unsigned long i = 0, k;
+    double a0, a1, a2, a3, t;
+    const double * h;
+
+    for(; i + 4 <= n; i += 4) {
+        h = history + i;
+        a0 = a1 = a2 = a3 = 0.0;
+        for(k = 0; k < ntaps; k++) {
+            t = taps[k];
+            a0 += t * h[k];
+            a1 += t * h[k + 1];
+            a2 += t * h[k + 2];
+            a3 += t * h[k + 3];
+        }
+        out[i] = a0;
+        out[i + 1] = a1;
+        out[i + 2] = a2;
+        out[i + 3] = a3;
+    }
+    for(; i < n; i++) {
+        h = history + i;
+        a0 = 0.0;
+        for(k = 0; k < ntaps; k++) {
+            a0 += taps[k] * h[k];
+        }
+        out[i] = a0;
+    }
+}
+
+#ifdef FIR_X86
+__attribute__((target("avx2,fma")))
+static void firAVX2(const double * taps, unsigned long ntaps, const double * history, double * out,
+                    unsigned long n) {
+    unsigned long i = 0, k;
+    const double * h;
+
+    for(; i + 16 <= n; i += 16) {
+        __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+        __m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+        h = history + i;
+        for(k = 0; k < ntaps; k++) {
+            __m256d t = _mm256_broadcast_sd(taps + k);
+            a0 = _mm256_fmadd_pd(t, _mm256_loadu_pd(h + k), a0);
+            a1 = _mm256_fmadd_pd(t, _mm256_loadu_pd(h + k + 4), a1);
+            a2 = _mm256_fmadd_pd(t, _mm256_loadu_pd(h + k + 8), a2);
+            a3 = _mm256_fmadd_pd(t, _mm256_loadu_pd(h + k + 12), a3);
+        }
+        _mm256_storeu_pd(out + i, a0);
+        _mm256_storeu_pd(out + i + 4, a1);
+        _mm256_storeu_pd(out + i + 8, a2);
+        _mm256_storeu_pd(out + i + 12, a3);
+    }
+    for(; i + 4 <= n; i += 4) {
+        __m256d a0 = _mm256_setzero_pd();
+        h = history + i;
+        for(k = 0; k < ntaps; k++) {
+            a0 = _mm256_fmadd_pd(_mm256_broadcast_sd(taps + k), _mm256_loadu_pd(h + k), a0);
+        }
+        _mm256_storeu_pd(out + i, a0);
+    }
+    /* The last one to three outputs take one masked pass: a scalar tail would serialise on its accumulator,
+       and calling the SSE-encoded scalar kernel from here costs a state transition */
+    if(i < n) {
+        __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x((long long) (n - i)), _mm256_setr_epi64x(0, 1, 2, 3));
+        __m256d a0 = _mm256_setzero_pd();
+        h = history + i;
+        for(k = 0; k < ntaps; k++) {
+            a0 = _mm256_fmadd_pd(_mm256_broadcast_sd(taps + k), _mm256_maskload_pd(h + k, mask), a0);
+        }
+        _mm256_maskstore_pd(out + i, mask, a0);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void firAVX512(const double * taps, unsigned long ntaps, const double * history, double * out,
+                      unsigned long n) {
+    unsigned long i = 0, k;
+    const double * h;
+
+    for(; i + 32 <= n; i += 32) {
+        __m512d a0 = _mm512_setzero_pd(), a1 = _mm512_setzero_pd();
+        __m512d a2 = _mm512_setzero_pd(), a3 = _mm512_setzero_pd();
+        h = history + i;
+        for(k = 0; k < ntaps; k++) {
+            __m512d t = _mm512_set1_pd(taps[k]);
+            a0 = _mm512_fmadd_pd(t, _mm512_loadu_pd(h + k), a0);
+            a1 = _mm512_fmadd_pd(t, _mm512_loadu_pd(h + k + 8), a1);
+            a2 = _mm512_fmadd_pd(t, _mm512_loadu_pd(h + k + 16), a2);
+            a3 = _mm512_fmadd_pd(t, _mm512_loadu_pd(h + k + 24), a3);
+        }
+        _mm512_storeu_pd(out + i, a0);
+        _mm512_storeu_pd(out + i + 8, a1);
+        _mm512_storeu_pd(out + i + 16, a2);
+        _mm512_storeu_pd(out + i + 24, a3);
+    }
+    for(; i + 8 <= n; i += 8) {
+        __m512d a0 = _mm512_setzero_pd();
+        h = history + i;
+        for(k = 0; k < ntaps; k++) {
+            a0 = _mm512_fmadd_pd(_mm512_set1_pd(taps[k]), _mm512_loadu_pd(h + k), a0);
+        }
+        _mm512_storeu_pd(out + i, a0);
+    }
+    if(i < n) {
+        __mmask8 mask = (__mmask8) ((1u << (n - i)) - 1);
+        __m512d a0 = _mm512_setzero_pd();
+        h = history + i;
+        for(k = 0; k < ntaps; k++) {
+            a0 = _mm512_fmadd_pd(_mm512_set1_pd(taps[k]), _mm512_maskz_loadu_pd(mask, h + k), a0);
+        }
+        _mm512_mask_storeu_pd(out + i, mask, a0);
+    }
+}
+#endif
+
+static FIRKERNEL selectKernel(const char ** name) {
+#ifdef FIR_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) {
+        *name = "avx512";
+        return firAVX512;
+    }
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        *name = "avx2";
+        return firAVX2;
+    }
+#endif
+    *name = "scalar";
+    return firScalar;
+}
+
+const char * fir_kernelname(void) {
+    const char * name;
+    selectKernel(&name);
+    return name;
+}
+
+FIRFILTER * new_FIR(const double * taps, unsigned long ntaps, unsigned long maxblock) {
+    return new_FIR_a(taps, ntaps, maxblock, NULL);
+}
+
+FIRFILTER * new_FIR_a(const double * taps, unsigned long ntaps, unsigned long maxblock, const DSPALLOC * alloc) {
+    FIRFILTER * fir;
+    unsigned long k;
+
+    if(!taps || !ntaps) {
+        return NULL;
+    }
+    if(!maxblock) {
+        maxblock = FIR_DEFAULTBLOCK;
+    }
+    if(!(fir = (FIRFILTER *) dsp_alloc(alloc, sizeof(FIRFILTER)))) {
+        return NULL;
+    }
+    fir->ntaps = ntaps;
+    fir->maxblock = maxblock;
+    fir->taps = (double *) dsp_alloc(alloc, ntaps * sizeof(double));
+    fir->history = (double *) dsp_calloc(alloc, ntaps - 1 + maxblock, sizeof(double));
+    if(!fir->taps || !fir->history) {
+        clear_FIR_a(&fir, alloc);
+        return NULL;
+    }
+    /* Reversed, so the kernels walk taps and history in the same direction */
+    for(k = 0; k < ntaps; k++) {
+        fir->taps[k] = taps[ntaps - 1 - k];
+    }
+    fir->kernel = selectKernel(&fir->kernelname);
+    return fir;
+}
+
+void fir_process(FIRFILTER * fir, const double * input, double * output, unsigned long n) {
+    unsigned long m, past = fir->ntaps - 1;
+
+    while(n) {
+        m = n < fir->maxblock ? n : fir->maxblock;
+        /* The input is staged first, so output may alias it */
+        memcpy(fir->history + past, input, m * sizeof(double));
+        fir->kernel(fir->taps, fir->ntaps, fir->history, output, m);
+        memmove(fir->history, fir->history + m, past * sizeof(double));
+        input += m;
+        output += m;
+        n -= m;
+    }
+}
+
+void fir_reset(FIRFILTER * fir) {
+    memset(fir->history, 0, (fir->ntaps - 1 + fir->maxblock) * sizeof(double));
+}
+
+void clear_FIR(FIRFILTER ** fir) {
+    clear_FIR_a(fir, NULL);
+}
+
+void clear_FIR_a(FIRFILTER ** fir, const DSPALLOC * alloc) {
+    if(fir && *fir) {
+        dsp_free(alloc, (*fir)->taps);
+        dsp_free(alloc, (*fir)->history);
+        dsp_free(alloc, *fir);
+        *fir = NULL;
+    }
+}
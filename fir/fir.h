@@ -0,0 +1,98 @@
+#ifndef _FIR_H_
+#define _FIR_H_
+
+#include "dspalloc.h"
+
+/**
+ * Define a function pointer for a direct-form FIR kernel.
+ *
+ * Computes out[i] = sum over k of taps[k] * history[i + k] for i from 0 to n - 1, where taps holds the
+ * impulse response reversed and history holds ntaps - 1 past input samples followed by the n new ones.
+ *
+ * @param taps - the reversed impulse response
+ * @param ntaps - the number of taps
+ * @param history - the input history
+ * @param out - the output samples
+ * @param n - the number of output samples
+ */
+typedef void (*FIRKERNEL) (const double * taps, unsigned long ntaps, const double * history, double * out,
+                           unsigned long n);
+
+/**
+ * Defines the schema for a direct-form FIR filter.
+ *
+ * Zero latency and any block size: each call filters exactly the samples it is given. The kernel is chosen
+ * once at creation from the instruction sets the CPU supports (AVX-512F, AVX2 with FMA, else scalar C). The
+ * SIMD kernels compute several outputs per pass, broadcasting each tap against unaligned loads of the
+ * history, with independent accumulators to hide the multiply-add latency.
+ *
+ * @param taps - the impulse response, reversed
+ * @param ntaps - the number of taps
+ * @param history - ntaps - 1 past input samples followed by room for maxblock new ones
+ * @param maxblock - the number of samples filtered per kernel call (longer inputs are split)
+ * @param kernel - the kernel in use
+ * @param kernelname - the name of the kernel in use ("avx512", "avx2" or "scalar")
+ */
+typedef struct firfilter {
+    double * taps;
+    unsigned long ntaps;
+    double * history;
+    unsigned long maxblock;
+    FIRKERNEL kernel;
+    const char * kernelname;
+} FIRFILTER;
+
+/**
+ * Create a FIR filter.
+ * @param taps - the impulse response
+ * @param ntaps - the number of taps (at least 1)
+ * @param maxblock - the number of samples filtered per kernel call, eg. the host block size (0 for a default)
+ * @return pointer to a dynamically allocated FIRFILTER object, or NULL if unsuccessful
+ */
+FIRFILTER * new_FIR(const double * taps, unsigned long ntaps, unsigned long maxblock);
+
+/**
+ * Create a FIR filter with the object and its buffers taken from an allocator.
+ * @param taps - the impulse response
+ * @param ntaps - the number of taps (at least 1)
+ * @param maxblock - the number of samples filtered per kernel call (0 for a default)
+ * @param alloc - the allocator, or NULL for the heap
+ * @return pointer to a FIRFILTER object, or NULL if unsuccessful
+ */
+FIRFILTER * new_FIR_a(const double * taps, unsigned long ntaps, unsigned long maxblock, const DSPALLOC * alloc);
+
+/**
+ * Filter a block of samples. Performs no allocation.
+ * @param fir - pointer to a FIRFILTER object
+ * @param input - the input samples
+ * @param output - the output samples (may be the input buffer)
+ * @param n - the number of samples (any length)
+ */
+void fir_process(FIRFILTER * fir, const double * input, double * output, unsigned long n);
+
+/**
+ * Clear the filter history (silence).
+ * @param fir - pointer to a FIRFILTER object
+ */
+void fir_reset(FIRFILTER * fir);
+
+/**
+ * Get the name of the kernel new filters will use on this CPU.
+ * @return "avx512", "avx2" or "scalar"
+ */
+const char * fir_kernelname(void);
+
+/**
+ * Destroy a FIR filter.
+ * @param fir - pointer to a pointer for the FIRFILTER object, set to NULL on return
+ */
+void clear_FIR(FIRFILTER ** fir);
+
+/**
+ * Destroy a FIR filter created by new_FIR_a.
+ * @param fir - pointer to a pointer for the FIRFILTER object, set to NULL on return
+ * @param alloc - the allocator the filter was created with
+ */
+void clear_FIR_a(FIRFILTER ** fir, const DSPALLOC * alloc);
+
+#endif
@@ -0,0 +1,659 @@
+#include "graph.h"
+#include "instrument.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+/**
+ * State of an oscillator node (OSCIL or TOSCIL).
+ */
+typedef struct oscnode {
+    OSCIL * osc;
+    tickfunc tick;
+    TOSCIL * tosc;
+    TABFUNC tabtick;
+    double freq;
+} OSCNODE;
+
+/**
+ * State of a panner node. The float buffers stage the signal for the float pan kernels.
+ */
+typedef struct pannode {
+    PANPOS current, target;
+    PANLAW law;
+    float * in;
+    float * out;
+} PANNODE;
+
+/**
+ * State of a convolver node.
+ */
+typedef struct convnode {
+    UPOLS * network;
+    unsigned long blocksize;
+    double * in;
+} CONVNODE;
+
+/**
+ * Block processing functions for the built-in nodes.
+ */
+static void processOscil(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes);
+static void processTOscil(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes);
+static void processEnvelope(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes);
+static void processMul(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes);
+static void processMix(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes);
+static void processPan(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes);
+static void processConvolver(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes);
+
+/**
+ * Destructors for the built-in node states.
+ */
+static void destroyPan(void * state);
+static void destroyConvolver(void * state);
+
+/**
+ * Gains of a fixed pan position under a given law (matching stereoPanDynamic).
+ */
+static PANPOS panGains(double position, PANLAW law);
+
+/**
+ * Run the nodes of the current level, claiming them one at a time (shared by the caller and the workers).
+ */
+static void runLevel(DSPGRAPH * graph);
+
+/**
+ * Worker thread: processes one level per pair of barrier waits until told to quit.
+ */
+static void * graphWorker(void * arg);
+
+/**
+ * Stop and join the worker pool.
+ */
+static void stopWorkers(DSPGRAPH * graph);
+
+static void processOscil(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes) {
+    OSCNODE * node = (OSCNODE *) state;
+    double * out = outputs[0];
+    unsigned long i;
+    if(inputs[0]) {
+        for(i = 0; i < nframes; i++) {
+            out[i] = node->tick(node->osc, inputs[0][i]);
+        }
+    }
+    else {
+        for(i = 0; i < nframes; i++) {
+            out[i] = node->tick(node->osc, node->freq);
+        }
+    }
+}
+
+static void processTOscil(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes) {
+    OSCNODE * node = (OSCNODE *) state;
+    double * out = outputs[0];
+    unsigned long i;
+    if(inputs[0]) {
+        for(i = 0; i < nframes; i++) {
+            out[i] = node->tabtick(node->tosc, inputs[0][i]);
+        }
+    }
+    else {
+        for(i = 0; i < nframes; i++) {
+            out[i] = node->tabtick(node->tosc, node->freq);
+        }
+    }
+}
+
+static void processEnvelope(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes) {
+    (void) inputs;
+    bps_render((BRKSTREAM *) state, outputs[0], nframes);
+}
+
+static void processMul(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes) {
+    const double * a = inputs[0], * b = inputs[1];
+    double * out = outputs[0];
+    unsigned long i;
+    (void) state;
+    if(a && b) {
+        for(i = 0; i < nframes; i++) {
+            out[i] = a[i] * b[i];
+        }
+    }
+    else if(a || b) {
+        memcpy(out, a ? a : b, sizeof(double) * nframes);
+    }
+    else {
+        for(i = 0; i < nframes; i++) {
+            out[i] = 1.0;
+        }
+    }
+}
+
+static void processMix(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes) {
+    unsigned int j, nin = *(unsigned int *) state;
+    double * out = outputs[0];
+    unsigned long i;
+    memset(out, 0, sizeof(double) * nframes);
+    for(j = 0; j < nin; j++) {
+        const double * in = inputs[j];
+        if(in) {
+            for(i = 0; i < nframes; i++) {
+                out[i] += in[i];
+            }
+        }
+    }
+}
+
+static PANPOS panGains(double position, PANLAW law) {
+    PANPOS pos;
+    position = position < -1.0 ? -1.0 : (position > 1.0 ? 1.0 : position);
+    if(law == PAN_CONSTPOWER) {
+        pos = constPower(position);
+    }
+    else {
+        pos.left = 0.5 * (1.0 - position);
+        pos.right = 0.5 * (1.0 + position);
+    }
+    return pos;
+}
+
+static void processPan(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes) {
+    PANNODE * node = (PANNODE *) state;
+    float * left = node->out, * right = node->out + nframes;
+    unsigned long i;
+
+    if(!inputs[0]) {
+        memset(outputs[0], 0, sizeof(double) * nframes);
+        memset(outputs[1], 0, sizeof(double) * nframes);
+        return;
+    }
+    for(i = 0; i < nframes; i++) {
+        node->in[i] = (float) inputs[0][i];
+    }
+    if(inputs[1]) {
+        stereoPanDynamicPlanar(node->in, left, right, inputs[1], nframes, node->law, PAN_REPLACE);
+    }
+    else {
+        stereoPanPlanar(node->in, left, right, nframes, node->current, node->target, PAN_REPLACE);
+        node->current = node->target;
+    }
+    for(i = 0; i < nframes; i++) {
+        outputs[0][i] = left[i];
+        outputs[1][i] = right[i];
+    }
+}
+
+static void destroyPan(void * state) {
+    PANNODE * node = (PANNODE *) state;
+    free(node->in);
+    free(node->out);
+    free(node);
+}
+
+static void processConvolver(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes) {
+    CONVNODE * node = (CONVNODE *) state;
+    char * errMsg;
+    (void) nframes;
+    /* fft_convolve takes a mutable input, so stage it (silence if unconnected) */
+    if(inputs[0]) {
+        memcpy(node->in, inputs[0], sizeof(double) * node->blocksize);
+    }
+    else {
+        memset(node->in, 0, sizeof(double) * node->blocksize);
+    }
+    fft_convolve(node->in, outputs[0], node->network, node->blocksize, &errMsg);
+}
+
+static void destroyConvolver(void * state) {
+    CONVNODE * node = (CONVNODE *) state;
+    free(node->in);
+    free(node);
+}
+
+DSPGRAPH * graph_new(unsigned long blocksize) {
+    DSPGRAPH * graph;
+    if(!blocksize) {
+        return NULL;
+    }
+    graph = (DSPGRAPH *) calloc(1, sizeof(DSPGRAPH));
+    if(!graph) {
+        return NULL;
+    }
+    graph->blocksize = blocksize;
+    graph->nthreads = 1;
+    return graph;
+}
+
+int graph_addnode(DSPGRAPH * graph, GRAPHPROC process, void * state, void (*destroy) (void * state),
+                  unsigned int nin, unsigned int nout) {
+    GRAPHNODE * node;
+    unsigned int i;
+
+    if(graph->compiled || !process || nin > GRAPH_MAXPORTS || nout > GRAPH_MAXPORTS) {
+        return GRAPH_INVALID;
+    }
+    if(graph->nnodes == graph->capacity) {
+        unsigned int capacity = graph->capacity ? graph->capacity * 2 : 16;
+        GRAPHNODE * nodes = (GRAPHNODE *) realloc(graph->nodes, sizeof(GRAPHNODE) * capacity);
+        if(!nodes) {
+            return GRAPH_INVALID;
+        }
+        graph->nodes = nodes;
+        graph->capacity = capacity;
+    }
+    node = graph->nodes + graph->nnodes;
+    memset(node, 0, sizeof(GRAPHNODE));
+    node->process = process;
+    node->destroy = destroy;
+    node->state = state;
+    node->nin = nin;
+    node->nout = nout;
+    for(i = 0; i < GRAPH_MAXPORTS; i++) {
+        node->srcnode[i] = -1;
+    }
+    return (int) graph->nnodes++;
+}
+
+int graph_connect(DSPGRAPH * graph, int src, unsigned int srcport, int dst, unsigned int dstport) {
+    if(graph->compiled || src < 0 || dst < 0 || src == dst ||
+       (unsigned int) src >= graph->nnodes || (unsigned int) dst >= graph->nnodes ||
+       srcport >= graph->nodes[src].nout || dstport >= graph->nodes[dst].nin) {
+        return 0;
+    }
+    graph->nodes[dst].srcnode[dstport] = src;
+    graph->nodes[dst].srcport[dstport] = srcport;
+    return 1;
+}
+
+int graph_addoscil(DSPGRAPH * graph, OSCIL * osc, tickfunc tick, double freq) {
+    int id;
+    OSCNODE * node = (OSCNODE *) calloc(1, sizeof(OSCNODE));
+    if(!node) {
+        return GRAPH_INVALID;
+    }
+    node->osc = osc;
+    node->tick = tick;
+    node->freq = freq;
+    if((id = graph_addnode(graph, processOscil, node, free, 1, 1)) == GRAPH_INVALID) {
+        free(node);
+    }
+    return id;
+}
+
+int graph_addtoscil(DSPGRAPH * graph, TOSCIL * osc, TABFUNC tick, double freq) {
+    int id;
+    OSCNODE * node = (OSCNODE *) calloc(1, sizeof(OSCNODE));
+    if(!node) {
+        return GRAPH_INVALID;
+    }
+    node->tosc = osc;
+    node->tabtick = tick;
+    node->freq = freq;
+    if((id = graph_addnode(graph, processTOscil, node, free, 1, 1)) == GRAPH_INVALID) {
+        free(node);
+    }
+    return id;
+}
+
+int graph_addenvelope(DSPGRAPH * graph, BRKSTREAM * stream) {
+    return graph_addnode(graph, processEnvelope, stream, NULL, 0, 1);
+}
+
+int graph_addmul(DSPGRAPH * graph) {
+    return graph_addnode(graph, processMul, NULL, NULL, 2, 1);
+}
+
+int graph_addmix(DSPGRAPH * graph, unsigned int nin) {
+    int id;
+    unsigned int * node = (unsigned int *) malloc(sizeof(unsigned int));
+    if(!node) {
+        return GRAPH_INVALID;
+    }
+    *node = nin;
+    if((id = graph_addnode(graph, processMix, node, free, nin, 1)) == GRAPH_INVALID) {
+        free(node);
+    }
+    return id;
+}
+
+int graph_addpan(DSPGRAPH * graph, double position, PANLAW law) {
+    int id;
+    PANNODE * node;
+    if(law != PAN_LINEAR && law != PAN_CONSTPOWER) {
+        return GRAPH_INVALID;
+    }
+    node = (PANNODE *) calloc(1, sizeof(PANNODE));
+    if(!node) {
+        return GRAPH_INVALID;
+    }
+    node->law = law;
+    node->current = node->target = panGains(position, law);
+    node->in = (float *) malloc(sizeof(float) * graph->blocksize);
+    node->out = (float *) malloc(sizeof(float) * 2 * graph->blocksize);
+    if(!node->in || !node->out) {
+        destroyPan(node);
+        return GRAPH_INVALID;
+    }
+    if((id = graph_addnode(graph, processPan, node, destroyPan, 2, 2)) == GRAPH_INVALID) {
+        destroyPan(node);
+    }
+    return id;
+}
+
+void graph_setpan(DSPGRAPH * graph, int node, double position) {
+    PANNODE * pan;
+    if(node < 0 || (unsigned int) node >= graph->nnodes || graph->nodes[node].process != processPan) {
+        return;
+    }
+    pan = (PANNODE *) graph->nodes[node].state;
+    pan->target = panGains(position, pan->law);
+}
+
+int graph_addconvolver(DSPGRAPH * graph, UPOLS * network) {
+    int id;
+    CONVNODE * node;
+    if(network->NFFT != 2 * graph->blocksize) {
+        return GRAPH_INVALID;
+    }
+    node = (CONVNODE *) calloc(1, sizeof(CONVNODE));
+    if(!node) {
+        return GRAPH_INVALID;
+    }
+    node->network = network;
+    node->blocksize = graph->blocksize;
+    node->in = (double *) malloc(sizeof(double) * graph->blocksize);
+    if(!node->in) {
+        destroyConvolver(node);
+        return GRAPH_INVALID;
+    }
+    if((id = graph_addnode(graph, processConvolver, node, destroyConvolver, 1, 1)) == GRAPH_INVALID) {
+        destroyConvolver(node);
+    }
+    return id;
+}
+
+int graph_compile(DSPGRAPH * graph, unsigned int nthreads, char ** errMsg) {
+    unsigned int n = graph->nnodes, i, j, k, head, tail, level, width, maxwidth = 0;
+    unsigned int * indegree, * queue, * lastuse, * freelist, * count, nfree = 0;
+    unsigned long b;
+
+    if(graph->compiled) {
+        *errMsg = "Graph is already compiled";
+        return 0;
+    }
+    if(!n) {
+        *errMsg = "Graph has no nodes";
+        return 0;
+    }
+    indegree = (unsigned int *) calloc(n, sizeof(unsigned int));
+    queue = (unsigned int *) malloc(sizeof(unsigned int) * n);
+    /* Worst case every output port needs its own buffer */
+    lastuse = (unsigned int *) malloc(sizeof(unsigned int) * n * GRAPH_MAXPORTS);
+    freelist = (unsigned int *) malloc(sizeof(unsigned int) * n * GRAPH_MAXPORTS);
+    count = (unsigned int *) calloc(n + 1, sizeof(unsigned int));
+    graph->order = (unsigned int *) malloc(sizeof(unsigned int) * n);
+    graph->levelstart = (unsigned int *) malloc(sizeof(unsigned int) * (n + 1));
+    if(!indegree || !queue || !lastuse || !freelist || !count || !graph->order || !graph->levelstart) {
+        *errMsg = "Could not allocate schedule";
+        goto fail;
+    }
+
+    /* Kahn's algorithm: a node's level is one more than its deepest source */
+    for(i = 0; i < n; i++) {
+        graph->nodes[i].level = 0;
+        for(j = 0; j < graph->nodes[i].nin; j++) {
+            if(graph->nodes[i].srcnode[j] >= 0) {
+                indegree[i]++;
+            }
+        }
+    }
+    head = tail = 0;
+    for(i = 0; i < n; i++) {
+        if(!indegree[i]) {
+            queue[tail++] = i;
+        }
+    }
+    while(head < tail) {
+        unsigned int src = queue[head++];
+        for(i = 0; i < n; i++) {
+            for(j = 0; j < graph->nodes[i].nin; j++) {
+                if(graph->nodes[i].srcnode[j] == (int) src) {
+                    if(graph->nodes[i].level < graph->nodes[src].level + 1) {
+                        graph->nodes[i].level = graph->nodes[src].level + 1;
+                    }
+                    if(!--indegree[i]) {
+                        queue[tail++] = i;
+                    }
+                }
+            }
+        }
+    }
+    if(tail != n) {
+        *errMsg = "Graph contains a cycle";
+        goto fail;
+    }
+
+    /* Counting sort of the nodes by level */
+    graph->nlevels = 0;
+    for(i = 0; i < n; i++) {
+        count[graph->nodes[i].level + 1]++;
+        if(graph->nodes[i].level + 1 > graph->nlevels) {
+            graph->nlevels = graph->nodes[i].level + 1;
+        }
+    }
+    for(level = 0; level < graph->nlevels; level++) {
+        count[level + 1] += count[level];
+    }
+    memcpy(graph->levelstart, count, sizeof(unsigned int) * (graph->nlevels + 1));
+    for(i = 0; i < n; i++) {
+        graph->order[count[graph->nodes[i].level]++] = i;
+    }
+
+    /* Lifetime analysis: a buffer is free again after the level of its last consumer has run.
+       Outputs without a consumer stay live for the whole block. */
+    graph->nbuffers = 0;
+    for(level = 0; level < graph->nlevels; level++) {
+        for(k = graph->levelstart[level]; k < graph->levelstart[level + 1]; k++) {
+            GRAPHNODE * node = graph->nodes + graph->order[k];
+            for(j = 0; j < node->nout; j++) {
+                unsigned int last = graph->nlevels, consumed = 0;
+                for(i = 0; i < n; i++) {
+                    unsigned int p;
+                    for(p = 0; p < graph->nodes[i].nin; p++) {
+                        if(graph->nodes[i].srcnode[p] == (int) graph->order[k] && graph->nodes[i].srcport[p] == j) {
+                            if(!consumed || graph->nodes[i].level > last) {
+                                last = graph->nodes[i].level;
+                            }
+                            consumed = 1;
+                        }
+                    }
+                }
+                node->outbufs[j] = nfree ? freelist[--nfree] : graph->nbuffers++;
+                lastuse[node->outbufs[j]] = consumed ? last : graph->nlevels;
+            }
+        }
+        /* Release after the whole level has been assigned, so no node writes a buffer its neighbours read */
+        for(b = 0; b < graph->nbuffers; b++) {
+            if(lastuse[b] == level) {
+                freelist[nfree++] = (unsigned int) b;
+                lastuse[b] = graph->nlevels + 1;
+            }
+        }
+    }
+
+    graph->buffers = (double *) calloc((size_t) (graph->nbuffers ? graph->nbuffers : 1) * graph->blocksize, sizeof(double));
+    if(!graph->buffers) {
+        *errMsg = "Could not allocate buffer pool";
+        goto fail;
+    }
+    for(i = 0; i < n; i++) {
+        GRAPHNODE * node = graph->nodes + i;
+        for(j = 0; j < node->nout; j++) {
+            node->outptrs[j] = graph->buffers + node->outbufs[j] * graph->blocksize;
+        }
+    }
+    for(i = 0; i < n; i++) {
+        GRAPHNODE * node = graph->nodes + i;
+        for(j = 0; j < node->nin; j++) {
+            node->inptrs[j] = node->srcnode[j] < 0 ? NULL : graph->nodes[node->srcnode[j]].outptrs[node->srcport[j]];
+        }
+    }
+
+    /* Only start workers if some level has independent nodes to share out */
+    for(level = 0; level < graph->nlevels; level++) {
+        width = graph->levelstart[level + 1] - graph->levelstart[level];
+        if(width > maxwidth) {
+            maxwidth = width;
+        }
+    }
+    if(nthreads > maxwidth) {
+        nthreads = maxwidth;
+    }
+    graph->nthreads = 1;
+    if(nthreads > 1) {
+        graph->workers = (pthread_t *) malloc(sizeof(pthread_t) * (nthreads - 1));
+        if(graph->workers && pthread_barrier_init(&graph->start, NULL, nthreads) == 0) {
+            if(pthread_barrier_init(&graph->done, NULL, nthreads) == 0) {
+                /* Workers hold at the gate until every one has started, as the barriers need them all */
+                __atomic_store_n(&graph->quit, -1, __ATOMIC_RELEASE);
+                for(i = 0; i < nthreads - 1; i++) {
+                    if(pthread_create(&graph->workers[i], NULL, graphWorker, graph) != 0) {
+                        break;
+                    }
+                }
+                graph->nthreads = i + 1;
+                if(i == nthreads - 1) {
+                    __atomic_store_n(&graph->quit, 0, __ATOMIC_RELEASE);
+                }
+                else {
+                    /* Could not start them all: release the started workers and run serially */
+                    stopWorkers(graph);
+                }
+            }
+            else {
+                pthread_barrier_destroy(&graph->start);
+                free(graph->workers);
+                graph->workers = NULL;
+            }
+        }
+        else {
+            free(graph->workers);
+            graph->workers = NULL;
+        }
+    }
+
+    free(indegree);
+    free(queue);
+    free(lastuse);
+    free(freelist);
+    free(count);
+    graph->compiled = 1;
+    return 1;
+
+fail:
+    free(indegree);
+    free(queue);
+    free(lastuse);
+    free(freelist);
+    free(count);
+    free(graph->order);
+    free(graph->levelstart);
+    graph->order = graph->levelstart = NULL;
+    return 0;
+}
+
+static void runLevel(DSPGRAPH * graph) {
+    unsigned int end = graph->levelstart[graph->curlevel + 1], k;
+    while((k = __atomic_fetch_add(&graph->next, 1, __ATOMIC_RELAXED)) < end) {
+        GRAPHNODE * node = graph->nodes + graph->order[k];
+        node->process(node->state, node->inptrs, node->outptrs, graph->blocksize);
+    }
+}
+
+static void * graphWorker(void * arg) {
+    DSPGRAPH * graph = (DSPGRAPH *) arg;
+    int gate;
+    while((gate = __atomic_load_n(&graph->quit, __ATOMIC_ACQUIRE)) < 0) {
+        sched_yield();
+    }
+    if(gate) {
+        return NULL;
+    }
+    while(1) {
+        pthread_barrier_wait(&graph->start);
+        if(graph->quit) {
+            break;
+        }
+        runLevel(graph);
+        pthread_barrier_wait(&graph->done);
+    }
+    return NULL;
+}
+
+static void stopWorkers(DSPGRAPH * graph) {
+    unsigned int i, started = graph->nthreads - 1;
+    if(__atomic_load_n(&graph->quit, __ATOMIC_ACQUIRE) < 0) {
+        /* Still at the gate: open it with quit set */
+        __atomic_store_n(&graph->quit, 1, __ATOMIC_RELEASE);
+    }
+    else {
+        /* Parked on the start barrier: pass it with quit set */
+        graph->quit = 1;
+        pthread_barrier_wait(&graph->start);
+    }
+    for(i = 0; i < started; i++) {
+        pthread_join(graph->workers[i], NULL);
+    }
+    pthread_barrier_destroy(&graph->start);
+    pthread_barrier_destroy(&graph->done);
+    free(graph->workers);
+    graph->workers = NULL;
+    graph->nthreads = 1;
+}
+
+void graph_process(DSPGRAPH * graph) {
+    unsigned int level, k;
+    DSP_PROBE_BEGIN(start);
+    for(level = 0; level < graph->nlevels; level++) {
+        unsigned int first = graph->levelstart[level], end = graph->levelstart[level + 1];
+        if(graph->nthreads > 1 && end - first > 1) {
+            graph->curlevel = level;
+            graph->next = first;
+            pthread_barrier_wait(&graph->start);
+            runLevel(graph);
+            pthread_barrier_wait(&graph->done);
+            continue;
+        }
+        for(k = first; k < end; k++) {
+            GRAPHNODE * node = graph->nodes + graph->order[k];
+            node->process(node->state, node->inptrs, node->outptrs, graph->blocksize);
+        }
+    }
+    DSP_PROBE_END(DSP_PROBE_GRAPH, start, graph->blocksize);
+}
+
+const double * graph_output(const DSPGRAPH * graph, int node, unsigned int port) {
+    if(!graph->compiled || node < 0 || (unsigned int) node >= graph->nnodes || port >= graph->nodes[node].nout) {
+        return NULL;
+    }
+    return graph->nodes[node].outptrs[port];
+}
+
+void graph_free(DSPGRAPH ** graph) {
+    unsigned int i;
+    if(graph && *graph) {
+        if((*graph)->workers) {
+            stopWorkers(*graph);
+        }
+        for(i = 0; i < (*graph)->nnodes; i++) {
+            if((*graph)->nodes[i].destroy) {
+                (*graph)->nodes[i].destroy((*graph)->nodes[i].state);
+            }
+        }
+        free((*graph)->nodes);
+        free((*graph)->order);
+        free((*graph)->levelstart);
+        free((*graph)->buffers);
+        free(*graph);
+        *graph = NULL;
+    }
+}
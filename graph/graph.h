@@ -0,0 +1,235 @@
+#ifndef _GRAPH_H_
+#define _GRAPH_H_
+
+#include <pthread.h>
+#include "wave.h"
+#include "gtable.h"
+#include "breakpoint.h"
+#include "pan.h"
+#include "fftproc.h"
+
+/**
+ * Maximum number of input or output ports on a graph node.
+ */
+#define GRAPH_MAXPORTS 16
+
+/**
+ * Node identifier returned when a node cannot be added.
+ */
+#define GRAPH_INVALID (-1)
+
+/**
+ * Define a function pointer for the block processing of a graph node.
+ *
+ * @param state - the node's private state
+ * @param inputs - one buffer per input port, or NULL for an unconnected input
+ * @param outputs - one buffer per output port, to be filled with nframes samples
+ * @param nframes - the number of frames in the block
+ */
+typedef void (*GRAPHPROC) (void * state, const double * const * inputs, double * const * outputs, unsigned long nframes);
+
+/**
+ * Defines the schema for a node of a DSP graph.
+ *
+ * @param process - the block processing function
+ * @param destroy - optional function to free the state when the graph is destroyed
+ * @param state - the node's private state
+ * @param nin,nout - the number of input and output ports
+ * @param srcnode,srcport - the node and output port feeding each input (srcnode -1 if unconnected)
+ * @param level - the node's depth in the schedule; nodes on the same level are independent
+ * @param outbufs - the pool buffer index assigned to each output port
+ * @param inptrs,outptrs - resolved buffer pointers, set when the graph is compiled
+ */
+typedef struct graphnode {
+    GRAPHPROC process;
+    void (*destroy) (void * state);
+    void * state;
+    unsigned int nin, nout;
+    int srcnode[GRAPH_MAXPORTS];
+    unsigned int srcport[GRAPH_MAXPORTS];
+    unsigned int level;
+    unsigned int outbufs[GRAPH_MAXPORTS];
+    const double * inptrs[GRAPH_MAXPORTS];
+    double * outptrs[GRAPH_MAXPORTS];
+} GRAPHNODE;
+
+/**
+ * Defines the schema for a block-based DSP graph.
+ *
+ * Nodes are added and connected, then the graph is compiled: a topological sort (Kahn's algorithm) groups the
+ * nodes into levels, and each output port is assigned a buffer from a pool, reusing a buffer once every consumer
+ * of its previous contents has run (lifetime analysis). Outputs with no consumer keep their buffer for the whole
+ * block so they can be read with graph_output. Processing a block then runs the nodes level by level; with more
+ * than one thread, the nodes within a level are shared out to a worker pool. The graph itself allocates nothing
+ * while processing, and neither do the built-in nodes: the convolver relies on the UPOLS network caching its FFT
+ * configurations (new_UPOLS_a), so fft_convolve does not allocate. Custom node callbacks must keep to the same rule
+ * for a block to be allocation free.
+ *
+ * @param nodes - the node array
+ * @param nnodes,capacity - the number of nodes and the allocated size of the node array
+ * @param blocksize - the number of frames processed per block
+ * @param order - node indices in schedule order (sorted by level)
+ * @param levelstart - index into order of the first node of each level (nlevels + 1 entries)
+ * @param nlevels - the number of levels in the schedule
+ * @param buffers - the pool storage, nbuffers * blocksize samples
+ * @param nbuffers - the number of pool buffers
+ * @param compiled - boolean integer specifying whether the graph has been compiled
+ * @param nthreads - the number of threads processing each block (including the caller)
+ * @param workers - the worker threads
+ * @param start,done - barriers bracketing each level when running in parallel
+ * @param curlevel - the level being processed
+ * @param next - the next schedule position to claim within the current level
+ * @param quit - boolean integer telling the workers to exit
+ */
+typedef struct dspgraph {
+    GRAPHNODE * nodes;
+    unsigned int nnodes, capacity;
+    unsigned long blocksize;
+    unsigned int * order;
+    unsigned int * levelstart;
+    unsigned int nlevels;
+    double * buffers;
+    unsigned int nbuffers;
+    int compiled;
+    unsigned int nthreads;
+    pthread_t * workers;
+    pthread_barrier_t start, done;
+    unsigned int curlevel;
+    unsigned int next;
+    int quit;
+} DSPGRAPH;
+
+/**
+ * Create an empty DSP graph. Returns NULL if unsuccessful.
+ * @param blocksize - the number of frames processed per block
+ * @return pointer to a dynamically allocated DSPGRAPH object
+ */
+DSPGRAPH * graph_new(unsigned long blocksize);
+
+/**
+ * Add a node with a custom processing function. Nodes cannot be added once the graph is compiled.
+ * @param graph - pointer to a DSPGRAPH object
+ * @param process - the block processing function
+ * @param state - the node's private state, passed to process
+ * @param destroy - function to free the state when the graph is destroyed (may be NULL)
+ * @param nin - the number of input ports (up to GRAPH_MAXPORTS)
+ * @param nout - the number of output ports (up to GRAPH_MAXPORTS)
+ * @return the node identifier, or GRAPH_INVALID if unsuccessful
+ */
+int graph_addnode(DSPGRAPH * graph, GRAPHPROC process, void * state, void (*destroy) (void * state),
+                  unsigned int nin, unsigned int nout);
+
+/**
+ * Connect an output port of one node to an input port of another, replacing any previous connection to the input.
+ * @param graph - pointer to a DSPGRAPH object
+ * @param src,srcport - the source node and its output port
+ * @param dst,dstport - the destination node and its input port
+ * @return boolean integer specifying whether the connection was made
+ */
+int graph_connect(DSPGRAPH * graph, int src, unsigned int srcport, int dst, unsigned int dstport);
+
+/**
+ * Add an oscillator node (1 input: frequency, 1 output). The OSCIL object is not owned by the graph.
+ * @param graph - pointer to a DSPGRAPH object
+ * @param osc - pointer to an initialised OSCIL object
+ * @param tick - the waveform tick function (eg. sinetick)
+ * @param freq - the frequency used while the frequency input is unconnected
+ * @return the node identifier, or GRAPH_INVALID if unsuccessful
+ */
+int graph_addoscil(DSPGRAPH * graph, OSCIL * osc, tickfunc tick, double freq);
+
+/**
+ * Add a lookup table oscillator node (1 input: frequency, 1 output). The TOSCIL object is not owned by the graph.
+ * @param graph - pointer to a DSPGRAPH object
+ * @param osc - pointer to an initialised TOSCIL object
+ * @param tick - the lookup function (tabtick or tabitick)
+ * @param freq - the frequency used while the frequency input is unconnected
+ * @return the node identifier, or GRAPH_INVALID if unsuccessful
+ */
+int graph_addtoscil(DSPGRAPH * graph, TOSCIL * osc, TABFUNC tick, double freq);
+
+/**
+ * Add a breakpoint envelope node (no inputs, 1 output), rendered with bps_render. The stream is not owned by the graph.
+ * @param graph - pointer to a DSPGRAPH object
+ * @param stream - pointer to an initialised BRKSTREAM object
+ * @return the node identifier, or GRAPH_INVALID if unsuccessful
+ */
+int graph_addenvelope(DSPGRAPH * graph, BRKSTREAM * stream);
+
+/**
+ * Add a multiplier node (2 inputs, 1 output), eg. to apply an envelope. An unconnected input counts as 1.
+ * @param graph - pointer to a DSPGRAPH object
+ * @return the node identifier, or GRAPH_INVALID if unsuccessful
+ */
+int graph_addmul(DSPGRAPH * graph);
+
+/**
+ * Add a mixer node summing its inputs (nin inputs, 1 output). Unconnected inputs are skipped.
+ * @param graph - pointer to a DSPGRAPH object
+ * @param nin - the number of inputs (up to GRAPH_MAXPORTS)
+ * @return the node identifier, or GRAPH_INVALID if unsuccessful
+ */
+int graph_addmix(DSPGRAPH * graph, unsigned int nin);
+
+/**
+ * Add a stereo panner node (input 0: signal, input 1: optional per-sample position; outputs 0/1: left/right).
+ *
+ * With the position input connected the node pans per sample (stereoPanDynamicPlanar); otherwise it uses a fixed
+ * position set with graph_setpan, ramping the gains across the block after each change (stereoPanPlanar).
+ *
+ * @param graph - pointer to a DSPGRAPH object
+ * @param position - the initial fixed position (-1 left to 1 right)
+ * @param law - the pan law (PAN_LINEAR or PAN_CONSTPOWER)
+ * @return the node identifier, or GRAPH_INVALID if unsuccessful or the law is unknown
+ */
+int graph_addpan(DSPGRAPH * graph, double position, PANLAW law);
+
+/**
+ * Change the fixed position of a panner node; the gains ramp to the new position over the next block.
+ * @param graph - pointer to a DSPGRAPH object
+ * @param node - a node created by graph_addpan
+ * @param position - the new position (-1 left to 1 right)
+ */
+void graph_setpan(DSPGRAPH * graph, int node, double position);
+
+/**
+ * Add a convolver node (1 input, 1 output) running fft_convolve. The UPOLS network is not owned by the graph; its
+ * cached FFT configurations keep the node free of allocation.
+ * @param graph - pointer to a DSPGRAPH object
+ * @param network - pointer to a UPOLS object whose NFFT is twice the graph blocksize
+ * @return the node identifier, or GRAPH_INVALID if unsuccessful
+ */
+int graph_addconvolver(DSPGRAPH * graph, UPOLS * network);
+
+/**
+ * Sort the graph, assign the buffer pool and optionally start the worker pool.
+ * @param graph - pointer to a DSPGRAPH object
+ * @param nthreads - the number of threads processing each block (including the caller); 0 or 1 runs serially
+ * @param errMsg - pointer to a string which is set to an error description on failure
+ * @return boolean integer specifying whether the graph was compiled
+ */
+int graph_compile(DSPGRAPH * graph, unsigned int nthreads, char ** errMsg);
+
+/**
+ * Process one block through a compiled graph.
+ * @param graph - pointer to a compiled DSPGRAPH object
+ */
+void graph_process(DSPGRAPH * graph);
+
+/**
+ * Obtain the buffer holding an output port after graph_process. Only outputs with no consumers are
+ * guaranteed to hold their block after processing; the buffers of other outputs are reused.
+ * @param graph - pointer to a compiled DSPGRAPH object
+ * @param node - the node identifier
+ * @param port - the output port
+ * @return pointer to blocksize samples, or NULL if the node or port is invalid
+ */
+const double * graph_output(const DSPGRAPH * graph, int node, unsigned int port);
+
+/**
+ * Destroy a DSPGRAPH object: stops the worker pool and frees the graph and all node states.
+ * @param graph - pointer to a pointer for the DSPGRAPH object, set to NULL on return
+ */
+void graph_free(DSPGRAPH ** graph);
+
+#endif
@@ -1,4 +1,5 @@
 #include "gtable.h"
+#include "instrument.h"
 #include <math.h>
 #include <stdio.h>
 
@@ -18,9 +19,10 @@ static void normtable(GTABLE * table);
 /**
  * Creates and initialises a lookup table with a guard point
  * @param length - the size of the table
+ * @param alloc - the allocator for the table, or NULL for the heap
  * @return Pointer to a GTABLE object allocated on the heap
 */
-static GTABLE * newtable(unsigned long length);
+static GTABLE * newtable(unsigned long length, const DSPALLOC * alloc);
 
 /**
  * Allocates memory for an initialised GTABLE and populates it with zeros for a given length. Includes a guard point.
@@ -30,20 +32,20 @@ static GTABLE * newtable(unsigned long length);
 */
 static int filltable(GTABLE * table, unsigned long length);
 
-static GTABLE * newtable(unsigned long length) {
+static GTABLE * newtable(unsigned long length, const DSPALLOC * alloc) {
     unsigned long i;
     GTABLE * table = NULL;
     if(length <= 0) {
         return NULL;
     }
-    table = (GTABLE *) malloc(sizeof(GTABLE));
+    table = (GTABLE *) dsp_alloc(alloc, sizeof(GTABLE));
     if(!table) {
         return NULL;
     }
     /* Allocate memory for waveform samples including guard point */
-    table->samples = (double *) malloc(sizeof(double) * (length+1));
+    table->samples = (double *) dsp_alloc(alloc, sizeof(double) * (length+1));
     if(!(table->samples)) {
-        free(table);
+        dsp_free(alloc, table);
         return NULL;
     }
     table->length = length;
@@ -92,23 +94,70 @@ static void normtable(GTABLE * table) {
 }
 
 void freeTable(GTABLE ** gTab) {
+    freeTable_a(gTab, NULL);
+}
+
+void freeTable_a(GTABLE ** gTab, const DSPALLOC * alloc) {
     /* -> has higher precedence than dereference * */
     if(gTab && *gTab && (*gTab)->samples) {
         /* Free the internal table memory */
-        free((*gTab)->samples);
+        dsp_free(alloc, (*gTab)->samples);
         /* Free the table generator object memory */
-        free(*gTab);
+        dsp_free(alloc, *gTab);
         /* Pointer gTab still holds the address of the table, so make it a null pointer */
         *gTab = NULL;
     }
 }
 
+GTABLE * cycletable(const double * cycle, unsigned long length) {
+    return cycletable_a(cycle, length, NULL);
+}
+
+GTABLE * cycletable_a(const double * cycle, unsigned long length, const DSPALLOC * alloc) {
+    unsigned long i;
+    GTABLE * table = NULL;
+    if(!cycle) {
+        return NULL;
+    }
+    table = newtable(length, alloc);
+    if(!table) {
+        return NULL;
+    }
+    for(i = 0; i < length; i++) {
+        table->samples[i] = cycle[i];
+    }
+    /* Add final guard point */
+    table->samples[i] = table->samples[0];
+    return table;
+}
+
+double normaliseTable(GTABLE * table) {
+    double maxamp = 0.0, amp;
+    unsigned long i;
+    for(i = 0; i < table->length; i++) {
+        amp = fabs(table->samples[i]);
+        if(amp > maxamp) {
+            maxamp = amp;
+        }
+    }
+    /* normtable would divide by zero here */
+    if(maxamp == 0.0) {
+        return 0.0;
+    }
+    normtable(table);
+    return 1.0 / maxamp;
+}
+
 GTABLE * sinetable(unsigned long length) {
+    return sinetable_a(length, NULL);
+}
+
+GTABLE * sinetable_a(unsigned long length, const DSPALLOC * alloc) {
     unsigned long i;
     double step;
     GTABLE * tabG = NULL;
 
-    tabG = newtable(length);
+    tabG = newtable(length, alloc);
     if(!tabG) {
         return NULL;
     }
@@ -128,6 +177,10 @@ GTABLE * sinetable(unsigned long length) {
 }
 
 GTABLE * tritable(unsigned long length, unsigned long nharms) {
+    return tritable_a(length, nharms, NULL);
+}
+
+GTABLE * tritable_a(unsigned long length, unsigned long nharms, const DSPALLOC * alloc) {
     unsigned long i, j, harmonic=1;
     double step, amp;
     GTABLE * tabG = NULL;
@@ -138,10 +191,10 @@ GTABLE * tritable(unsigned long length, unsigned long nharms) {
     }
     /* If a single harmonic, simply return a sinusoid */
     if(nharms == 1) {
-        return sinetable(length);
+        return sinetable_a(length, alloc);
     }
     
-    tabG = newtable(length);
+    tabG = newtable(length, alloc);
     if(!tabG) {
         return NULL;
     }
@@ -171,6 +224,10 @@ GTABLE * tritable(unsigned long length, unsigned long nharms) {
 }
 
 GTABLE * squaretable(unsigned long length, unsigned long nharms) {
+    return squaretable_a(length, nharms, NULL);
+}
+
+GTABLE * squaretable_a(unsigned long length, unsigned long nharms, const DSPALLOC * alloc) {
     unsigned long i, j, harmonic = 1;
     double amp, step;
     GTABLE * table = NULL;
@@ -178,7 +235,7 @@ GTABLE * squaretable(unsigned long length, unsigned long nharms) {
         return NULL;
     }
     /* Create and initialise GTABLE object/structure */
-    table = newtable(length);
+    table = newtable(length, alloc);
     if(!table) {
         return NULL;
     }
@@ -197,6 +254,10 @@ GTABLE * squaretable(unsigned long length, unsigned long nharms) {
 }
 
 GTABLE * sawtable(unsigned long length, unsigned long nharms, int UP) {
+    return sawtable_a(length, nharms, UP, NULL);
+}
+
+GTABLE * sawtable_a(unsigned long length, unsigned long nharms, int UP, const DSPALLOC * alloc) {
     unsigned long i, j, harmonic=1;
     double amp, step;
     double fac = 1.0;
@@ -204,7 +265,7 @@ GTABLE * sawtable(unsigned long length, unsigned long nharms, int UP) {
     if(nharms <= 0 || nharms >= length / 2) {
         return NULL;
     }
-    table = newtable(length);
+    table = newtable(length, alloc);
     if(!table) {
         return NULL;
     }
@@ -226,13 +287,17 @@ GTABLE * sawtable(unsigned long length, unsigned long nharms, int UP) {
 }
 
 GTABLE * pulsetable(unsigned long length, unsigned long nharms) {
+    return pulsetable_a(length, nharms, NULL);
+}
+
+GTABLE * pulsetable_a(unsigned long length, unsigned long nharms, const DSPALLOC * alloc) {
     unsigned long i, j, harmonic = 1;
     double step;
     GTABLE * ptab = NULL;
     if(nharms <= 0 || nharms >= length / 2) {
         return NULL;
     }
-    ptab = newtable(length);
+    ptab = newtable(length, alloc);
     if(!ptab) {
         return NULL;
     }
@@ -248,6 +313,17 @@ GTABLE * pulsetable(unsigned long length, unsigned long nharms) {
 }
 
 TOSCIL * oscil_t(double fs, double phase, GTABLE * gtable) {
+    return oscil_t_a(fs, phase, gtable, NULL);
+}
+
+void freeTOscil_a(TOSCIL ** oscil, const DSPALLOC * alloc) {
+    if(oscil && *oscil) {
+        dsp_free(alloc, *oscil);
+        *oscil = NULL;
+    }
+}
+
+TOSCIL * oscil_t_a(double fs, double phase, GTABLE * gtable, const DSPALLOC * alloc) {
     /* Comprised of a lookup table and an oscillator object. */
     TOSCIL * oscil;
     
@@ -255,7 +331,7 @@ TOSCIL * oscil_t(double fs, double phase, GTABLE * gtable) {
         return NULL;
     }
     
-    oscil = (TOSCIL *) malloc(sizeof(TOSCIL));
+    oscil = (TOSCIL *) dsp_alloc(alloc, sizeof(TOSCIL));
     if(!oscil) {
         return NULL;
     }
@@ -295,6 +371,8 @@ double tabtick(TOSCIL * oscil, double freq) {
      (int)(-4.5) = -4
      */
     unsigned long idx = (unsigned long) oscil->osc.curPhase; /* Phase is in table length units */
+    double val;
+    DSP_PROBE_BEGIN(start);
 
     /* Update frequency */
     if(oscil->osc.curFreq != freq) {
@@ -323,7 +401,9 @@ double tabtick(TOSCIL * oscil, double freq) {
     }
 
     /* Return the table value at the current index - obtained at the start prior to update */
-    return oscil->table->samples[idx];
+    val = oscil->table->samples[idx];
+    DSP_PROBE_END(DSP_PROBE_TABOSCIL, start, 1);
+    return val;
 }
 
 double tabitick(TOSCIL * oscil, double freq) {
@@ -331,6 +411,7 @@ double tabitick(TOSCIL * oscil, double freq) {
      not applicable here since we wrap between 0 < x < 2pi) */
     unsigned long base_idx = (unsigned int) oscil->osc.curPhase;
     double frac, slope, val;
+    DSP_PROBE_BEGIN(start);
 
     if(oscil->osc.curFreq != freq) {
         /* Update frequency and increment */
@@ -358,5 +439,6 @@ double tabitick(TOSCIL * oscil, double freq) {
     while(oscil->osc.curPhase < 0) {
         oscil->osc.curPhase += oscil->tablen;
     }
+    DSP_PROBE_END(DSP_PROBE_TABOSCIL, start, 1);
     return val;
 }
@@ -49,6 +49,13 @@ typedef double (* TABFUNC) (TOSCIL * oscil, double freq);
  */
 void freeTable(GTABLE ** gTab);
 
+/**
+ * Destroy a GTABLE lookup table object created by one of the _a table constructors
+ * @param gTab - pointer to a pointer for the GTABLE object to be freed.
+ * @param alloc - the allocator the table was created with
+ */
+void freeTable_a(GTABLE ** gTab, const DSPALLOC * alloc);
+
 /**
  * Create a sine-wave lookup table for a given length.
  * @param length - the sample size of the lookup oscillator
@@ -56,6 +63,14 @@ void freeTable(GTABLE ** gTab);
  */
 GTABLE * sinetable(unsigned long length);
 
+/**
+ * Create a sine-wave lookup table with a given allocator.
+ * @param length - the sample size of the lookup oscillator
+ * @param alloc - the allocator, or NULL for the heap
+ * @return pointer to a GTABLE object, or NULL if unsuccessful.
+ */
+GTABLE * sinetable_a(unsigned long length, const DSPALLOC * alloc);
+
 /**
  * Create a triangle-wave lookup table for a given length.
  * @param length - the sample size of the lookup oscillator
@@ -64,6 +79,12 @@ GTABLE * sinetable(unsigned long length);
  */
 GTABLE * tritable(unsigned long length, unsigned long nharms);
 
+/**
+ * Create a triangle-wave lookup table with a given allocator (see tritable).
+ * @param alloc - the allocator, or NULL for the heap
+ */
+GTABLE * tritable_a(unsigned long length, unsigned long nharms, const DSPALLOC * alloc);
+
 /**
  * Create a square-wave lookup table for a given length.
  * @param length - the sample size of the lookup oscillator
@@ -72,6 +93,12 @@ GTABLE * tritable(unsigned long length, unsigned long nharms);
  */
 GTABLE * squaretable(unsigned long length, unsigned long nharms);
 
+/**
+ * Create a square-wave lookup table with a given allocator (see squaretable).
+ * @param alloc - the allocator, or NULL for the heap
+ */
+GTABLE * squaretable_a(unsigned long length, unsigned long nharms, const DSPALLOC * alloc);
+
 /**
  * Create a sawtooth-wave lookup table for a given length.
  * @param length - the sample size of the lookup oscillator
@@ -81,6 +108,12 @@ GTABLE * squaretable(unsigned long length, unsigned long nharms);
  */
 GTABLE * sawtable(unsigned long length, unsigned long nharms, int UP);
 
+/**
+ * Create a sawtooth-wave lookup table with a given allocator (see sawtable).
+ * @param alloc - the allocator, or NULL for the heap
+ */
+GTABLE * sawtable_a(unsigned long length, unsigned long nharms, int UP, const DSPALLOC * alloc);
+
 /**
  * Create a pulse-wave lookup table for a given length.
  * @param length - the sample size of the lookup oscillator
@@ -89,6 +122,35 @@ GTABLE * sawtable(unsigned long length, unsigned long nharms, int UP);
  */
 GTABLE * pulsetable(unsigned long length, unsigned long nharms);
 
+/**
+ * Create a pulse-wave lookup table with a given allocator (see pulsetable).
+ * @param alloc - the allocator, or NULL for the heap
+ */
+GTABLE * pulsetable_a(unsigned long length, unsigned long nharms, const DSPALLOC * alloc);
+
+/**
+ * Create a lookup table from one cycle of an arbitrary waveform. The samples are copied unscaled and the guard
+ * point is added; use normaliseTable to scale it like the harmonic tables.
+ * @param cycle - the samples of one cycle
+ * @param length - the number of samples (the table length)
+ * @return pointer to a GTABLE object allocated on the heap, or NULL if unsuccessful.
+ */
+GTABLE * cycletable(const double * cycle, unsigned long length);
+
+/**
+ * Create a lookup table from one cycle of an arbitrary waveform with a given allocator (see cycletable).
+ * @param alloc - the allocator, or NULL for the heap
+ */
+GTABLE * cycletable_a(const double * cycle, unsigned long length, const DSPALLOC * alloc);
+
+/**
+ * Normalise a table by its maximum amplitude and refresh its guard point, as the harmonic table constructors do.
+ * A silent table is left unchanged.
+ * @param table - pointer to a GTABLE object
+ * @return the gain applied, or 0 if the table is silent
+ */
+double normaliseTable(GTABLE * table);
+
 /**
  * Create a TOSCIL lookup table oscillator object for a given GTABLE lookup table containing a predefined waveform.
  * @param fs - The sample rate of the system
@@ -98,6 +160,19 @@ GTABLE * pulsetable(unsigned long length, unsigned long nharms);
  */
 TOSCIL * oscil_t(double fs, double phase, GTABLE * gtable);
 
+/**
+ * Create a TOSCIL lookup table oscillator object with a given allocator (see oscil_t).
+ * @param alloc - the allocator, or NULL for the heap
+ */
+TOSCIL * oscil_t_a(double fs, double phase, GTABLE * gtable, const DSPALLOC * alloc);
+
+/**
+ * Destroy a TOSCIL object created by oscil_t_a. The lookup table is not freed.
+ * @param oscil - pointer to a pointer for the TOSCIL object, set to NULL on return
+ * @param alloc - the allocator the object was created with
+ */
+void freeTOscil_a(TOSCIL ** oscil, const DSPALLOC * alloc);
+
 /**
  * Performs a truncated lookup for a given TOSCIL lookup table oscillator
  * @param oscil - pointer to a lookup table oscillator with a predefined waveform
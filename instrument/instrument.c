@@ -0,0 +1,247 @@
+#include "instrument.h"
+#include <sched.h>
+#include <time.h>
+
+/**
+ * Number of attempts dsp_probe_snapshot makes at a consistent copy before giving up.
+ */
+#define SNAPSHOT_TRIES 1000
+
+#define NWORDS (sizeof(DSPPROBESTATS) / sizeof(uint64_t))
+
+/**
+ * Defines the schema for a probe slot: the statistics guarded by a sequence number which is odd while a
+ * writer is updating them. Slots are cache-line aligned so probes used by different threads do not share lines.
+ */
+typedef struct probeslot {
+    uint64_t seq;
+    DSPPROBESTATS stats;
+} __attribute__((aligned(64))) PROBESLOT;
+
+static PROBESLOT probes[DSP_NPROBES];
+
+static const char * probeNames[DSP_NPROBES] = {
+    "block", "oscil", "taboscil", "bpstick", "bpsrender", "pan", "spatial", "sweepgen", "convolve", "graph"
+};
+
+static double cyclesPerSecond;
+
+#ifdef DSP_INSTRUMENT
+/**
+ * Map a cycle count to its histogram bucket: the exponent selects a group of 2^DSP_PROBE_SUBBITS buckets and
+ * the bits below the leading one select the bucket within it. Counts below 2^DSP_PROBE_SUBBITS map directly.
+ * Only the recording path needs it, so it is compiled with the probes.
+ * @param cycles - the cycle count
+ * @return the bucket index
+ */
+static unsigned int bucketIndex(uint64_t cycles);
+#endif
+
+/**
+ * The largest cycle count falling into a histogram bucket (the inverse of bucketIndex).
+ * @param bucket - the bucket index
+ * @return the bucket's upper bound in cycles
+ */
+static uint64_t bucketUpper(unsigned int bucket);
+
+/**
+ * Acquire a probe slot for writing from a non-realtime thread, waiting for any writer to finish.
+ * @param slot - pointer to the slot
+ * @return the (even) sequence number before acquisition
+ */
+static uint64_t lockSlot(PROBESLOT * slot);
+
+#ifdef DSP_INSTRUMENT
+static unsigned int bucketIndex(uint64_t cycles) {
+    unsigned int msb;
+    if(cycles < (1u << DSP_PROBE_SUBBITS)) {
+        return (unsigned int) cycles;
+    }
+    msb = 63 - __builtin_clzll(cycles);
+    return ((msb - DSP_PROBE_SUBBITS + 1) << DSP_PROBE_SUBBITS) +
+           (unsigned int) ((cycles >> (msb - DSP_PROBE_SUBBITS)) & ((1u << DSP_PROBE_SUBBITS) - 1));
+}
+#endif
+
+static uint64_t bucketUpper(unsigned int bucket) {
+    unsigned int msb, sub;
+    if(bucket < (1u << DSP_PROBE_SUBBITS)) {
+        return bucket;
+    }
+    msb = (bucket >> DSP_PROBE_SUBBITS) - 1 + DSP_PROBE_SUBBITS;
+    sub = bucket & ((1u << DSP_PROBE_SUBBITS) - 1);
+    return ((((uint64_t) 1 << DSP_PROBE_SUBBITS) + sub) << (msb - DSP_PROBE_SUBBITS)) +
+           ((uint64_t) 1 << (msb - DSP_PROBE_SUBBITS)) - 1;
+}
+
+static uint64_t lockSlot(PROBESLOT * slot) {
+    uint64_t seq;
+    for(;;) {
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+        if(!(seq & 1) && __atomic_compare_exchange_n(&slot->seq, &seq, seq + 1, 0, __ATOMIC_ACQUIRE,
+                                                     __ATOMIC_RELAXED)) {
+            return seq;
+        }
+        sched_yield();
+    }
+}
+
+void dsp_probe_record(int probe, uint64_t cycles, unsigned long items) {
+#ifdef DSP_INSTRUMENT
+    PROBESLOT * slot;
+    DSPPROBESTATS * stats;
+    uint64_t seq, count, deadline;
+    unsigned int bucket;
+
+    if(probe < 0 || probe >= DSP_NPROBES) {
+        return;
+    }
+    slot = &probes[probe];
+    stats = &slot->stats;
+    /* Never wait on the audio path: if another writer holds the probe, count the call as dropped */
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    if((seq & 1) || !__atomic_compare_exchange_n(&slot->seq, &seq, seq + 1, 0, __ATOMIC_ACQUIRE,
+                                                 __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&stats->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    /* Fields are written with relaxed atomics as the reader may be copying them concurrently */
+    count = __atomic_load_n(&stats->count, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->count, count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->items, __atomic_load_n(&stats->items, __ATOMIC_RELAXED) + items, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->total, __atomic_load_n(&stats->total, __ATOMIC_RELAXED) + cycles, __ATOMIC_RELAXED);
+    if(!count || cycles < __atomic_load_n(&stats->min, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&stats->min, cycles, __ATOMIC_RELAXED);
+    }
+    if(cycles > __atomic_load_n(&stats->max, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&stats->max, cycles, __ATOMIC_RELAXED);
+    }
+    deadline = __atomic_load_n(&stats->deadline, __ATOMIC_RELAXED);
+    if(deadline && cycles > deadline) {
+        __atomic_store_n(&stats->misses, __atomic_load_n(&stats->misses, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    }
+    bucket = bucketIndex(cycles);
+    __atomic_store_n(&stats->histogram[bucket], __atomic_load_n(&stats->histogram[bucket], __ATOMIC_RELAXED) + 1,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+#else
+    (void) probe;
+    (void) cycles;
+    (void) items;
+#endif
+}
+
+void dsp_probe_setdeadline(int probe, uint64_t cycles) {
+    if(probe >= 0 && probe < DSP_NPROBES) {
+        __atomic_store_n(&probes[probe].stats.deadline, cycles, __ATOMIC_RELAXED);
+    }
+}
+
+int dsp_probe_snapshot(int probe, DSPPROBESTATS * stats) {
+#ifdef DSP_INSTRUMENT
+    PROBESLOT * slot;
+    uint64_t * src, * dst;
+    uint64_t before, after;
+    unsigned long i;
+    int tries;
+
+    if(probe < 0 || probe >= DSP_NPROBES || !stats) {
+        return 0;
+    }
+    slot = &probes[probe];
+    src = (uint64_t *) &slot->stats;
+    dst = (uint64_t *) stats;
+    for(tries = 0; tries < SNAPSHOT_TRIES; tries++) {
+        before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if(before & 1) {
+            continue;
+        }
+        for(i = 0; i < NWORDS; i++) {
+            dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+        if(before == after) {
+            if(!stats->count) {
+                stats->min = UINT64_MAX;
+            }
+            return 1;
+        }
+    }
+    return 0;
+#else
+    (void) probe;
+    (void) stats;
+    return 0;
+#endif
+}
+
+void dsp_probe_reset(int probe) {
+    PROBESLOT * slot;
+    uint64_t * words;
+    uint64_t seq, deadline;
+    unsigned long i;
+
+    if(probe < 0 || probe >= DSP_NPROBES) {
+        return;
+    }
+    slot = &probes[probe];
+    words = (uint64_t *) &slot->stats;
+    seq = lockSlot(slot);
+    deadline = __atomic_load_n(&slot->stats.deadline, __ATOMIC_RELAXED);
+    for(i = 0; i < NWORDS; i++) {
+        __atomic_store_n(&words[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&slot->stats.deadline, deadline, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+uint64_t dsp_probe_percentile(const DSPPROBESTATS * stats, double percentile) {
+    uint64_t target, sum = 0, upper;
+    unsigned int i;
+
+    if(!stats || !stats->count) {
+        return 0;
+    }
+    percentile = percentile < 0.0 ? 0.0 : (percentile > 100.0 ? 100.0 : percentile);
+    target = (uint64_t) (percentile * 0.01 * stats->count + 0.5);
+    if(!target) {
+        target = 1;
+    }
+    for(i = 0; i < DSP_PROBE_BUCKETS; i++) {
+        sum += stats->histogram[i];
+        if(sum >= target) {
+            upper = bucketUpper(i);
+            return upper < stats->max ? upper : stats->max;
+        }
+    }
+    return stats->max;
+}
+
+const char * dsp_probe_name(int probe) {
+    if(probe < 0 || probe >= DSP_NPROBES) {
+        return NULL;
+    }
+    return probeNames[probe];
+}
+
+double dsp_cycles_per_second(void) {
+    struct timespec start, now;
+    uint64_t c0, c1;
+    double rate, elapsed;
+
+    __atomic_load(&cyclesPerSecond, &rate, __ATOMIC_RELAXED);
+    if(rate > 0.0) {
+        return rate;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    c0 = dsp_cycles();
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = (double) (now.tv_sec - start.tv_sec) + (double) (now.tv_nsec - start.tv_nsec) * 1e-9;
+    } while(elapsed < 0.01);
+    c1 = dsp_cycles();
+    rate = (double) (c1 - c0) / elapsed;
+    __atomic_store(&cyclesPerSecond, &rate, __ATOMIC_RELAXED);
+    return rate;
+}
@@ -0,0 +1,150 @@
+#ifndef _INSTRUMENT_H_
+#define _INSTRUMENT_H_
+
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif !defined(__aarch64__)
+#include <time.h>
+#endif
+
+/**
+ * Hot-path instrumentation.
+ *
+ * Build with DSP_INSTRUMENT defined to compile probes into the main entry points. Each probe records the
+ * cycle count of every call into a per-probe histogram with count, total, min and max, and counts calls that
+ * exceed the probe's deadline. Without DSP_INSTRUMENT the probe macros expand to nothing and the snapshot API
+ * reports that no data is available, so the hot paths are unchanged.
+ *
+ * The audio threads only ever write; a monitoring thread polls dsp_probe_snapshot. Each probe is guarded by a
+ * sequence lock: writers never wait (a call that finds the probe held by another writer, eg. two graph
+ * workers convolving at once, is counted as dropped instead of recorded), and readers retry until they copy a
+ * consistent snapshot.
+ */
+
+/**
+ * Probe enumeration for the instrumented entry points. DSP_PROBE_BLOCK is not used by the library and is free
+ * for the host to wrap its own audio callback, giving whole-block timings to compare against the others.
+ */
+enum {
+    DSP_PROBE_BLOCK,
+    DSP_PROBE_OSCIL,
+    DSP_PROBE_TABOSCIL,
+    DSP_PROBE_BPSTICK,
+    DSP_PROBE_BPSRENDER,
+    DSP_PROBE_PAN,
+    DSP_PROBE_SPATIAL,
+    DSP_PROBE_SWEEPGEN,
+    DSP_PROBE_CONVOLVE,
+    DSP_PROBE_GRAPH,
+    DSP_NPROBES
+};
+
+/**
+ * Histogram resolution: each power of two of cycles is split into 2^DSP_PROBE_SUBBITS buckets (about 19% wide).
+ */
+#define DSP_PROBE_SUBBITS 2
+#define DSP_PROBE_BUCKETS (64 << DSP_PROBE_SUBBITS)
+
+/**
+ * Defines the schema for a probe snapshot.
+ * @param count - the number of recorded calls
+ * @param items - the total number of items (eg. samples) processed by the recorded calls
+ * @param total - the total cycles of the recorded calls
+ * @param min,max - the fastest and slowest recorded call in cycles (min is UINT64_MAX before any call)
+ * @param deadline - the deadline in cycles (0 for none)
+ * @param misses - the number of calls slower than the deadline
+ * @param dropped - the number of calls not recorded because another thread held the probe
+ * @param histogram - call counts per cycle bucket (see dsp_probe_percentile)
+ */
+typedef struct dspprobestats {
+    uint64_t count;
+    uint64_t items;
+    uint64_t total;
+    uint64_t min, max;
+    uint64_t deadline;
+    uint64_t misses;
+    uint64_t dropped;
+    uint64_t histogram[DSP_PROBE_BUCKETS];
+} DSPPROBESTATS;
+
+/**
+ * Read the cycle counter: the TSC on x86, the virtual counter on AArch64, otherwise the monotonic clock in ns.
+ * @return the current counter value
+ */
+static inline uint64_t dsp_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t val;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (val));
+    return val;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+#ifdef DSP_INSTRUMENT
+#define DSP_PROBE_BEGIN(start) uint64_t start = dsp_cycles()
+#define DSP_PROBE_END(probe, start, nitems) dsp_probe_record((probe), dsp_cycles() - (start), (nitems))
+#else
+#define DSP_PROBE_BEGIN(start)
+#define DSP_PROBE_END(probe, start, nitems)
+#endif
+
+/**
+ * Record one call. Normally used through DSP_PROBE_BEGIN/DSP_PROBE_END. Never blocks.
+ * @param probe - the probe (DSP_PROBE_BLOCK to DSP_NPROBES - 1)
+ * @param cycles - the duration of the call in cycles
+ * @param items - the number of items the call processed
+ */
+void dsp_probe_record(int probe, uint64_t cycles, unsigned long items);
+
+/**
+ * Set the deadline for a probe. Calls slower than the deadline are counted as misses.
+ * @param probe - the probe
+ * @param cycles - the deadline in cycles, or 0 to disable (see dsp_cycles_per_second)
+ */
+void dsp_probe_setdeadline(int probe, uint64_t cycles);
+
+/**
+ * Copy a consistent snapshot of a probe. Safe to call from any thread while the probe is being recorded.
+ * @param probe - the probe
+ * @param stats - pointer to the DSPPROBESTATS to fill
+ * @return boolean integer, 0 if instrumentation is compiled out, the probe is invalid or no consistent copy
+ * could be taken (retry later)
+ */
+int dsp_probe_snapshot(int probe, DSPPROBESTATS * stats);
+
+/**
+ * Clear the counters and histogram of a probe, keeping its deadline. May briefly wait for a writer.
+ * @param probe - the probe
+ */
+void dsp_probe_reset(int probe);
+
+/**
+ * Estimate a percentile of the call durations from a snapshot's histogram.
+ * @param stats - pointer to a snapshot
+ * @param percentile - the percentile (0 to 100)
+ * @return the upper bound of the bucket containing the percentile in cycles, clamped to the observed max
+ * (0 if no calls were recorded)
+ */
+uint64_t dsp_probe_percentile(const DSPPROBESTATS * stats, double percentile);
+
+/**
+ * Get the name of a probe (eg. "convolve").
+ * @param probe - the probe
+ * @return the name, or NULL for an invalid probe
+ */
+const char * dsp_probe_name(int probe);
+
+/**
+ * Measure the rate of dsp_cycles against the monotonic clock (about 10 ms on the first call, cached after).
+ * Useful to convert a block period into a deadline: blocksize / fs * dsp_cycles_per_second().
+ * @return counter ticks per second
+ */
+double dsp_cycles_per_second(void);
+
+#endif
@@ -0,0 +1,456 @@
+#include "measure.h"
+#include "sweep.h"
+#include "parallel.h"
+#include <kiss_fftr.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * Shared state for the deconvolution workers.
+ */
+typedef struct measurejob {
+    const double * const * recordings;
+    unsigned int nchans;
+    unsigned long reclen;
+    const IRSPEC * spec;
+    IRMEASURE * irs;
+    const kiss_fft_cpx * filter;
+    unsigned long nfft;
+    unsigned long sweeplen;
+    unsigned int next;
+    int failed;
+} MEASUREJOB;
+
+/**
+ * The effective sweep start frequency (adjusted for synchronized sweeps).
+ */
+static double sweepStart(const IRSPEC * spec);
+
+/**
+ * Compute the normalised inverse filter spectrum, including the 1/nfft scaling of the inverse FFT.
+ * @return boolean integer specifying whether the spectrum was computed
+ */
+static int inverseSpectrum(const IRSPEC * spec, unsigned long nfft, kiss_fft_cpx * filter);
+
+/**
+ * Multiply a half spectrum by the inverse filter spectrum in place.
+ */
+static void applyFilter(kiss_fft_cpx * spectrum, const kiss_fft_cpx * filter, unsigned long nfft);
+
+/**
+ * Allocate the harmonic arrays of an IRMEASURE object.
+ * @return boolean integer specifying whether the allocation succeeded
+ */
+static int allocResult(IRMEASURE * ir, unsigned int nharmonics);
+
+/**
+ * Window the linear and harmonic IRs out of a deconvolution output.
+ * @return boolean integer specifying whether the IRs were allocated
+ */
+static int extractIRs(const IRSPEC * spec, IRMEASURE * ir, const kiss_fft_scalar * timebuf,
+                      unsigned long nfft, unsigned long sweeplen);
+
+/**
+ * Deconvolve one channel and extract its linear and harmonic IRs.
+ * @return boolean integer specifying whether the channel was processed
+ */
+static int deconvolve(MEASUREJOB * job, unsigned int chan, kiss_fftr_cfg fwd, kiss_fftr_cfg inv,
+                      kiss_fft_scalar * timebuf, kiss_fft_cpx * freqbuf);
+
+/**
+ * Copy a window of the deconvolution output into a newly allocated IR.
+ */
+static double * extractIR(const kiss_fft_scalar * timebuf, long start, unsigned long length);
+
+/**
+ * Worker thread: claims channels until none remain.
+ */
+static void measureWorker(void * arg);
+
+static double sweepStart(const IRSPEC * spec) {
+    return spec->synchronized ? essgen_syncfreq(spec->T, spec->startFreq, spec->endFreq) : spec->startFreq;
+}
+
+static int inverseSpectrum(const IRSPEC * spec, unsigned long nfft, kiss_fft_cpx * filter) {
+    ESSGEN * gen;
+    kiss_fftr_cfg cfg;
+    kiss_fft_scalar * timebuf;
+    kiss_fft_cpx * sweepspec;
+    unsigned long i, bin;
+    double * block, gain, scale;
+    double startFreq = sweepStart(spec);
+    int ok = 0;
+
+    gen = newSweepGen(spec->T, spec->fs, startFreq, spec->endFreq);
+    cfg = kiss_fftr_alloc((int) nfft, 0, NULL, NULL);
+    timebuf = (kiss_fft_scalar *) calloc(nfft, sizeof(kiss_fft_scalar));
+    sweepspec = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * (nfft / 2 + 1));
+    block = (double *) malloc(sizeof(double) * ESS_RESYNC);
+    if(!gen || !cfg || !timebuf || !sweepspec || !block) {
+        goto done;
+    }
+
+    /* Stream the forward sweep and then the inverse filter into the (zero padded) FFT buffer */
+    for(i = 0; i < gen->size; i += ESS_RESYNC) {
+        unsigned long j, n = essgen_forward(gen, block, ESS_RESYNC);
+        for(j = 0; j < n; j++) {
+            timebuf[i + j] = (kiss_fft_scalar) block[j];
+        }
+    }
+    kiss_fftr(cfg, timebuf, sweepspec);
+    for(i = 0; i < gen->size; i += ESS_RESYNC) {
+        unsigned long j, n = essgen_inverse(gen, block, ESS_RESYNC);
+        for(j = 0; j < n; j++) {
+            timebuf[i + j] = (kiss_fft_scalar) block[j];
+        }
+    }
+    kiss_fftr(cfg, timebuf, filter);
+
+    /* Unit gain for the sweep itself at the geometric centre of the band */
+    bin = (unsigned long) (sqrt(startFreq * spec->endFreq) * nfft / spec->fs + 0.5);
+    gain = hypot(sweepspec[bin].r * filter[bin].r - sweepspec[bin].i * filter[bin].i,
+                 sweepspec[bin].r * filter[bin].i + sweepspec[bin].i * filter[bin].r);
+    if(gain <= 0.0) {
+        goto done;
+    }
+    scale = 1.0 / (gain * nfft);
+    for(i = 0; i <= nfft / 2; i++) {
+        filter[i].r *= scale;
+        filter[i].i *= scale;
+    }
+    ok = 1;
+
+done:
+    clearSweepGen(&gen);
+    kiss_fftr_free(cfg);
+    free(timebuf);
+    free(sweepspec);
+    free(block);
+    return ok;
+}
+
+static double * extractIR(const kiss_fft_scalar * timebuf, long start, unsigned long length) {
+    unsigned long i;
+    double * ir = (double *) malloc(sizeof(double) * (length ? length : 1));
+    if(ir) {
+        for(i = 0; i < length; i++) {
+            ir[i] = (double) timebuf[start + i];
+        }
+    }
+    return ir;
+}
+
+static void applyFilter(kiss_fft_cpx * spectrum, const kiss_fft_cpx * filter, unsigned long nfft) {
+    unsigned long i;
+    for(i = 0; i <= nfft / 2; i++) {
+        kiss_fft_scalar re = spectrum[i].r * filter[i].r - spectrum[i].i * filter[i].i;
+        spectrum[i].i = spectrum[i].r * filter[i].i + spectrum[i].i * filter[i].r;
+        spectrum[i].r = re;
+    }
+}
+
+static int allocResult(IRMEASURE * ir, unsigned int nharmonics) {
+    ir->nharmonics = nharmonics;
+    if(nharmonics) {
+        ir->harmonics = (double **) calloc(nharmonics, sizeof(double *));
+        ir->harmlens = (unsigned long *) calloc(nharmonics, sizeof(unsigned long));
+        if(!ir->harmonics || !ir->harmlens) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int extractIRs(const IRSPEC * spec, IRMEASURE * ir, const kiss_fft_scalar * timebuf,
+                      unsigned long nfft, unsigned long sweeplen) {
+    double rate = spec->fs * spec->T / log(spec->endFreq / sweepStart(spec));
+    long onset = (long) sweeplen - 1;
+    long start, prevoffset = 0;
+    unsigned long length;
+    unsigned int k;
+
+    /* The linear IR starts where the sweep onset lands in the full convolution */
+    start = onset - (long) spec->predelay;
+    if(start < 0) {
+        start = 0;
+    }
+    length = spec->predelay + spec->irlength;
+    if(length > nfft - (unsigned long) start) {
+        length = nfft - (unsigned long) start;
+    }
+    ir->linlen = length;
+    if(!(ir->linear = extractIR(timebuf, start, length))) {
+        return 0;
+    }
+
+    /* Harmonic k sits rate * ln(k) samples earlier; its window must stop where harmonic k - 1 begins */
+    for(k = 0; k < ir->nharmonics; k++) {
+        long offset = (long) (rate * log(k + 2.0) + 0.5);
+        start = onset - offset - (long) spec->predelay;
+        length = spec->predelay + spec->irlength;
+        if(length > (unsigned long) (offset - prevoffset)) {
+            length = (unsigned long) (offset - prevoffset);
+        }
+        if(start < 0) {
+            length = 0;
+            start = 0;
+        }
+        prevoffset = offset;
+        ir->harmlens[k] = length;
+        if(!(ir->harmonics[k] = extractIR(timebuf, start, length))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int deconvolve(MEASUREJOB * job, unsigned int chan, kiss_fftr_cfg fwd, kiss_fftr_cfg inv,
+                      kiss_fft_scalar * timebuf, kiss_fft_cpx * freqbuf) {
+    const double * rec = job->recordings[chan];
+    unsigned long i;
+
+    for(i = 0; i < job->reclen; i++) {
+        timebuf[i] = (kiss_fft_scalar) rec[i];
+    }
+    memset(timebuf + job->reclen, 0, sizeof(kiss_fft_scalar) * (job->nfft - job->reclen));
+    kiss_fftr(fwd, timebuf, freqbuf);
+    applyFilter(freqbuf, job->filter, job->nfft);
+    kiss_fftri(inv, freqbuf, timebuf);
+    return extractIRs(job->spec, job->irs + chan, timebuf, job->nfft, job->sweeplen);
+}
+
+static void measureWorker(void * arg) {
+    MEASUREJOB * job = (MEASUREJOB *) arg;
+    kiss_fftr_cfg fwd = kiss_fftr_alloc((int) job->nfft, 0, NULL, NULL);
+    kiss_fftr_cfg inv = kiss_fftr_alloc((int) job->nfft, 1, NULL, NULL);
+    kiss_fft_scalar * timebuf = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * job->nfft);
+    kiss_fft_cpx * freqbuf = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * (job->nfft / 2 + 1));
+    unsigned int chan;
+
+    if(!fwd || !inv || !timebuf || !freqbuf) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+    else {
+        while(!__atomic_load_n(&job->failed, __ATOMIC_RELAXED) &&
+              (chan = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nchans) {
+            if(!deconvolve(job, chan, fwd, inv, timebuf, freqbuf)) {
+                __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    kiss_fftr_free(fwd);
+    kiss_fftr_free(inv);
+    free(timebuf);
+    free(freqbuf);
+}
+
+IRMEASURE * measure_ir(const double * const * recordings, unsigned int nchans, unsigned long reclen,
+                       const IRSPEC * spec, char ** errMsg) {
+    MEASUREJOB job;
+    kiss_fft_cpx * filter;
+    unsigned int i;
+
+    if(!nchans || !reclen || spec->T <= 0.0 || spec->fs <= 0.0 ||
+       spec->startFreq <= 0.0 || spec->endFreq <= spec->startFreq) {
+        *errMsg = "Invalid measurement settings";
+        return NULL;
+    }
+    memset(&job, 0, sizeof(MEASUREJOB));
+    job.recordings = recordings;
+    job.nchans = nchans;
+    job.reclen = reclen;
+    job.spec = spec;
+    job.sweeplen = (unsigned long) (spec->T * spec->fs);
+    /* Linear convolution of the recording with the inverse filter, without wrap-around */
+    job.nfft = (unsigned long) kiss_fftr_next_fast_size_real((int) (reclen + job.sweeplen - 1));
+
+    /* Allocate the results so workers only fill them in */
+    job.irs = (IRMEASURE *) calloc(nchans, sizeof(IRMEASURE));
+    if(!job.irs) {
+        *errMsg = "Could not allocate measurement results";
+        return NULL;
+    }
+    for(i = 0; i < nchans; i++) {
+        if(!allocResult(job.irs + i, spec->nharmonics)) {
+            clearMeasurements(&job.irs, nchans);
+            *errMsg = "Could not allocate measurement results";
+            return NULL;
+        }
+    }
+
+    filter = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * (job.nfft / 2 + 1));
+    if(!filter || !inverseSpectrum(spec, job.nfft, filter)) {
+        free(filter);
+        clearMeasurements(&job.irs, nchans);
+        *errMsg = "Could not compute the inverse filter spectrum";
+        return NULL;
+    }
+    job.filter = filter;
+
+    /* The calling thread works too; extra threads that fail to start just leave it more channels */
+    dsp_parallel_for(measureWorker, &job, nchans, spec->nthreads);
+    free(filter);
+
+    if(job.failed) {
+        clearMeasurements(&job.irs, nchans);
+        *errMsg = "Could not allocate deconvolution buffers";
+        return NULL;
+    }
+    return job.irs;
+}
+
+void clearMeasurements(IRMEASURE ** irs, unsigned int nchans) {
+    unsigned int i, k;
+    if(irs && *irs) {
+        for(i = 0; i < nchans; i++) {
+            free((*irs)[i].linear);
+            if((*irs)[i].harmonics) {
+                for(k = 0; k < (*irs)[i].nharmonics; k++) {
+                    free((*irs)[i].harmonics[k]);
+                }
+            }
+            free((*irs)[i].harmonics);
+            free((*irs)[i].harmlens);
+        }
+        free(*irs);
+        *irs = NULL;
+    }
+}
+
+SWEEPAVG * new_SWEEPAVG(const IRSPEC * spec, unsigned long reclen, double rejectfactor, char ** errMsg) {
+    SWEEPAVG * avg;
+    unsigned long sweeplen, nbins;
+
+    if(!reclen || spec->T <= 0.0 || spec->fs <= 0.0 ||
+       spec->startFreq <= 0.0 || spec->endFreq <= spec->startFreq) {
+        *errMsg = "Invalid measurement settings";
+        return NULL;
+    }
+    avg = (SWEEPAVG *) calloc(1, sizeof(SWEEPAVG));
+    if(!avg) {
+        *errMsg = "Could not allocate memory for SWEEPAVG structure";
+        return NULL;
+    }
+    avg->spec = *spec;
+    avg->reclen = reclen;
+    avg->rejectfactor = rejectfactor;
+    sweeplen = (unsigned long) (spec->T * spec->fs);
+    avg->nfft = (unsigned long) kiss_fftr_next_fast_size_real((int) (reclen + sweeplen - 1));
+    nbins = avg->nfft / 2 + 1;
+
+    avg->fwd = kiss_fftr_alloc((int) avg->nfft, 0, NULL, NULL);
+    avg->inv = kiss_fftr_alloc((int) avg->nfft, 1, NULL, NULL);
+    avg->filter = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * nbins);
+    avg->mean = (kiss_fft_cpx *) calloc(nbins, sizeof(kiss_fft_cpx));
+    avg->m2 = (double *) calloc(nbins, sizeof(double));
+    avg->timebuf = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * avg->nfft);
+    avg->freqbuf = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * nbins);
+    if(!avg->fwd || !avg->inv || !avg->filter || !avg->mean || !avg->m2 || !avg->timebuf || !avg->freqbuf) {
+        clear_SWEEPAVG(&avg);
+        *errMsg = "Could not allocate SWEEPAVG buffers";
+        return NULL;
+    }
+    if(!inverseSpectrum(spec, avg->nfft, avg->filter)) {
+        clear_SWEEPAVG(&avg);
+        *errMsg = "Could not compute the inverse filter spectrum";
+        return NULL;
+    }
+    return avg;
+}
+
+int sweepavg_push(SWEEPAVG * avg, const double * recording) {
+    unsigned long i, nbins = avg->nfft / 2 + 1;
+    double n, dr, di, deviation = 0.0, variance = 0.0, signal = 0.0;
+
+    for(i = 0; i < avg->reclen; i++) {
+        avg->timebuf[i] = (kiss_fft_scalar) recording[i];
+    }
+    memset(avg->timebuf + avg->reclen, 0, sizeof(kiss_fft_scalar) * (avg->nfft - avg->reclen));
+    kiss_fftr(avg->fwd, avg->timebuf, avg->freqbuf);
+    applyFilter(avg->freqbuf, avg->filter, avg->nfft);
+
+    /* Reject repetitions whose distance from the mean is far beyond the spread seen so far */
+    if(avg->rejectfactor > 0.0 && avg->count >= SWEEPAVG_MINCOUNT) {
+        for(i = 0; i < nbins; i++) {
+            dr = avg->freqbuf[i].r - avg->mean[i].r;
+            di = avg->freqbuf[i].i - avg->mean[i].i;
+            deviation += dr * dr + di * di;
+            variance += avg->m2[i];
+            signal += (double) avg->mean[i].r * avg->mean[i].r + (double) avg->mean[i].i * avg->mean[i].i;
+        }
+        variance /= (double) (avg->count - 1);
+        /* Identical early repetitions leave no spread, which would reject everything after them */
+        if(variance < SWEEPAVG_VARFLOOR * signal) {
+            variance = SWEEPAVG_VARFLOOR * signal;
+        }
+        signal = 0.0;
+        if(deviation > avg->rejectfactor * variance) {
+            avg->rejected++;
+            return 0;
+        }
+    }
+
+    /* Welford update of the per-bin complex mean and squared deviation */
+    avg->count++;
+    n = (double) avg->count;
+    variance = 0.0;
+    for(i = 0; i < nbins; i++) {
+        dr = avg->freqbuf[i].r - avg->mean[i].r;
+        di = avg->freqbuf[i].i - avg->mean[i].i;
+        avg->mean[i].r += (kiss_fft_scalar) (dr / n);
+        avg->mean[i].i += (kiss_fft_scalar) (di / n);
+        avg->m2[i] += dr * (avg->freqbuf[i].r - avg->mean[i].r) + di * (avg->freqbuf[i].i - avg->mean[i].i);
+        variance += avg->m2[i];
+        signal += (double) avg->mean[i].r * avg->mean[i].r + (double) avg->mean[i].i * avg->mean[i].i;
+    }
+
+    /* Noise left in the mean: the summed per-bin variance over the repetition count */
+    if(avg->count >= 2) {
+        double noise = variance / (n - 1.0) / n;
+        signal -= noise;
+        avg->snr = noise > 0.0 ? 10.0 * log10((signal > noise * 1e-12 ? signal : noise * 1e-12) / noise) : HUGE_VAL;
+    }
+    return 1;
+}
+
+double sweepavg_snr(const SWEEPAVG * avg) {
+    return avg->snr;
+}
+
+IRMEASURE * sweepavg_result(SWEEPAVG * avg, char ** errMsg) {
+    IRMEASURE * ir;
+
+    if(!avg->count) {
+        *errMsg = "No repetitions have been averaged";
+        return NULL;
+    }
+    ir = (IRMEASURE *) calloc(1, sizeof(IRMEASURE));
+    if(!ir || !allocResult(ir, avg->spec.nharmonics)) {
+        clearMeasurements(&ir, 1);
+        *errMsg = "Could not allocate measurement results";
+        return NULL;
+    }
+    memcpy(avg->freqbuf, avg->mean, sizeof(kiss_fft_cpx) * (avg->nfft / 2 + 1));
+    kiss_fftri(avg->inv, avg->freqbuf, avg->timebuf);
+    if(!extractIRs(&avg->spec, ir, avg->timebuf, avg->nfft, (unsigned long) (avg->spec.T * avg->spec.fs))) {
+        clearMeasurements(&ir, 1);
+        *errMsg = "Could not allocate measurement results";
+        return NULL;
+    }
+    return ir;
+}
+
+void clear_SWEEPAVG(SWEEPAVG ** avg) {
+    if(avg && *avg) {
+        kiss_fftr_free((*avg)->fwd);
+        kiss_fftr_free((*avg)->inv);
+        free((*avg)->filter);
+        free((*avg)->mean);
+        free((*avg)->m2);
+        free((*avg)->timebuf);
+        free((*avg)->freqbuf);
+        free(*avg);
+        *avg = NULL;
+    }
+}
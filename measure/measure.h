@@ -0,0 +1,168 @@
+#ifndef MEASURE_H
+#define MEASURE_H
+
+#include <kiss_fftr.h>
+
+/**
+ * Defines the sweep and analysis settings for an impulse response measurement.
+ *
+ * @param T - the sweep duration in seconds
+ * @param fs - the sample rate
+ * @param startFreq - the sweep start frequency in Hz
+ * @param endFreq - the sweep end frequency in Hz (above startFreq: harmonic separation needs an up-sweep)
+ * @param irlength - the maximum length of each extracted impulse response in samples
+ * @param predelay - samples kept before each impulse response onset (captures non-causal ringing)
+ * @param nharmonics - the number of harmonic distortion IRs to extract (orders 2 to nharmonics + 1)
+ * @param nthreads - the number of worker threads; 0 uses one per online processor
+ * @param synchronized - boolean integer specifying a synchronized sweep (start frequency adjusted by essgen_syncfreq)
+ */
+typedef struct irspec {
+    double T;
+    double fs;
+    double startFreq;
+    double endFreq;
+    unsigned long irlength;
+    unsigned long predelay;
+    unsigned int nharmonics;
+    unsigned int nthreads;
+    int synchronized;
+} IRSPEC;
+
+/**
+ * Defines the schema for the impulse responses measured on one channel.
+ *
+ * The deconvolved response of an exponential sweep places the k-th harmonic's IR L*ln(k) seconds before the
+ * linear IR (L = T / ln(f2/f1)), so the harmonics are separated by windowing the deconvolution output.
+ *
+ * @param linear - the linear impulse response
+ * @param linlen - the length of the linear impulse response
+ * @param harmonics - the harmonic distortion IRs, harmonics[0] holding the 2nd harmonic
+ * @param harmlens - the length of each harmonic IR (0 if it falls outside the recording)
+ * @param nharmonics - the number of harmonic IRs
+ */
+typedef struct irmeasure {
+    double * linear;
+    unsigned long linlen;
+    double ** harmonics;
+    unsigned long * harmlens;
+    unsigned int nharmonics;
+} IRMEASURE;
+
+/**
+ * Defines the schema for a streaming synchronized-average of repeated sweep responses.
+ *
+ * Each repetition is transformed and deconvolved on arrival, then folded into a per-bin running mean and variance
+ * (Welford's method), so memory stays constant however many repetitions are averaged. The variance gives a running
+ * estimate of the background noise left in the mean and hence the SNR. Once enough repetitions have been seen,
+ * repetitions far from the current mean (eg. a door slam) are rejected.
+ *
+ * @param spec - copy of the measurement settings
+ * @param reclen - the length of each repetition in samples
+ * @param nfft - the real FFT size
+ * @param fwd,inv - the real FFT plans
+ * @param filter - the normalised inverse filter spectrum
+ * @param mean - the running mean spectrum of the deconvolved repetitions
+ * @param m2 - the running sum of squared deviations of each bin
+ * @param timebuf,freqbuf - FFT scratch buffers
+ * @param count - the number of repetitions accepted
+ * @param rejected - the number of repetitions rejected
+ * @param rejectfactor - rejection threshold as a multiple of the expected deviation energy (0 disables rejection)
+ * @param snr - the current SNR estimate in dB
+ */
+typedef struct sweepavg {
+    IRSPEC spec;
+    unsigned long reclen;
+    unsigned long nfft;
+    kiss_fftr_cfg fwd;
+    kiss_fftr_cfg inv;
+    kiss_fft_cpx * filter;
+    kiss_fft_cpx * mean;
+    double * m2;
+    kiss_fft_scalar * timebuf;
+    kiss_fft_cpx * freqbuf;
+    unsigned long count;
+    unsigned long rejected;
+    double rejectfactor;
+    double snr;
+} SWEEPAVG;
+
+/**
+ * Minimum number of accepted repetitions before outlier rejection starts.
+ */
+#define SWEEPAVG_MINCOUNT 3
+
+/**
+ * Floor on the deviation energy outlier rejection expects, relative to the energy of the mean (-60 dB), so that
+ * repetitions with no spread between them (eg. a loopback) do not make every later repetition an outlier.
+ */
+#define SWEEPAVG_VARFLOOR 1e-6
+
+/**
+ * Deconvolve recorded sweep responses into linear and harmonic impulse responses.
+ *
+ * Each channel is deconvolved with one large real FFT against the inverse filter spectrum, which is computed
+ * once (from the streaming sweep generator) and shared. Channels are processed in parallel by a pool of threads.
+ * IRs are normalised so that a recording of the bare sweep gives unit gain in the middle of the sweep band.
+ *
+ * @param recordings - array of nchans recorded responses, each starting at the sweep onset
+ * @param nchans - the number of channels
+ * @param reclen - the length of each recording in samples
+ * @param spec - pointer to the measurement settings
+ * @param errMsg - pointer to a string which is set to an error description on failure
+ * @return dynamically allocated array of nchans IRMEASURE objects, or NULL if unsuccessful
+ */
+IRMEASURE * measure_ir(const double * const * recordings, unsigned int nchans, unsigned long reclen,
+                       const IRSPEC * spec, char ** errMsg);
+
+/**
+ * Destroy an array of IRMEASURE objects by freeing all memory.
+ * @param irs - pointer to the array returned by measure_ir, set to NULL on return
+ * @param nchans - the number of channels in the array
+ */
+void clearMeasurements(IRMEASURE ** irs, unsigned int nchans);
+
+/**
+ * Create a streaming sweep averager. Returns NULL if unsuccessful.
+ * @param spec - pointer to the measurement settings (copied; nthreads is ignored)
+ * @param reclen - the length of each repetition in samples, starting at its sweep onset
+ * @param rejectfactor - reject repetitions whose deviation from the mean exceeds this multiple of the expected
+ *                       deviation (eg. 4.0); 0 disables rejection
+ * @param errMsg - pointer to a string which is set to an error description on failure
+ * @return pointer to a dynamically allocated SWEEPAVG object
+ */
+SWEEPAVG * new_SWEEPAVG(const IRSPEC * spec, unsigned long reclen, double rejectfactor, char ** errMsg);
+
+/**
+ * Fold one repetition into the average.
+ * @param avg - pointer to a SWEEPAVG object
+ * @param recording - the repetition, avg->reclen samples
+ * @return boolean integer, 1 if the repetition was accepted and 0 if it was rejected as an outlier
+ */
+int sweepavg_push(SWEEPAVG * avg, const double * recording);
+
+/**
+ * Obtain the current SNR estimate of the averaged response.
+ *
+ * The noise is the summed per-bin variance divided by the repetition count; the signal is the energy of the mean
+ * spectrum less that noise. Each doubling of the repetition count improves the SNR by about 3dB.
+ *
+ * @param avg - pointer to a SWEEPAVG object
+ * @return the SNR in dB (0 until two repetitions have been accepted)
+ */
+double sweepavg_snr(const SWEEPAVG * avg);
+
+/**
+ * Extract the linear and harmonic IRs of the averaged response.
+ * @param avg - pointer to a SWEEPAVG object with at least one accepted repetition
+ * @param errMsg - pointer to a string which is set to an error description on failure
+ * @return dynamically allocated IRMEASURE object (free with clearMeasurements(&ir, 1)), or NULL if unsuccessful
+ */
+IRMEASURE * sweepavg_result(SWEEPAVG * avg, char ** errMsg);
+
+/**
+ * Destroy a SWEEPAVG object by freeing all memory.
+ * @param avg - pointer to a pointer for the SWEEPAVG object, set to NULL on return
+ */
+void clear_SWEEPAVG(SWEEPAVG ** avg);
+
+#endif
@@ -1,8 +1,99 @@
 #include "pan.h"
+#include "instrument.h"
 #include <stdio.h>
 #include "breakpoint.h"
 #include <math.h>
 
+/**
+ * Polynomial sine for 0 <= x <= pi/2 (Taylor series to x^11, error below 6e-8).
+ * Inlined into the block loops so they vectorise.
+ */
+static inline double quartersin(double x) {
+    double x2 = x * x;
+    return x * (1.0 + x2 * (-1.0/6.0 + x2 * (1.0/120.0 + x2 * (-1.0/5040.0 +
+           x2 * (1.0/362880.0 + x2 * (-1.0/39916800.0))))));
+}
+
+/**
+ * Interleaved pan kernel. Gains are computed from the sample index rather than accumulated, so there is no
+ * loop-carried dependency; with mode a compile-time constant at each call site the loops vectorise.
+ */
+static inline void panInterleaved(const float * restrict in, float * restrict out, size_t size,
+                                  float left, float right, float dleft, float dright, PANMODE mode) {
+    size_t i;
+    if(mode == PAN_MIX) {
+        for(i = 0; i < size; i++) {
+            out[2 * i] += in[i] * (left + dleft * (float) i);
+            out[2 * i + 1] += in[i] * (right + dright * (float) i);
+        }
+    }
+    else {
+        for(i = 0; i < size; i++) {
+            out[2 * i] = in[i] * (left + dleft * (float) i);
+            out[2 * i + 1] = in[i] * (right + dright * (float) i);
+        }
+    }
+}
+
+/**
+ * Planar pan kernel. No restrict qualifiers, as the outputs may alias the input.
+ */
+static inline void panPlanar(const float * in, float * outl, float * outr, size_t size,
+                             float left, float right, float dleft, float dright, PANMODE mode) {
+    size_t i;
+    float val;
+    if(mode == PAN_MIX) {
+        for(i = 0; i < size; i++) {
+            val = in[i];
+            outl[i] += val * (left + dleft * (float) i);
+            outr[i] += val * (right + dright * (float) i);
+        }
+    }
+    else {
+        for(i = 0; i < size; i++) {
+            val = in[i];
+            outl[i] = val * (left + dleft * (float) i);
+            outr[i] = val * (right + dright * (float) i);
+        }
+    }
+}
+
+/**
+ * Per-sample position kernel, shared by the interleaved (stride 2) and planar (stride 1) layouts. As with the ramp
+ * kernels, law, mode and stride are compile-time constants at each call site. The input sample is read before
+ * either output is written, so a planar output may alias the input.
+ */
+static inline void panDynamic(const float * in, float * outl, float * outr, size_t stride, const double * positions,
+                              size_t size, PANLAW law, PANMODE mode) {
+    size_t i;
+    double pos, left, right, theta, val;
+    const double quarterpi = atan(1.0);
+    const double halfpi = 2.0 * quarterpi;
+    for(i = 0; i < size; i++) {
+        pos = positions[i];
+        pos = pos < -1.0 ? -1.0 : (pos > 1.0 ? 1.0 : pos);
+        if(law == PAN_CONSTPOWER) {
+            /* Same law as constPower: theta runs from 0 (left) to pi/2 (right) */
+            theta = (pos + 1.0) * quarterpi;
+            left = quartersin(halfpi - theta);
+            right = quartersin(theta);
+        }
+        else {
+            left = 0.5 * (1.0 - pos);
+            right = 0.5 * (1.0 + pos);
+        }
+        val = in[i];
+        if(mode == PAN_MIX) {
+            outl[stride * i] += (float) (val * left);
+            outr[stride * i] += (float) (val * right);
+        }
+        else {
+            outl[stride * i] = (float) (val * left);
+            outr[stride * i] = (float) (val * right);
+        }
+    }
+}
+
 PANPOS simplepan(double position)
 {
     /*
@@ -51,12 +142,128 @@ void stereoPan(float *inBuffer, float *outBuffer, int inBuffsize, PANPOS fac)
  Applies a stereo pan to a buffer.
  */
 {
-    int i, out_i;
-    float val;
-    // Go through each sample and pan across the output stereo file.
-    for (i = 0, out_i = 0; i < inBuffsize; i++) {
-        val = inBuffer[i];
-        outBuffer[out_i++] = val * fac.left;
-        outBuffer[out_i++] = val * fac.right;
+    if(inBuffsize > 0) {
+        stereoPanInterleaved(inBuffer, outBuffer, (size_t) inBuffsize, fac, fac, PAN_REPLACE);
+    }
+}
+
+int stereoPanInterleaved(const float *inBuffer, float *outBuffer, size_t size, PANPOS start, PANPOS end, PANMODE mode) {
+    float left = (float) start.left, right = (float) start.right;
+    float dleft = 0.0f, dright = 0.0f;
+    DSP_PROBE_BEGIN(startcycles);
+    if(mode != PAN_REPLACE && mode != PAN_MIX) {
+        return 0;
+    }
+    if(size) {
+        dleft = (float) ((end.left - start.left) / size);
+        dright = (float) ((end.right - start.right) / size);
+    }
+    if(mode == PAN_MIX) {
+        panInterleaved(inBuffer, outBuffer, size, left, right, dleft, dright, PAN_MIX);
+    }
+    else {
+        panInterleaved(inBuffer, outBuffer, size, left, right, dleft, dright, PAN_REPLACE);
+    }
+    DSP_PROBE_END(DSP_PROBE_PAN, startcycles, size);
+    return 1;
+}
+
+int stereoPanPlanar(const float *inBuffer, float *leftBuffer, float *rightBuffer, size_t size,
+                    PANPOS start, PANPOS end, PANMODE mode) {
+    float left = (float) start.left, right = (float) start.right;
+    float dleft = 0.0f, dright = 0.0f;
+    DSP_PROBE_BEGIN(startcycles);
+    if(mode != PAN_REPLACE && mode != PAN_MIX) {
+        return 0;
+    }
+    if(size) {
+        dleft = (float) ((end.left - start.left) / size);
+        dright = (float) ((end.right - start.right) / size);
+    }
+    if(mode == PAN_MIX) {
+        panPlanar(inBuffer, leftBuffer, rightBuffer, size, left, right, dleft, dright, PAN_MIX);
+    }
+    else {
+        panPlanar(inBuffer, leftBuffer, rightBuffer, size, left, right, dleft, dright, PAN_REPLACE);
+    }
+    DSP_PROBE_END(DSP_PROBE_PAN, startcycles, size);
+    return 1;
+}
+
+int stereoPanDynamic(const float *inBuffer, float *outBuffer, const double *positions, size_t size,
+                     PANLAW law, PANMODE mode) {
+    DSP_PROBE_BEGIN(start);
+    if((law != PAN_LINEAR && law != PAN_CONSTPOWER) || (mode != PAN_REPLACE && mode != PAN_MIX)) {
+        return 0;
+    }
+    if(law == PAN_CONSTPOWER) {
+        if(mode == PAN_MIX) {
+            panDynamic(inBuffer, outBuffer, outBuffer + 1, 2, positions, size, PAN_CONSTPOWER, PAN_MIX);
+        }
+        else {
+            panDynamic(inBuffer, outBuffer, outBuffer + 1, 2, positions, size, PAN_CONSTPOWER, PAN_REPLACE);
+        }
+    }
+    else if(mode == PAN_MIX) {
+        panDynamic(inBuffer, outBuffer, outBuffer + 1, 2, positions, size, PAN_LINEAR, PAN_MIX);
+    }
+    else {
+        panDynamic(inBuffer, outBuffer, outBuffer + 1, 2, positions, size, PAN_LINEAR, PAN_REPLACE);
+    }
+    DSP_PROBE_END(DSP_PROBE_PAN, start, size);
+    return 1;
+}
+
+int stereoPanDynamicPlanar(const float *inBuffer, float *leftBuffer, float *rightBuffer, const double *positions,
+                           size_t size, PANLAW law, PANMODE mode) {
+    DSP_PROBE_BEGIN(start);
+    if((law != PAN_LINEAR && law != PAN_CONSTPOWER) || (mode != PAN_REPLACE && mode != PAN_MIX)) {
+        return 0;
+    }
+    if(law == PAN_CONSTPOWER) {
+        if(mode == PAN_MIX) {
+            panDynamic(inBuffer, leftBuffer, rightBuffer, 1, positions, size, PAN_CONSTPOWER, PAN_MIX);
+        }
+        else {
+            panDynamic(inBuffer, leftBuffer, rightBuffer, 1, positions, size, PAN_CONSTPOWER, PAN_REPLACE);
+        }
+    }
+    else if(mode == PAN_MIX) {
+        panDynamic(inBuffer, leftBuffer, rightBuffer, 1, positions, size, PAN_LINEAR, PAN_MIX);
+    }
+    else {
+        panDynamic(inBuffer, leftBuffer, rightBuffer, 1, positions, size, PAN_LINEAR, PAN_REPLACE);
+    }
+    DSP_PROBE_END(DSP_PROBE_PAN, start, size);
+    return 1;
+}
+
+int stereoPanStream(const float *inBuffer, float *outBuffer, BRKSTREAM *stream, size_t size,
+                    PANLAW law, PANMODE mode) {
+    double positions[PAN_BLOCKSIZE];
+    size_t done, n;
+    if((law != PAN_LINEAR && law != PAN_CONSTPOWER) || (mode != PAN_REPLACE && mode != PAN_MIX)) {
+        return 0;
+    }
+    for(done = 0; done < size; done += n) {
+        n = size - done < PAN_BLOCKSIZE ? size - done : PAN_BLOCKSIZE;
+        bps_render(stream, positions, (unsigned long) n);
+        stereoPanDynamic(inBuffer + done, outBuffer + 2 * done, positions, n, law, mode);
+    }
+    return 1;
+}
+
+int stereoPanStreamPlanar(const float *inBuffer, float *leftBuffer, float *rightBuffer, BRKSTREAM *stream,
+                          size_t size, PANLAW law, PANMODE mode) {
+    double positions[PAN_BLOCKSIZE];
+    size_t done, n;
+    if((law != PAN_LINEAR && law != PAN_CONSTPOWER) || (mode != PAN_REPLACE && mode != PAN_MIX)) {
+        return 0;
+    }
+    for(done = 0; done < size; done += n) {
+        n = size - done < PAN_BLOCKSIZE ? size - done : PAN_BLOCKSIZE;
+        bps_render(stream, positions, (unsigned long) n);
+        stereoPanDynamicPlanar(inBuffer + done, leftBuffer + done, rightBuffer + done, positions, n, law, mode);
     }
+    return 1;
 }
@@ -2,8 +2,26 @@
 #define _PAN_H_
 
 
+#include <stddef.h>
 #include "breakpoint.h"
 
+/**
+ * Pan law enumeration for the block panners.
+ * PAN_LINEAR splits the signal linearly (gains sum to 1), PAN_CONSTPOWER keeps left^2 + right^2 = 1.
+ */
+typedef enum panlaw {PAN_LINEAR, PAN_CONSTPOWER} PANLAW;
+
+/**
+ * Output mode for the stereo pan kernels: PAN_REPLACE overwrites the output, PAN_MIX accumulates into it (eg. a bus).
+ * The values do not overlap the pan laws, so the kernels reject a law passed as a mode and vice versa.
+ */
+typedef enum panmode {PAN_REPLACE = 16, PAN_MIX} PANMODE;
+
+/**
+ * Number of pan positions rendered per internal block by stereoPanStream.
+ */
+#define PAN_BLOCKSIZE 256
+
 typedef struct panpos {
     double left;
     double right;
@@ -17,4 +35,103 @@ void stereoPan(float *inBuffer, float *outBuffer, int inBuffsize, PANPOS fac);
 
 PANPOS constPower(double position);
 
+/**
+ * Pans a mono buffer into an interleaved stereo buffer with a separate position for every sample.
+ *
+ * Gains are computed per sample with a polynomial sine approximation (error below 1e-7) rather than
+ * cos/sin calls, in a branch-free loop the compiler can vectorise.
+ *
+ * @param inBuffer - the mono input samples
+ * @param outBuffer - the interleaved stereo output (2 * size samples)
+ * @param positions - the pan position (-1 left to 1 right) for each sample; values outside are clamped
+ * @param size - the number of input samples
+ * @param law - the pan law (PAN_LINEAR or PAN_CONSTPOWER)
+ * @param mode - PAN_REPLACE or PAN_MIX
+ * @return 1 if successful, 0 (leaving the output untouched) for an unknown law or mode
+ */
+int stereoPanDynamic(const float *inBuffer, float *outBuffer, const double *positions, size_t size,
+                     PANLAW law, PANMODE mode);
+
+/**
+ * Pans a mono buffer into separate left and right buffers with a separate position for every sample, as
+ * stereoPanDynamic. Either output may be the input buffer itself.
+ *
+ * @param inBuffer - the mono input samples
+ * @param leftBuffer - the left channel output (size samples)
+ * @param rightBuffer - the right channel output (size samples)
+ * @param positions - the pan position (-1 left to 1 right) for each sample; values outside are clamped
+ * @param size - the number of input samples
+ * @param law - the pan law (PAN_LINEAR or PAN_CONSTPOWER)
+ * @param mode - PAN_REPLACE or PAN_MIX
+ * @return 1 if successful, 0 (leaving the outputs untouched) for an unknown law or mode
+ */
+int stereoPanDynamicPlanar(const float *inBuffer, float *leftBuffer, float *rightBuffer, const double *positions,
+                           size_t size, PANLAW law, PANMODE mode);
+
+/**
+ * Pans a mono buffer into an interleaved stereo buffer, driving the position from a breakpoint stream.
+ *
+ * The stream is advanced by size ticks, rendered a block at a time with bps_render.
+ *
+ * @param inBuffer - the mono input samples
+ * @param outBuffer - the interleaved stereo output (2 * size samples)
+ * @param stream - pointer to an initialised BRKSTREAM of pan positions
+ * @param size - the number of input samples
+ * @param law - the pan law (PAN_LINEAR or PAN_CONSTPOWER)
+ * @param mode - PAN_REPLACE or PAN_MIX
+ * @return 1 if successful, 0 (leaving the output untouched and the stream where it was) for an unknown law or mode
+ */
+int stereoPanStream(const float *inBuffer, float *outBuffer, BRKSTREAM *stream, size_t size,
+                    PANLAW law, PANMODE mode);
+
+/**
+ * Pans a mono buffer into separate left and right buffers, driving the position from a breakpoint stream, as
+ * stereoPanStream. Either output may be the input buffer itself.
+ *
+ * @param inBuffer - the mono input samples
+ * @param leftBuffer - the left channel output (size samples)
+ * @param rightBuffer - the right channel output (size samples)
+ * @param stream - pointer to an initialised BRKSTREAM of pan positions
+ * @param size - the number of input samples
+ * @param law - the pan law (PAN_LINEAR or PAN_CONSTPOWER)
+ * @param mode - PAN_REPLACE or PAN_MIX
+ * @return 1 if successful, 0 (leaving the outputs untouched and the stream where it was) for an unknown law or mode
+ */
+int stereoPanStreamPlanar(const float *inBuffer, float *leftBuffer, float *rightBuffer, BRKSTREAM *stream,
+                          size_t size, PANLAW law, PANMODE mode);
+
+/**
+ * Pans a mono buffer into an interleaved stereo buffer, ramping the gains linearly across the block.
+ *
+ * Passing the same PANPOS for start and end gives a fixed pan; changing positions between blocks with a ramp
+ * avoids zipper noise. stereoPan is the fixed, PAN_REPLACE case of this kernel.
+ *
+ * @param inBuffer - the mono input samples
+ * @param outBuffer - the interleaved stereo output (2 * size samples, must not overlap the input)
+ * @param size - the number of input samples
+ * @param start - the gains at the first sample
+ * @param end - the gains reached at the sample after the last (ie. the start of the next block)
+ * @param mode - PAN_REPLACE or PAN_MIX
+ * @return 1 if successful, 0 (leaving the output untouched) for an unknown mode
+ */
+int stereoPanInterleaved(const float *inBuffer, float *outBuffer, size_t size, PANPOS start, PANPOS end, PANMODE mode);
+
+/**
+ * Pans a mono buffer into separate (planar) left and right buffers, ramping the gains linearly across the block.
+ *
+ * Each output sample depends only on the input sample at the same index, so either output may be the input
+ * buffer itself (in-place panning).
+ *
+ * @param inBuffer - the mono input samples
+ * @param leftBuffer - the left channel output (size samples)
+ * @param rightBuffer - the right channel output (size samples)
+ * @param size - the number of input samples
+ * @param start - the gains at the first sample
+ * @param end - the gains reached at the sample after the last
+ * @param mode - PAN_REPLACE or PAN_MIX
+ * @return 1 if successful, 0 (leaving the outputs untouched) for an unknown mode
+ */
+int stereoPanPlanar(const float *inBuffer, float *leftBuffer, float *rightBuffer, size_t size,
+                    PANPOS start, PANPOS end, PANMODE mode);
+
 #endif
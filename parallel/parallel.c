@@ -0,0 +1,61 @@
+#include "parallel.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+/**
+ * Defines the schema for the start argument of an extra thread.
+ *
+ * @param worker - the function to run
+ * @param arg - the shared job
+ */
+typedef struct dspthreadstart {
+    DSPWORKER worker;
+    void * arg;
+} DSPTHREADSTART;
+
+/**
+ * pthread entry point running a DSPTHREADSTART's worker.
+ */
+static void * threadMain(void * start);
+
+static void * threadMain(void * start) {
+    DSPTHREADSTART * s = (DSPTHREADSTART *) start;
+    s->worker(s->arg);
+    return NULL;
+}
+
+unsigned int dsp_nthreads(unsigned int nthreads, unsigned long nitems) {
+    if(!nthreads) {
+        long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = nprocs > 0 ? (unsigned int) nprocs : 1;
+    }
+    if(nthreads > nitems) {
+        nthreads = nitems ? (unsigned int) nitems : 1;
+    }
+    return nthreads;
+}
+
+unsigned int dsp_parallel_for(DSPWORKER worker, void * arg, unsigned long nitems, unsigned int nthreads) {
+    DSPTHREADSTART start;
+    pthread_t * threads;
+    unsigned int i, started = 0;
+
+    nthreads = dsp_nthreads(nthreads, nitems);
+    start.worker = worker;
+    start.arg = arg;
+    threads = nthreads > 1 ? (pthread_t *) malloc(sizeof(pthread_t) * (nthreads - 1)) : NULL;
+    if(threads) {
+        for(i = 1; i < nthreads; i++) {
+            if(pthread_create(&threads[started], NULL, threadMain, &start) == 0) {
+                started++;
+            }
+        }
+    }
+    worker(arg);
+    for(i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    return started + 1;
+}
@@ -0,0 +1,32 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+/**
+ * Define a function pointer for a parallel worker. Every thread runs the same worker on the same argument, so
+ * the worker claims its share of the work itself, typically by atomically advancing a counter in arg until it
+ * passes the number of items. A worker that cannot set up (eg. allocate its scratch buffers) should return
+ * without claiming anything, leaving the items to the threads that could.
+ * @param arg - the shared job
+ */
+typedef void (*DSPWORKER) (void * arg);
+
+/**
+ * Resolve a requested thread count.
+ * @param nthreads - the number of threads wanted, 0 for one per online processor
+ * @param nitems - the number of independent work items, so that no thread is started without work
+ * @return the thread count, between 1 and nitems (1 if nitems is 0)
+ */
+unsigned int dsp_nthreads(unsigned int nthreads, unsigned long nitems);
+
+/**
+ * Run a worker on the calling thread and on up to nthreads - 1 extra threads, returning once they have all
+ * finished. The calling thread always works, so extra threads that fail to start just leave it more items.
+ * @param worker - the function run by every thread
+ * @param arg - the shared job passed to every thread
+ * @param nitems - the number of independent work items
+ * @param nthreads - the number of threads wanted, 0 for one per online processor (see dsp_nthreads)
+ * @return the number of threads that ran the worker
+ */
+unsigned int dsp_parallel_for(DSPWORKER worker, void * arg, unsigned long nitems, unsigned int nthreads);
+
+#endif
@@ -0,0 +1,271 @@
+#include "render.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * Samples of envelope rendered per pass within a chunk.
+ */
+#define RENDER_BLOCK 1024
+
+/**
+ * Render pass enumeration.
+ * RENDER_SUMS - sum the frequency envelope over each chunk
+ * RENDER_SAMPLES - render each chunk from its starting phase
+ */
+enum {RENDER_SUMS, RENDER_SAMPLES};
+
+/**
+ * Defines the schema for the state shared by the render threads.
+ *
+ * @param spec - the render settings
+ * @param output - the output
+ * @param length - the number of samples to render
+ * @param chunk - the number of samples per chunk
+ * @param nchunks - the number of chunks
+ * @param phases - the frequency envelope sum over each chunk after the first pass, then the starting phase of
+ * each chunk (table length units)
+ * @param pass - RENDER_SUMS or RENDER_SAMPLES
+ * @param next - the next chunk of the pass (advanced atomically)
+ * @param done - the number of chunks completed in the pass (advanced atomically)
+ */
+typedef struct renderjob {
+    const RENDERSPEC * spec;
+    double * output;
+    unsigned long length;
+    unsigned long chunk;
+    unsigned long nchunks;
+    double * phases;
+    int pass;
+    unsigned long next;
+    unsigned long done;
+} RENDERJOB;
+
+/**
+ * Defines the schema for one thread's oscillator and envelope cursors.
+ *
+ * @param osc - the oscillator
+ * @param freq - the frequency cursor
+ * @param amp - the amplitude cursor (unused without an amplitude envelope)
+ */
+typedef struct renderer {
+    TOSCIL * osc;
+    BRKSTREAM freq;
+    BRKSTREAM amp;
+} RENDERER;
+
+/**
+ * Validate the render settings.
+ * @param spec - the render settings
+ * @param errMsg - pointer to a string which is set to an error description on failure
+ * @return boolean integer specifying whether the settings are usable
+ */
+static int checkSpec(const RENDERSPEC * spec, char ** errMsg);
+
+/**
+ * Create an oscillator and attach envelope cursors for one thread.
+ * @param spec - the render settings
+ * @param r - pointer to the RENDERER to set up
+ * @return boolean integer specifying whether the renderer was set up
+ */
+static int openRenderer(const RENDERSPEC * spec, RENDERER * r);
+
+/**
+ * Release a thread's oscillator and cursors.
+ * @param spec - the render settings
+ * @param r - pointer to the RENDERER
+ */
+static void closeRenderer(const RENDERSPEC * spec, RENDERER * r);
+
+/**
+ * Render samples start to start + n, from a given oscillator phase.
+ * @param spec - the render settings
+ * @param r - pointer to the RENDERER
+ * @param phase - the oscillator phase at start (table length units)
+ * @param start - the first sample
+ * @param n - the number of samples
+ * @param output - the output for this range
+ */
+static void renderRange(const RENDERSPEC * spec, RENDERER * r, double phase, unsigned long start, unsigned long n,
+                        double * output);
+
+/**
+ * Take chunks of the current pass until none are left.
+ * @param arg - pointer to the RENDERJOB
+ */
+static void renderWorker(void * arg);
+
+/**
+ * Run one pass over every chunk, splitting the chunks between threads.
+ * @param job - pointer to the RENDERJOB
+ * @param pass - RENDER_SUMS or RENDER_SAMPLES
+ * @param nthreads - the number of threads
+ * @return boolean integer specifying whether every chunk was completed
+ */
+static int runPass(RENDERJOB * job, int pass, unsigned int nthreads);
+
+static int checkSpec(const RENDERSPEC * spec, char ** errMsg) {
+    if(!spec->table || !spec->table->samples || !spec->tick) {
+        *errMsg = "Render needs a table and a tick function";
+        return 0;
+    }
+    if(!spec->freq || !spec->fs) {
+        *errMsg = "Render needs a frequency envelope and a sample rate";
+        return 0;
+    }
+    return 1;
+}
+
+static int openRenderer(const RENDERSPEC * spec, RENDERER * r) {
+    memset(r, 0, sizeof(RENDERER));
+    if(!(r->osc = oscil_t((double) spec->fs, spec->phase, spec->table))) {
+        return 0;
+    }
+    bps_attach(&r->freq, spec->freq, spec->fs);
+    if(spec->amp) {
+        bps_attach(&r->amp, spec->amp, spec->fs);
+    }
+    return 1;
+}
+
+static void closeRenderer(const RENDERSPEC * spec, RENDERER * r) {
+    freeTOscil_a(&r->osc, NULL);
+    bps_freepoints(&r->freq);
+    if(spec->amp) {
+        bps_freepoints(&r->amp);
+    }
+}
+
+static void renderRange(const RENDERSPEC * spec, RENDERER * r, double phase, unsigned long start, unsigned long n,
+                        double * output) {
+    double freqs[RENDER_BLOCK], amps[RENDER_BLOCK];
+    unsigned long m, k;
+
+    r->osc->osc.curPhase = phase;
+    bps_seeksample(&r->freq, start);
+    if(spec->amp) {
+        bps_seeksample(&r->amp, start);
+    }
+    while(n) {
+        m = n < RENDER_BLOCK ? n : RENDER_BLOCK;
+        bps_render(&r->freq, freqs, m);
+        if(spec->amp) {
+            bps_render(&r->amp, amps, m);
+            for(k = 0; k < m; k++) {
+                output[k] = spec->tick(r->osc, freqs[k]) * amps[k];
+            }
+        }
+        else {
+            for(k = 0; k < m; k++) {
+                output[k] = spec->tick(r->osc, freqs[k]);
+            }
+        }
+        output += m;
+        n -= m;
+    }
+}
+
+static void renderWorker(void * arg) {
+    RENDERJOB * job = (RENDERJOB *) arg;
+    RENDERER r;
+    unsigned long c, start, n;
+
+    if(!openRenderer(job->spec, &r)) {
+        /* Leave the chunks to the threads that could set up */
+        closeRenderer(job->spec, &r);
+        return;
+    }
+    while((c = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nchunks) {
+        start = c * job->chunk;
+        n = job->length - start < job->chunk ? job->length - start : job->chunk;
+        if(job->pass == RENDER_SUMS) {
+            bps_seeksample(&r.freq, start);
+            job->phases[c] = bps_sum(&r.freq, n);
+        }
+        else {
+            renderRange(job->spec, &r, job->phases[c], start, n, job->output + start);
+        }
+        __atomic_fetch_add(&job->done, 1, __ATOMIC_RELAXED);
+    }
+    closeRenderer(job->spec, &r);
+}
+
+static int runPass(RENDERJOB * job, int pass, unsigned int nthreads) {
+    job->pass = pass;
+    job->next = 0;
+    job->done = 0;
+    dsp_parallel_for(renderWorker, job, job->nchunks, nthreads);
+    return job->done == job->nchunks;
+}
+
+int render_sequential(const RENDERSPEC * spec, double * output, unsigned long length, char ** errMsg) {
+    RENDERER r;
+
+    if(!checkSpec(spec, errMsg)) {
+        return 0;
+    }
+    if(!openRenderer(spec, &r)) {
+        *errMsg = "Could not allocate the oscillator";
+        return 0;
+    }
+    renderRange(spec, &r, r.osc->osc.curPhase, 0, length, output);
+    closeRenderer(spec, &r);
+    return 1;
+}
+
+int render_offline(const RENDERSPEC * spec, double * output, unsigned long length, unsigned long chunk,
+                   unsigned int nthreads, char ** errMsg) {
+    RENDERJOB job;
+    RENDERER r;
+    double phase, sum, tablen, sizeovrsr;
+    unsigned long c;
+    int ok;
+
+    if(!checkSpec(spec, errMsg)) {
+        return 0;
+    }
+    if(!length) {
+        return 1;
+    }
+    if(!chunk) {
+        chunk = RENDER_DEFAULTCHUNK;
+    }
+    if(!openRenderer(spec, &r)) {
+        *errMsg = "Could not allocate the oscillator";
+        return 0;
+    }
+    phase = r.osc->osc.curPhase;
+    tablen = r.osc->tablen;
+    sizeovrsr = r.osc->sizeovrsr;
+    closeRenderer(spec, &r);
+
+    job.spec = spec;
+    job.output = output;
+    job.length = length;
+    job.chunk = chunk;
+    job.nchunks = (length + chunk - 1) / chunk;
+    if(!(job.phases = (double *) malloc(job.nchunks * sizeof(double)))) {
+        *errMsg = "Could not allocate the chunk phases";
+        return 0;
+    }
+    /* Sums are independent per chunk (BRK_POW spans cost a pow per sample), only the scan over them is serial:
+     each chunk starts where the phase increments of every earlier sample have carried the oscillator */
+    ok = runPass(&job, RENDER_SUMS, nthreads);
+    if(ok) {
+        for(c = 0; c < job.nchunks; c++) {
+            sum = job.phases[c];
+            job.phases[c] = phase;
+            phase = fmod(phase + sizeovrsr * sum, tablen);
+            if(phase < 0.0) {
+                phase += tablen;
+            }
+        }
+        ok = runPass(&job, RENDER_SAMPLES, nthreads);
+    }
+    free(job.phases);
+    if(!ok) {
+        *errMsg = "Could not allocate the oscillator";
+    }
+    return ok;
+}
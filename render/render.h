@@ -0,0 +1,70 @@
+#ifndef _RENDER_H_
+#define _RENDER_H_
+
+#include "gtable.h"
+#include "breakpoint.h"
+
+/**
+ * Samples per chunk when no chunk length is given (about 1.4 seconds at 48 kHz).
+ */
+#define RENDER_DEFAULTCHUNK 65536
+
+/**
+ * Defines the schema for an offline render of a table oscillator driven by breakpoint envelopes.
+ *
+ * @param table - the oscillator's lookup table
+ * @param tick - the lookup (tabtick or tabitick)
+ * @param freq - the frequency envelope (Hz)
+ * @param amp - the amplitude envelope, or NULL for a constant amplitude of 1
+ * @param fs - the sample rate
+ * @param phase - the initial phase (degrees, as for oscil_t)
+ */
+typedef struct renderspec {
+    GTABLE * table;
+    TABFUNC tick;
+    BRKTABLE * freq;
+    BRKTABLE * amp;
+    unsigned long fs;
+    double phase;
+} RENDERSPEC;
+
+/**
+ * Render a table oscillator driven by breakpoint envelopes, splitting the timeline between threads.
+ *
+ * The timeline is cut into chunks and rendered in two passes over them, each split between threads through a
+ * shared counter. The first sums the frequency envelope over every chunk with bps_sum, which works in closed
+ * form span by span, so it costs about as much as the number of breakpoints rather than the length of the
+ * render (BRK_POW spans excepted). A scan over those sums then gives each chunk's starting phase: the initial
+ * phase plus the table increment per Hz times the sum of the envelope over all earlier samples. The second pass
+ * seeks each thread's own cursors to a chunk (bps_seeksample) and ticks a private oscillator through it.
+ *
+ * The result differs from render_sequential only in the rounding of the phase: the sequential render adds one
+ * rounded increment per sample, so its error grows with the length of the render, while each chunk here
+ * starts from an exactly summed phase. With tabitick the difference is within 1e-6 of full scale after an hour
+ * at 48 kHz (1e-7 after five minutes). With tabtick, about one sample in a million whose phase lies within that
+ * rounding of a table index truncates to the neighbouring index. BRK_EXP spans are evaluated from a fresh exp()
+ * at each chunk start rather than recursively, which adds differences of a smaller order.
+ *
+ * @param spec - the render settings
+ * @param output - the output, length samples
+ * @param length - the number of samples to render
+ * @param chunk - the number of samples per chunk (0 for RENDER_DEFAULTCHUNK)
+ * @param nthreads - the number of threads (0 for one per online processor)
+ * @param errMsg - pointer to a string which is set to an error description on failure
+ * @return boolean integer specifying whether the render succeeded
+ */
+int render_offline(const RENDERSPEC * spec, double * output, unsigned long length, unsigned long chunk,
+                   unsigned int nthreads, char ** errMsg);
+
+/**
+ * Render a table oscillator driven by breakpoint envelopes in a single pass, ticking one oscillator and one
+ * cursor per envelope from start to finish. This is the reference render_offline is measured against.
+ * @param spec - the render settings
+ * @param output - the output, length samples
+ * @param length - the number of samples to render
+ * @param errMsg - pointer to a string which is set to an error description on failure
+ * @return boolean integer specifying whether the render succeeded
+ */
+int render_sequential(const RENDERSPEC * spec, double * output, unsigned long length, char ** errMsg);
+
+#endif
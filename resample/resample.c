@@ -0,0 +1,316 @@
+#include "resample.h"
+#include <math.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(RESAMPLE_NO_SIMD)
+#define RESAMPLE_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Input samples staged per pass when no maximum block size is given.
+ */
+#define RESAMPLE_DEFAULTBLOCK 256
+
+/**
+ * Filter design per quality setting: length in samples of the lower rate, Kaiser beta and cutoff.
+ */
+static const struct {
+    unsigned long length;
+    double beta;
+    double cutoff;
+} designs[] = {
+    {16, 5.65, 0.75},
+    {32, 8.6, 0.85},
+    {64, 10.5, 0.9}
+};
+
+/**
+ * Portable kernel: four independent accumulators.
+ */
+static double dotScalar(const double * taps, const double * input, unsigned long ntaps);
+
+#ifdef RESAMPLE_X86
+/**
+ * AVX2/FMA kernel: eight taps per pass in two 4-wide accumulators, then four at a time, then scalar.
+ */
+static double dotAVX2(const double * taps, const double * input, unsigned long ntaps);
+
+/**
+ * AVX-512F kernel: sixteen taps per pass in two 8-wide accumulators, then eight at a time, then scalar.
+ */
+static double dotAVX512(const double * taps, const double * input, unsigned long ntaps);
+#endif
+
+/**
+ * Pick the fastest kernel the CPU supports.
+ * @param name - pointer populated with the kernel name
+ * @return the kernel
+ */
+static RESAMPLEKERNEL selectKernel(const char ** name);
+
+/**
+ * Zeroth order modified Bessel function of the first kind, for the Kaiser window.
+ * @param x - the argument
+ * @return I0(x)
+ */
+static double besselI0(double x);
+
+/**
+ * Design the prototype lowpass and split it into the polyphase bank.
+ * @param rs - pointer to a RESAMPLER object with up, down, ntaps and bank set up
+ * @param quality - the quality setting
+ */
+static void designBank(RESAMPLER * rs, int quality);
+
+/**
+ * Produce every output whose newest input sample is among the m samples staged after the history, then
+ * shift the history along.
+ * @param rs - pointer to a RESAMPLER object
+ * @param m - the number of staged input samples
+ * @param output - the output samples
+ * @return the number of output samples written
+ */
+static unsigned long runStaged(RESAMPLER * rs, unsigned long m, double * output);
+
+static double dotScalar(const double * taps, const double * input, unsigned long ntaps) {
+    unsigned long k = 0;
+    double a0 = 0.0, a1 = 0.0, a2 = 0.0, a3 = 0.0;
+
+    for(; k + 4 <= ntaps; k += 4) {
+        a0 += taps[k] * input[k];
+        a1 += taps[k + 1] * input[k + 1];
+        a2 += taps[k + 2] * input[k + 2];
+        a3 += taps[k + 3] * input[k + 3];
+    }
+    for(; k < ntaps; k++) {
+        a0 += taps[k] * input[k];
+    }
+    return (a0 + a1) + (a2 + a3);
+}
+
+#ifdef RESAMPLE_X86
+__attribute__((target("avx2,fma")))
+static double dotAVX2(const double * taps, const double * input, unsigned long ntaps) {
+    unsigned long k = 0;
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    __m128d s;
+    double sum;
+
+    for(; k + 8 <= ntaps; k += 8) {
+        a0 = _mm256_fmadd_pd(_mm256_loadu_pd(taps + k), _mm256_loadu_pd(input + k), a0);
+        a1 = _mm256_fmadd_pd(_mm256_loadu_pd(taps + k + 4), _mm256_loadu_pd(input + k + 4), a1);
+    }
+    for(; k + 4 <= ntaps; k += 4) {
+        a0 = _mm256_fmadd_pd(_mm256_loadu_pd(taps + k), _mm256_loadu_pd(input + k), a0);
+    }
+    a0 = _mm256_add_pd(a0, a1);
+    s = _mm_add_pd(_mm256_castpd256_pd128(a0), _mm256_extractf128_pd(a0, 1));
+    s = _mm_add_sd(s, _mm_unpackhi_pd(s, s));
+    sum = _mm_cvtsd_f64(s);
+    /* The tail stays in this function: calling the SSE-encoded scalar kernel here costs a state transition */
+    for(; k < ntaps; k++) {
+        sum += taps[k] * input[k];
+    }
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+static double dotAVX512(const double * taps, const double * input, unsigned long ntaps) {
+    unsigned long k = 0;
+    __m512d a0 = _mm512_setzero_pd(), a1 = _mm512_setzero_pd();
+    double sum;
+
+    for(; k + 16 <= ntaps; k += 16) {
+        a0 = _mm512_fmadd_pd(_mm512_loadu_pd(taps + k), _mm512_loadu_pd(input + k), a0);
+        a1 = _mm512_fmadd_pd(_mm512_loadu_pd(taps + k + 8), _mm512_loadu_pd(input + k + 8), a1);
+    }
+    for(; k + 8 <= ntaps; k += 8) {
+        a0 = _mm512_fmadd_pd(_mm512_loadu_pd(taps + k), _mm512_loadu_pd(input + k), a0);
+    }
+    sum = _mm512_reduce_add_pd(_mm512_add_pd(a0, a1));
+    for(; k < ntaps; k++) {
+        sum += taps[k] * input[k];
+    }
+    return sum;
+}
+#endif
+
+static RESAMPLEKERNEL selectKernel(const char ** name) {
+#ifdef RESAMPLE_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) {
+        *name = "avx512";
+        return dotAVX512;
+    }
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        *name = "avx2";
+        return dotAVX2;
+    }
+#endif
+    *name = "scalar";
+    return dotScalar;
+}
+
+const char * resample_kernelname(void) {
+    const char * name;
+    selectKernel(&name);
+    return name;
+}
+
+static double besselI0(double x) {
+    double sum = 1.0, term = 1.0, q = 0.25 * x * x;
+    unsigned int k;
+    for(k = 1; k < 64 && term > 1e-21 * sum; k++) {
+        term *= q / ((double) k * k);
+        sum += term;
+    }
+    return sum;
+}
+
+static void designBank(RESAMPLER * rs, int quality) {
+    unsigned long len = rs->ntaps * rs->up, m, p, k;
+    unsigned long wider = rs->up > rs->down ? rs->up : rs->down;
+    double centre = 0.5 * (double) (len - 1), fc, beta, x, r, h, sum = 0.0, norm;
+
+    /* Cutoff as a fraction of the Nyquist frequency at up times the input rate */
+    fc = designs[quality].cutoff / (double) wider;
+    beta = designs[quality].beta;
+    norm = besselI0(beta);
+    for(m = 0; m < len; m++) {
+        x = (double) m - centre;
+        h = x == 0.0 ? fc : sin(M_PI * fc * x) / (M_PI * x);
+        r = x / (centre + 0.5);
+        h *= besselI0(beta * sqrt(1.0 - r * r)) / norm;
+        /* Phase p holds prototype taps p, p + up, p + 2 * up... reversed, to run forwards over the history */
+        p = m % rs->up;
+        k = m / rs->up;
+        rs->bank[p * rs->ntaps + rs->ntaps - 1 - k] = h;
+        sum += h;
+    }
+    /* Unity gain at DC through every phase on average: the zero-stuffed input only carries 1 / up of it */
+    for(m = 0; m < len; m++) {
+        rs->bank[m] *= (double) rs->up / sum;
+    }
+}
+
+RESAMPLER * new_RESAMPLER(unsigned long inrate, unsigned long outrate, int quality, unsigned long maxblock) {
+    return new_RESAMPLER_a(inrate, outrate, quality, maxblock, NULL);
+}
+
+RESAMPLER * new_RESAMPLER_a(unsigned long inrate, unsigned long outrate, int quality, unsigned long maxblock,
+                            const DSPALLOC * alloc) {
+    RESAMPLER * rs;
+    unsigned long a, b, t, wider;
+
+    if(!inrate || !outrate) {
+        return NULL;
+    }
+    if(quality < RESAMPLE_FAST || quality > RESAMPLE_BEST) {
+        quality = RESAMPLE_MEDIUM;
+    }
+    for(a = inrate, b = outrate; b; a = b, b = t) {
+        t = a % b;
+    }
+    if(outrate / a > RESAMPLE_MAXPHASES) {
+        return NULL;
+    }
+    if(!maxblock) {
+        maxblock = RESAMPLE_DEFAULTBLOCK;
+    }
+    if(!(rs = (RESAMPLER *) dsp_calloc(alloc, 1, sizeof(RESAMPLER)))) {
+        return NULL;
+    }
+    rs->up = outrate / a;
+    rs->down = inrate / a;
+    rs->maxblock = maxblock;
+    /* The filter spans the same number of samples of the lower rate whatever the ratio */
+    wider = rs->up > rs->down ? rs->up : rs->down;
+    rs->ntaps = (designs[quality].length * wider + rs->up - 1) / rs->up;
+    rs->bank = (double *) dsp_alloc(alloc, rs->up * rs->ntaps * sizeof(double));
+    rs->history = (double *) dsp_calloc(alloc, rs->ntaps - 1 + maxblock, sizeof(double));
+    if(!rs->bank || !rs->history) {
+        clear_RESAMPLER_a(&rs, alloc);
+        return NULL;
+    }
+    designBank(rs, quality);
+    rs->kernel = selectKernel(&rs->kernelname);
+    return rs;
+}
+
+unsigned long resample_pending(const RESAMPLER * rs, unsigned long n) {
+    /* Outputs fall every down steps of the up-times rate, starting from the next one */
+    unsigned long start = rs->skip * rs->up + rs->phase, end = n * rs->up;
+    return start >= end ? 0 : (end - start - 1) / rs->down + 1;
+}
+
+static unsigned long runStaged(RESAMPLER * rs, unsigned long m, double * output) {
+    unsigned long i = rs->skip, p = rs->phase, written = 0;
+    unsigned long whole = rs->down / rs->up, part = rs->down % rs->up;
+
+    while(i < m) {
+        output[written++] = rs->kernel(rs->bank + p * rs->ntaps, rs->history + i, rs->ntaps);
+        i += whole;
+        p += part;
+        if(p >= rs->up) {
+            p -= rs->up;
+            i++;
+        }
+    }
+    rs->skip = i - m;
+    rs->phase = p;
+    memmove(rs->history, rs->history + m, (rs->ntaps - 1) * sizeof(double));
+    return written;
+}
+
+unsigned long resample_process(RESAMPLER * rs, const double * input, unsigned long n, double * output) {
+    unsigned long m, written = 0;
+
+    while(n) {
+        m = n < rs->maxblock ? n : rs->maxblock;
+        memcpy(rs->history + rs->ntaps - 1, input, m * sizeof(double));
+        written += runStaged(rs, m, output + written);
+        input += m;
+        n -= m;
+    }
+    return written;
+}
+
+unsigned long resample_oscil(RESAMPLER * rs, OSCIL * osc, tickfunc tick, double freq, unsigned long n,
+                             double * output) {
+    unsigned long m, k, written = 0;
+    double * staged = rs->history + rs->ntaps - 1;
+
+    while(n) {
+        m = n < rs->maxblock ? n : rs->maxblock;
+        for(k = 0; k < m; k++) {
+            staged[k] = tick(osc, freq);
+        }
+        written += runStaged(rs, m, output + written);
+        n -= m;
+    }
+    return written;
+}
+
+double resample_delay(const RESAMPLER * rs) {
+    return 0.5 * (double) (rs->ntaps * rs->up - 1) / (double) rs->up;
+}
+
+void resample_reset(RESAMPLER * rs) {
+    memset(rs->history, 0, (rs->ntaps - 1 + rs->maxblock) * sizeof(double));
+    rs->phase = 0;
+    rs->skip = 0;
+}
+
+void clear_RESAMPLER(RESAMPLER ** rs) {
+    clear_RESAMPLER_a(rs, NULL);
+}
+
+void clear_RESAMPLER_a(RESAMPLER ** rs, const DSPALLOC * alloc) {
+    if(rs && *rs) {
+        dsp_free(alloc, (*rs)->bank);
+        dsp_free(alloc, (*rs)->history);
+        dsp_free(alloc, *rs);
+        *rs = NULL;
+    }
+}
@@ -0,0 +1,157 @@
+#ifndef _RESAMPLE_H_
+#define _RESAMPLE_H_
+
+#include "dspalloc.h"
+#include "wave.h"
+
+/**
+ * Resampler quality enumeration: filter length in samples of the lower of the two rates, Kaiser stopband
+ * attenuation and cutoff (as a fraction of the lower Nyquist frequency).
+ * RESAMPLE_FAST - 16 samples, about 60 dB, cutoff 0.75
+ * RESAMPLE_MEDIUM - 32 samples, about 85 dB, cutoff 0.85
+ * RESAMPLE_BEST - 64 samples, about 105 dB, cutoff 0.9
+ */
+enum {RESAMPLE_FAST, RESAMPLE_MEDIUM, RESAMPLE_BEST};
+
+/**
+ * Largest interpolation factor (output rate / gcd of the rates) a resampler accepts. 44.1 kHz to any of
+ * 48/96/192 kHz needs at most 640.
+ */
+#define RESAMPLE_MAXPHASES 1024
+
+/**
+ * Define a function pointer for a resampler kernel: the dot product of one filter phase with the input.
+ *
+ * @param taps - the filter phase, reversed
+ * @param input - the oldest of the input samples it covers
+ * @param ntaps - the number of taps
+ * @return the output sample
+ */
+typedef double (*RESAMPLEKERNEL) (const double * taps, const double * input, unsigned long ntaps);
+
+/**
+ * Defines the schema for a streaming rational polyphase resampler, converting by up / down.
+ *
+ * A Kaiser-windowed sinc lowpass designed at up times the input rate is split into its up phases when the
+ * resampler is created, so each output sample costs one ntaps dot product with the phase it falls on. Integer
+ * oversampling is up = 2, 4 or 8 with down = 1, and decimating back is up = 1 with down = the factor. As with
+ * the FIR filter, the dot product kernel is picked at creation from the instruction sets the CPU supports.
+ *
+ * Every input sample is consumed by the call it is pushed in, and outputs are written as soon as the input they
+ * depend on has arrived, so the only latency is the filter's group delay (resample_delay).
+ *
+ * @param up - the interpolation factor L
+ * @param down - the decimation factor M
+ * @param ntaps - the number of taps per phase
+ * @param bank - up phases of ntaps taps, each reversed
+ * @param history - ntaps - 1 past input samples followed by room for maxblock new ones
+ * @param maxblock - the number of input samples staged per pass (longer inputs are split)
+ * @param phase - the filter phase of the next output (0 to up - 1)
+ * @param skip - the index of the newest input sample of the next output, relative to the next block
+ * @param kernel - the kernel in use
+ * @param kernelname - the name of the kernel in use ("avx512", "avx2" or "scalar")
+ */
+typedef struct resampler {
+    unsigned long up;
+    unsigned long down;
+    unsigned long ntaps;
+    double * bank;
+    double * history;
+    unsigned long maxblock;
+    unsigned long phase;
+    unsigned long skip;
+    RESAMPLEKERNEL kernel;
+    const char * kernelname;
+} RESAMPLER;
+
+/**
+ * Create a resampler between two sample rates. The ratio is reduced by the greatest common divisor, so
+ * new_RESAMPLER(44100, 48000, ...) runs at 160 / 147 and new_RESAMPLER(1, 4, ...) oversamples by 4.
+ * @param inrate - the input sample rate
+ * @param outrate - the output sample rate
+ * @param quality - RESAMPLE_FAST, RESAMPLE_MEDIUM or RESAMPLE_BEST
+ * @param maxblock - the number of input samples staged per pass (0 for a default)
+ * @return pointer to a dynamically allocated RESAMPLER object, or NULL if the rates are 0, the reduced
+ * interpolation factor exceeds RESAMPLE_MAXPHASES, or allocation failed
+ */
+RESAMPLER * new_RESAMPLER(unsigned long inrate, unsigned long outrate, int quality, unsigned long maxblock);
+
+/**
+ * Create a resampler with the object and its buffers taken from an allocator.
+ * @param inrate - the input sample rate
+ * @param outrate - the output sample rate
+ * @param quality - RESAMPLE_FAST, RESAMPLE_MEDIUM or RESAMPLE_BEST
+ * @param maxblock - the number of input samples staged per pass (0 for a default)
+ * @param alloc - the allocator, or NULL for the heap
+ * @return pointer to a RESAMPLER object, or NULL if unsuccessful
+ */
+RESAMPLER * new_RESAMPLER_a(unsigned long inrate, unsigned long outrate, int quality, unsigned long maxblock,
+                            const DSPALLOC * alloc);
+
+/**
+ * Get the number of output samples the next n input samples will produce, to size the output of
+ * resample_process. Over a stream this averages n * up / down.
+ * @param rs - pointer to a RESAMPLER object
+ * @param n - the number of input samples
+ * @return the number of output samples
+ */
+unsigned long resample_pending(const RESAMPLER * rs, unsigned long n);
+
+/**
+ * Resample a block of input samples. Performs no allocation.
+ * @param rs - pointer to a RESAMPLER object
+ * @param input - the input samples
+ * @param n - the number of input samples (any length)
+ * @param output - the output samples, resample_pending(rs, n) long
+ * @return the number of output samples written
+ */
+unsigned long resample_process(RESAMPLER * rs, const double * input, unsigned long n, double * output);
+
+/**
+ * Render an oscillator through the resampler without an intermediate buffer, eg. an oscillator created at
+ * 4 * fs into a resampler created with new_RESAMPLER(4, 1, ...) gives band-limited output at fs.
+ * Performs no allocation.
+ * @param rs - pointer to a RESAMPLER object
+ * @param osc - the oscillator, running at the resampler's input rate
+ * @param tick - the tick function for the waveform
+ * @param freq - the oscillator frequency
+ * @param n - the number of oscillator samples to render
+ * @param output - the output samples, resample_pending(rs, n) long
+ * @return the number of output samples written
+ */
+unsigned long resample_oscil(RESAMPLER * rs, OSCIL * osc, tickfunc tick, double freq, unsigned long n,
+                             double * output);
+
+/**
+ * Get the group delay of the resampler.
+ * @param rs - pointer to a RESAMPLER object
+ * @return the delay in input samples
+ */
+double resample_delay(const RESAMPLER * rs);
+
+/**
+ * Clear the resampler history (silence) and realign it to the start of a stream.
+ * @param rs - pointer to a RESAMPLER object
+ */
+void resample_reset(RESAMPLER * rs);
+
+/**
+ * Get the name of the kernel new resamplers will use on this CPU.
+ * @return "avx512", "avx2" or "scalar"
+ */
+const char * resample_kernelname(void);
+
+/**
+ * Destroy a resampler.
+ * @param rs - pointer to a pointer for the RESAMPLER object, set to NULL on return
+ */
+void clear_RESAMPLER(RESAMPLER ** rs);
+
+/**
+ * Destroy a resampler created by new_RESAMPLER_a.
+ * @param rs - pointer to a pointer for the RESAMPLER object, set to NULL on return
+ * @param alloc - the allocator the resampler was created with
+ */
+void clear_RESAMPLER_a(RESAMPLER ** rs, const DSPALLOC * alloc);
+
+#endif
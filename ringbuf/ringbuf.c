@@ -0,0 +1,188 @@
+#include "ringbuf.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Allocate cache-line aligned memory. The heap path uses posix_memalign (released by free), other allocators
+ * are relied on to align to DSP_ALIGN.
+ * @param alloc - the allocator, or NULL for the heap
+ * @param size - the number of bytes
+ * @return pointer to the memory, or NULL if unsuccessful
+ */
+static void * allocAligned(const DSPALLOC * alloc, size_t size);
+
+/**
+ * Space available to the producer, refreshing the cached tail only if the cache shows less than wanted.
+ * @param ring - pointer to a RINGBUF object
+ * @param head - the producer's current head
+ * @param wanted - the number of elements the caller wants to write
+ * @return the free space in elements
+ */
+static inline size_t freeSpace(RINGBUF * ring, size_t head, size_t wanted);
+
+/**
+ * Elements available to the consumer, refreshing the cached head only if the cache shows less than wanted.
+ * @param ring - pointer to a RINGBUF object
+ * @param tail - the consumer's current tail
+ * @param wanted - the number of elements the caller wants to read
+ * @return the number of queued elements
+ */
+static inline size_t queued(RINGBUF * ring, size_t tail, size_t wanted);
+
+static void * allocAligned(const DSPALLOC * alloc, size_t size) {
+    void * ptr;
+    if(alloc) {
+        return dsp_alloc(alloc, size);
+    }
+    if(posix_memalign(&ptr, RING_CACHELINE, size)) {
+        return NULL;
+    }
+    return ptr;
+}
+
+static inline size_t freeSpace(RINGBUF * ring, size_t head, size_t wanted) {
+    size_t space = ring->capacity - (head - ring->tailcache);
+    if(space < wanted) {
+        /* Acquire pairs with the consumer's release, so the popped slots are no longer being read */
+        ring->tailcache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        space = ring->capacity - (head - ring->tailcache);
+    }
+    return space;
+}
+
+static inline size_t queued(RINGBUF * ring, size_t tail, size_t wanted) {
+    size_t avail = ring->headcache - tail;
+    if(avail < wanted) {
+        /* Acquire pairs with the producer's release, so the pushed elements are visible */
+        ring->headcache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        avail = ring->headcache - tail;
+    }
+    return avail;
+}
+
+RINGBUF * ring_new(size_t capacity, size_t elemsize) {
+    return ring_new_a(capacity, elemsize, NULL);
+}
+
+RINGBUF * ring_new_a(size_t capacity, size_t elemsize, const DSPALLOC * alloc) {
+    RINGBUF * ring;
+    size_t size = 1;
+
+    if(!capacity || !elemsize) {
+        return NULL;
+    }
+    while(size < capacity) {
+        if(size > ((size_t) -1 >> 1)) {
+            return NULL;
+        }
+        size <<= 1;
+    }
+    if(size > (size_t) -1 / elemsize) {
+        return NULL;
+    }
+    if(!(ring = allocAligned(alloc, sizeof(RINGBUF)))) {
+        return NULL;
+    }
+    memset(ring, 0, sizeof(RINGBUF));
+    if(!(ring->data = allocAligned(alloc, size * elemsize))) {
+        dsp_free(alloc, ring);
+        return NULL;
+    }
+    ring->capacity = size;
+    ring->mask = size - 1;
+    ring->elemsize = elemsize;
+    return ring;
+}
+
+void ring_free(RINGBUF ** ring) {
+    ring_free_a(ring, NULL);
+}
+
+void ring_free_a(RINGBUF ** ring, const DSPALLOC * alloc) {
+    if(ring && *ring) {
+        dsp_free(alloc, (*ring)->data);
+        dsp_free(alloc, *ring);
+        *ring = NULL;
+    }
+}
+
+size_t ring_writable(RINGBUF * ring) {
+    return freeSpace(ring, ring->head, ring->capacity);
+}
+
+size_t ring_readable(RINGBUF * ring) {
+    return queued(ring, ring->tail, ring->capacity);
+}
+
+size_t ring_push(RINGBUF * ring, const void * items, size_t n) {
+    size_t head = ring->head, space, idx, first;
+
+    space = freeSpace(ring, head, n);
+    if(n > space) {
+        n = space;
+    }
+    if(!n) {
+        return 0;
+    }
+    /* Copy in at most two pieces: up to the end of the storage, then from the start */
+    idx = head & ring->mask;
+    first = ring->capacity - idx < n ? ring->capacity - idx : n;
+    memcpy(ring->data + idx * ring->elemsize, items, first * ring->elemsize);
+    if(first < n) {
+        memcpy(ring->data, (const unsigned char *) items + first * ring->elemsize, (n - first) * ring->elemsize);
+    }
+    __atomic_store_n(&ring->head, head + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+size_t ring_pop(RINGBUF * ring, void * items, size_t n) {
+    size_t tail = ring->tail, avail, idx, first;
+
+    avail = queued(ring, tail, n);
+    if(n > avail) {
+        n = avail;
+    }
+    if(!n) {
+        return 0;
+    }
+    idx = tail & ring->mask;
+    first = ring->capacity - idx < n ? ring->capacity - idx : n;
+    memcpy(items, ring->data + idx * ring->elemsize, first * ring->elemsize);
+    if(first < n) {
+        memcpy((unsigned char *) items + first * ring->elemsize, ring->data, (n - first) * ring->elemsize);
+    }
+    __atomic_store_n(&ring->tail, tail + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+size_t ring_reserve(RINGBUF * ring, void ** region, size_t n) {
+    size_t head = ring->head, space, idx;
+
+    space = freeSpace(ring, head, n);
+    idx = head & ring->mask;
+    if(space > ring->capacity - idx) {
+        space = ring->capacity - idx;
+    }
+    *region = ring->data + idx * ring->elemsize;
+    return n < space ? n : space;
+}
+
+void ring_commit(RINGBUF * ring, size_t n) {
+    __atomic_store_n(&ring->head, ring->head + n, __ATOMIC_RELEASE);
+}
+
+size_t ring_peek(RINGBUF * ring, const void ** region, size_t n) {
+    size_t tail = ring->tail, avail, idx;
+
+    avail = queued(ring, tail, n);
+    idx = tail & ring->mask;
+    if(avail > ring->capacity - idx) {
+        avail = ring->capacity - idx;
+    }
+    *region = ring->data + idx * ring->elemsize;
+    return n < avail ? n : avail;
+}
+
+void ring_release(RINGBUF * ring, size_t n) {
+    __atomic_store_n(&ring->tail, ring->tail + n, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,144 @@
+#ifndef _RINGBUF_H_
+#define _RINGBUF_H_
+
+#include <stddef.h>
+#include "dspalloc.h"
+
+/**
+ * Cache line size used to pad the producer and consumer sides of a ring apart.
+ */
+#define RING_CACHELINE 64
+
+/**
+ * Defines the schema for a wait-free single-producer/single-consumer ring buffer of fixed-size elements.
+ *
+ * Exactly one thread may push (ring_push, ring_reserve/ring_commit, ring_writable) and exactly one thread may
+ * pop (ring_pop, ring_peek/ring_release, ring_readable); every call completes in a bounded number of steps
+ * without locks or system calls, so either side may be a real-time audio thread.
+ *
+ * Elements are opaque: use nchans * sizeof(float) for interleaved sample frames, or a message struct
+ * (eg. a type tag and a pointer to a new GTABLE or IR spectrum) to hand objects between threads.
+ * Ownership of a pointed-to object passes with the message; the ring itself never dereferences it.
+ *
+ * The indices run freely and are masked on access. Each side keeps its own index and a cached copy of the
+ * other side's on its own cache line, and only re-reads the other side's index when the cached copy says the
+ * ring is full (producer) or empty (consumer).
+ *
+ * @param head - the number of elements ever pushed (written by the producer)
+ * @param tailcache - the producer's last read of tail
+ * @param tail - the number of elements ever popped (written by the consumer)
+ * @param headcache - the consumer's last read of head
+ * @param data - the element storage
+ * @param capacity - the number of elements (a power of 2)
+ * @param mask - capacity - 1
+ * @param elemsize - the size of each element in bytes
+ */
+typedef struct ringbuf {
+    size_t head __attribute__((aligned(RING_CACHELINE)));
+    size_t tailcache;
+    size_t tail __attribute__((aligned(RING_CACHELINE)));
+    size_t headcache;
+    unsigned char * data __attribute__((aligned(RING_CACHELINE)));
+    size_t capacity;
+    size_t mask;
+    size_t elemsize;
+} RINGBUF;
+
+/**
+ * Create a ring buffer.
+ * @param capacity - the minimum number of elements (rounded up to a power of 2)
+ * @param elemsize - the size of each element in bytes
+ * @return pointer to a dynamically allocated RINGBUF object, or NULL if unsuccessful
+ */
+RINGBUF * ring_new(size_t capacity, size_t elemsize);
+
+/**
+ * Create a ring buffer with the object and its storage taken from an allocator.
+ * @param capacity - the minimum number of elements (rounded up to a power of 2)
+ * @param elemsize - the size of each element in bytes
+ * @param alloc - the allocator, or NULL for the heap
+ * @return pointer to a RINGBUF object, or NULL if unsuccessful
+ */
+RINGBUF * ring_new_a(size_t capacity, size_t elemsize, const DSPALLOC * alloc);
+
+/**
+ * Destroy a ring buffer. Neither side may be using it.
+ * @param ring - pointer to a pointer for the RINGBUF object, set to NULL on return
+ */
+void ring_free(RINGBUF ** ring);
+
+/**
+ * Destroy a ring buffer created by ring_new_a.
+ * @param ring - pointer to a pointer for the RINGBUF object, set to NULL on return
+ * @param alloc - the allocator the ring was created with
+ */
+void ring_free_a(RINGBUF ** ring, const DSPALLOC * alloc);
+
+/**
+ * Get the number of elements the producer can push. Producer only.
+ * @param ring - pointer to a RINGBUF object
+ * @return the free space in elements
+ */
+size_t ring_writable(RINGBUF * ring);
+
+/**
+ * Get the number of elements the consumer can pop. Consumer only.
+ * @param ring - pointer to a RINGBUF object
+ * @return the number of queued elements
+ */
+size_t ring_readable(RINGBUF * ring);
+
+/**
+ * Copy up to n elements into the ring. Producer only.
+ * @param ring - pointer to a RINGBUF object
+ * @param items - the elements
+ * @param n - the number of elements
+ * @return the number of elements pushed (less than n if the ring filled up)
+ */
+size_t ring_push(RINGBUF * ring, const void * items, size_t n);
+
+/**
+ * Copy up to n elements out of the ring. Consumer only.
+ * @param ring - pointer to a RINGBUF object
+ * @param items - the destination for the elements
+ * @param n - the maximum number of elements
+ * @return the number of elements popped (less than n if the ring ran empty)
+ */
+size_t ring_pop(RINGBUF * ring, void * items, size_t n);
+
+/**
+ * Reserve contiguous space in the ring for the producer to fill in place, avoiding a copy.
+ * The region ends at the end of the storage, so a second reserve after committing may be needed to use
+ * space that wraps around. Nothing is visible to the consumer until ring_commit. Producer only.
+ * @param ring - pointer to a RINGBUF object
+ * @param region - pointer populated with the start of the reserved region
+ * @param n - the number of elements wanted
+ * @return the number of elements reserved (0 to n)
+ */
+size_t ring_reserve(RINGBUF * ring, void ** region, size_t n);
+
+/**
+ * Publish elements written into a reserved region. Producer only.
+ * @param ring - pointer to a RINGBUF object
+ * @param n - the number of elements written (at most the number reserved)
+ */
+void ring_commit(RINGBUF * ring, size_t n);
+
+/**
+ * Get contiguous queued elements for the consumer to read in place, avoiding a copy.
+ * The elements stay queued until ring_release. Consumer only.
+ * @param ring - pointer to a RINGBUF object
+ * @param region - pointer populated with the start of the readable region
+ * @param n - the number of elements wanted
+ * @return the number of elements available in the region (0 to n)
+ */
+size_t ring_peek(RINGBUF * ring, const void ** region, size_t n);
+
+/**
+ * Drop elements read in place, returning their space to the producer. Consumer only.
+ * @param ring - pointer to a RINGBUF object
+ * @param n - the number of elements consumed (at most the number peeked)
+ */
+void ring_release(RINGBUF * ring, size_t n);
+
+#endif
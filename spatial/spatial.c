@@ -0,0 +1,441 @@
+#include "spatial.h"
+#include "instrument.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* Number of nearest speakers searched for a triplet at each grid direction (3D VBAP) */
+#define SPAT_NEAREST 8
+/* Determinant below which a speaker pair/triplet is treated as degenerate */
+#define SPAT_MINDET 1e-6
+
+/**
+ * Convert a direction in degrees to a unit vector (x front, y left, z up).
+ */
+static void dirVector(double azimuth, double elevation, double * v);
+
+/**
+ * Allocate a SPATPAN object and its direction grid. Sets and matrices are allocated by the caller.
+ */
+static SPATPAN * newPanner(int type, unsigned int nchans, unsigned int setsize, unsigned int nele);
+
+/**
+ * Invert a 2x2 or 3x3 row-major matrix.
+ * @return boolean integer, 0 if the matrix is degenerate
+ */
+static int invertMatrix(const double * m, double * inv, unsigned int n);
+
+/**
+ * Compute the raw (unnormalised) gains of a speaker set for a direction vector.
+ */
+static void setGains(const SPATPAN * pan, unsigned int set, const double * v, double * g);
+
+/**
+ * Grid cell index for a direction in degrees.
+ */
+static unsigned int gridCell(const SPATPAN * pan, double azimuth, double elevation);
+
+/**
+ * Add a speaker set (sorted indices) to a panner if it is new and non-degenerate.
+ * @return the set index, or -1 if the set is degenerate or cannot be stored
+ */
+static long addSet(SPATPAN * pan, const unsigned int * idx, unsigned int * capacity);
+
+static void dirVector(double azimuth, double elevation, double * v) {
+    double a = azimuth * M_PI / 180.0, e = elevation * M_PI / 180.0;
+    v[0] = cos(a) * cos(e);
+    v[1] = sin(a) * cos(e);
+    v[2] = sin(e);
+}
+
+static SPATPAN * newPanner(int type, unsigned int nchans, unsigned int setsize, unsigned int nele) {
+    SPATPAN * pan = (SPATPAN *) calloc(1, sizeof(SPATPAN));
+    if(!pan) {
+        return NULL;
+    }
+    pan->type = type;
+    pan->nchans = nchans;
+    pan->setsize = setsize;
+    if(setsize) {
+        pan->nazi = (unsigned int) (360.0 / SPAT_GRIDRES);
+        pan->nele = nele;
+        pan->lookup = (unsigned int *) malloc(sizeof(unsigned int) * pan->nazi * pan->nele);
+        pan->speakers = (double *) malloc(sizeof(double) * 3 * nchans);
+        if(!pan->lookup || !pan->speakers) {
+            clearSpatPan(&pan);
+            return NULL;
+        }
+    }
+    return pan;
+}
+
+static int invertMatrix(const double * m, double * inv, unsigned int n) {
+    double det;
+    if(n == 2) {
+        det = m[0] * m[3] - m[1] * m[2];
+        if(fabs(det) < SPAT_MINDET) {
+            return 0;
+        }
+        inv[0] = m[3] / det;
+        inv[1] = -m[1] / det;
+        inv[2] = -m[2] / det;
+        inv[3] = m[0] / det;
+        return 1;
+    }
+    det = m[0] * (m[4] * m[8] - m[5] * m[7]) - m[1] * (m[3] * m[8] - m[5] * m[6]) + m[2] * (m[3] * m[7] - m[4] * m[6]);
+    if(fabs(det) < SPAT_MINDET) {
+        return 0;
+    }
+    inv[0] = (m[4] * m[8] - m[5] * m[7]) / det;
+    inv[1] = (m[2] * m[7] - m[1] * m[8]) / det;
+    inv[2] = (m[1] * m[5] - m[2] * m[4]) / det;
+    inv[3] = (m[5] * m[6] - m[3] * m[8]) / det;
+    inv[4] = (m[0] * m[8] - m[2] * m[6]) / det;
+    inv[5] = (m[2] * m[3] - m[0] * m[5]) / det;
+    inv[6] = (m[3] * m[7] - m[4] * m[6]) / det;
+    inv[7] = (m[1] * m[6] - m[0] * m[7]) / det;
+    inv[8] = (m[0] * m[4] - m[1] * m[3]) / det;
+    return 1;
+}
+
+static void setGains(const SPATPAN * pan, unsigned int set, const double * v, double * g) {
+    /* VBAP: p = g L, where the rows of L are the speaker vectors, so g = p L^-1 */
+    unsigned int i, j, n = pan->setsize;
+    const double * inv = pan->invmats + set * n * n;
+    for(j = 0; j < n; j++) {
+        g[j] = 0.0;
+        for(i = 0; i < n; i++) {
+            g[j] += v[i] * inv[i * n + j];
+        }
+    }
+}
+
+static unsigned int gridCell(const SPATPAN * pan, double azimuth, double elevation) {
+    long a, e = 0;
+    azimuth = fmod(azimuth, 360.0);
+    if(azimuth < 0.0) {
+        azimuth += 360.0;
+    }
+    a = (long) (azimuth / SPAT_GRIDRES + 0.5) % pan->nazi;
+    if(pan->nele > 1) {
+        if(elevation > 90.0) {
+            elevation = 90.0;
+        }
+        if(elevation < -90.0) {
+            elevation = -90.0;
+        }
+        e = (long) ((elevation + 90.0) / SPAT_GRIDRES + 0.5);
+    }
+    return (unsigned int) (e * pan->nazi + a);
+}
+
+static long addSet(SPATPAN * pan, const unsigned int * idx, unsigned int * capacity) {
+    unsigned int i, j, n = pan->setsize;
+    double m[9];
+    for(i = 0; i < pan->nsets; i++) {
+        if(!memcmp(pan->sets + i * n, idx, sizeof(unsigned int) * n)) {
+            return i;
+        }
+    }
+    if(pan->nsets == *capacity) {
+        unsigned int * sets;
+        double * invmats;
+        *capacity = *capacity ? *capacity * 2 : 64;
+        sets = (unsigned int *) realloc(pan->sets, sizeof(unsigned int) * n * *capacity);
+        if(sets) {
+            pan->sets = sets;
+        }
+        invmats = (double *) realloc(pan->invmats, sizeof(double) * n * n * *capacity);
+        if(invmats) {
+            pan->invmats = invmats;
+        }
+        if(!sets || !invmats) {
+            return -1;
+        }
+    }
+    for(i = 0; i < n; i++) {
+        for(j = 0; j < n; j++) {
+            m[i * n + j] = pan->speakers[3 * idx[i] + j];
+        }
+    }
+    if(!invertMatrix(m, pan->invmats + pan->nsets * n * n, n)) {
+        return -1;
+    }
+    memcpy(pan->sets + pan->nsets * n, idx, sizeof(unsigned int) * n);
+    return pan->nsets++;
+}
+
+SPATPAN * newVBAP2D(const double * azimuths, unsigned int nspeakers) {
+    SPATPAN * pan;
+    unsigned int i, j, cell, capacity = 0, order[SPAT_MAXCHANS];
+    double v[3], g[2];
+
+    if(nspeakers < 2 || nspeakers > SPAT_MAXCHANS) {
+        return NULL;
+    }
+    if(!(pan = newPanner(SPAT_VBAP2D, nspeakers, 2, 1))) {
+        return NULL;
+    }
+    for(i = 0; i < nspeakers; i++) {
+        dirVector(azimuths[i], 0.0, pan->speakers + 3 * i);
+        order[i] = i;
+    }
+    /* Sort speakers around the ring (insertion sort - layouts are small) */
+    for(i = 1; i < nspeakers; i++) {
+        unsigned int k = order[i];
+        double ak = atan2(pan->speakers[3 * k + 1], pan->speakers[3 * k]);
+        for(j = i; j > 0 && atan2(pan->speakers[3 * order[j - 1] + 1], pan->speakers[3 * order[j - 1]]) > ak; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = k;
+    }
+    /* Adjacent speakers form the pairs. The sine of the angle from one speaker anticlockwise to the next (the z
+     of their cross product) is at most 0 once that gap reaches 180 degrees: no pair can cover such a gap, and
+     inverting it would give a negative gain for every direction inside, so it is dropped. Directions in the gap
+     go to the nearest speaker of the best remaining pair (see spat_gains) */
+    for(i = 0; i < nspeakers; i++) {
+        unsigned int pair[2];
+        const double * p, * q;
+        pair[0] = order[i];
+        pair[1] = order[(i + 1) % nspeakers];
+        p = pan->speakers + 3 * pair[0];
+        q = pan->speakers + 3 * pair[1];
+        if(p[0] * q[1] - p[1] * q[0] < SPAT_MINDET) {
+            continue;
+        }
+        if(pair[0] > pair[1]) {
+            unsigned int t = pair[0];
+            pair[0] = pair[1];
+            pair[1] = t;
+        }
+        addSet(pan, pair, &capacity);
+    }
+    if(!pan->nsets) {
+        clearSpatPan(&pan);
+        return NULL;
+    }
+    /* For each grid azimuth pick the pair whose smallest gain is largest (ie. the enclosing pair) */
+    for(cell = 0; cell < pan->nazi; cell++) {
+        double best = -HUGE_VAL;
+        dirVector(cell * SPAT_GRIDRES, 0.0, v);
+        pan->lookup[cell] = 0;
+        for(i = 0; i < pan->nsets; i++) {
+            setGains(pan, i, v, g);
+            if(fmin(g[0], g[1]) > best) {
+                best = fmin(g[0], g[1]);
+                pan->lookup[cell] = i;
+            }
+        }
+    }
+    return pan;
+}
+
+SPATPAN * newVBAP3D(const double * azimuths, const double * elevations, unsigned int nspeakers) {
+    SPATPAN * pan;
+    unsigned int i, a, e, capacity = 0;
+    unsigned int nearest[SPAT_NEAREST];
+    double v[3], g[3];
+
+    if(nspeakers < 3 || nspeakers > SPAT_MAXCHANS) {
+        return NULL;
+    }
+    if(!(pan = newPanner(SPAT_VBAP3D, nspeakers, 3, (unsigned int) (180.0 / SPAT_GRIDRES) + 1))) {
+        return NULL;
+    }
+    for(i = 0; i < nspeakers; i++) {
+        dirVector(azimuths[i], elevations[i], pan->speakers + 3 * i);
+    }
+
+    for(e = 0; e < pan->nele; e++) {
+        for(a = 0; a < pan->nazi; a++) {
+            unsigned int nnear = 0, x, y, z, best[3];
+            double bestmin = -HUGE_VAL, bestspread = -HUGE_VAL;
+            long bestset;
+            int found = 0;
+            dirVector(a * SPAT_GRIDRES, e * SPAT_GRIDRES - 90.0, v);
+
+            /* Keep the SPAT_NEAREST speakers closest to this direction, sorted by index */
+            for(i = 0; i < nspeakers; i++) {
+                double d = v[0] * pan->speakers[3 * i] + v[1] * pan->speakers[3 * i + 1] + v[2] * pan->speakers[3 * i + 2];
+                if(nnear < SPAT_NEAREST) {
+                    nearest[nnear++] = i;
+                    continue;
+                }
+                for(x = 0, y = 0; x < nnear; x++) {
+                    const double * s = pan->speakers + 3 * nearest[x], * t = pan->speakers + 3 * nearest[y];
+                    if(v[0] * s[0] + v[1] * s[1] + v[2] * s[2] < v[0] * t[0] + v[1] * t[1] + v[2] * t[2]) {
+                        y = x;
+                    }
+                }
+                {
+                    const double * t = pan->speakers + 3 * nearest[y];
+                    if(d > v[0] * t[0] + v[1] * t[1] + v[2] * t[2]) {
+                        memmove(nearest + y, nearest + y + 1, sizeof(unsigned int) * (nnear - y - 1));
+                        nearest[nnear - 1] = i;
+                    }
+                }
+            }
+
+            /* Enclosing triplets win; among those the tightest (largest summed pairwise dot product) */
+            for(x = 0; x < nnear; x++) {
+                for(y = x + 1; y < nnear; y++) {
+                    for(z = y + 1; z < nnear; z++) {
+                        double m[9], inv[9], mingain, spread;
+                        const double * p = pan->speakers + 3 * nearest[x];
+                        const double * q = pan->speakers + 3 * nearest[y];
+                        const double * r = pan->speakers + 3 * nearest[z];
+                        memcpy(m, p, sizeof(double) * 3);
+                        memcpy(m + 3, q, sizeof(double) * 3);
+                        memcpy(m + 6, r, sizeof(double) * 3);
+                        if(!invertMatrix(m, inv, 3)) {
+                            continue;
+                        }
+                        for(i = 0; i < 3; i++) {
+                            g[i] = v[0] * inv[i] + v[1] * inv[3 + i] + v[2] * inv[6 + i];
+                        }
+                        mingain = fmin(g[0], fmin(g[1], g[2]));
+                        spread = p[0] * q[0] + p[1] * q[1] + p[2] * q[2] +
+                                 q[0] * r[0] + q[1] * r[1] + q[2] * r[2] +
+                                 p[0] * r[0] + p[1] * r[1] + p[2] * r[2];
+                        if(mingain >= -1e-9 ? (bestmin < -1e-9 || spread > bestspread) : mingain > bestmin) {
+                            bestmin = mingain;
+                            bestspread = spread;
+                            /* nearest[] is in index order, so the set is sorted */
+                            best[0] = nearest[x];
+                            best[1] = nearest[y];
+                            best[2] = nearest[z];
+                            found = 1;
+                        }
+                    }
+                }
+            }
+            /* Fails if every nearby triplet is degenerate (eg. all speakers on one great circle) */
+            if(!found || (bestset = addSet(pan, best, &capacity)) < 0) {
+                clearSpatPan(&pan);
+                return NULL;
+            }
+            pan->lookup[e * pan->nazi + a] = (unsigned int) bestset;
+        }
+    }
+    return pan;
+}
+
+SPATPAN * newAmbiEncoder(unsigned int order) {
+    SPATPAN * pan;
+    if(order < 1 || order > SPAT_MAXORDER) {
+        return NULL;
+    }
+    pan = newPanner(SPAT_AMBISONIC, (order + 1) * (order + 1), 0, 0);
+    if(pan) {
+        pan->order = order;
+    }
+    return pan;
+}
+
+void clearSpatPan(SPATPAN ** pan) {
+    if(pan && *pan) {
+        free((*pan)->speakers);
+        free((*pan)->sets);
+        free((*pan)->invmats);
+        free((*pan)->lookup);
+        free(*pan);
+        *pan = NULL;
+    }
+}
+
+void spat_gains(const SPATPAN * pan, double azimuth, double elevation, double * gains) {
+    unsigned int i, set;
+    double v[3], g[3], norm = 0.0;
+
+    if(pan->type == SPAT_AMBISONIC) {
+        /* Real spherical harmonics, ACN order, SN3D normalisation */
+        double a = azimuth * M_PI / 180.0, e = elevation * M_PI / 180.0;
+        double se = sin(e), ce = cos(e);
+        gains[0] = 1.0;
+        gains[1] = sin(a) * ce;
+        gains[2] = se;
+        gains[3] = cos(a) * ce;
+        if(pan->order >= 2) {
+            double k = sqrt(3.0) / 2.0;
+            gains[4] = k * sin(2.0 * a) * ce * ce;
+            gains[5] = k * sin(a) * sin(2.0 * e);
+            gains[6] = 0.5 * (3.0 * se * se - 1.0);
+            gains[7] = k * cos(a) * sin(2.0 * e);
+            gains[8] = k * cos(2.0 * a) * ce * ce;
+        }
+        if(pan->order >= 3) {
+            double k1 = sqrt(5.0 / 8.0), k2 = sqrt(15.0) / 2.0, k3 = sqrt(3.0 / 8.0);
+            gains[9] = k1 * sin(3.0 * a) * ce * ce * ce;
+            gains[10] = k2 * sin(2.0 * a) * se * ce * ce;
+            gains[11] = k3 * sin(a) * ce * (5.0 * se * se - 1.0);
+            gains[12] = 0.5 * se * (5.0 * se * se - 3.0);
+            gains[13] = k3 * cos(a) * ce * (5.0 * se * se - 1.0);
+            gains[14] = k2 * cos(2.0 * a) * se * ce * ce;
+            gains[15] = k1 * cos(3.0 * a) * ce * ce * ce;
+        }
+        return;
+    }
+
+    for(i = 0; i < pan->nchans; i++) {
+        gains[i] = 0.0;
+    }
+    dirVector(azimuth, pan->type == SPAT_VBAP3D ? elevation : 0.0, v);
+    set = pan->lookup[gridCell(pan, azimuth, elevation)];
+    setGains(pan, set, v, g);
+    /* Directions between grid points may fall fractionally outside the chosen set */
+    for(i = 0; i < pan->setsize; i++) {
+        if(g[i] < 0.0) {
+            g[i] = 0.0;
+        }
+        norm += g[i] * g[i];
+    }
+    if(norm == 0.0) {
+        /* Outside every set (eg. in a gap of 180 degrees or more), so the set's nearest speaker takes it all */
+        unsigned int nearest = 0;
+        double dot, best = -HUGE_VAL;
+        for(i = 0; i < pan->setsize; i++) {
+            const double * sp = pan->speakers + 3 * pan->sets[set * pan->setsize + i];
+            dot = v[0] * sp[0] + v[1] * sp[1] + v[2] * sp[2];
+            if(dot > best) {
+                best = dot;
+                nearest = i;
+            }
+        }
+        g[nearest] = norm = 1.0;
+    }
+    norm = 1.0 / sqrt(norm);
+    for(i = 0; i < pan->setsize; i++) {
+        gains[pan->sets[set * pan->setsize + i]] = g[i] * norm;
+    }
+}
+
+void spat_render(const SPATPAN * pan, const float * const * sources, const double * azimuths,
+                 const double * elevations, unsigned int nsources, float * const * bus, size_t nframes,
+                 double * lastgains) {
+    double gains[SPAT_MAXCHANS];
+    unsigned int s, ch;
+    size_t i;
+    DSP_PROBE_BEGIN(start);
+
+    for(s = 0; s < nsources; s++) {
+        const float * src = sources[s];
+        double * last = lastgains ? lastgains + (size_t) s * pan->nchans : NULL;
+        spat_gains(pan, azimuths[s], elevations ? elevations[s] : 0.0, gains);
+        for(ch = 0; ch < pan->nchans; ch++) {
+            float gain = (float) (last ? last[ch] : gains[ch]);
+            float dgain = last && nframes ? (float) ((gains[ch] - last[ch]) / nframes) : 0.0f;
+            float * out = bus[ch];
+            if(last) {
+                last[ch] = gains[ch];
+            }
+            if(gain == 0.0f && dgain == 0.0f) {
+                continue;
+            }
+            /* As stereoPanPlanar: the gain is computed from the frame index, so the loop still vectorises */
+            for(i = 0; i < nframes; i++) {
+                out[i] += (gain + dgain * (float) i) * src[i];
+            }
+        }
+    }
+    DSP_PROBE_END(DSP_PROBE_SPATIAL, start, nframes * nsources);
+}
@@ -0,0 +1,127 @@
+#ifndef _SPATIAL_H_
+#define _SPATIAL_H_
+
+#include <stddef.h>
+
+/**
+ * Multichannel panner type enumeration.
+ */
+enum {SPAT_VBAP2D, SPAT_VBAP3D, SPAT_AMBISONIC};
+
+/**
+ * Resolution (degrees) of the direction grid used to look up VBAP speaker pairs and triplets.
+ */
+#define SPAT_GRIDRES 2.0
+
+/**
+ * Maximum number of output channels (speakers).
+ */
+#define SPAT_MAXCHANS 256
+
+/**
+ * Highest supported ambisonic order.
+ */
+#define SPAT_MAXORDER 3
+
+/**
+ * Defines the schema for a multichannel panner - a generalisation of PANPOS to N outputs.
+ *
+ * Directions are given in degrees: azimuth anticlockwise from the front, elevation upwards from the horizon.
+ * VBAP panners precompute the inverse of every speaker pair (2D) or triplet (3D) and a direction grid that
+ * maps each direction to its pair/triplet, so finding the gains costs one lookup and one small matrix product.
+ *
+ * @param type - the panner type (SPAT_VBAP2D, SPAT_VBAP3D, SPAT_AMBISONIC)
+ * @param nchans - the number of output channels (speakers, or (order+1)^2 ambisonic channels)
+ * @param order - the ambisonic order (0 for VBAP)
+ * @param speakers - speaker unit vectors, 3 per speaker (VBAP only)
+ * @param setsize - speakers per set: 2 for pairs, 3 for triplets
+ * @param nsets - the number of speaker sets
+ * @param sets - the speaker indices of each set, setsize per set
+ * @param invmats - the inverse speaker matrix of each set, setsize * setsize per set (row major)
+ * @param lookup - the set index for each direction grid cell
+ * @param nazi,nele - the direction grid dimensions
+ */
+typedef struct spatpan {
+    int type;
+    unsigned int nchans;
+    unsigned int order;
+    double * speakers;
+    unsigned int setsize;
+    unsigned int nsets;
+    unsigned int * sets;
+    double * invmats;
+    unsigned int * lookup;
+    unsigned int nazi, nele;
+} SPATPAN;
+
+/**
+ * Create a horizontal (2D) VBAP panner for a ring of speakers.
+ * @param azimuths - the speaker azimuths in degrees (any order)
+ * @param nspeakers - the number of speakers (2 to SPAT_MAXCHANS)
+ * @return pointer to a dynamically allocated SPATPAN object, or NULL if unsuccessful
+ */
+SPATPAN * newVBAP2D(const double * azimuths, unsigned int nspeakers);
+
+/**
+ * Create a 3D VBAP panner for an arbitrary speaker layout.
+ *
+ * For each grid direction the triplet is chosen from the nearest speakers, preferring triplets that enclose
+ * the direction (all gains non-negative) and, among those, the tightest one.
+ *
+ * @param azimuths - the speaker azimuths in degrees
+ * @param elevations - the speaker elevations in degrees
+ * @param nspeakers - the number of speakers (3 to SPAT_MAXCHANS, not all on one great circle)
+ * @return pointer to a dynamically allocated SPATPAN object, or NULL if unsuccessful
+ */
+SPATPAN * newVBAP3D(const double * azimuths, const double * elevations, unsigned int nspeakers);
+
+/**
+ * Create an ambisonic encoder (ACN channel order, SN3D normalisation).
+ * @param order - the ambisonic order (1 to SPAT_MAXORDER)
+ * @return pointer to a dynamically allocated SPATPAN object, or NULL if unsuccessful
+ */
+SPATPAN * newAmbiEncoder(unsigned int order);
+
+/**
+ * Destroy a SPATPAN object by freeing all memory.
+ * @param pan - pointer to a pointer for the SPATPAN object, set to NULL on return
+ */
+void clearSpatPan(SPATPAN ** pan);
+
+/**
+ * Compute the channel gains for a direction.
+ *
+ * VBAP gains are power normalised; at most 2 (2D) or 3 (3D) gains are non-zero.
+ *
+ * @param pan - pointer to an initialised SPATPAN object
+ * @param azimuth - the source azimuth in degrees
+ * @param elevation - the source elevation in degrees (ignored by 2D VBAP)
+ * @param gains - output array of pan->nchans gains
+ */
+void spat_gains(const SPATPAN * pan, double azimuth, double elevation, double * gains);
+
+/**
+ * Pan a batch of mono sources into a planar N-channel bus, accumulating into the bus.
+ *
+ * Gains are computed once per source per block. With lastgains, each channel's gain ramps linearly from the
+ * gain the source reached at the end of the previous block to the new one (reached at the frame after the last,
+ * as for stereoPanPlanar), so a moving source does not step at block boundaries. Each source is mixed only into
+ * the channels with a non-zero gain at either end, with the per-channel inner loop running over frames so it
+ * vectorises.
+ *
+ * @param pan - pointer to an initialised SPATPAN object
+ * @param sources - array of nsources mono input buffers
+ * @param azimuths - the azimuth of each source in degrees
+ * @param elevations - the elevation of each source in degrees (may be NULL for all-horizontal sources)
+ * @param nsources - the number of sources
+ * @param bus - array of pan->nchans output buffers, accumulated into
+ * @param nframes - the number of frames in each buffer
+ * @param lastgains - nsources * pan->nchans gains, source by source, holding each source's gains at the end of
+ * the previous block and updated to the new ones on return. Fill a source's entries with spat_gains to start it
+ * in place, or with zeros to fade it in. NULL applies the new gains to the whole block.
+ */
+void spat_render(const SPATPAN * pan, const float * const * sources, const double * azimuths,
+                 const double * elevations, unsigned int nsources, float * const * bus, size_t nframes,
+                 double * lastgains);
+
+#endif
@@ -1,46 +1,258 @@
 #include "sweep.h"
+#include "instrument.h"
 #include <math.h>
 #include <stdlib.h>
 
+/**
+ * Set the forward (direction > 0) or backward state of a generator to the exact phase at sample m.
+ */
+static void resync(ESSGEN * gen, unsigned long m, int direction);
+
+/**
+ * Shared block generator for the forward sweep and the inverse filter, writing to either a double or float buffer.
+ */
+static unsigned long generate(ESSGEN * gen, int inverse, double * outd, float * outf, unsigned long n);
+
+static void resync(ESSGEN * gen, unsigned long m, int direction) {
+    double E = exp(m / (gen->L * gen->fs));
+    double phase = gen->K * (E - 1.0);
+    /* Phase increment from sample m to m + 1 */
+    double delta = gen->K * E * gen->rm1;
+    double * z = direction > 0 ? gen->fz : gen->iz;
+    double * w = direction > 0 ? gen->fw : gen->iw;
+    z[0] = cos(phase);
+    z[1] = sin(phase);
+    if(direction > 0) {
+        w[0] = cos(delta);
+        w[1] = sin(delta);
+        /* The increment grows by delta * (r - 1) per sample */
+        gen->feps = delta * gen->rm1;
+    }
+    else {
+        /* Stepping backwards needs the increment from m - 1 to m */
+        delta /= gen->r;
+        w[0] = cos(delta);
+        w[1] = sin(delta);
+        gen->ieps = delta * gen->rm1 / gen->r;
+        gen->amp = exp((gen->size - 1 - m) / gen->fs * gen->Ka / gen->T);
+    }
+}
+
+static unsigned long generate(ESSGEN * gen, int inverse, double * outd, float * outf, unsigned long n) {
+    unsigned long i, pos = inverse ? gen->ipos : gen->pos;
+    double * z = inverse ? gen->iz : gen->fz;
+    double * w = inverse ? gen->iw : gen->fw;
+    double eps = inverse ? gen->ieps : gen->feps;
+    double invr = 1.0 / gen->r;
+    double zr = z[0], zi = z[1], wr = w[0], wi = w[1], amp = gen->amp;
+    double e2, cr, ci, t, val;
+    DSP_PROBE_BEGIN(start);
+
+    if(n > gen->size - pos) {
+        n = gen->size - pos;
+    }
+    for(i = 0; i < n; i++, pos++) {
+        if(pos % ESS_RESYNC == 0) {
+            /* Exact phase every ESS_RESYNC samples bounds the drift of the recurrences */
+            if(inverse) {
+                resync(gen, gen->size - 1 - pos, -1);
+                eps = gen->ieps;
+                amp = gen->amp;
+            }
+            else {
+                resync(gen, pos, 1);
+                eps = gen->feps;
+            }
+            zr = z[0]; zi = z[1]; wr = w[0]; wi = w[1];
+        }
+        /* cos and sin of the small increment angle (|eps| << 1) */
+        e2 = eps * eps;
+        cr = 1.0 - e2 * (0.5 - e2 / 24.0);
+        ci = eps * (1.0 - e2 * (1.0 / 6.0 - e2 / 120.0));
+        if(inverse) {
+            val = amp * zi;
+            amp *= gen->ampmul;
+            /* w holds the rotation from m - 1 to m: z[m-1] = z[m] * conj(w), then w steps back by conj(rot) */
+            t = zr * wr + zi * wi;
+            zi = zi * wr - zr * wi;
+            zr = t;
+            t = wr * cr + wi * ci;
+            wi = wi * cr - wr * ci;
+            wr = t;
+            eps *= invr;
+        }
+        else {
+            val = zi;
+            /* z[m+1] = z[m] * w[m], w[m+1] = w[m] * rot */
+            t = zr * wr - zi * wi;
+            zi = zr * wi + zi * wr;
+            zr = t;
+            t = wr * cr - wi * ci;
+            wi = wr * ci + wi * cr;
+            wr = t;
+            eps *= gen->r;
+        }
+        if(outd) {
+            outd[i] = val;
+        }
+        else {
+            outf[i] = (float) val;
+        }
+    }
+
+    z[0] = zr; z[1] = zi; w[0] = wr; w[1] = wi;
+    if(inverse) {
+        gen->ieps = eps;
+        gen->amp = amp;
+        gen->ipos = pos;
+    }
+    else {
+        gen->feps = eps;
+        gen->pos = pos;
+    }
+    DSP_PROBE_END(DSP_PROBE_SWEEPGEN, start, n);
+    return n;
+}
+
 ESS * newSweep(double T, double fs, double startFreq, double endFreq) {
-    unsigned int i;
-    double pi = 4.0 * atan(1.0);
-    double dT = 1.0/fs;
-    double Ka, K, L;
+    return newSweep_a(T, fs, startFreq, endFreq, NULL);
+}
+
+ESS * newSweep_a(double T, double fs, double startFreq, double endFreq, const DSPALLOC * alloc) {
     ESS * sweep;
-    
-    /* Allocate memory for sweep object */
-    sweep = (ESS *) malloc(sizeof(ESS));
-    
-    sweep->size = (unsigned long) T * fs;
+    ESSGEN * gen;
 
-    /* Allocate memory for sweep buffers */
-    sweep->forward = (double *) malloc(sizeof(double) * (sweep->size));
-    sweep->inverse = (double *) malloc(sizeof(double) * (sweep->size));
+    if(!(gen = newSweepGen_a(T, fs, startFreq, endFreq, alloc))) {
+        return NULL;
+    }
 
-    /* Constant definitions */
-    K = (T * 2 * pi * startFreq) / log(endFreq/startFreq);
-    L = (T / log(endFreq/startFreq));
-    Ka = log(pow(10.0, -6*log2(endFreq/startFreq)/20));
-    
-    /* Compute forward sweep */
-    for (i = 0; i < sweep->size; i++) {
-        sweep->forward[i] = sin(K * (exp(i*dT/L) - 1));
+    /* Allocate memory for sweep object */
+    sweep = (ESS *) dsp_alloc(alloc, sizeof(ESS));
+    if(!sweep) {
+        clearSweepGen_a(&gen, alloc);
+        return NULL;
     }
+    sweep->size = gen->size;
 
-    /* Compute inverse sweep */
-    for (i = 0; i < sweep->size; i++) {
-        double amp = exp(i * dT * Ka/T);
-        sweep->inverse[i] = amp * sweep->forward[sweep->size-1-i];
+    /* Allocate memory for sweep buffers */
+    sweep->forward = (double *) dsp_alloc(alloc, sizeof(double) * (sweep->size));
+    sweep->inverse = (double *) dsp_alloc(alloc, sizeof(double) * (sweep->size));
+    if(!sweep->forward || !sweep->inverse) {
+        clearSweep_a(&sweep, alloc);
+        clearSweepGen_a(&gen, alloc);
+        return NULL;
     }
 
+    /* Compute forward sweep and inverse filter */
+    essgen_forward(gen, sweep->forward, sweep->size);
+    essgen_inverse(gen, sweep->inverse, sweep->size);
+
+    clearSweepGen_a(&gen, alloc);
     return sweep;
 }
 
 void clearSweep(ESS ** sweep) {
+    clearSweep_a(sweep, NULL);
+}
+
+void clearSweep_a(ESS ** sweep, const DSPALLOC * alloc) {
     if(*sweep) {
-        free((*sweep)->forward);
-        free((*sweep)->inverse);
-        free(*sweep);
+        dsp_free(alloc, (*sweep)->forward);
+        dsp_free(alloc, (*sweep)->inverse);
+        dsp_free(alloc, *sweep);
+        *sweep = NULL;
+    }
+}
+
+ESSGEN * newSweepGen(double T, double fs, double startFreq, double endFreq) {
+    return newSweepGen_a(T, fs, startFreq, endFreq, NULL);
+}
+
+ESSGEN * newSweepGen_a(double T, double fs, double startFreq, double endFreq, const DSPALLOC * alloc) {
+    double pi = 4.0 * atan(1.0);
+    ESSGEN * gen;
+
+    /* Down-sweeps (endFreq < startFreq) run on the same recurrences: L, K and rm1 turn negative, the phase still
+     increases, and the inverse filter's envelope grows instead of decaying */
+    if(T <= 0.0 || fs <= 0.0 || startFreq <= 0.0 || endFreq <= 0.0 || endFreq == startFreq) {
+        return NULL;
+    }
+    gen = (ESSGEN *) dsp_alloc(alloc, sizeof(ESSGEN));
+    if(!gen) {
+        return NULL;
+    }
+    gen->size = (unsigned long) (T * fs);
+    gen->fs = fs;
+    gen->T = T;
+
+    /* Constant definitions */
+    gen->K = (T * 2 * pi * startFreq) / log(endFreq/startFreq);
+    gen->L = (T / log(endFreq/startFreq));
+    gen->Ka = log(pow(10.0, -6*log2(endFreq/startFreq)/20));
+    gen->rm1 = expm1(1.0 / (gen->L * fs));
+    gen->r = 1.0 + gen->rm1;
+    gen->ampmul = exp(gen->Ka / (T * fs));
+
+    essgen_reset(gen);
+    return gen;
+}
+
+ESSGEN * newSyncSweepGen(double T, double fs, double startFreq, double endFreq) {
+    if(T <= 0.0 || startFreq <= 0.0 || endFreq <= startFreq) {
+        return NULL;
+    }
+    return newSweepGen(T, fs, essgen_syncfreq(T, startFreq, endFreq), endFreq);
+}
+
+double essgen_syncfreq(double T, double startFreq, double endFreq) {
+    /* g(f) = f * T / ln(endFreq / f) increases monotonically from 0 towards infinity on (0, endFreq) */
+    double lo = 0.0, hi = endFreq, mid, target;
+    int i;
+    target = floor(startFreq * T / log(endFreq / startFreq) + 0.5);
+    if(target < 1.0) {
+        target = 1.0;
+    }
+    for(i = 0; i < 200 && hi - lo > hi * 1e-15; i++) {
+        mid = 0.5 * (lo + hi);
+        if(mid * T / log(endFreq / mid) < target) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return 0.5 * (lo + hi);
+}
+
+void essgen_reset(ESSGEN * gen) {
+    gen->pos = 0;
+    gen->ipos = 0;
+    gen->amp = 1.0;
+}
+
+unsigned long essgen_forward(ESSGEN * gen, double * out, unsigned long n) {
+    return generate(gen, 0, out, NULL, n);
+}
+
+unsigned long essgen_forwardf(ESSGEN * gen, float * out, unsigned long n) {
+    return generate(gen, 0, NULL, out, n);
+}
+
+unsigned long essgen_inverse(ESSGEN * gen, double * out, unsigned long n) {
+    return generate(gen, 1, out, NULL, n);
+}
+
+unsigned long essgen_inversef(ESSGEN * gen, float * out, unsigned long n) {
+    return generate(gen, 1, NULL, out, n);
+}
+
+void clearSweepGen(ESSGEN ** gen) {
+    clearSweepGen_a(gen, NULL);
+}
+
+void clearSweepGen_a(ESSGEN ** gen, const DSPALLOC * alloc) {
+    if(*gen) {
+        dsp_free(alloc, *gen);
+        *gen = NULL;
     }
 }
@@ -1,6 +1,12 @@
 #ifndef SWEEP_H
 #define SWEEP_H
 #include <math.h>
+#include "dspalloc.h"
+
+/**
+ * Number of samples generated by the ESSGEN recurrences between exact phase resynchronisations.
+ */
+#define ESS_RESYNC 256
 
 typedef struct logSweep {
     double * forward;
@@ -8,7 +14,161 @@ typedef struct logSweep {
     unsigned long size;
 } ESS;
 
+/**
+ * Defines the schema for a streaming exponential sine sweep generator.
+ *
+ * The forward sweep x[n] = sin(K(exp(n/Lfs) - 1)) and its inverse filter are produced block by block without
+ * per-sample transcendentals: the phasor is advanced by a complex rotation whose angle is itself rotated by a
+ * geometrically growing increment (a short Taylor series), and resynchronised with the exact phase every
+ * ESS_RESYNC samples. The inverse filter is generated backwards from the end of the sweep with a recursive
+ * amplitude envelope, so neither signal is ever held in memory.
+ *
+ * @param size - the length of the sweep in samples
+ * @param fs - the sample rate
+ * @param T - the sweep duration in seconds
+ * @param K - the phase scale T * 2pi * f1 / ln(f2/f1)
+ * @param L - the sweep rate T / ln(f2/f1) in seconds
+ * @param Ka - the log amplitude decay of the inverse filter over the whole sweep
+ * @param r - the per-sample growth of the instantaneous frequency, exp(1 / (L fs))
+ * @param rm1 - r - 1, computed without cancellation
+ * @param pos - the next forward sample index
+ * @param fz,fw,feps - forward phasor, per-sample rotation and rotation increment angle
+ * @param ipos - the next inverse filter sample index
+ * @param iz,iw,ieps - inverse (backwards) phasor, rotation and increment angle
+ * @param amp,ampmul - the inverse filter envelope and its per-sample multiplier
+ */
+typedef struct essgen {
+    unsigned long size;
+    double fs;
+    double T;
+    double K, L, Ka;
+    double r, rm1;
+    unsigned long pos;
+    double fz[2], fw[2], feps;
+    unsigned long ipos;
+    double iz[2], iw[2], ieps;
+    double amp, ampmul;
+} ESSGEN;
+
+/**
+ * Create a sweep and its inverse filter in memory (see newSweepGen; down-sweeps are accepted).
+ * @param T - the sweep duration in seconds
+ * @param fs - the sample rate
+ * @param startFreq - the start frequency in Hz
+ * @param endFreq - the end frequency in Hz (different from startFreq)
+ * @return pointer to a dynamically allocated ESS object, or NULL if unsuccessful
+ */
 ESS * newSweep(double T, double fs, double startFreq, double endFreq);
 void clearSweep(ESS ** sweep);
 
+/**
+ * Create a sweep with its forward and inverse buffers taken from a given allocator (see newSweep).
+ * @param alloc - the allocator, or NULL for the heap
+ * @return pointer to an ESS object, or NULL if unsuccessful
+ */
+ESS * newSweep_a(double T, double fs, double startFreq, double endFreq, const DSPALLOC * alloc);
+
+/**
+ * Destroy a sweep created by newSweep_a.
+ * @param sweep - pointer to a pointer for the ESS object, set to NULL on return
+ * @param alloc - the allocator the sweep was created with
+ */
+void clearSweep_a(ESS ** sweep, const DSPALLOC * alloc);
+
+/**
+ * Create a streaming sweep generator. Returns NULL if unsuccessful. An end frequency below the start frequency
+ * gives a down-sweep, whose inverse filter envelope rises instead of decaying, as newSweep has always produced.
+ * @param T - the sweep duration in seconds
+ * @param fs - the sample rate
+ * @param startFreq - the start frequency in Hz
+ * @param endFreq - the end frequency in Hz (different from startFreq)
+ * @return pointer to a dynamically allocated ESSGEN object
+ */
+ESSGEN * newSweepGen(double T, double fs, double startFreq, double endFreq);
+
+/**
+ * Create a streaming sweep generator with a given allocator (see newSweepGen).
+ * @param alloc - the allocator, or NULL for the heap
+ * @return pointer to an ESSGEN object, or NULL if unsuccessful
+ */
+ESSGEN * newSweepGen_a(double T, double fs, double startFreq, double endFreq, const DSPALLOC * alloc);
+
+/**
+ * Create a streaming synchronized sweep generator, whose harmonics stay phase aligned with the fundamental.
+ * The start frequency is adjusted with essgen_syncfreq. Only up-sweeps can be synchronized. Returns NULL if
+ * unsuccessful.
+ * @param T - the sweep duration in seconds
+ * @param fs - the sample rate
+ * @param startFreq - the requested start frequency in Hz
+ * @param endFreq - the end frequency in Hz (greater than startFreq)
+ * @return pointer to a dynamically allocated ESSGEN object
+ */
+ESSGEN * newSyncSweepGen(double T, double fs, double startFreq, double endFreq);
+
+/**
+ * Find the start frequency closest to startFreq for which the sweep is synchronized, ie. startFreq * L is an
+ * integer (L = T / ln(endFreq / startFreq)), so each harmonic's phase matches the fundamental's at its
+ * time-advanced position. Solved by bisection with T and endFreq fixed.
+ * @param T - the sweep duration in seconds
+ * @param startFreq - the requested start frequency in Hz
+ * @param endFreq - the end frequency in Hz (greater than startFreq)
+ * @return the adjusted start frequency
+ */
+double essgen_syncfreq(double T, double startFreq, double endFreq);
+
+/**
+ * Rewind both the forward and inverse outputs of a sweep generator to the start.
+ * @param gen - pointer to an ESSGEN object
+ */
+void essgen_reset(ESSGEN * gen);
+
+/**
+ * Generate the next block of the forward sweep.
+ * @param gen - pointer to an ESSGEN object
+ * @param out - output buffer
+ * @param n - the maximum number of samples to generate
+ * @return the number of samples generated (less than n at the end of the sweep)
+ */
+unsigned long essgen_forward(ESSGEN * gen, double * out, unsigned long n);
+
+/**
+ * Generate the next block of the forward sweep as floats.
+ * @param gen - pointer to an ESSGEN object
+ * @param out - output buffer
+ * @param n - the maximum number of samples to generate
+ * @return the number of samples generated
+ */
+unsigned long essgen_forwardf(ESSGEN * gen, float * out, unsigned long n);
+
+/**
+ * Generate the next block of the inverse filter (the time-reversed sweep with an exponentially decaying envelope).
+ * @param gen - pointer to an ESSGEN object
+ * @param out - output buffer
+ * @param n - the maximum number of samples to generate
+ * @return the number of samples generated (less than n at the end of the filter)
+ */
+unsigned long essgen_inverse(ESSGEN * gen, double * out, unsigned long n);
+
+/**
+ * Generate the next block of the inverse filter as floats.
+ * @param gen - pointer to an ESSGEN object
+ * @param out - output buffer
+ * @param n - the maximum number of samples to generate
+ * @return the number of samples generated
+ */
+unsigned long essgen_inversef(ESSGEN * gen, float * out, unsigned long n);
+
+/**
+ * Destroy an ESSGEN object.
+ * @param gen - pointer to a pointer for the ESSGEN object, set to NULL on return
+ */
+void clearSweepGen(ESSGEN ** gen);
+
+/**
+ * Destroy an ESSGEN object created by newSweepGen_a.
+ * @param gen - pointer to a pointer for the ESSGEN object, set to NULL on return
+ * @param alloc - the allocator the generator was created with
+ */
+void clearSweepGen_a(ESSGEN ** gen, const DSPALLOC * alloc);
+
 #endif
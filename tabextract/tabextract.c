@@ -0,0 +1,570 @@
+#include "tabextract.h"
+#include "parallel.h"
+#include <kiss_fftr.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * Half-length in samples of the band-limited interpolator used to resample a cycle.
+ */
+#define TAB_INTERPRADIUS 16
+
+/**
+ * Default aperiodicity threshold for the pitch detector.
+ */
+#define TAB_THRESHOLD 0.15
+
+/**
+ * Aperiodicity above which a recording is treated as having no period at all.
+ */
+#define TAB_APERIODIC 0.5
+
+/**
+ * Largest number of periods the period estimate is refined over.
+ */
+#define TAB_REFINECYCLES 16
+
+/**
+ * Default top of the first mipmap band (Hz).
+ */
+#define TAB_BASEFREQ 20.0
+
+/**
+ * Largest number of tables in a mipmap set.
+ */
+#define TAB_MAXTABLES 32
+
+/**
+ * Shared state for the tab_batch workers.
+ */
+typedef struct tabbatch {
+    TABJOB * jobs;
+    unsigned int njobs;
+    unsigned int next;
+} TABBATCH;
+
+/**
+ * Defines the schema for the spectrum of one averaged cycle.
+ *
+ * @param bins - the spectrum, size / 2 + 1 bins
+ * @param size - the number of points the cycle was resampled to (a power of 2)
+ * @param nharms - the number of harmonics below the recording's Nyquist frequency
+ * @param period - the period of the cycle in samples
+ */
+typedef struct cyclespec {
+    kiss_fft_cpx * bins;
+    unsigned long size;
+    unsigned long nharms;
+    double period;
+} CYCLESPEC;
+
+/**
+ * Get the smallest power of 2 no less than n.
+ */
+static unsigned long nextPow2(unsigned long n);
+
+/**
+ * Band-limited interpolation of a recording with a Blackman-windowed sinc. Samples outside the recording
+ * count as silence.
+ * @param samples - the recording
+ * @param length - the length of the recording
+ * @param pos - the fractional sample position
+ * @return the interpolated value
+ */
+static double interpolate(const double * samples, unsigned long length, double pos);
+
+/**
+ * Refine a period estimate by locating the difference function minimum at a lag of several periods, where the
+ * error of the interpolated minimum is divided by the number of periods.
+ * @param x - the recording from the analysis offset
+ * @param available - the number of samples from the offset
+ * @param window - the difference function window
+ * @param period - the period estimate
+ * @return the refined period
+ */
+static double refinePeriod(const double * x, unsigned long available, unsigned long window, double period);
+
+/**
+ * The difference function: sum of squared differences between a window and the window lag samples on.
+ */
+static double difference(const double * x, unsigned long window, unsigned long lag);
+
+/**
+ * Detect the period, then resample the requested number of cycles to a power of 2, average and transform them.
+ * The fundamental is rotated to sine phase so tables from different recordings line up.
+ * @param samples - the recording
+ * @param length - the length of the recording
+ * @param spec - the extraction settings
+ * @param cycle - populated with the spectrum, to be freed by the caller
+ * @param errMsg - pointer to a string which is set to an error description on failure
+ * @return boolean integer specifying whether the spectrum was computed
+ */
+static int cycleSpectrum(const double * samples, unsigned long length, const TABSPEC * spec, CYCLESPEC * cycle,
+                         char ** errMsg);
+
+/**
+ * Resynthesise a table from the first nharms harmonics of a cycle spectrum (without DC).
+ * @param cycle - the cycle spectrum
+ * @param nharms - the number of harmonics
+ * @param tablen - the table length (a power of 2)
+ * @param cfg - an inverse real FFT configuration for tablen
+ * @param freq - tablen / 2 + 1 work bins
+ * @param time - tablen work samples
+ * @return pointer to an unnormalised GTABLE object allocated on the heap, or NULL if unsuccessful
+ */
+static GTABLE * synthTable(const CYCLESPEC * cycle, unsigned long nharms, unsigned long tablen, kiss_fftr_cfg cfg,
+                           kiss_fft_cpx * freq, kiss_fft_scalar * time);
+
+/**
+ * Scale a table and its guard point.
+ */
+static void scaleTable(GTABLE * table, double gain);
+
+/**
+ * Run jobs until none are left.
+ * @param arg - pointer to the TABBATCH
+ */
+static void batchWorker(void * arg);
+
+static unsigned long nextPow2(unsigned long n) {
+    unsigned long size = 1;
+    while(size < n) {
+        size <<= 1;
+    }
+    return size;
+}
+
+static double difference(const double * x, unsigned long window, unsigned long lag) {
+    unsigned long j;
+    double delta, sum = 0.0;
+    for(j = 0; j < window; j++) {
+        delta = x[j] - x[j + lag];
+        sum += delta * delta;
+    }
+    return sum;
+}
+
+static double refinePeriod(const double * x, unsigned long available, unsigned long window, double period) {
+    unsigned long cycles, lag, steps;
+    double below, here, above, den;
+
+    /* Room for the lag, one more sample and up to cycles / 2 steps of walking */
+    cycles = (unsigned long) (((double) available - window - 2) / (period + 0.5));
+    if(cycles > TAB_REFINECYCLES) {
+        cycles = TAB_REFINECYCLES;
+    }
+    if(cycles < 2) {
+        return period;
+    }
+    lag = (unsigned long) floor(cycles * period + 0.5);
+    below = difference(x, window, lag - 1);
+    here = difference(x, window, lag);
+    above = difference(x, window, lag + 1);
+    /* The estimate is within half a sample per period, so walk downhill at most cycles / 2 samples */
+    for(steps = 0; steps < cycles / 2 + 1 && (below < here || above < here); steps++) {
+        if(below < above) {
+            lag--;
+            above = here;
+            here = below;
+            below = difference(x, window, lag - 1);
+        }
+        else {
+            lag++;
+            below = here;
+            here = above;
+            above = difference(x, window, lag + 1);
+        }
+    }
+    /* Keep the estimate unless the minimum is bracketed, eg. when the pitch drifts over the span */
+    den = below - 2.0 * here + above;
+    if(below < here || above < here || den <= 0.0) {
+        return period;
+    }
+    return ((double) lag + 0.5 * (below - above) / den) / (double) cycles;
+}
+
+static double interpolate(const double * samples, unsigned long length, double pos) {
+    long first = (long) floor(pos) - TAB_INTERPRADIUS + 1, last = (long) floor(pos) + TAB_INTERPRADIUS, i;
+    double sum = 0.0, x, w;
+
+    for(i = first; i <= last; i++) {
+        if(i < 0 || i >= (long) length) {
+            continue;
+        }
+        x = pos - (double) i;
+        if(fabs(x) >= TAB_INTERPRADIUS) {
+            continue;
+        }
+        w = 0.42 + 0.5 * cos(M_PI * x / TAB_INTERPRADIUS) + 0.08 * cos(2.0 * M_PI * x / TAB_INTERPRADIUS);
+        sum += samples[i] * w * (x == 0.0 ? 1.0 : sin(M_PI * x) / (M_PI * x));
+    }
+    return sum;
+}
+
+double tab_period(const double * samples, unsigned long length, const TABSPEC * spec, char ** errMsg) {
+    unsigned long tmin, tmax, window, nfft, j, tau, best;
+    kiss_fftr_cfg fwd = NULL, inv = NULL;
+    kiss_fft_scalar * a = NULL, * b = NULL;
+    kiss_fft_cpx * fa = NULL, * fb = NULL;
+    double * d = NULL, * energy = NULL;
+    double threshold, running, re, im, shift, den, period = 0.0;
+    const double * x;
+
+    if(spec->fs <= 0.0 || spec->minfreq <= 0.0 || spec->maxfreq <= spec->minfreq) {
+        *errMsg = "Invalid frequency search range";
+        return 0.0;
+    }
+    tmin = (unsigned long) floor(spec->fs / spec->maxfreq);
+    tmax = (unsigned long) ceil(spec->fs / spec->minfreq);
+    if(tmin < 2) {
+        tmin = 2;
+    }
+    /* The difference function compares a window of one longest period with every lag up to that period */
+    window = tmax;
+    if(tmax <= tmin || spec->offset >= length || length - spec->offset < window + tmax + 1) {
+        *errMsg = "Recording is too short for the lowest frequency searched for";
+        return 0.0;
+    }
+    x = samples + spec->offset;
+    threshold = spec->threshold > 0.0 ? spec->threshold : TAB_THRESHOLD;
+    nfft = nextPow2(window + tmax + 1);
+
+    fwd = kiss_fftr_alloc((int) nfft, 0, NULL, NULL);
+    inv = kiss_fftr_alloc((int) nfft, 1, NULL, NULL);
+    a = (kiss_fft_scalar *) calloc(nfft, sizeof(kiss_fft_scalar));
+    b = (kiss_fft_scalar *) calloc(nfft, sizeof(kiss_fft_scalar));
+    fa = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * (nfft / 2 + 1));
+    fb = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * (nfft / 2 + 1));
+    d = (double *) malloc(sizeof(double) * (tmax + 2));
+    energy = (double *) malloc(sizeof(double) * (window + tmax + 2));
+    if(!fwd || !inv || !a || !b || !fa || !fb || !d || !energy) {
+        *errMsg = "Could not allocate pitch detection buffers";
+        goto done;
+    }
+
+    /* Correlation of the window with the window plus every lag: r(tau) = sum over j of x[j] * x[j + tau] */
+    for(j = 0; j < window + tmax + 1; j++) {
+        b[j] = (kiss_fft_scalar) x[j];
+        if(j < window) {
+            a[j] = b[j];
+        }
+    }
+    kiss_fftr(fwd, a, fa);
+    kiss_fftr(fwd, b, fb);
+    for(j = 0; j <= nfft / 2; j++) {
+        re = fa[j].r * fb[j].r + fa[j].i * fb[j].i;
+        im = fa[j].r * fb[j].i - fa[j].i * fb[j].r;
+        fa[j].r = (kiss_fft_scalar) re;
+        fa[j].i = (kiss_fft_scalar) im;
+    }
+    kiss_fftri(inv, fa, a);
+
+    /* Prefix sums of the energy, for the energy of the window at each lag */
+    energy[0] = 0.0;
+    for(j = 0; j < window + tmax + 1; j++) {
+        energy[j + 1] = energy[j] + x[j] * x[j];
+    }
+    if(energy[window] <= 0.0) {
+        *errMsg = "Recording is silent";
+        goto done;
+    }
+
+    /* Cumulative mean normalised difference: d(tau) * tau / sum of d(1..tau) */
+    d[0] = 1.0;
+    running = 0.0;
+    for(tau = 1; tau <= tmax; tau++) {
+        d[tau] = energy[window] + (energy[tau + window] - energy[tau]) - 2.0 * (double) a[tau] / (double) nfft;
+        running += d[tau];
+        d[tau] = running > 0.0 ? d[tau] * (double) tau / running : 1.0;
+    }
+
+    /* First dip below the threshold, followed down to its minimum, else the lowest value in range */
+    best = tmin;
+    for(tau = tmin; tau <= tmax; tau++) {
+        if(d[tau] < threshold) {
+            while(tau < tmax && d[tau + 1] < d[tau]) {
+                tau++;
+            }
+            best = tau;
+            break;
+        }
+        if(d[tau] < d[best]) {
+            best = tau;
+        }
+    }
+    if(d[best] >= TAB_APERIODIC) {
+        *errMsg = "No period found in the frequency range";
+        goto done;
+    }
+    shift = 0.0;
+    if(best > tmin && best < tmax) {
+        den = d[best - 1] - 2.0 * d[best] + d[best + 1];
+        if(den > 0.0) {
+            shift = 0.5 * (d[best - 1] - d[best + 1]) / den;
+        }
+    }
+    period = refinePeriod(x, length - spec->offset, window, (double) best + shift);
+
+done:
+    kiss_fftr_free(fwd);
+    kiss_fftr_free(inv);
+    free(a);
+    free(b);
+    free(fa);
+    free(fb);
+    free(d);
+    free(energy);
+    return period;
+}
+
+static int cycleSpectrum(const double * samples, unsigned long length, const TABSPEC * spec, CYCLESPEC * cycle,
+                         char ** errMsg) {
+    kiss_fftr_cfg cfg;
+    kiss_fft_scalar * time;
+    unsigned long j, k, size;
+    unsigned int c, ncycles = spec->ncycles ? spec->ncycles : 1;
+    double step, pos, rot, re, im, cr, ci;
+
+    memset(cycle, 0, sizeof(CYCLESPEC));
+    if(!(cycle->period = tab_period(samples, length, spec, errMsg))) {
+        return 0;
+    }
+    /* Average only the cycles the recording holds after the offset */
+    while(ncycles > 1 && (double) spec->offset + ncycles * cycle->period > (double) length) {
+        ncycles--;
+    }
+    size = nextPow2((unsigned long) ceil(cycle->period));
+    cycle->size = size;
+    /* Harmonics at or above the recording's Nyquist frequency are not in the recording */
+    cycle->nharms = (unsigned long) ceil(0.5 * cycle->period) - 1;
+    if(cycle->nharms > size / 2 - 1) {
+        cycle->nharms = size / 2 - 1;
+    }
+
+    cfg = kiss_fftr_alloc((int) size, 0, NULL, NULL);
+    time = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * size);
+    cycle->bins = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * (size / 2 + 1));
+    if(!cfg || !time || !cycle->bins) {
+        kiss_fftr_free(cfg);
+        free(time);
+        free(cycle->bins);
+        cycle->bins = NULL;
+        *errMsg = "Could not allocate cycle buffers";
+        return 0;
+    }
+    step = cycle->period / (double) size;
+    for(j = 0; j < size; j++) {
+        pos = (double) spec->offset + (double) j * step;
+        re = 0.0;
+        for(c = 0; c < ncycles; c++) {
+            re += interpolate(samples, length, pos + c * cycle->period);
+        }
+        time[j] = (kiss_fft_scalar) (re / ncycles);
+    }
+    kiss_fftr(cfg, time, cycle->bins);
+    kiss_fftr_free(cfg);
+    free(time);
+
+    /* Circular shift putting the fundamental in sine phase: bin k turns by k times the fundamental's turn */
+    rot = -M_PI / 2.0 - atan2(cycle->bins[1].i, cycle->bins[1].r);
+    if(cycle->bins[1].r != 0.0 || cycle->bins[1].i != 0.0) {
+        for(k = 1; k <= size / 2; k++) {
+            cr = cos(rot * k);
+            ci = sin(rot * k);
+            re = cycle->bins[k].r * cr - cycle->bins[k].i * ci;
+            im = cycle->bins[k].r * ci + cycle->bins[k].i * cr;
+            cycle->bins[k].r = (kiss_fft_scalar) re;
+            cycle->bins[k].i = (kiss_fft_scalar) im;
+        }
+    }
+    return 1;
+}
+
+static GTABLE * synthTable(const CYCLESPEC * cycle, unsigned long nharms, unsigned long tablen, kiss_fftr_cfg cfg,
+                           kiss_fft_cpx * freq, kiss_fft_scalar * time) {
+    double * samples;
+    GTABLE * table;
+    unsigned long k;
+
+    if(nharms > tablen / 2 - 1) {
+        nharms = tablen / 2 - 1;
+    }
+    memset(freq, 0, sizeof(kiss_fft_cpx) * (tablen / 2 + 1));
+    for(k = 1; k <= nharms; k++) {
+        freq[k] = cycle->bins[k];
+    }
+    kiss_fftri(cfg, freq, time);
+    if(!(samples = (double *) malloc(sizeof(double) * tablen))) {
+        return NULL;
+    }
+    /* The forward transform of size points and the unnormalised inverse leave a gain of size */
+    for(k = 0; k < tablen; k++) {
+        samples[k] = (double) time[k] / (double) cycle->size;
+    }
+    table = cycletable(samples, tablen);
+    free(samples);
+    return table;
+}
+
+static void scaleTable(GTABLE * table, double gain) {
+    unsigned long i;
+    for(i = 0; i <= table->length; i++) {
+        table->samples[i] *= gain;
+    }
+}
+
+GTABLE * tab_extract(const double * samples, unsigned long length, const TABSPEC * spec, double * period,
+                     char ** errMsg) {
+    CYCLESPEC cycle;
+    kiss_fftr_cfg cfg;
+    kiss_fft_cpx * freq;
+    kiss_fft_scalar * time;
+    GTABLE * table = NULL;
+
+    if(spec->tablen < 4 || (spec->tablen & (spec->tablen - 1))) {
+        *errMsg = "Table length must be a power of 2";
+        return NULL;
+    }
+    if(!cycleSpectrum(samples, length, spec, &cycle, errMsg)) {
+        return NULL;
+    }
+    cfg = kiss_fftr_alloc((int) spec->tablen, 1, NULL, NULL);
+    freq = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * (spec->tablen / 2 + 1));
+    time = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * spec->tablen);
+    if(cfg && freq && time) {
+        table = synthTable(&cycle, cycle.nharms, spec->tablen, cfg, freq, time);
+    }
+    if(table) {
+        normaliseTable(table);
+        if(period) {
+            *period = cycle.period;
+        }
+    }
+    else {
+        *errMsg = "Could not allocate table";
+    }
+    kiss_fftr_free(cfg);
+    free(freq);
+    free(time);
+    free(cycle.bins);
+    return table;
+}
+
+TABMIPMAP * tab_mipmap(const double * samples, unsigned long length, const TABSPEC * spec, char ** errMsg) {
+    CYCLESPEC cycle;
+    TABMIPMAP * mipmap = NULL;
+    kiss_fftr_cfg cfg;
+    kiss_fft_cpx * freq;
+    kiss_fft_scalar * time;
+    GTABLE * full = NULL;
+    unsigned long nharms[TAB_MAXTABLES], h;
+    unsigned int i, ntables = 0;
+    double top, gain;
+
+    if(spec->tablen < 4 || (spec->tablen & (spec->tablen - 1))) {
+        *errMsg = "Table length must be a power of 2";
+        return NULL;
+    }
+    if(!cycleSpectrum(samples, length, spec, &cycle, errMsg)) {
+        return NULL;
+    }
+    /* Harmonic counts per octave band: h * top must stay below fs / 2, down to a single sinusoid */
+    top = spec->basefreq > 0.0 ? spec->basefreq : TAB_BASEFREQ;
+    do {
+        top *= 2.0;
+        h = (unsigned long) ceil(0.5 * spec->fs / top) - 1;
+        if(h < 1) {
+            h = 1;
+        }
+        nharms[ntables++] = h < cycle.nharms ? h : cycle.nharms;
+    } while(h > 1 && ntables < TAB_MAXTABLES);
+
+    cfg = kiss_fftr_alloc((int) spec->tablen, 1, NULL, NULL);
+    freq = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx) * (spec->tablen / 2 + 1));
+    time = (kiss_fft_scalar *) malloc(sizeof(kiss_fft_scalar) * spec->tablen);
+    mipmap = (TABMIPMAP *) calloc(1, sizeof(TABMIPMAP));
+    if(!cfg || !freq || !time || !mipmap ||
+       !(mipmap->tables = (GTABLE **) calloc(ntables, sizeof(GTABLE *))) ||
+       !(mipmap->nharms = (unsigned long *) malloc(sizeof(unsigned long) * ntables)) ||
+       !(full = synthTable(&cycle, cycle.nharms, spec->tablen, cfg, freq, time))) {
+        *errMsg = "Could not allocate tables";
+        clear_TABMIPMAP(&mipmap);
+        goto done;
+    }
+    mipmap->ntables = ntables;
+    mipmap->basefreq = spec->basefreq > 0.0 ? spec->basefreq : TAB_BASEFREQ;
+    mipmap->period = cycle.period;
+    /* One gain for the whole set, from the full-band table */
+    gain = normaliseTable(full);
+    for(i = 0; i < ntables; i++) {
+        mipmap->nharms[i] = nharms[i];
+        if(!(mipmap->tables[i] = synthTable(&cycle, nharms[i], spec->tablen, cfg, freq, time))) {
+            *errMsg = "Could not allocate tables";
+            clear_TABMIPMAP(&mipmap);
+            goto done;
+        }
+        scaleTable(mipmap->tables[i], gain);
+    }
+
+done:
+    freeTable(&full);
+    kiss_fftr_free(cfg);
+    free(freq);
+    free(time);
+    free(cycle.bins);
+    return mipmap;
+}
+
+GTABLE * mipmap_table(const TABMIPMAP * mipmap, double freq) {
+    unsigned int i = 0;
+    double top = 2.0 * mipmap->basefreq;
+    while(i + 1 < mipmap->ntables && freq >= top) {
+        top *= 2.0;
+        i++;
+    }
+    return mipmap->tables[i];
+}
+
+static void batchWorker(void * arg) {
+    TABBATCH * batch = (TABBATCH *) arg;
+    TABJOB * job;
+    unsigned int i;
+
+    while((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) < batch->njobs) {
+        job = batch->jobs + i;
+        job->errMsg = NULL;
+        job->mipmap = tab_mipmap(job->samples, job->length, job->spec, &job->errMsg);
+    }
+}
+
+unsigned int tab_batch(TABJOB * jobs, unsigned int njobs, unsigned int nthreads) {
+    TABBATCH batch;
+    unsigned int i, succeeded = 0;
+
+    batch.jobs = jobs;
+    batch.njobs = njobs;
+    batch.next = 0;
+    dsp_parallel_for(batchWorker, &batch, njobs, nthreads);
+
+    for(i = 0; i < njobs; i++) {
+        if(jobs[i].mipmap) {
+            succeeded++;
+        }
+    }
+    return succeeded;
+}
+
+void clear_TABMIPMAP(TABMIPMAP ** mipmap) {
+    unsigned int i;
+    if(mipmap && *mipmap) {
+        if((*mipmap)->tables) {
+            for(i = 0; i < (*mipmap)->ntables; i++) {
+                freeTable(&(*mipmap)->tables[i]);
+            }
+            free((*mipmap)->tables);
+        }
+        free((*mipmap)->nharms);
+        free(*mipmap);
+        *mipmap = NULL;
+    }
+}
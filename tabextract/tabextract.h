@@ -0,0 +1,125 @@
+#ifndef _TABEXTRACT_H_
+#define _TABEXTRACT_H_
+
+#include "gtable.h"
+
+/**
+ * Defines the schema for wavetable extraction settings.
+ *
+ * @param tablen - the length of the tables to build (a power of 2)
+ * @param fs - the sample rate of the recordings, which is also the rate the mipmap bands are computed for
+ * @param minfreq - the lowest fundamental frequency searched for (Hz)
+ * @param maxfreq - the highest fundamental frequency searched for (Hz)
+ * @param threshold - the pitch detector's aperiodicity threshold (0 for the default 0.15); lower is stricter
+ * @param offset - the first sample analysed, eg. to skip the attack of a note
+ * @param ncycles - the number of consecutive cycles averaged into the table (0 or 1 for a single cycle)
+ * @param basefreq - the fundamental frequency (Hz) up to which the first mipmap table is used (0 for 20 Hz)
+ */
+typedef struct tabspec {
+    unsigned long tablen;
+    double fs;
+    double minfreq;
+    double maxfreq;
+    double threshold;
+    unsigned long offset;
+    unsigned int ncycles;
+    double basefreq;
+} TABSPEC;
+
+/**
+ * Defines the schema for a set of band-limited tables, one per octave.
+ *
+ * Table i holds only the harmonics that stay below fs / 2 for fundamentals under basefreq * 2^(i + 1), so
+ * playing each fundamental from the table mipmap_table picks for it never aliases. All tables share one gain:
+ * the full-band table is normalised to a peak of 1, keeping the level continuous across table changes.
+ *
+ * @param tables - the tables, from the most harmonics to a single sinusoid
+ * @param nharms - the number of harmonics in each table
+ * @param ntables - the number of tables
+ * @param basefreq - the fundamental frequency up to which tables[0] is used
+ * @param period - the detected period of the source in samples
+ */
+typedef struct tabmipmap {
+    GTABLE ** tables;
+    unsigned long * nharms;
+    unsigned int ntables;
+    double basefreq;
+    double period;
+} TABMIPMAP;
+
+/**
+ * Defines the schema for one extraction in a batch.
+ *
+ * @param samples - the recording
+ * @param length - the length of the recording in samples
+ * @param spec - the extraction settings
+ * @param mipmap - populated with the tables on success, NULL on failure
+ * @param errMsg - set to an error description on failure
+ */
+typedef struct tabjob {
+    const double * samples;
+    unsigned long length;
+    const TABSPEC * spec;
+    TABMIPMAP * mipmap;
+    char * errMsg;
+} TABJOB;
+
+/**
+ * Detect the period of a recording. Uses the YIN difference function (computed with FFT correlation) over
+ * a window of two longest periods from spec->offset, with parabolic interpolation of the chosen minimum.
+ * @param samples - the recording
+ * @param length - the length of the recording in samples
+ * @param spec - the extraction settings (fs, minfreq, maxfreq, threshold and offset are used)
+ * @param errMsg - pointer to a string which is set to an error description on failure
+ * @return the period in samples (fractional), or 0 if no period was found
+ */
+double tab_period(const double * samples, unsigned long length, const TABSPEC * spec, char ** errMsg);
+
+/**
+ * Extract a single-cycle table holding every harmonic of the recording below fs / 2 that fits the table.
+ * The cycle is resampled to a power of 2 with band-limited interpolation, transformed, and resynthesised at
+ * the table length without its DC offset, then normalised like the harmonic tables.
+ * @param samples - the recording
+ * @param length - the length of the recording in samples
+ * @param spec - the extraction settings
+ * @param period - pointer populated with the detected period in samples, or NULL
+ * @param errMsg - pointer to a string which is set to an error description on failure
+ * @return pointer to a GTABLE object allocated on the heap, or NULL if unsuccessful
+ */
+GTABLE * tab_extract(const double * samples, unsigned long length, const TABSPEC * spec, double * period,
+                     char ** errMsg);
+
+/**
+ * Extract a set of band-limited tables, one per octave (see TABMIPMAP).
+ * @param samples - the recording
+ * @param length - the length of the recording in samples
+ * @param spec - the extraction settings
+ * @param errMsg - pointer to a string which is set to an error description on failure
+ * @return pointer to a TABMIPMAP object allocated on the heap, or NULL if unsuccessful
+ */
+TABMIPMAP * tab_mipmap(const double * samples, unsigned long length, const TABSPEC * spec, char ** errMsg);
+
+/**
+ * Pick the table to play a fundamental frequency from.
+ * @param mipmap - pointer to a TABMIPMAP object
+ * @param freq - the fundamental frequency (Hz)
+ * @return the table with the most harmonics that does not alias at freq
+ */
+GTABLE * mipmap_table(const TABMIPMAP * mipmap, double freq);
+
+/**
+ * Run a batch of extractions, splitting the jobs between threads.
+ * @param jobs - the jobs, each of which gets its mipmap or errMsg set
+ * @param njobs - the number of jobs
+ * @param nthreads - the number of threads (0 for one per online processor)
+ * @return the number of jobs that succeeded
+ */
+unsigned int tab_batch(TABJOB * jobs, unsigned int njobs, unsigned int nthreads);
+
+/**
+ * Destroy a set of tables.
+ * @param mipmap - pointer to a pointer for the TABMIPMAP object, set to NULL on return
+ */
+void clear_TABMIPMAP(TABMIPMAP ** mipmap);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+/*
+ Minimal assertion helpers for the CTest executables. A failed check prints its location and a message and
+ the test keeps going, so one run reports every failure; CHECK_RESULT gives the process exit status.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/**
+ * Number of checks failed so far in this test executable.
+ */
+static int checkFailures = 0;
+
+/**
+ * Check a condition, printing a printf-style message on failure.
+ */
+#define CHECK(cond, ...) \
+    do { \
+        if(!(cond)) { \
+            checkFailures++; \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+        } \
+    } while(0)
+
+/**
+ * Check that two doubles agree to within an absolute tolerance.
+ */
+#define CHECK_NEAR(a, b, tol, what) \
+    CHECK(fabs((double) (a) - (double) (b)) <= (tol), "%s: %.17g vs %.17g (tolerance %g)", (what), \
+          (double) (a), (double) (b), (double) (tol))
+
+/**
+ * The exit status of a test executable.
+ */
+#define CHECK_RESULT() (checkFailures ? EXIT_FAILURE : EXIT_SUCCESS)
+
+#endif
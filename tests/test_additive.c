@@ -0,0 +1,152 @@
+/*
+ additive: from the centre of the first frame on, steady partials, including ones whose kernels fold over DC and
+ Nyquist, must overlap-add to A cos(2 pi f t + phase) within ADDITIVE_TEST_TOL, with each frame's phase reached
+ at its centre hop samples into the next block. Explicit phases must match continued ones, amplitude changes
+ must crossfade linearly between frame centres, and partials at or above fs / 2 or with no amplitude are silent.
+ */
+#include "additive.h"
+#include "check.h"
+#include <math.h>
+#include <stdlib.h>
+
+/**
+ * Sample rate, hop and number of frames rendered per case.
+ */
+#define ADDITIVE_TEST_FS 48000.0
+#define ADDITIVE_TEST_HOP 256
+#define ADDITIVE_TEST_FRAMES 24
+
+/**
+ * Agreement required with the closed form, relative to the total amplitude: the window transform is truncated
+ * to its main lobe and tabulated, so the synthesis is close to but not exactly a sum of sinusoids.
+ */
+#define ADDITIVE_TEST_TOL 1e-4
+
+/**
+ * Test partials: near DC, mid band and near Nyquist.
+ */
+static const double testFreqs[] = {30.0, 440.0, 1234.5, 9876.5, 23900.0};
+static const double testAmps[] = {0.2, 0.5, 0.25, 0.1, 0.05};
+#define ADDITIVE_TEST_NPARTIALS (sizeof(testFreqs) / sizeof(testFreqs[0]))
+
+/**
+ * Largest difference between a render and a reference from the centre of the first frame on.
+ */
+static double worstError(const double * out, const double * ref, unsigned long n, unsigned long * at) {
+    unsigned long i;
+    double err, worst = 0.0;
+    for(i = ADDITIVE_TEST_HOP; i < n; i++) {
+        if((err = fabs(out[i] - ref[i])) > worst) {
+            worst = err;
+            *at = i;
+        }
+    }
+    return worst;
+}
+
+/**
+ * Render frames of steady partials, with explicit phases from the given start phases or continued ones.
+ */
+static int renderSteady(ADDITIVE * synth, const double * startPhases, double * out) {
+    double phases[ADDITIVE_TEST_NPARTIALS];
+    unsigned long f, i;
+
+    for(f = 0; f < ADDITIVE_TEST_FRAMES; f++) {
+        for(i = 0; startPhases && i < ADDITIVE_TEST_NPARTIALS; i++) {
+            phases[i] = startPhases[i] + 2.0 * M_PI * testFreqs[i] * (double) (f * ADDITIVE_TEST_HOP) /
+                        ADDITIVE_TEST_FS;
+        }
+        if(!additive_frame(synth, testFreqs, testAmps, startPhases ? phases : NULL, ADDITIVE_TEST_NPARTIALS,
+                           out + f * ADDITIVE_TEST_HOP)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void testSteady(ADDITIVE * synth, double * out, double * ref) {
+    static const double startPhases[] = {0.3, -2.0, 1.0, 3.0, -0.5};
+    unsigned long n = ADDITIVE_TEST_FRAMES * ADDITIVE_TEST_HOP, i, k, at = 0;
+    double t, total = 0.0, worst;
+
+    for(k = 0; k < ADDITIVE_TEST_NPARTIALS; k++) {
+        total += testAmps[k];
+    }
+    /* Continued phases start at 0, explicit ones at startPhases, both reached at sample hop */
+    for(k = 0; k < 2; k++) {
+        additive_reset(synth);
+        CHECK(renderSteady(synth, k ? startPhases : NULL, out), "additive_frame failed");
+        for(i = 0; i < n; i++) {
+            t = ((double) i - ADDITIVE_TEST_HOP) / ADDITIVE_TEST_FS;
+            ref[i] = 0.0;
+            for(at = 0; at < ADDITIVE_TEST_NPARTIALS; at++) {
+                ref[i] += testAmps[at] * cos(2.0 * M_PI * testFreqs[at] * t + (k ? startPhases[at] : 0.0));
+            }
+        }
+        worst = worstError(out, ref, n, &at);
+        CHECK(worst <= ADDITIVE_TEST_TOL * total, "%s phases: sample %lu is %g off the sum of cosines",
+              k ? "explicit" : "continued", at, worst);
+    }
+    /* The first frame fades in over the first hop */
+    CHECK(fabs(out[0]) < 1e-12, "first sample is %g", out[0]);
+}
+
+static void testCrossfade(ADDITIVE * synth, double * out, double * ref) {
+    static const double amps[] = {0.0, 1.0, 1.0, 0.4, 0.4, 0.0, 0.0, 0.0};
+    const double freq = 1000.0;
+    unsigned long nframes = sizeof(amps) / sizeof(amps[0]), n = nframes * ADDITIVE_TEST_HOP, f, i, at = 0;
+    double pos, frac, env, worst;
+
+    additive_reset(synth);
+    for(f = 0; f < nframes; f++) {
+        CHECK(additive_frame(synth, &freq, &amps[f], NULL, 1, out + f * ADDITIVE_TEST_HOP), "additive_frame failed");
+    }
+    /* Frame f is reached at sample (f + 1) * hop, with a linear crossfade from the previous frame */
+    for(i = 0; i < n; i++) {
+        pos = (double) i / ADDITIVE_TEST_HOP - 1.0;
+        f = (unsigned long) floor(pos + 1.0);
+        frac = pos + 1.0 - (double) f;
+        env = (f ? (1.0 - frac) * amps[f - 1] : 0.0) + (f < nframes ? frac * amps[f] : 0.0);
+        ref[i] = env * cos(2.0 * M_PI * freq * pos * ADDITIVE_TEST_HOP / ADDITIVE_TEST_FS);
+    }
+    worst = worstError(out, ref, n, &at);
+    CHECK(worst <= ADDITIVE_TEST_TOL, "crossfade sample %lu is %g off", at, worst);
+    for(i = 6 * ADDITIVE_TEST_HOP; i < n; i++) {
+        CHECK(out[i] == 0.0, "sample %lu after the fade out is %g", i, out[i]);
+    }
+}
+
+static void testSilent(ADDITIVE * synth, double * out) {
+    static const double freqs[] = {24000.0, 30000.0, 1000.0, -500.0};
+    static const double amps[] = {1.0, 1.0, 0.0, 1.0};
+    unsigned long i;
+    int ok;
+
+    additive_reset(synth);
+    ok = additive_frame(synth, freqs, amps, NULL, 4, out) && additive_frame(synth, freqs, amps, NULL, 4, out);
+    CHECK(ok, "additive_frame failed");
+    for(i = 0; ok && i < ADDITIVE_TEST_HOP; i++) {
+        CHECK(out[i] == 0.0, "silent partials rendered %g at sample %lu", out[i], i);
+    }
+    CHECK(!additive_frame(synth, testFreqs, testAmps, NULL, synth->maxpartials + 1, out),
+          "more partials than maxpartials were rendered");
+}
+
+int main(void) {
+    unsigned long n = ADDITIVE_TEST_FRAMES * ADDITIVE_TEST_HOP;
+    ADDITIVE * synth = new_ADDITIVE(ADDITIVE_TEST_FS, ADDITIVE_TEST_HOP, ADDITIVE_TEST_NPARTIALS);
+    double * out = (double *) malloc(n * sizeof(double)), * ref = (double *) malloc(n * sizeof(double));
+
+    CHECK(new_ADDITIVE(ADDITIVE_TEST_FS, 8, 1) == NULL, "a hop of 8 was accepted");
+    CHECK(synth && out && ref, "could not create the synthesiser");
+    if(synth && out && ref) {
+        CHECK(synth->nfft == 4 * ADDITIVE_TEST_HOP, "frame of %lu samples", synth->nfft);
+        testSteady(synth, out, ref);
+        testCrossfade(synth, out, ref);
+        testSilent(synth, out);
+    }
+    clear_ADDITIVE(&synth);
+    free(out);
+    free(ref);
+    return CHECK_RESULT();
+}
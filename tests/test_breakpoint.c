@@ -0,0 +1,265 @@
+/*
+ breakpoint: bps_tick is the reference. bps_render in uneven blocks and bps_seek/bps_seeksample (with and without
+ the coarse index) must reproduce its values over linear, discontinuous, BRK_EXP and BRK_POW spans and the held
+ tail, and leave the stream where bps_tick would. Also covers the pool's double giveback guard, and checks that
+ bps_simplify reports the error its output actually has.
+ */
+#include "breakpoint.h"
+#include "check.h"
+#include <math.h>
+#include <stdlib.h>
+
+/**
+ * Sample rate of the streams under test.
+ */
+#define BRK_TEST_FS 48000
+
+/**
+ * Ticks compared: the envelope lasts 0.05s (2400 samples), the rest is the held final value.
+ */
+#define BRK_TEST_TICKS 3000
+
+/**
+ * Agreement required between bps_tick and the block paths (linear spans differ by rounding only).
+ */
+#define BRK_TEST_TOL 1e-12
+
+/**
+ * Input length for the simplifier.
+ */
+#define BRK_TEST_NSIMPLIFY 1000
+
+/**
+ * Build the test envelope: two linear spans, a discontinuity at 20ms, a BRK_EXP and a BRK_POW span, then a
+ * final linear span.
+ */
+static BRKTABLE * newEnvelope(void) {
+    static const BREAKPOINT shape[] = {
+        {0.0, 0.0}, {0.01, 1.0}, {0.02, 0.5}, {0.02, -0.25}, {0.03, 0.75}, {0.045, 0.1}, {0.05, 0.3}
+    };
+    unsigned long i, n = sizeof(shape) / sizeof(shape[0]);
+    BREAKPOINT * points = (BREAKPOINT *) malloc(n * sizeof(BREAKPOINT));
+    BRKCURVE * curves = (BRKCURVE *) malloc(n * sizeof(BRKCURVE));
+    BRKTABLE * table;
+
+    if(!points || !curves) {
+        free(points);
+        free(curves);
+        return NULL;
+    }
+    for(i = 0; i < n; i++) {
+        points[i] = shape[i];
+        curves[i].type = BRK_LINEAR;
+        curves[i].shape = 0.0;
+    }
+    curves[3].type = BRK_EXP;
+    curves[3].shape = -3.0;
+    curves[4].type = BRK_POW;
+    curves[4].shape = 2.5;
+    if(!(table = bpt_new(points, curves, n))) {
+        free(points);
+        free(curves);
+    }
+    return table;
+}
+
+/**
+ * Next pseudo-random integer between 1 and max.
+ */
+static unsigned long nextLength(unsigned long * seed, unsigned long max) {
+    *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return 1 + (*seed >> 8) % max;
+}
+
+static void testRender(BRKTABLE * table, const double * ref) {
+    static double out[BRK_TEST_TICKS];
+    BRKSTREAM * stream = bps_new_a(table, BRK_TEST_FS, NULL);
+    unsigned long seed = 3, done, n, i;
+
+    for(done = 0; done < BRK_TEST_TICKS; done += n) {
+        n = nextLength(&seed, 97);
+        if(n > BRK_TEST_TICKS - done) {
+            n = BRK_TEST_TICKS - done;
+        }
+        bps_render(stream, out + done, n);
+    }
+    for(i = 0; i < BRK_TEST_TICKS; i++) {
+        CHECK_NEAR(out[i], ref[i], BRK_TEST_TOL, "bps_render against bps_tick");
+    }
+    /* Rendering and ticking interleave: the stream position is shared */
+    bps_free_a(&stream, NULL);
+    stream = bps_new_a(table, BRK_TEST_FS, NULL);
+    for(i = 0; i < BRK_TEST_TICKS; i += 10) {
+        bps_render(stream, out, 9);
+        CHECK_NEAR(out[0], ref[i], BRK_TEST_TOL, "bps_render after bps_tick");
+        CHECK_NEAR(bps_tick(stream), ref[i + 9], BRK_TEST_TOL, "bps_tick after bps_render");
+    }
+    bps_free_a(&stream, NULL);
+}
+
+static void testSeek(BRKTABLE * table, const double * ref, int indexed) {
+    static const unsigned long targets[] = {
+        2900, 0, 1, 479, 480, 481, 959, 960, 961, 1439, 1440, 2159, 2160, 2399, 2400, 2401, 700, 1
+    };
+    BRKSTREAM * stream = bps_new_a(table, BRK_TEST_FS, NULL);
+    const char * what = indexed ? "indexed seek" : "seek";
+    unsigned long t, i, k, seed = 5;
+    double first;
+
+    if(indexed) {
+        CHECK(bps_buildindex(stream, 2), "bps_buildindex failed");
+    }
+    for(t = 0; t < sizeof(targets) / sizeof(targets[0]) + 40; t++) {
+        k = t < sizeof(targets) / sizeof(targets[0]) ? targets[t] : nextLength(&seed, BRK_TEST_TICKS - 50);
+        bps_seeksample(stream, k);
+        for(i = 0; i < 50; i++) {
+            CHECK_NEAR(bps_tick(stream), ref[k + i], BRK_TEST_TOL, what);
+        }
+        /* The same position by time, then through the block path, which must leave the stream where bps_tick does */
+        bps_seek(stream, (double) k / BRK_TEST_FS);
+        CHECK_NEAR(bps_tick(stream), ref[k], BRK_TEST_TOL, what);
+        bps_seek(stream, (double) k / BRK_TEST_FS);
+        bps_render(stream, &first, 1);
+        CHECK_NEAR(first, ref[k], BRK_TEST_TOL, what);
+        CHECK_NEAR(bps_tick(stream), ref[k + 1], BRK_TEST_TOL, what);
+    }
+    bps_seek(stream, -1.0);
+    CHECK_NEAR(bps_tick(stream), ref[0], BRK_TEST_TOL, "seek before the start");
+    bps_free_a(&stream, NULL);
+}
+
+static void testPool(BRKTABLE * table, const double * ref) {
+    BRKPOOL * pool = bps_newpool(2);
+    BRKSTREAM * streams[3], other;
+    unsigned long i;
+
+    CHECK(pool != NULL, "bps_newpool failed");
+    if(!pool) {
+        return;
+    }
+    CHECK(bps_acquire(pool, table, BRK_TEST_FS, streams, 3) == 2, "pool of 2 handed out more or fewer cursors");
+    /* Cursors over a shared table advance independently */
+    for(i = 0; i < BRK_TEST_TICKS; i++) {
+        CHECK_NEAR(bps_tick(streams[0]), ref[i], 0.0, "first pooled cursor");
+        if(i % 2) {
+            CHECK_NEAR(bps_tick(streams[1]), ref[i / 2], 0.0, "second pooled cursor");
+        }
+    }
+    CHECK(bps_giveback(pool, streams[0]), "giveback of an acquired cursor failed");
+    CHECK(!bps_giveback(pool, streams[0]), "double giveback was accepted");
+    CHECK(!bps_giveback(pool, &other), "giveback of a foreign cursor was accepted");
+    CHECK(bps_acquire(pool, table, BRK_TEST_FS, streams, 3) == 1, "returned cursor was not reusable");
+    bps_freepool(&pool);
+    CHECK(pool == NULL, "bps_freepool did not clear the pointer");
+}
+
+/**
+ * Worst-case absolute difference between input points and the simplified polyline, read back at the input times.
+ * At a repeated output time (a discontinuity) the input points take the output values in order.
+ */
+static double simplifyError(const BREAKPOINT * points, unsigned long npoints, const BREAKPOINT * out,
+                            unsigned long nout) {
+    unsigned long i, j = 0;
+    double t, err, maxerror = 0.0;
+
+    for(i = 0; i < npoints; i++) {
+        t = points[i].time;
+        while(j + 1 < nout && out[j].time < t) {
+            j++;
+        }
+        if(out[j].time == t) {
+            err = fabs(points[i].value - out[j].value);
+            if(j + 1 < nout && out[j + 1].time == t) {
+                j++;
+            }
+        } else {
+            err = fabs(points[i].value - (out[j - 1].value + (out[j].value - out[j - 1].value) *
+                                          ((t - out[j - 1].time) / (out[j].time - out[j - 1].time))));
+        }
+        if(err > maxerror) {
+            maxerror = err;
+        }
+    }
+    return maxerror;
+}
+
+static int countSink(const BREAKPOINT * point, void * userdata) {
+    (void) point;
+    ++*(unsigned long *) userdata;
+    return 1;
+}
+
+static void testSimplify(void) {
+    static BREAKPOINT points[BRK_TEST_NSIMPLIFY], out[BRK_TEST_NSIMPLIFY], inplace[BRK_TEST_NSIMPLIFY];
+    BRKSIMPLIFY * simp;
+    unsigned long i, n, nstream = 0;
+    double maxerror = -1.0, inplaceerror = -1.0, measured;
+
+    /* A noisy ramp with a discontinuity half way */
+    for(i = 0; i < BRK_TEST_NSIMPLIFY; i++) {
+        points[i].time = i * 0.001;
+        points[i].value = (double) ((i * i) % 997) / 997.0 < 0.5 ? i * 0.001 : i * 0.001 + 0.004;
+    }
+    points[BRK_TEST_NSIMPLIFY / 2].time = points[BRK_TEST_NSIMPLIFY / 2 - 1].time;
+    points[BRK_TEST_NSIMPLIFY / 2].value -= 0.5;
+
+    n = bps_simplify(points, BRK_TEST_NSIMPLIFY, out, 0.01, &maxerror);
+    CHECK(n >= 4 && n < BRK_TEST_NSIMPLIFY, "simplified %d points to %lu", BRK_TEST_NSIMPLIFY, n);
+    CHECK(out[0].time == points[0].time && out[n - 1].time == points[BRK_TEST_NSIMPLIFY - 1].time,
+          "end points moved");
+    measured = simplifyError(points, BRK_TEST_NSIMPLIFY, out, n);
+    CHECK(measured > 0.0 && measured <= 0.01 + 1e-12, "simplified line is %g off the input", measured);
+    CHECK_NEAR(maxerror, measured, 1e-12, "reported against measured simplification error");
+
+    /* In place gives the same output */
+    for(i = 0; i < BRK_TEST_NSIMPLIFY; i++) {
+        inplace[i] = points[i];
+    }
+    CHECK(bps_simplify(inplace, BRK_TEST_NSIMPLIFY, inplace, 0.01, &inplaceerror) == n, "in-place output length");
+    for(i = 0; i < n; i++) {
+        CHECK(inplace[i].time == out[i].time && inplace[i].value == out[i].value, "in-place point %lu differs", i);
+    }
+    CHECK_NEAR(inplaceerror, maxerror, 0.0, "in-place simplification error");
+
+    /* Streaming keeps no input, so it reports the tolerance as the bound */
+    simp = bps_simplify_new(0.01, countSink, &nstream);
+    CHECK(simp != NULL, "bps_simplify_new failed");
+    if(!simp) {
+        return;
+    }
+    for(i = 0; i < BRK_TEST_NSIMPLIFY; i++) {
+        bps_simplify_push(simp, points[i]);
+    }
+    CHECK(bps_simplify_finish(simp), "streaming simplifier failed");
+    CHECK(nstream == n && simp->nout == n, "streaming emitted %lu points, not %lu", nstream, n);
+    CHECK_NEAR(simp->maxerror, 0.01, 0.0, "streaming error bound");
+    bps_simplify_free(&simp);
+}
+
+int main(void) {
+    static double ref[BRK_TEST_TICKS];
+    BRKTABLE * table = newEnvelope();
+    BRKSTREAM * stream;
+    unsigned long i;
+
+    CHECK(table != NULL, "bpt_new failed");
+    if(!table) {
+        return CHECK_RESULT();
+    }
+    stream = bps_new_a(table, BRK_TEST_FS, NULL);
+    for(i = 0; i < BRK_TEST_TICKS; i++) {
+        ref[i] = bps_tick(stream);
+    }
+    bps_free_a(&stream, NULL);
+    CHECK_NEAR(ref[0], 0.0, 0.0, "first tick");
+    CHECK_NEAR(ref[480], 1.0, 1e-12, "tick at the first breakpoint");
+    CHECK_NEAR(ref[BRK_TEST_TICKS - 1], 0.3, 0.0, "held final value");
+
+    testRender(table, ref);
+    testSeek(table, ref, 0);
+    testPool(table, ref);
+    testSeek(table, ref, 1);
+    testSimplify();
+    bpt_release(&table);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,195 @@
+/*
+ dspalloc: arena blocks are DSP_ALIGN aligned and packed, the arena fails cleanly when full and starts over after
+ dsp_arena_reset. Pool blocks come from the slab until it is empty and are reused last in, first out. Requests the
+ slab cannot serve go to the fallback allocator: nfallback counts them, releasing one unlinks it from the
+ outstanding list wherever it sits, and dsp_pool_free returns the rest.
+ */
+#include "dspalloc.h"
+#include "check.h"
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * A heap allocator that counts its outstanding blocks, for checking what a pool hands back.
+ */
+typedef struct countalloc {
+    long live;
+    long total;
+} COUNTALLOC;
+
+static void * countAlloc(void * ctx, size_t size) {
+    COUNTALLOC * count = (COUNTALLOC *) ctx;
+    void * ptr;
+    if(posix_memalign(&ptr, DSP_ALIGN, size)) {
+        return NULL;
+    }
+    count->live++;
+    count->total++;
+    return ptr;
+}
+
+static void countRelease(void * ctx, void * ptr) {
+    ((COUNTALLOC *) ctx)->live--;
+    free(ptr);
+}
+
+/**
+ * Whether a pointer is DSP_ALIGN aligned.
+ */
+static int isAligned(const void * ptr) {
+    return ((uintptr_t) ptr & (DSP_ALIGN - 1)) == 0;
+}
+
+/**
+ * Number of blocks on a pool's outstanding fallback list (each header starts with its prev and next links).
+ */
+static size_t countSpills(const DSPPOOL * pool) {
+    void * const * spill;
+    size_t n = 0;
+    for(spill = (void * const *) pool->fallbacklist; spill; spill = (void * const *) spill[1]) {
+        n++;
+    }
+    return n;
+}
+
+static void testArena(void) {
+    static const size_t sizes[] = {1, 3, 64, 65, 0, 200};
+    DSPARENA * arena = dsp_arena_new(1000);
+    unsigned char * ptrs[6], * big;
+    size_t i, used = 0;
+
+    CHECK(arena != NULL, "dsp_arena_new failed");
+    if(!arena) {
+        return;
+    }
+    CHECK(arena->size == 1024, "arena of 1000 bytes has capacity %zu", arena->size);
+    for(i = 0; i < 6; i++) {
+        ptrs[i] = (unsigned char *) dsp_alloc(&arena->allocator, sizes[i]);
+        CHECK(ptrs[i] != NULL && isAligned(ptrs[i]), "arena block %zu (%zu bytes) is %p", i, sizes[i],
+              (void *) ptrs[i]);
+        /* Packed: each block starts where the previous one's aligned size ends */
+        CHECK(ptrs[i] == arena->base + used, "arena block %zu is not packed", i);
+        used += sizes[i] > DSP_ALIGN ? (sizes[i] + DSP_ALIGN - 1) / DSP_ALIGN * DSP_ALIGN : DSP_ALIGN;
+        if(ptrs[i]) {
+            memset(ptrs[i], (int) i, sizes[i]);
+        }
+    }
+    CHECK(arena->used == used, "arena used %zu bytes, not %zu", arena->used, used);
+    CHECK(ptrs[3][64] == 3 && ptrs[5][0] == 5, "arena blocks overlap");
+
+    /* Exhaustion: the last free bytes, then nothing */
+    dsp_free(&arena->allocator, ptrs[5]);
+    CHECK(arena->used == used, "an arena release changed its use");
+    CHECK(dsp_alloc(&arena->allocator, arena->size - arena->used + 1) == NULL, "arena overcommitted");
+    big = (unsigned char *) dsp_alloc(&arena->allocator, arena->size - arena->used);
+    CHECK(big != NULL && arena->used == arena->size, "arena could not hand out its last bytes");
+    CHECK(dsp_alloc(&arena->allocator, 1) == NULL, "full arena handed out a block");
+    CHECK(dsp_calloc(&arena->allocator, SIZE_MAX / 2, 4) == NULL, "dsp_calloc overflow was not caught");
+
+    dsp_arena_reset(arena);
+    ptrs[0] = (unsigned char *) dsp_calloc(&arena->allocator, 10, 10);
+    CHECK(ptrs[0] == arena->base && arena->used == 128, "reset arena did not start over");
+    for(i = 0; ptrs[0] && i < 100; i++) {
+        CHECK(ptrs[0][i] == 0, "dsp_calloc byte %zu is %d", i, ptrs[0][i]);
+    }
+    dsp_arena_free(&arena);
+    CHECK(arena == NULL, "dsp_arena_free did not clear the pointer");
+}
+
+static void testPool(void) {
+    DSPPOOL * pool = dsp_pool_new(100, 4, NULL);
+    void * ptrs[4], * again;
+    size_t i, j;
+
+    CHECK(pool != NULL, "dsp_pool_new failed");
+    if(!pool) {
+        return;
+    }
+    CHECK(pool->blocksize == 128 && pool->nfree == 4, "pool of 4 x 100 bytes has %zu x %zu", pool->nfree,
+          pool->blocksize);
+    for(i = 0; i < 4; i++) {
+        ptrs[i] = dsp_alloc(&pool->allocator, 100);
+        CHECK(ptrs[i] != NULL && isAligned(ptrs[i]), "pool block %zu is %p", i, ptrs[i]);
+        CHECK((unsigned char *) ptrs[i] >= pool->slab && (unsigned char *) ptrs[i] < pool->slab + 4 * 128,
+              "pool block %zu is outside the slab", i);
+        for(j = 0; j < i; j++) {
+            CHECK(ptrs[i] != ptrs[j], "pool handed out block %zu twice", j);
+        }
+    }
+    CHECK(pool->nfree == 0, "empty pool has %zu free blocks", pool->nfree);
+    CHECK(dsp_alloc(&pool->allocator, 1) == NULL, "empty pool without a fallback handed out a block");
+    CHECK(dsp_alloc(&pool->allocator, 129) == NULL, "oversized request without a fallback succeeded");
+
+    /* Released blocks are reused, most recent first */
+    dsp_free(&pool->allocator, ptrs[1]);
+    dsp_free(&pool->allocator, ptrs[3]);
+    CHECK(pool->nfree == 2, "pool has %zu free blocks after two releases", pool->nfree);
+    again = dsp_alloc(&pool->allocator, 8);
+    CHECK(again == ptrs[3], "pool did not reuse the last block released");
+    again = dsp_alloc(&pool->allocator, 128);
+    CHECK(again == ptrs[1], "pool did not reuse the first block released");
+    dsp_pool_free(&pool);
+    CHECK(pool == NULL, "dsp_pool_free did not clear the pointer");
+}
+
+static void testFallback(void) {
+    COUNTALLOC count = {0, 0};
+    DSPALLOC fallback;
+    DSPPOOL * pool;
+    unsigned char * slab[2], * spill[4];
+    size_t i;
+
+    fallback.alloc = countAlloc;
+    fallback.release = countRelease;
+    fallback.ctx = &count;
+    pool = dsp_pool_new(64, 2, &fallback);
+    CHECK(pool != NULL, "dsp_pool_new failed");
+    if(!pool) {
+        return;
+    }
+    for(i = 0; i < 2; i++) {
+        slab[i] = (unsigned char *) dsp_alloc(&pool->allocator, 64);
+    }
+    CHECK(pool->nfallback == 0 && count.total == 0, "the slab was not used first");
+    /* An oversized request, then requests against the empty slab */
+    spill[0] = (unsigned char *) dsp_alloc(&pool->allocator, 1000);
+    for(i = 1; i < 4; i++) {
+        spill[i] = (unsigned char *) dsp_alloc(&pool->allocator, 64);
+    }
+    for(i = 0; i < 4; i++) {
+        CHECK(spill[i] != NULL && isAligned(spill[i]), "fallback block %zu is %p", i, (void *) spill[i]);
+        if(spill[i]) {
+            memset(spill[i], 0xa5, i ? 64 : 1000);
+        }
+    }
+    CHECK(pool->nfallback == 4 && count.live == 4 && countSpills(pool) == 4,
+          "4 fallback blocks: nfallback %zu, %ld live, %zu listed", pool->nfallback, count.live, countSpills(pool));
+
+    /* Unlink from the middle, the head (most recent) and the tail of the list */
+    dsp_free(&pool->allocator, spill[2]);
+    CHECK(pool->nfallback == 3 && count.live == 3 && countSpills(pool) == 3, "release from the middle of the list");
+    dsp_free(&pool->allocator, spill[3]);
+    CHECK(pool->nfallback == 2 && count.live == 2 && countSpills(pool) == 2, "release of the list head");
+    dsp_free(&pool->allocator, spill[0]);
+    CHECK(pool->nfallback == 1 && count.live == 1 && countSpills(pool) == 1, "release of the list tail");
+
+    /* A slab release goes back to the free list, not the fallback */
+    dsp_free(&pool->allocator, slab[0]);
+    CHECK(pool->nfree == 1 && count.live == 1, "slab block released to the fallback");
+    CHECK(dsp_alloc(&pool->allocator, 64) == slab[0], "released slab block was not reused before the fallback");
+
+    /* Two more outstanding, then dsp_pool_free returns all three */
+    spill[0] = (unsigned char *) dsp_alloc(&pool->allocator, 64);
+    spill[2] = (unsigned char *) dsp_alloc(&pool->allocator, 500);
+    CHECK(pool->nfallback == 3 && count.live == 3, "nfallback %zu, %ld live", pool->nfallback, count.live);
+    dsp_pool_free(&pool);
+    CHECK(count.live == 0, "dsp_pool_free left %ld fallback blocks outstanding", count.live);
+    CHECK(count.total == 6, "the fallback served %ld requests, not 6", count.total);
+}
+
+int main(void) {
+    testArena();
+    testPool();
+    testFallback();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,293 @@
+/*
+ dspcxx: with its default policies every template must be sample-exact with the C function it replaces. Each
+ Oscillator waveform and TableOscillator order 0 and 1 is run against its C tick through tick() and both
+ render() overloads, for double and float output, and must leave the C state where the tick does. Envelope
+ and renderModulated are compared with bps_render and tabitick (bps_tick agrees with bps_render only to
+ rounding), and Convolver (with kissfft) with fft_convolve.
+ Cubic interpolation has no C counterpart: it must read the table points exactly at whole phases.
+ */
+#include "dspcxx.hpp"
+#include "check.h"
+
+namespace {
+
+/**
+ * Sample rate of the oscillators.
+ */
+constexpr double testFs = 48000.0;
+
+/**
+ * Samples compared per case: several blocks, so the phase wraps many times.
+ */
+constexpr std::size_t testLength = 1000;
+
+/**
+ * Frequency of the constant frequency renders.
+ */
+constexpr double testFreq = 1234.5;
+
+/**
+ * Fill a frequency track: a fast glide through zero into negative frequencies and back, with repeated values so
+ * the C ticks also take their unchanged-frequency path.
+ */
+void fillFreqs(double * freqs, std::size_t n) {
+    for(std::size_t i = 0; i < n; i++) {
+        freqs[i] = 9000.0 * std::cos(0.013 * static_cast<double>(i / 3)) + 700.0;
+    }
+}
+
+/**
+ * Check that n samples agree exactly with the reference, reporting the first that does not.
+ */
+template<class T>
+void checkSame(const T * got, const double * ref, std::size_t n, const char * what) {
+    for(std::size_t i = 0; i < n; i++) {
+        if(got[i] != static_cast<T>(ref[i])) {
+            CHECK(false, "%s: sample %zu is %.17g, not %.17g", what, i, static_cast<double>(got[i]), ref[i]);
+            return;
+        }
+    }
+}
+
+template<class Wave, class T>
+void testOscillator(tickfunc ctick, const char * what) {
+    static double freqs[testLength], ref[testLength];
+    static T out[testLength];
+    OSCIL * cosc = oscil(testFs, 0.0), * state = oscil(testFs, 0.0);
+    std::size_t i;
+
+    CHECK(cosc && state, "%s: oscil failed", what);
+    if(!cosc || !state) {
+        freeOscil_a(&cosc, nullptr);
+        freeOscil_a(&state, nullptr);
+        return;
+    }
+    cosc->mod = state->mod = 0.3;
+    dsp::Oscillator<Wave, T> osc(*state);
+    fillFreqs(freqs, testLength);
+
+    for(i = 0; i < testLength; i++) {
+        ref[i] = ctick(cosc, freqs[i]);
+        out[i] = osc.tick(freqs[i]);
+    }
+    checkSame(out, ref, testLength, what);
+
+    for(i = 0; i < testLength; i++) {
+        ref[i] = ctick(cosc, testFreq);
+    }
+    osc.render(out, 100, testFreq);
+    osc.render(out + 100, testLength - 100, testFreq);
+    checkSame(out, ref, testLength, what);
+
+    for(i = 0; i < testLength; i++) {
+        ref[i] = ctick(cosc, freqs[i]);
+    }
+    osc.render(out, freqs, 300);
+    osc.render(out + 300, freqs + 300, testLength - 300);
+    checkSame(out, ref, testLength, what);
+
+    CHECK(state->curPhase == cosc->curPhase && state->incr == cosc->incr && state->curFreq == cosc->curFreq,
+          "%s: oscillator state differs from the C tick's", what);
+    freeOscil_a(&cosc, nullptr);
+    freeOscil_a(&state, nullptr);
+}
+
+template<int Order, class T>
+void testTable(GTABLE * table, TABFUNC ctick, const char * what) {
+    static double freqs[testLength], ref[testLength];
+    static T out[testLength];
+    TOSCIL * cosc = oscil_t(testFs, 0.0, table), * state = oscil_t(testFs, 0.0, table);
+    std::size_t i;
+
+    CHECK(cosc && state, "%s: oscil_t failed", what);
+    if(!cosc || !state) {
+        freeTOscil_a(&cosc, nullptr);
+        freeTOscil_a(&state, nullptr);
+        return;
+    }
+    dsp::TableOscillator<Order, T> osc(*state);
+    fillFreqs(freqs, testLength);
+
+    for(i = 0; i < testLength; i++) {
+        ref[i] = ctick(cosc, freqs[i]);
+        out[i] = osc.tick(freqs[i]);
+    }
+    checkSame(out, ref, testLength, what);
+
+    for(i = 0; i < testLength; i++) {
+        ref[i] = ctick(cosc, testFreq);
+    }
+    osc.render(out, 100, testFreq);
+    osc.render(out + 100, testLength - 100, testFreq);
+    checkSame(out, ref, testLength, what);
+
+    for(i = 0; i < testLength; i++) {
+        ref[i] = ctick(cosc, freqs[i]);
+    }
+    osc.render(out, freqs, 300);
+    osc.render(out + 300, freqs + 300, testLength - 300);
+    checkSame(out, ref, testLength, what);
+
+    CHECK(state->osc.curPhase == cosc->osc.curPhase && state->osc.incr == cosc->osc.incr &&
+          state->osc.curFreq == cosc->osc.curFreq, "%s: oscillator state differs from the C tick's", what);
+    freeTOscil_a(&cosc, nullptr);
+    freeTOscil_a(&state, nullptr);
+}
+
+void testCubic(GTABLE * table) {
+    static double out[testLength];
+    /* At a sample rate of the table length, 7Hz steps exactly 7 table points per sample */
+    TOSCIL * state = oscil_t(static_cast<double>(table->length), 0.0, table);
+    std::size_t i;
+
+    CHECK(state != nullptr, "oscil_t failed");
+    if(!state) {
+        return;
+    }
+    dsp::TableOscillator<3> osc(*state);
+    osc.render(out, testLength, 7.0);
+    for(i = 0; i < testLength; i++) {
+        CHECK_NEAR(out[i], table->samples[(7 * i) % table->length], 0.0, "cubic lookup at a table point");
+    }
+    freeTOscil_a(&state, nullptr);
+}
+
+/**
+ * A frequency envelope with a discontinuity and curved spans.
+ */
+BRKTABLE * newEnvelope() {
+    static const BREAKPOINT shape[] = {{0.0, 100.0}, {0.005, 3000.0}, {0.005, 400.0}, {0.015, 12000.0}, {0.02, 50.0}};
+    constexpr unsigned long n = sizeof(shape) / sizeof(shape[0]);
+    auto * points = static_cast<BREAKPOINT *>(std::malloc(sizeof(shape)));
+    auto * curves = static_cast<BRKCURVE *>(std::calloc(n, sizeof(BRKCURVE)));
+    BRKTABLE * table;
+
+    if(!points || !curves) {
+        std::free(points);
+        std::free(curves);
+        return nullptr;
+    }
+    std::memcpy(points, shape, sizeof(shape));
+    curves[1].type = BRK_EXP;
+    curves[1].shape = 2.0;
+    curves[3].type = BRK_POW;
+    curves[3].shape = 0.5;
+    if(!(table = bpt_new(points, curves, n))) {
+        std::free(points);
+        std::free(curves);
+    }
+    return table;
+}
+
+void testEnvelope(BRKTABLE * envelope, GTABLE * table) {
+    static double ref[testLength], out[testLength];
+    static float fout[testLength];
+    BRKSTREAM * cstream = bps_new_a(envelope, testFs, nullptr), * stream = bps_new_a(envelope, testFs, nullptr);
+    TOSCIL * cosc = oscil_t(testFs, 0.0, table), * state = oscil_t(testFs, 0.0, table);
+    std::size_t i;
+
+    CHECK(cstream && stream && cosc && state, "could not create the envelope streams");
+    if(cstream && stream && cosc && state) {
+        dsp::Envelope<> env(*stream);
+        dsp::Envelope<float> fenv(*stream);
+        dsp::TableOscillator<1> osc(*state);
+
+        bps_render(cstream, ref, testLength);
+        env.render(out, 300);
+        fenv.render(fout + 300, testLength - 300);
+        checkSame(out, ref, 300, "Envelope<double>");
+        checkSame(fout + 300, ref + 300, testLength - 300, "Envelope<float>");
+
+        /* renderModulated renders the envelope a block at a time */
+        bps_seeksample(cstream, 0);
+        env.seek(0);
+        for(i = 0; i < testLength; i += dsp::blockSize) {
+            bps_render(cstream, ref + i, testLength - i < dsp::blockSize ? testLength - i : dsp::blockSize);
+        }
+        for(i = 0; i < testLength; i++) {
+            ref[i] = tabitick(cosc, ref[i]);
+        }
+        dsp::renderModulated(osc, env, out, testLength);
+        checkSame(out, ref, testLength, "renderModulated");
+    }
+    bps_free_a(&cstream, nullptr);
+    bps_free_a(&stream, nullptr);
+    freeTOscil_a(&cosc, nullptr);
+    freeTOscil_a(&state, nullptr);
+}
+
+#ifdef DSP_HAVE_KISSFFT
+void testConvolver() {
+    constexpr std::size_t block = 64, ntaps = 300;
+    static double taps[ntaps], input[block], ref[block], out[block];
+    static float finput[block], fout[block];
+    char * errMsg = nullptr;
+    UPOLS * cnet = nullptr, * net = nullptr, * fcnet = nullptr, * fnet = nullptr;
+    std::size_t b, i;
+
+    for(i = 0; i < ntaps; i++) {
+        taps[i] = std::exp(-0.02 * static_cast<double>(i)) * (i % 2 ? -1.0 : 1.0);
+    }
+    /* One network per convolution, as each carries its own input history */
+    if((cnet = new_UPOLS(taps, ntaps, block, &errMsg)) && (net = new_UPOLS(taps, ntaps, block, &errMsg)) &&
+       (fcnet = new_UPOLS(taps, ntaps, block, &errMsg))) {
+        fnet = new_UPOLS(taps, ntaps, block, &errMsg);
+    }
+    CHECK(fnet != nullptr, "new_UPOLS: %s", errMsg);
+    if(fnet) {
+        dsp::Convolver<> conv(*net);
+        dsp::Convolver<float> fconv(*fnet);
+        for(b = 0; b < 8; b++) {
+            for(i = 0; i < block; i++) {
+                input[i] = std::sin(0.37 * static_cast<double>(b * block + i));
+            }
+            CHECK(conv.process(input, out, &errMsg), "Convolver<double>: %s", errMsg);
+            CHECK(fft_convolve(input, ref, cnet, block, &errMsg), "fft_convolve: %s", errMsg);
+            checkSame(out, ref, block, "Convolver<double>");
+
+            for(i = 0; i < block; i++) {
+                finput[i] = static_cast<float>(input[i]);
+                input[i] = static_cast<double>(finput[i]);
+            }
+            CHECK(fconv.process(finput, fout, &errMsg), "Convolver<float>: %s", errMsg);
+            CHECK(fft_convolve(input, ref, fcnet, block, &errMsg), "fft_convolve: %s", errMsg);
+            checkSame(fout, ref, block, "Convolver<float>");
+        }
+    }
+    clear_UPOLS(&cnet);
+    clear_UPOLS(&net);
+    clear_UPOLS(&fcnet);
+    clear_UPOLS(&fnet);
+}
+#endif
+
+}
+
+int main() {
+    GTABLE * saw = sawtable(1024, 40, SAW_UP);
+    BRKTABLE * envelope = newEnvelope();
+
+    testOscillator<dsp::wave::Sine, double>(sinetick, "Sine");
+    testOscillator<dsp::wave::Square, double>(squaretick, "Square");
+    testOscillator<dsp::wave::SawDown, double>(sawdtick, "SawDown");
+    testOscillator<dsp::wave::SawUp, double>(sawutick, "SawUp");
+    testOscillator<dsp::wave::Triangle, double>(tritick, "Triangle");
+    testOscillator<dsp::wave::Sine, float>(sinetick, "Sine<float>");
+    testOscillator<dsp::wave::Triangle, float>(tritick, "Triangle<float>");
+
+    CHECK(saw && envelope, "could not create the table and envelope");
+    if(saw && envelope) {
+        testTable<0, double>(saw, tabtick, "TableOscillator<0>");
+        testTable<1, double>(saw, tabitick, "TableOscillator<1>");
+        testTable<0, float>(saw, tabtick, "TableOscillator<0, float>");
+        testTable<1, float>(saw, tabitick, "TableOscillator<1, float>");
+        testCubic(saw);
+        testEnvelope(envelope, saw);
+    }
+#ifdef DSP_HAVE_KISSFFT
+    testConvolver();
+#endif
+    freeTable(&saw);
+    bpt_release(&envelope);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,207 @@
+/*
+ fftproc: fft_convolve and every CONVOLVER engine, including the one CONV_AUTO picks, must match a direct
+ convolution at unity gain. The streaming STFT fed in uneven blocks and stft_batch on one or several threads must
+ write identical frames for every output type, and both must reject an output type outside the enumeration.
+ */
+#include "fftproc.h"
+#include "check.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Convolution block size, and the number of blocks convolved.
+ */
+#define FFT_TEST_BLOCK 64
+#define FFT_TEST_NBLOCKS 24
+
+/**
+ * Agreement required with the direct convolution: the FFT path rounds at the precision of kiss_fft_scalar.
+ */
+#define FFT_TEST_CONVTOL (sizeof(kiss_fft_scalar) < sizeof(double) ? 1e-4 : 1e-10)
+
+/**
+ * STFT frame length and hop.
+ */
+#define FFT_TEST_NFFT 256
+#define FFT_TEST_HOP 96
+
+/**
+ * Input length: 60 frames and a partial one.
+ */
+#define FFT_TEST_LENGTH (FFT_TEST_NFFT + 59 * FFT_TEST_HOP + 50)
+
+/**
+ * Frequency bin of the test sine.
+ */
+#define FFT_TEST_BIN 20
+
+/**
+ * Next pseudo-random value in [-1, 1).
+ */
+static double nextValue(unsigned long * seed) {
+    *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return (double) (*seed >> 8) / 4194304.0 - 1.0;
+}
+
+/**
+ * Next pseudo-random integer between 1 and max.
+ */
+static unsigned long nextLength(unsigned long * seed, unsigned long max) {
+    *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return 1 + (*seed >> 8) % max;
+}
+
+/**
+ * Worst-case difference between output and the direct convolution of the first n samples of input with taps.
+ */
+static double convolutionError(const double * taps, unsigned long ntaps, const double * input, const double * output,
+                               unsigned long n) {
+    unsigned long i, k;
+    double expect, worst = 0.0;
+
+    for(i = 0; i < n; i++) {
+        for(k = 0, expect = 0.0; k < ntaps && k <= i; k++) {
+            expect += taps[k] * input[i - k];
+        }
+        if(fabs(output[i] - expect) > worst) {
+            worst = fabs(output[i] - expect);
+        }
+    }
+    return worst;
+}
+
+static void testConvolve(unsigned long ntaps) {
+    static const int engines[] = {CONV_AUTO, CONV_FIR, CONV_UPOLS};
+    static double input[FFT_TEST_BLOCK * FFT_TEST_NBLOCKS], output[FFT_TEST_BLOCK * FFT_TEST_NBLOCKS];
+    double * taps = (double *) malloc(ntaps * sizeof(double));
+    unsigned long seed = 5, i, b;
+    char * errMsg = NULL;
+    CONVOLVER * conv;
+    UPOLS * upols;
+    double worst;
+
+    CHECK(taps != NULL, "could not allocate %lu taps", ntaps);
+    if(!taps) {
+        return;
+    }
+    for(i = 0; i < ntaps; i++) {
+        taps[i] = nextValue(&seed) * exp(-4.0 * i / ntaps);
+    }
+    for(i = 0; i < FFT_TEST_BLOCK * FFT_TEST_NBLOCKS; i++) {
+        input[i] = nextValue(&seed);
+    }
+
+    /* fft_convolve takes a mutable input block, so give it a copy */
+    upols = new_UPOLS(taps, ntaps, FFT_TEST_BLOCK, &errMsg);
+    CHECK(upols != NULL, "new_UPOLS: %s", errMsg);
+    if(upols) {
+        memcpy(output, input, sizeof(input));
+        for(b = 0; b < FFT_TEST_NBLOCKS; b++) {
+            CHECK(fft_convolve(output + b * FFT_TEST_BLOCK, output + b * FFT_TEST_BLOCK, upols, FFT_TEST_BLOCK,
+                               &errMsg), "fft_convolve: %s", errMsg);
+        }
+        worst = convolutionError(taps, ntaps, input, output, FFT_TEST_BLOCK * FFT_TEST_NBLOCKS);
+        CHECK(worst <= FFT_TEST_CONVTOL, "fft_convolve with %lu taps is %g off the direct convolution", ntaps, worst);
+        clear_UPOLS(&upols);
+    }
+
+    for(i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        conv = new_CONVOLVER(taps, ntaps, FFT_TEST_BLOCK, engines[i], &errMsg);
+        CHECK(conv != NULL, "new_CONVOLVER: %s", errMsg);
+        if(!conv) {
+            continue;
+        }
+        if(engines[i] == CONV_AUTO) {
+            CHECK(conv->engine == (convolver_usefir(ntaps, FFT_TEST_BLOCK) ? CONV_FIR : CONV_UPOLS),
+                  "CONV_AUTO picked engine %d for %lu taps", conv->engine, ntaps);
+        }
+        /* In place on alternate blocks */
+        for(b = 0; b < FFT_TEST_NBLOCKS; b++) {
+            if(b % 2) {
+                memcpy(output + b * FFT_TEST_BLOCK, input + b * FFT_TEST_BLOCK, FFT_TEST_BLOCK * sizeof(double));
+                CHECK(convolver_process(conv, output + b * FFT_TEST_BLOCK, output + b * FFT_TEST_BLOCK, &errMsg),
+                      "convolver_process: %s", errMsg);
+            }
+            else {
+                CHECK(convolver_process(conv, input + b * FFT_TEST_BLOCK, output + b * FFT_TEST_BLOCK, &errMsg),
+                      "convolver_process: %s", errMsg);
+            }
+        }
+        worst = convolutionError(taps, ntaps, input, output, FFT_TEST_BLOCK * FFT_TEST_NBLOCKS);
+        CHECK(worst <= FFT_TEST_CONVTOL, "engine %d (requested %d) with %lu taps is %g off the direct convolution",
+              conv->engine, engines[i], ntaps, worst);
+        clear_CONVOLVER(&conv);
+    }
+    free(taps);
+}
+
+static void testSTFT(const STFTPLAN * plan, const double * signal, int output) {
+    unsigned long nframes = stft_batchframes(plan, FFT_TEST_LENGTH), framesize = stft_framesize(plan, output);
+    unsigned long seed = 11, done, n, written = 0;
+    double * batch = (double *) malloc(nframes * framesize * sizeof(double));
+    double * threaded = (double *) malloc(nframes * framesize * sizeof(double));
+    double * pushed = (double *) malloc((nframes + 1) * framesize * sizeof(double));
+    char * errMsg = NULL;
+    STFT * stft = new_STFT(plan, output, &errMsg);
+
+    CHECK(batch && threaded && pushed && stft, "could not allocate output %d: %s", output, errMsg);
+    if(!batch || !threaded || !pushed || !stft) {
+        goto done;
+    }
+    CHECK(stft_batch(plan, signal, FFT_TEST_LENGTH, output, batch, 1, &errMsg) == (long) nframes,
+          "stft_batch on one thread: %s", errMsg);
+    CHECK(stft_batch(plan, signal, FFT_TEST_LENGTH, output, threaded, 3, &errMsg) == (long) nframes,
+          "stft_batch on three threads: %s", errMsg);
+    for(done = 0; done < FFT_TEST_LENGTH; done += n) {
+        n = nextLength(&seed, 2 * FFT_TEST_HOP);
+        if(n > FFT_TEST_LENGTH - done) {
+            n = FFT_TEST_LENGTH - done;
+        }
+        CHECK(written + stft_pending(stft, n) <= nframes, "stft_pending promised more frames than the signal has");
+        written += stft_push(stft, signal + done, n, pushed + written * framesize);
+    }
+    CHECK(written == nframes, "output %d: pushed %lu frames, batch wrote %lu", output, written, nframes);
+    CHECK(!memcmp(batch, threaded, nframes * framesize * sizeof(double)),
+          "output %d: threaded batch frames differ", output);
+    CHECK(!memcmp(batch, pushed, nframes * framesize * sizeof(double)),
+          "output %d: pushed frames differ from the batch", output);
+    if(output == STFT_MAGNITUDE) {
+        /* A full-scale sine centred on a bin reads wsum / 2 there */
+        CHECK_NEAR(batch[FFT_TEST_BIN] / (plan->wsum / 2.0), 1.0, 1e-9, "sine magnitude");
+    }
+done:
+    clear_STFT(&stft);
+    free(batch);
+    free(threaded);
+    free(pushed);
+}
+
+int main(void) {
+    static double signal[FFT_TEST_LENGTH], frame[FFT_TEST_NFFT];
+    char * errMsg = NULL;
+    STFTPLAN * plan = new_STFTPLAN(FFT_TEST_NFFT, FFT_TEST_HOP, STFT_HANN, &errMsg);
+    unsigned long i;
+
+    /* Shorter than a block, a partial last partition, and long enough for CONV_AUTO to pick UPOLS on any CPU */
+    testConvolve(40);
+    testConvolve(FFT_TEST_BLOCK * 4 + 13);
+    testConvolve(FFTPROC_FIR_MAXTAPS_AVX512 + 1);
+
+    CHECK(plan != NULL, "new_STFTPLAN: %s", errMsg);
+    if(!plan) {
+        return CHECK_RESULT();
+    }
+    for(i = 0; i < FFT_TEST_LENGTH; i++) {
+        signal[i] = sin(2.0 * M_PI * FFT_TEST_BIN * i / FFT_TEST_NFFT);
+    }
+    testSTFT(plan, signal, STFT_MAGNITUDE);
+    testSTFT(plan, signal, STFT_POWER);
+    testSTFT(plan, signal, STFT_COMPLEX);
+
+    CHECK(new_STFT(plan, STFT_COMPLEX + 1, &errMsg) == NULL, "new_STFT accepted an unknown output");
+    CHECK(new_STFT(plan, -1, &errMsg) == NULL, "new_STFT accepted a negative output");
+    CHECK(stft_batch(plan, signal, FFT_TEST_LENGTH, STFT_COMPLEX + 1, frame, 1, &errMsg) == -1,
+          "stft_batch accepted an unknown output");
+    clear_STFTPLAN(&plan);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,87 @@
+/*
+ fir: the impulse response must reproduce the taps, and random input filtered in uneven blocks (longer and
+ shorter than maxblock) must match a direct convolution, whichever SIMD kernel the CPU selects.
+ */
+#include "fir.h"
+#include "check.h"
+#include <string.h>
+
+/**
+ * Number of taps: odd, and not a multiple of any SIMD width, so every kernel runs its remainder loop.
+ */
+#define FIR_TEST_TAPS 37
+
+/**
+ * Samples filtered per run.
+ */
+#define FIR_TEST_LENGTH 600
+
+/**
+ * Next pseudo-random value in [-1, 1).
+ */
+static double nextValue(unsigned long * seed) {
+    *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return (double) (*seed >> 8) / 4194304.0 - 1.0;
+}
+
+/**
+ * Filter a signal through a FIR filter in pseudo-random blocks of 1 to 20 samples.
+ */
+static void filterInBlocks(FIRFILTER * fir, const double * in, double * out, unsigned long n, unsigned long seed) {
+    unsigned long done, len;
+    for(done = 0; done < n; done += len) {
+        seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+        len = 1 + (seed >> 8) % 20;
+        if(len > n - done) {
+            len = n - done;
+        }
+        fir_process(fir, in + done, out + done, len);
+    }
+}
+
+int main(void) {
+    static double taps[FIR_TEST_TAPS], in[FIR_TEST_LENGTH], out[FIR_TEST_LENGTH], expect[FIR_TEST_LENGTH];
+    unsigned long seed = 11, i, k;
+    FIRFILTER * fir;
+
+    for(i = 0; i < FIR_TEST_TAPS; i++) {
+        taps[i] = nextValue(&seed);
+    }
+    /* A maxblock of 7 makes the 1 to 20 sample blocks split across kernel calls */
+    fir = new_FIR(taps, FIR_TEST_TAPS, 7);
+    CHECK(fir != NULL, "new_FIR failed");
+    if(!fir) {
+        return CHECK_RESULT();
+    }
+    printf("fir kernel: %s\n", fir_kernelname());
+
+    /* Impulse response */
+    memset(in, 0, sizeof(in));
+    in[0] = 1.0;
+    filterInBlocks(fir, in, out, FIR_TEST_LENGTH, 1);
+    for(i = 0; i < FIR_TEST_LENGTH; i++) {
+        CHECK_NEAR(out[i], i < FIR_TEST_TAPS ? taps[i] : 0.0, 0.0, "impulse response");
+    }
+
+    /* Random input against a direct convolution, after a reset clears the impulse's history */
+    for(i = 0; i < FIR_TEST_LENGTH; i++) {
+        in[i] = nextValue(&seed);
+        for(k = 0, expect[i] = 0.0; k < FIR_TEST_TAPS && k <= i; k++) {
+            expect[i] += taps[k] * in[i - k];
+        }
+    }
+    fir_reset(fir);
+    filterInBlocks(fir, in, out, FIR_TEST_LENGTH, 2);
+    for(i = 0; i < FIR_TEST_LENGTH; i++) {
+        CHECK_NEAR(out[i], expect[i], 1e-12, "random input against direct convolution");
+    }
+    /* One call covering the whole signal */
+    fir_reset(fir);
+    fir_process(fir, in, out, FIR_TEST_LENGTH);
+    for(i = 0; i < FIR_TEST_LENGTH; i++) {
+        CHECK_NEAR(out[i], expect[i], 1e-12, "single call against direct convolution");
+    }
+    clear_FIR(&fir);
+    CHECK(fir == NULL, "clear_FIR did not clear the pointer");
+    return CHECK_RESULT();
+}
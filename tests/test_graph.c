@@ -0,0 +1,216 @@
+/*
+ graph: nodes added out of dependency order must be scheduled by level, a long chain must run in a couple of
+ recycled buffers, terminal outputs must survive the buffer reuse, cycles must be rejected and a worker pool
+ must produce the serial result.
+ */
+#include "graph.h"
+#include "check.h"
+#include <stdlib.h>
+
+/**
+ * Frames per block in every test graph.
+ */
+#define GRAPH_TEST_BLOCK 64
+
+/**
+ * Source node: no inputs, one output counting up by one per frame from the value in its state.
+ */
+static void rampProcess(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes) {
+    double * next = (double *) state;
+    unsigned long i;
+    (void) inputs;
+    for(i = 0; i < nframes; i++) {
+        outputs[0][i] = *next + (double) i;
+    }
+    *next += (double) nframes;
+}
+
+/**
+ * Gain node: one input scaled by the factor in its state (an unconnected input counts as 0).
+ */
+static void gainProcess(void * state, const double * const * inputs, double * const * outputs, unsigned long nframes) {
+    double gain = *(double *) state;
+    unsigned long i;
+    for(i = 0; i < nframes; i++) {
+        outputs[0][i] = inputs[0] ? gain * inputs[0][i] : 0.0;
+    }
+}
+
+/**
+ * Add a ramp source starting at 0.
+ */
+static int addRamp(DSPGRAPH * graph) {
+    double * state = (double *) calloc(1, sizeof(double));
+    int node = state ? graph_addnode(graph, rampProcess, state, free, 0, 1) : GRAPH_INVALID;
+    if(node == GRAPH_INVALID) {
+        free(state);
+    }
+    return node;
+}
+
+/**
+ * Add a gain node with a given factor.
+ */
+static int addGain(DSPGRAPH * graph, double gain) {
+    double * state = (double *) malloc(sizeof(double));
+    int node = GRAPH_INVALID;
+    if(state) {
+        *state = gain;
+        node = graph_addnode(graph, gainProcess, state, free, 1, 1);
+    }
+    if(node == GRAPH_INVALID) {
+        free(state);
+    }
+    return node;
+}
+
+/**
+ * Check an output against gain times the ramp value of a given block.
+ */
+static void checkOutput(const DSPGRAPH * graph, int node, double gain, unsigned int block, const char * what) {
+    const double * out = graph_output(graph, node, 0);
+    unsigned long i;
+    CHECK(out != NULL, "%s: no output buffer", what);
+    for(i = 0; out && i < GRAPH_TEST_BLOCK; i++) {
+        CHECK_NEAR(out[i], gain * (double) (block * GRAPH_TEST_BLOCK + i), 1e-9, what);
+    }
+}
+
+static void testOrder(void) {
+    DSPGRAPH * graph = graph_new(GRAPH_TEST_BLOCK);
+    char * errMsg = NULL;
+    int mix, gain, ramp;
+    unsigned int block;
+
+    /* Added sink first and source last, so the schedule cannot follow insertion order */
+    mix = graph_addmix(graph, 2);
+    gain = addGain(graph, 3.0);
+    ramp = addRamp(graph);
+    CHECK(mix == 0 && gain == 1 && ramp == 2, "node ids %d %d %d", mix, gain, ramp);
+    CHECK(graph_connect(graph, ramp, 0, gain, 0) && graph_connect(graph, gain, 0, mix, 0) &&
+          graph_connect(graph, ramp, 0, mix, 1), "connect failed");
+    CHECK(!graph_connect(graph, ramp, 1, mix, 0) && !graph_connect(graph, ramp, 0, mix, 2), "invalid port accepted");
+    CHECK(graph_compile(graph, 1, &errMsg), "compile failed: %s", errMsg);
+    CHECK(graph->nlevels == 3, "%u levels, expected 3", graph->nlevels);
+    CHECK(graph->nodes[ramp].level == 0 && graph->nodes[gain].level == 1 && graph->nodes[mix].level == 2,
+          "levels %u %u %u", graph->nodes[ramp].level, graph->nodes[gain].level, graph->nodes[mix].level);
+    CHECK(graph->order[0] == (unsigned int) ramp && graph->order[1] == (unsigned int) gain &&
+          graph->order[2] == (unsigned int) mix, "order %u %u %u", graph->order[0], graph->order[1], graph->order[2]);
+    for(block = 0; block < 3; block++) {
+        graph_process(graph);
+        checkOutput(graph, mix, 4.0, block, "ramp * 3 + ramp");
+    }
+    graph_free(&graph);
+    CHECK(graph == NULL, "graph_free did not clear the pointer");
+}
+
+static void testChain(void) {
+    DSPGRAPH * graph = graph_new(GRAPH_TEST_BLOCK);
+    char * errMsg = NULL;
+    int prev, node = GRAPH_INVALID, i;
+    unsigned int block;
+
+    prev = addRamp(graph);
+    for(i = 0; i < 10; i++) {
+        node = addGain(graph, 2.0);
+        CHECK(graph_connect(graph, prev, 0, node, 0), "connect %d -> %d failed", prev, node);
+        prev = node;
+    }
+    CHECK(graph_compile(graph, 1, &errMsg), "compile failed: %s", errMsg);
+    CHECK(graph->nlevels == 11, "%u levels, expected 11", graph->nlevels);
+    /* Each link only lives across one level, so two buffers alternate down the chain */
+    CHECK(graph->nbuffers <= 2, "an 11 node chain used %u buffers", graph->nbuffers);
+    for(block = 0; block < 3; block++) {
+        graph_process(graph);
+        checkOutput(graph, node, 1024.0, block, "chain of ten doublings");
+    }
+    graph_free(&graph);
+}
+
+static void testDiamond(void) {
+    DSPGRAPH * graph = graph_new(GRAPH_TEST_BLOCK);
+    char * errMsg = NULL;
+    int ramp, left, right, side, mix;
+    unsigned int block;
+
+    /* ramp feeds two branches that rejoin in mix, and a side node whose output nothing reads */
+    ramp = addRamp(graph);
+    left = addGain(graph, 2.0);
+    right = addGain(graph, 3.0);
+    side = addGain(graph, 5.0);
+    mix = graph_addmix(graph, 2);
+    CHECK(graph_connect(graph, ramp, 0, left, 0) && graph_connect(graph, ramp, 0, right, 0) &&
+          graph_connect(graph, ramp, 0, side, 0) && graph_connect(graph, left, 0, mix, 0) &&
+          graph_connect(graph, right, 0, mix, 1), "connect failed");
+    CHECK(graph_compile(graph, 1, &errMsg), "compile failed: %s", errMsg);
+    CHECK(graph->nodes[side].outbufs[0] != graph->nodes[mix].outbufs[0], "both terminal outputs share a buffer");
+    for(block = 0; block < 3; block++) {
+        graph_process(graph);
+        checkOutput(graph, mix, 5.0, block, "diamond: ramp * 2 + ramp * 3");
+        checkOutput(graph, side, 5.0, block, "diamond: terminal side branch");
+    }
+    CHECK(graph_output(graph, mix, 1) == NULL && graph_output(graph, 99, 0) == NULL, "invalid output returned");
+    graph_free(&graph);
+}
+
+static void testCycle(void) {
+    DSPGRAPH * graph = graph_new(GRAPH_TEST_BLOCK);
+    char * errMsg = NULL;
+    int ramp, a, b, mix;
+
+    ramp = addRamp(graph);
+    a = addGain(graph, 1.0);
+    b = addGain(graph, 1.0);
+    mix = graph_addmix(graph, 2);
+    graph_connect(graph, ramp, 0, mix, 0);
+    graph_connect(graph, mix, 0, a, 0);
+    graph_connect(graph, a, 0, b, 0);
+    graph_connect(graph, b, 0, mix, 1);
+    CHECK(!graph_compile(graph, 1, &errMsg), "a graph with a cycle compiled");
+    CHECK(errMsg != NULL, "cycle rejected without an error message");
+    graph_free(&graph);
+}
+
+static void testThreads(void) {
+    DSPGRAPH * graph[2];
+    const double * out[2];
+    char * errMsg = NULL;
+    int ramp, gain, mix[2] = {GRAPH_INVALID, GRAPH_INVALID}, i, g;
+    unsigned int block;
+    unsigned long j;
+
+    /* The same wide graph, run serially and with four threads */
+    for(g = 0; g < 2; g++) {
+        graph[g] = graph_new(GRAPH_TEST_BLOCK);
+        ramp = addRamp(graph[g]);
+        mix[g] = graph_addmix(graph[g], 8);
+        for(i = 0; i < 8; i++) {
+            gain = addGain(graph[g], (double) (i + 1));
+            graph_connect(graph[g], ramp, 0, gain, 0);
+            graph_connect(graph[g], gain, 0, mix[g], (unsigned int) i);
+        }
+        CHECK(graph_compile(graph[g], g ? 4 : 1, &errMsg), "compile failed: %s", errMsg);
+    }
+    CHECK(graph[1]->nthreads == 4, "parallel graph runs on %u threads", graph[1]->nthreads);
+    for(block = 0; block < 8; block++) {
+        for(g = 0; g < 2; g++) {
+            graph_process(graph[g]);
+            out[g] = graph_output(graph[g], mix[g], 0);
+        }
+        checkOutput(graph[0], mix[0], 36.0, block, "serial sum of eight gains");
+        for(j = 0; j < GRAPH_TEST_BLOCK; j++) {
+            CHECK(out[1][j] == out[0][j], "block %u frame %lu: parallel %g, serial %g", block, j, out[1][j], out[0][j]);
+        }
+    }
+    graph_free(&graph[0]);
+    graph_free(&graph[1]);
+}
+
+int main(void) {
+    testOrder();
+    testChain();
+    testDiamond();
+    testCycle();
+    testThreads();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,131 @@
+/*
+ instrument: bucketUpper must be the exact inverse of bucketIndex, every bucket ending one cycle before the next
+ begins and no wider than 2^-DSP_PROBE_SUBBITS of its start, with UINT64_MAX still inside the histogram.
+ dsp_probe_percentile must return the upper bound of the bucket holding the requested rank, clamped to the
+ slowest call, and a probe fed through dsp_probe_record must snapshot to the same counts, bounds and percentiles.
+ Built only with DSP_INSTRUMENT, as the recording path compiles to nothing without it.
+ */
+/* Included rather than linked, to reach the static bucket helpers */
+#include "instrument.c"
+#include "check.h"
+#include <string.h>
+
+/**
+ * Probe the recording test writes to.
+ */
+#define INSTRUMENT_TEST_PROBE DSP_PROBE_BLOCK
+
+/**
+ * Cycle counts of the synthetic calls, and how many of each: a percentile lands in a known bucket.
+ */
+static const uint64_t callCycles[] = {3, 100, 1000, 100000};
+static const unsigned long callCounts[] = {1, 49, 49, 1};
+
+static void testBuckets(void) {
+    unsigned int b, last = bucketIndex(UINT64_MAX);
+    uint64_t upper, prev = 0;
+
+    CHECK(last < DSP_PROBE_BUCKETS, "UINT64_MAX maps to bucket %u of %d", last, DSP_PROBE_BUCKETS);
+    CHECK(bucketUpper(last) == UINT64_MAX, "the last bucket ends at %llu", (unsigned long long) bucketUpper(last));
+    for(b = 0; b <= last; b++) {
+        upper = bucketUpper(b);
+        CHECK(bucketIndex(upper) == b, "bucketUpper(%u) = %llu maps to bucket %u", b, (unsigned long long) upper,
+              bucketIndex(upper));
+        if(b < last) {
+            CHECK(bucketIndex(upper + 1) == b + 1, "%llu, one past bucket %u, maps to bucket %u",
+                  (unsigned long long) upper + 1, b, bucketIndex(upper + 1));
+        }
+        if(b >= (1u << DSP_PROBE_SUBBITS)) {
+            /* prev + 1 is the bucket's first count */
+            CHECK((upper - prev) << DSP_PROBE_SUBBITS <= prev + 1, "bucket %u spans %llu..%llu", b,
+                  (unsigned long long) prev + 1, (unsigned long long) upper);
+        }
+        prev = upper;
+    }
+}
+
+/**
+ * Check the percentiles of a histogram holding the synthetic calls.
+ */
+static void checkPercentiles(const DSPPROBESTATS * stats, const char * what) {
+    uint64_t max = callCycles[3];
+
+    CHECK(dsp_probe_percentile(stats, 0.0) == bucketUpper(bucketIndex(callCycles[0])), "%s: 0th percentile", what);
+    CHECK(dsp_probe_percentile(stats, 1.0) == bucketUpper(bucketIndex(callCycles[0])), "%s: 1st percentile", what);
+    CHECK(dsp_probe_percentile(stats, 2.0) == bucketUpper(bucketIndex(callCycles[1])), "%s: 2nd percentile", what);
+    CHECK(dsp_probe_percentile(stats, 50.0) == bucketUpper(bucketIndex(callCycles[1])), "%s: median", what);
+    CHECK(dsp_probe_percentile(stats, 51.0) == bucketUpper(bucketIndex(callCycles[2])), "%s: 51st percentile",
+          what);
+    CHECK(dsp_probe_percentile(stats, 99.0) == bucketUpper(bucketIndex(callCycles[2])), "%s: 99th percentile",
+          what);
+    /* The slowest call's bucket reaches past it, so the top percentile is clamped to max */
+    CHECK(bucketUpper(bucketIndex(max)) > max, "%llu is the last count of its bucket", (unsigned long long) max);
+    CHECK(dsp_probe_percentile(stats, 100.0) == max && dsp_probe_percentile(stats, 250.0) == max,
+          "%s: 100th percentile is %llu", what, (unsigned long long) dsp_probe_percentile(stats, 100.0));
+    CHECK(dsp_probe_percentile(stats, -5.0) == dsp_probe_percentile(stats, 0.0), "%s: negative percentile", what);
+}
+
+static void testPercentiles(void) {
+    DSPPROBESTATS stats;
+    unsigned long i;
+
+    memset(&stats, 0, sizeof(stats));
+    CHECK(dsp_probe_percentile(&stats, 50.0) == 0, "percentile of an empty histogram");
+    for(i = 0; i < 4; i++) {
+        stats.histogram[bucketIndex(callCycles[i])] += callCounts[i];
+        stats.count += callCounts[i];
+    }
+    stats.min = callCycles[0];
+    stats.max = callCycles[3];
+    checkPercentiles(&stats, "synthetic histogram");
+}
+
+static void testRecord(void) {
+    DSPPROBESTATS stats;
+    unsigned long i, j, n = 0;
+    uint64_t total = 0;
+
+    dsp_probe_reset(INSTRUMENT_TEST_PROBE);
+    dsp_probe_setdeadline(INSTRUMENT_TEST_PROBE, 5000);
+    CHECK(dsp_probe_snapshot(INSTRUMENT_TEST_PROBE, &stats), "dsp_probe_snapshot failed");
+    CHECK(stats.count == 0 && stats.min == UINT64_MAX && stats.deadline == 5000, "reset probe: %llu calls",
+          (unsigned long long) stats.count);
+    /* Interleaved, so the histogram does not depend on the order of the calls */
+    for(j = 0; j < callCounts[1]; j++) {
+        for(i = 0; i < 4; i++) {
+            if(j < callCounts[i]) {
+                dsp_probe_record(INSTRUMENT_TEST_PROBE, callCycles[i], i + 1);
+                total += callCycles[i];
+                n += i + 1;
+            }
+        }
+    }
+    dsp_probe_record(-1, 1, 1);
+    dsp_probe_record(DSP_NPROBES, 1, 1);
+
+    CHECK(dsp_probe_snapshot(INSTRUMENT_TEST_PROBE, &stats), "dsp_probe_snapshot failed");
+    CHECK(stats.count == 100 && stats.items == n && stats.total == total, "%llu calls, %llu items, %llu cycles",
+          (unsigned long long) stats.count, (unsigned long long) stats.items, (unsigned long long) stats.total);
+    CHECK(stats.min == callCycles[0] && stats.max == callCycles[3], "min %llu, max %llu",
+          (unsigned long long) stats.min, (unsigned long long) stats.max);
+    CHECK(stats.misses == 1 && stats.dropped == 0, "%llu misses, %llu dropped", (unsigned long long) stats.misses,
+          (unsigned long long) stats.dropped);
+    for(i = 0; i < 4; i++) {
+        CHECK(stats.histogram[bucketIndex(callCycles[i])] == callCounts[i], "bucket of %llu cycles holds %llu",
+              (unsigned long long) callCycles[i], (unsigned long long) stats.histogram[bucketIndex(callCycles[i])]);
+    }
+    checkPercentiles(&stats, "recorded probe");
+
+    /* A reset clears the counts but keeps the deadline */
+    dsp_probe_reset(INSTRUMENT_TEST_PROBE);
+    CHECK(dsp_probe_snapshot(INSTRUMENT_TEST_PROBE, &stats), "dsp_probe_snapshot failed");
+    CHECK(stats.count == 0 && stats.histogram[bucketIndex(callCycles[1])] == 0 && stats.deadline == 5000,
+          "reset left %llu calls", (unsigned long long) stats.count);
+}
+
+int main(void) {
+    testBuckets();
+    testPercentiles();
+    testRecord();
+    return CHECK_RESULT();
+}
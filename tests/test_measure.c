@@ -0,0 +1,186 @@
+/*
+ measure: a sweep convolved with a known two-tap response must deconvolve to taps at the right positions with the
+ right levels relative to the bare sweep's impulse, and leave the harmonic windows of this linear system empty.
+ Averaging noisy repetitions with SWEEPAVG must keep the response and lower its noise floor by about sqrt(N),
+ with the SNR estimate gaining about 3dB per doubling.
+ */
+#include "measure.h"
+#include "sweep.h"
+#include "check.h"
+#include <stdlib.h>
+
+/**
+ * Sweep settings: kept short, as the FFTs run on the whole recording.
+ */
+#define MEASURE_TEST_FS 4000.0
+#define MEASURE_TEST_T 0.5
+
+/**
+ * Impulse response window and predelay.
+ */
+#define MEASURE_TEST_IRLEN 400
+#define MEASURE_TEST_PREDELAY 20
+
+/**
+ * Number of noisy repetitions averaged, and the noise level (uniform, peak).
+ */
+#define MEASURE_TEST_NREPS 8
+#define MEASURE_TEST_NOISE 0.02
+
+/**
+ * Delays and gains of the known response.
+ */
+static const unsigned long tapDelays[] = {37, 120};
+static const double tapGains[] = {0.5, -0.2};
+
+/**
+ * Next pseudo-random value in [-1, 1).
+ */
+static double nextValue(unsigned long * seed) {
+    *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return (double) (*seed >> 8) / 4194304.0 - 1.0;
+}
+
+/**
+ * Index of the largest magnitude in a buffer.
+ */
+static unsigned long peakIndex(const double * x, unsigned long n) {
+    unsigned long i, peak = 0;
+    for(i = 1; i < n; i++) {
+        if(fabs(x[i]) > fabs(x[peak])) {
+            peak = i;
+        }
+    }
+    return peak;
+}
+
+/**
+ * RMS difference between two impulse responses.
+ */
+static double rmsDifference(const double * a, const double * b, unsigned long n) {
+    unsigned long i;
+    double sum = 0.0;
+    for(i = 0; i < n; i++) {
+        sum += (a[i] - b[i]) * (a[i] - b[i]);
+    }
+    return sqrt(sum / n);
+}
+
+/**
+ * Add a noisy repetition of the response to a buffer.
+ */
+static void noisyRepetition(const double * clean, double * out, unsigned long n, unsigned long * seed) {
+    unsigned long i;
+    for(i = 0; i < n; i++) {
+        out[i] = clean[i] + MEASURE_TEST_NOISE * nextValue(seed);
+    }
+}
+
+int main(void) {
+    IRSPEC spec = {MEASURE_TEST_T, MEASURE_TEST_FS, 50.0, 1800.0, MEASURE_TEST_IRLEN, MEASURE_TEST_PREDELAY, 2, 2, 0};
+    ESSGEN * gen = newSweepGen(spec.T, spec.fs, spec.startFreq, spec.endFreq);
+    unsigned long sweeplen, reclen, i, k, seed = 9, peak;
+    double * sweep = NULL, * response = NULL, * noisy = NULL, bare, floor1, floorN, snr2 = 0.0;
+    const double * recordings[2];
+    IRMEASURE * irs = NULL, * single = NULL, * averaged = NULL;
+    SWEEPAVG * avg = NULL, * one = NULL;
+    char * errMsg = NULL;
+
+    CHECK(gen != NULL, "newSweepGen failed");
+    if(!gen) {
+        return CHECK_RESULT();
+    }
+    sweeplen = gen->size;
+    reclen = sweeplen + MEASURE_TEST_IRLEN;
+    sweep = (double *) calloc(reclen, sizeof(double));
+    response = (double *) calloc(reclen, sizeof(double));
+    noisy = (double *) malloc(reclen * sizeof(double));
+    CHECK(sweep && response && noisy, "could not allocate the recordings");
+    if(!sweep || !response || !noisy) {
+        goto done;
+    }
+    essgen_forward(gen, sweep, sweeplen);
+    for(k = 0; k < 2; k++) {
+        for(i = 0; i < sweeplen; i++) {
+            response[i + tapDelays[k]] += tapGains[k] * sweep[i];
+        }
+    }
+
+    /* The bare sweep and the response, on two threads */
+    recordings[0] = sweep;
+    recordings[1] = response;
+    irs = measure_ir(recordings, 2, reclen, &spec, &errMsg);
+    CHECK(irs != NULL, "measure_ir: %s", errMsg);
+    if(!irs) {
+        goto done;
+    }
+    CHECK(irs[0].linlen == MEASURE_TEST_PREDELAY + MEASURE_TEST_IRLEN, "linear IR of %lu samples", irs[0].linlen);
+    peak = peakIndex(irs[0].linear, irs[0].linlen);
+    bare = irs[0].linear[peak];
+    CHECK(peak == MEASURE_TEST_PREDELAY, "bare sweep's impulse at %lu, not at the predelay", peak);
+    CHECK(bare > 0.8 && bare < 1.1, "bare sweep's impulse is %g", bare);
+    peak = peakIndex(irs[1].linear, irs[1].linlen);
+    CHECK(peak == MEASURE_TEST_PREDELAY + tapDelays[0], "response peak at %lu, not %lu", peak,
+          MEASURE_TEST_PREDELAY + tapDelays[0]);
+    for(k = 0; k < 2; k++) {
+        CHECK_NEAR(irs[1].linear[MEASURE_TEST_PREDELAY + tapDelays[k]] / bare, tapGains[k], 0.01, "tap level");
+    }
+    for(k = 0; k < irs[1].nharmonics; k++) {
+        CHECK(irs[1].harmlens[k] > 0, "harmonic %lu has no window", k + 2);
+        if(irs[1].harmlens[k]) {
+            peak = peakIndex(irs[1].harmonics[k], irs[1].harmlens[k]);
+            CHECK(fabs(irs[1].harmonics[k][peak]) < 0.01 * bare, "linear system shows harmonic %lu at %g", k + 2,
+                  irs[1].harmonics[k][peak]);
+        }
+    }
+
+    /* One noisy repetition, then the average of several */
+    one = new_SWEEPAVG(&spec, reclen, 0.0, &errMsg);
+    avg = new_SWEEPAVG(&spec, reclen, 4.0, &errMsg);
+    CHECK(one && avg, "new_SWEEPAVG: %s", errMsg);
+    if(!one || !avg) {
+        goto done;
+    }
+    noisyRepetition(response, noisy, reclen, &seed);
+    CHECK(sweepavg_push(one, noisy), "single repetition rejected");
+    CHECK(sweepavg_push(avg, noisy), "first repetition rejected");
+    for(i = 1; i < MEASURE_TEST_NREPS; i++) {
+        noisyRepetition(response, noisy, reclen, &seed);
+        CHECK(sweepavg_push(avg, noisy), "repetition %lu rejected", i);
+        if(i == 1) {
+            snr2 = sweepavg_snr(avg);
+        }
+    }
+    CHECK(avg->count == MEASURE_TEST_NREPS && avg->rejected == 0, "%lu accepted, %lu rejected", avg->count,
+          avg->rejected);
+    /* Two doublings from 2 to 8 repetitions */
+    CHECK(sweepavg_snr(avg) - snr2 > 4.5 && sweepavg_snr(avg) - snr2 < 7.5, "SNR went from %g to %g dB", snr2,
+          sweepavg_snr(avg));
+
+    single = sweepavg_result(one, &errMsg);
+    averaged = sweepavg_result(avg, &errMsg);
+    CHECK(single && averaged, "sweepavg_result: %s", errMsg);
+    if(!single || !averaged) {
+        goto done;
+    }
+    peak = peakIndex(averaged->linear, averaged->linlen);
+    CHECK(peak == MEASURE_TEST_PREDELAY + tapDelays[0], "averaged response peak at %lu", peak);
+    CHECK_NEAR(averaged->linear[peak] / bare, tapGains[0], 0.01, "averaged tap level");
+    floor1 = rmsDifference(single->linear, irs[1].linear, irs[1].linlen);
+    floorN = rmsDifference(averaged->linear, irs[1].linear, irs[1].linlen);
+    CHECK(floor1 > 0.0 && floorN / floor1 > 0.7 / sqrt(MEASURE_TEST_NREPS) &&
+          floorN / floor1 < 1.4 / sqrt(MEASURE_TEST_NREPS),
+          "noise floor went from %g to %g over %d repetitions", floor1, floorN, MEASURE_TEST_NREPS);
+
+done:
+    clearMeasurements(&irs, 2);
+    clearMeasurements(&single, 1);
+    clearMeasurements(&averaged, 1);
+    clear_SWEEPAVG(&one);
+    clear_SWEEPAVG(&avg);
+    clearSweepGen(&gen);
+    free(sweep);
+    free(response);
+    free(noisy);
+    return CHECK_RESULT();
+}
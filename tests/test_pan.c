@@ -0,0 +1,208 @@
+/*
+ pan: the Taylor sine behind the constant-power law must stay within its documented error of sin() over
+ [0, pi/2], and the block kernels must reject a pan law passed as an output mode and vice versa, leaving their
+ outputs untouched. The ramps start on the start gains and stop one step short of the end gains, PAN_MIX adds
+ exactly what PAN_REPLACE writes, and the planar kernels give the interleaved results, also in place.
+ */
+/* Included rather than linked, to reach the static quartersin */
+#include "pan.c"
+#include "check.h"
+#include <string.h>
+
+/**
+ * Documented error bound of quartersin.
+ */
+#define PAN_TEST_SINTOL 6e-8
+
+/**
+ * Samples per test block.
+ */
+#define PAN_TEST_SIZE 64
+
+/**
+ * Agreement required between PAN_MIX and PAN_REPLACE plus the bus: a contracted multiply-add rounds once, not twice.
+ */
+#define PAN_TEST_MIXTOL 1e-6
+
+static void testQuarterSin(void) {
+    const double halfpi = 2.0 * atan(1.0);
+    double x, err, worst = 0.0, worstx = 0.0;
+    unsigned long i, n = 100000;
+
+    for(i = 0; i <= n; i++) {
+        x = halfpi * i / n;
+        err = fabs(quartersin(x) - sin(x));
+        if(err > worst) {
+            worst = err;
+            worstx = x;
+        }
+    }
+    CHECK(worst < PAN_TEST_SINTOL, "quartersin is %g off sin() at %.17g", worst, worstx);
+    CHECK(quartersin(0.0) == 0.0, "quartersin(0) is %g", quartersin(0.0));
+}
+
+static void testEnums(void) {
+    static float in[PAN_TEST_SIZE], out[2 * PAN_TEST_SIZE], expect[2 * PAN_TEST_SIZE];
+    static double positions[PAN_TEST_SIZE];
+    PANPOS pos = constPower(0.0);
+    unsigned long i;
+
+    for(i = 0; i < PAN_TEST_SIZE; i++) {
+        in[i] = 1.0f;
+        positions[i] = 0.0;
+        out[2 * i] = out[2 * i + 1] = expect[2 * i] = expect[2 * i + 1] = 0.5f;
+    }
+    CHECK(!stereoPanInterleaved(in, out, PAN_TEST_SIZE, pos, pos, (PANMODE) PAN_CONSTPOWER),
+          "stereoPanInterleaved accepted a pan law as its mode");
+    CHECK(!stereoPanPlanar(in, out, out + PAN_TEST_SIZE, PAN_TEST_SIZE, pos, pos, (PANMODE) PAN_LINEAR),
+          "stereoPanPlanar accepted a pan law as its mode");
+    CHECK(!stereoPanDynamic(in, out, positions, PAN_TEST_SIZE, (PANLAW) PAN_MIX, PAN_REPLACE),
+          "stereoPanDynamic accepted an output mode as its law");
+    CHECK(!stereoPanStream(in, out, NULL, PAN_TEST_SIZE, PAN_LINEAR, (PANMODE) PAN_CONSTPOWER),
+          "stereoPanStream accepted a pan law as its mode");
+    CHECK(!memcmp(out, expect, sizeof(out)), "a rejected call wrote its output");
+
+    /* Every valid value is accepted: the centre reads sqrt(0.5) constant-power and 0.5 linear */
+    CHECK(stereoPanDynamic(in, out, positions, PAN_TEST_SIZE, PAN_CONSTPOWER, PAN_REPLACE), "PAN_CONSTPOWER rejected");
+    CHECK_NEAR(out[0], sqrt(0.5), 1e-7, "constant-power centre");
+    CHECK(stereoPanDynamic(in, out, positions, PAN_TEST_SIZE, PAN_LINEAR, PAN_REPLACE), "PAN_LINEAR rejected");
+    CHECK_NEAR(out[1], 0.5, 0.0, "linear centre");
+    CHECK(stereoPanInterleaved(in, out, PAN_TEST_SIZE, pos, pos, PAN_REPLACE), "PAN_REPLACE rejected");
+    CHECK(stereoPanInterleaved(in, out, PAN_TEST_SIZE, pos, pos, PAN_MIX), "PAN_MIX rejected");
+    CHECK_NEAR(out[0], 2.0 * pos.left, 1e-7, "replaced then mixed");
+}
+
+/**
+ * Fill a buffer with a pseudo-random signal in [-1, 1).
+ */
+static void fillNoise(float * buffer, unsigned long n, unsigned long seed) {
+    unsigned long i;
+    for(i = 0; i < n; i++) {
+        seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+        buffer[i] = (float) ((double) (seed >> 8) / 4194304.0 - 1.0);
+    }
+}
+
+static void testRamp(void) {
+    static float in[PAN_TEST_SIZE], inter[2 * PAN_TEST_SIZE], left[PAN_TEST_SIZE], right[PAN_TEST_SIZE];
+    PANPOS start = constPower(-0.8), end = constPower(0.6);
+    double step;
+    unsigned long i;
+
+    for(i = 0; i < PAN_TEST_SIZE; i++) {
+        in[i] = 1.0f;
+    }
+    CHECK(stereoPanInterleaved(in, inter, PAN_TEST_SIZE, start, end, PAN_REPLACE), "stereoPanInterleaved failed");
+    CHECK(stereoPanPlanar(in, left, right, PAN_TEST_SIZE, start, end, PAN_REPLACE), "stereoPanPlanar failed");
+    CHECK_NEAR(inter[0], start.left, 1e-7, "interleaved ramp start, left");
+    CHECK_NEAR(inter[1], start.right, 1e-7, "interleaved ramp start, right");
+    CHECK_NEAR(left[0], start.left, 1e-7, "planar ramp start, left");
+    CHECK_NEAR(right[0], start.right, 1e-7, "planar ramp start, right");
+    /* The end gains belong to the first sample of the next block */
+    step = (end.left - start.left) / PAN_TEST_SIZE;
+    CHECK_NEAR(inter[2 * PAN_TEST_SIZE - 2], end.left - step, 1e-6, "interleaved ramp end, left");
+    CHECK_NEAR(left[PAN_TEST_SIZE - 1], end.left - step, 1e-6, "planar ramp end, left");
+    step = (end.right - start.right) / PAN_TEST_SIZE;
+    CHECK_NEAR(inter[2 * PAN_TEST_SIZE - 1], end.right - step, 1e-6, "interleaved ramp end, right");
+    CHECK_NEAR(right[PAN_TEST_SIZE - 1], end.right - step, 1e-6, "planar ramp end, right");
+    for(i = 0; i < PAN_TEST_SIZE; i++) {
+        CHECK(inter[2 * i] == left[i] && inter[2 * i + 1] == right[i], "planar ramp differs at %lu", i);
+    }
+    /* An empty block writes nothing */
+    inter[0] = 2.0f;
+    CHECK(stereoPanInterleaved(in, inter, 0, start, end, PAN_REPLACE), "empty block rejected");
+    CHECK(inter[0] == 2.0f, "empty block wrote its output");
+}
+
+static void testLayouts(BRKTABLE * table, PANLAW law) {
+    static float in[PAN_TEST_SIZE], replaced[2 * PAN_TEST_SIZE], mixed[2 * PAN_TEST_SIZE];
+    static float left[PAN_TEST_SIZE], right[PAN_TEST_SIZE], inplace[PAN_TEST_SIZE];
+    static double positions[PAN_TEST_SIZE];
+    PANPOS start = constPower(0.3), end = constPower(-0.9);
+    BRKSTREAM * stream = bps_new_a(table, PAN_TEST_SIZE, NULL);
+    unsigned long i;
+
+    fillNoise(in, PAN_TEST_SIZE, 3);
+    fillNoise(mixed, 2 * PAN_TEST_SIZE, 4);
+    bps_render(stream, positions, PAN_TEST_SIZE);
+    bps_seeksample(stream, 0);
+
+    /* Per-sample positions: mix adds what replace writes, planar matches interleaved, and the stream matches both */
+    CHECK(stereoPanDynamic(in, replaced, positions, PAN_TEST_SIZE, law, PAN_REPLACE), "stereoPanDynamic failed");
+    for(i = 0; i < 2 * PAN_TEST_SIZE; i++) {
+        replaced[i] += mixed[i];
+    }
+    CHECK(stereoPanDynamic(in, mixed, positions, PAN_TEST_SIZE, law, PAN_MIX), "stereoPanDynamic mix failed");
+    for(i = 0; i < 2 * PAN_TEST_SIZE; i++) {
+        CHECK_NEAR(mixed[i], replaced[i], PAN_TEST_MIXTOL, "dynamic PAN_MIX against PAN_REPLACE plus the bus");
+    }
+    CHECK(stereoPanDynamic(in, replaced, positions, PAN_TEST_SIZE, law, PAN_REPLACE), "stereoPanDynamic failed");
+    CHECK(stereoPanStreamPlanar(in, left, right, stream, PAN_TEST_SIZE, law, PAN_REPLACE),
+          "stereoPanStreamPlanar failed");
+    for(i = 0; i < PAN_TEST_SIZE; i++) {
+        CHECK(replaced[2 * i] == left[i] && replaced[2 * i + 1] == right[i],
+              "law %d: planar stream differs from the interleaved pan at %lu", law, i);
+    }
+    /* In place: the left output overwrites the input, then the right output does */
+    memcpy(inplace, in, sizeof(in));
+    CHECK(stereoPanDynamicPlanar(inplace, inplace, right, positions, PAN_TEST_SIZE, law, PAN_REPLACE),
+          "stereoPanDynamicPlanar failed");
+    CHECK(!memcmp(inplace, left, sizeof(left)), "law %d: dynamic planar pan in place (left) differs", law);
+    memcpy(inplace, in, sizeof(in));
+    CHECK(stereoPanDynamicPlanar(inplace, left, inplace, positions, PAN_TEST_SIZE, law, PAN_REPLACE),
+          "stereoPanDynamicPlanar failed");
+    CHECK(!memcmp(inplace, right, sizeof(right)), "law %d: dynamic planar pan in place (right) differs", law);
+
+    /* The same for the ramp kernels */
+    CHECK(stereoPanPlanar(in, left, right, PAN_TEST_SIZE, start, end, PAN_REPLACE), "stereoPanPlanar failed");
+    memcpy(inplace, in, sizeof(in));
+    CHECK(stereoPanPlanar(inplace, inplace, right, PAN_TEST_SIZE, start, end, PAN_REPLACE), "stereoPanPlanar failed");
+    CHECK(!memcmp(inplace, left, sizeof(left)), "planar ramp in place differs");
+    fillNoise(mixed, 2 * PAN_TEST_SIZE, 5);
+    memcpy(replaced, mixed, sizeof(mixed));
+    CHECK(stereoPanInterleaved(in, mixed, PAN_TEST_SIZE, start, end, PAN_MIX), "stereoPanInterleaved mix failed");
+    CHECK(stereoPanPlanar(in, left, right, PAN_TEST_SIZE, start, end, PAN_REPLACE), "stereoPanPlanar failed");
+    for(i = 0; i < PAN_TEST_SIZE; i++) {
+        CHECK_NEAR(mixed[2 * i], replaced[2 * i] + left[i], PAN_TEST_MIXTOL, "ramp PAN_MIX, left");
+        CHECK_NEAR(mixed[2 * i + 1], replaced[2 * i + 1] + right[i], PAN_TEST_MIXTOL, "ramp PAN_MIX, right");
+    }
+    bps_free_a(&stream, NULL);
+}
+
+/**
+ * A pan sweep from hard left past hard right (clamped). At a rate of PAN_TEST_SIZE one block covers the sweep
+ * and part of the held end.
+ */
+static BRKTABLE * newSweep(void) {
+    static const BREAKPOINT shape[] = {{0.0, -1.0}, {0.5, 0.2}, {0.8, 1.4}};
+    BREAKPOINT * points = (BREAKPOINT *) malloc(sizeof(shape));
+    BRKCURVE * curves = (BRKCURVE *) calloc(3, sizeof(BRKCURVE));
+    BRKTABLE * table;
+
+    if(!points || !curves) {
+        free(points);
+        free(curves);
+        return NULL;
+    }
+    memcpy(points, shape, sizeof(shape));
+    if(!(table = bpt_new(points, curves, 3))) {
+        free(points);
+        free(curves);
+    }
+    return table;
+}
+
+int main(void) {
+    BRKTABLE * sweep = newSweep();
+
+    testQuarterSin();
+    testEnums();
+    testRamp();
+    CHECK(sweep != NULL, "bpt_new failed");
+    if(sweep) {
+        testLayouts(sweep, PAN_LINEAR);
+        testLayouts(sweep, PAN_CONSTPOWER);
+        bpt_release(&sweep);
+    }
+    return CHECK_RESULT();
+}
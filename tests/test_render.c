@@ -0,0 +1,167 @@
+/*
+ render: render_sequential is the reference. render_offline must match it for every chunk length and thread
+ count, including chunks that start exactly on a discontinuity or inside a run of zero-width spans, and
+ bps_sum (which gives render_offline its chunk phases) must match the summed ticks it replaces.
+ */
+#include "render.h"
+#include "check.h"
+#include <stdlib.h>
+
+/**
+ * Sample rate of the renders.
+ */
+#define RENDER_TEST_FS 48000
+
+/**
+ * Samples rendered: the envelopes end at 0.4s (19200 samples), the rest is the held final value.
+ */
+#define RENDER_TEST_LENGTH 24000
+
+/**
+ * Agreement required between the chunked and the sequential render. The phases differ by rounding only, which
+ * the steep edge of the sawtooth magnifies; a wrong chunk phase is off by a large fraction of full scale.
+ */
+#define RENDER_TEST_TOL 1e-8
+
+/**
+ * Relative agreement required between bps_sum and the summed ticks.
+ */
+#define RENDER_TEST_SUMTOL 1e-12
+
+/**
+ * Build a breakpoint table from a shape, with the given curve on the span starting at curveat.
+ */
+static BRKTABLE * newEnvelope(const BREAKPOINT * shape, unsigned long n, unsigned long curveat, int type,
+                              double curveshape) {
+    BREAKPOINT * points = (BREAKPOINT *) malloc(n * sizeof(BREAKPOINT));
+    BRKCURVE * curves = (BRKCURVE *) malloc(n * sizeof(BRKCURVE));
+    BRKTABLE * table;
+    unsigned long i;
+
+    if(!points || !curves) {
+        free(points);
+        free(curves);
+        return NULL;
+    }
+    for(i = 0; i < n; i++) {
+        points[i] = shape[i];
+        curves[i].type = BRK_LINEAR;
+        curves[i].shape = 0.0;
+    }
+    curves[curveat].type = type;
+    curves[curveat].shape = curveshape;
+    if(!(table = bpt_new(points, curves, n))) {
+        free(points);
+        free(curves);
+    }
+    return table;
+}
+
+/**
+ * Next pseudo-random integer between 1 and max.
+ */
+static unsigned long nextLength(unsigned long * seed, unsigned long max) {
+    *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return 1 + (*seed >> 8) % max;
+}
+
+static void testSum(BRKTABLE * table, const char * what) {
+    static double ref[RENDER_TEST_LENGTH];
+    BRKSTREAM * stream = bps_new_a(table, RENDER_TEST_FS, NULL);
+    unsigned long seed = 7, done, n, i, k;
+    double expect, got;
+
+    for(i = 0; i < RENDER_TEST_LENGTH; i++) {
+        ref[i] = bps_tick(stream);
+    }
+    bps_seeksample(stream, 0);
+    for(done = 0; done < RENDER_TEST_LENGTH; done += n) {
+        n = nextLength(&seed, 700);
+        if(n > RENDER_TEST_LENGTH - done) {
+            n = RENDER_TEST_LENGTH - done;
+        }
+        got = bps_sum(stream, n);
+        for(i = 0, expect = 0.0; i < n; i++) {
+            expect += ref[done + i];
+        }
+        CHECK_NEAR(got, expect, RENDER_TEST_SUMTOL * (1.0 + fabs(expect)), what);
+    }
+    /* From a seek, and leaving the stream where bps_tick would */
+    for(i = 0; i < 60; i++) {
+        k = i < 20 ? 4790 + i : nextLength(&seed, RENDER_TEST_LENGTH - 2);
+        bps_seeksample(stream, k);
+        CHECK_NEAR(bps_sum(stream, 1), ref[k], RENDER_TEST_SUMTOL * (1.0 + fabs(ref[k])), what);
+        CHECK_NEAR(bps_tick(stream), ref[k + 1], RENDER_TEST_SUMTOL * (1.0 + fabs(ref[k + 1])), what);
+    }
+    CHECK(bps_sum(stream, 0) == 0.0, "%s: empty sum", what);
+    bps_free_a(&stream, NULL);
+}
+
+static void testRender(const RENDERSPEC * spec, const char * what) {
+    static const unsigned long chunks[] = {0, 1, 97, 1600, 4800, 4801, 9999, RENDER_TEST_LENGTH};
+    static const unsigned int threads[] = {1, 3};
+    static double ref[RENDER_TEST_LENGTH], out[RENDER_TEST_LENGTH];
+    char * errMsg = NULL;
+    unsigned long c, i, n;
+    unsigned int t;
+    double worst;
+
+    CHECK(render_sequential(spec, ref, RENDER_TEST_LENGTH, &errMsg), "%s: render_sequential: %s", what, errMsg);
+    for(c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        for(t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+            for(i = 0; i < RENDER_TEST_LENGTH; i++) {
+                out[i] = 2.0;
+            }
+            CHECK(render_offline(spec, out, RENDER_TEST_LENGTH, chunks[c], threads[t], &errMsg),
+                  "%s: render_offline: %s", what, errMsg);
+            for(i = 0, worst = 0.0, n = 0; i < RENDER_TEST_LENGTH; i++) {
+                if(fabs(out[i] - ref[i]) > worst) {
+                    worst = fabs(out[i] - ref[i]);
+                    n = i;
+                }
+            }
+            CHECK(worst <= RENDER_TEST_TOL, "%s: chunk %lu, %u threads: sample %lu is %g off the sequential render",
+                  what, chunks[c], threads[t], n, worst);
+        }
+    }
+    CHECK(render_offline(spec, out, 0, 0, 0, &errMsg), "%s: empty render", what);
+}
+
+int main(void) {
+    /* Glides with a step at exactly 0.1s (sample 4800), a run of zero-width spans between samples at 0.2001s and
+     a BRK_EXP glide */
+    static const BREAKPOINT freqshape[] = {
+        {0.0, 220.0}, {0.1, 880.0}, {0.1, 440.0}, {0.2001, 300.0}, {0.2001, 1200.0}, {0.2001, 50.0},
+        {0.2001, 600.0}, {0.3, 2000.0}, {0.4, 110.0}
+    };
+    /* A BRK_POW attack and a step in the amplitude */
+    static const BREAKPOINT ampshape[] = {
+        {0.0, 0.0}, {0.05, 1.0}, {0.15, 0.5}, {0.15, 0.8}, {0.4, 0.25}
+    };
+    RENDERSPEC spec;
+    BRKTABLE * freq = newEnvelope(freqshape, sizeof(freqshape) / sizeof(freqshape[0]), 6, BRK_EXP, 2.0);
+    BRKTABLE * amp = newEnvelope(ampshape, sizeof(ampshape) / sizeof(ampshape[0]), 0, BRK_POW, 3.0);
+    GTABLE * table = sawtable(1024, 20, 1);
+
+    CHECK(freq && amp && table, "could not build the render inputs");
+    if(!freq || !amp || !table) {
+        return CHECK_RESULT();
+    }
+    testSum(freq, "bps_sum over the frequency envelope");
+    testSum(amp, "bps_sum over the amplitude envelope");
+
+    spec.table = table;
+    spec.tick = tabitick;
+    spec.freq = freq;
+    spec.amp = NULL;
+    spec.fs = RENDER_TEST_FS;
+    spec.phase = 30.0;
+    testRender(&spec, "frequency envelope");
+    spec.amp = amp;
+    testRender(&spec, "frequency and amplitude envelopes");
+
+    freeTable(&table);
+    bpt_release(&freq);
+    bpt_release(&amp);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,116 @@
+/*
+ resample: the 4x oversampler's impulse response is the linear-phase prototype filter, symmetric about the
+ reported group delay with every phase summing to unity gain. Constant input through a decimator and a
+ 44.1 to 48 kHz converter settles to the same constant, and splitting the input into uneven calls does not
+ change the output.
+ */
+#include "resample.h"
+#include "check.h"
+#include <string.h>
+
+/**
+ * Input samples pushed by the streaming tests.
+ */
+#define RS_TEST_LENGTH 4410
+
+static const char * qualityNames[] = {"fast", "medium", "best"};
+
+/**
+ * Largest deviation from unity DC gain allowed at each quality.
+ */
+static const double dcTolerance[] = {2e-3, 1e-4, 1e-5};
+
+static void testImpulse(int quality) {
+    static double in[256], out[1024];
+    RESAMPLER * rs = new_RESAMPLER(1, 4, quality, 0);
+    const char * name = qualityNames[quality];
+    unsigned long n, i, length;
+    double sum;
+    unsigned int p;
+
+    CHECK(rs != NULL, "%s: new_RESAMPLER(1, 4) failed", name);
+    if(!rs) {
+        return;
+    }
+    CHECK(rs->up == 4 && rs->down == 1, "%s: ratio %lu/%lu, expected 4/1", name, rs->up, rs->down);
+    length = rs->ntaps * rs->up;
+    CHECK(length + 64 <= 1024, "%s: %lu taps per phase is too long for the test buffer", name, rs->ntaps);
+    if(length + 64 > 1024) {
+        clear_RESAMPLER(&rs);
+        return;
+    }
+    memset(in, 0, sizeof(in));
+    in[0] = 1.0;
+    n = rs->ntaps + 16;
+    CHECK(resample_pending(rs, n) == 4 * n, "%s: %lu outputs pending for %lu inputs", name,
+          resample_pending(rs, n), n);
+    CHECK(resample_process(rs, in, n, out) == 4 * n, "%s: resample_process output count", name);
+
+    /* Symmetric about the centre of the prototype, which is the reported group delay */
+    CHECK_NEAR(resample_delay(rs) * rs->up, 0.5 * (length - 1), 1e-12, name);
+    for(i = 0; i < length / 2; i++) {
+        CHECK_NEAR(out[i], out[length - 1 - i], 1e-12, name);
+    }
+    CHECK(out[length / 2] > 0.5, "%s: prototype peak %g is not at the centre", name, out[length / 2]);
+    for(i = length; i < 4 * n; i++) {
+        CHECK_NEAR(out[i], 0.0, 0.0, name);
+    }
+    /* Every phase passes DC at unity gain */
+    for(p = 0; p < rs->up; p++) {
+        for(i = p, sum = 0.0; i < length; i += rs->up) {
+            sum += out[i];
+        }
+        CHECK_NEAR(sum, 1.0, dcTolerance[quality], name);
+    }
+    clear_RESAMPLER(&rs);
+    CHECK(rs == NULL, "%s: clear_RESAMPLER did not clear the pointer", name);
+}
+
+static void testConstant(unsigned long inrate, unsigned long outrate, int quality) {
+    static double in[RS_TEST_LENGTH], out[2][2 * RS_TEST_LENGTH];
+    RESAMPLER * rs = new_RESAMPLER(inrate, outrate, quality, 256);
+    unsigned long n[2] = {0, 0}, done, len, i, settle, seed = 13;
+
+    CHECK(rs != NULL, "new_RESAMPLER(%lu, %lu) failed", inrate, outrate);
+    if(!rs) {
+        return;
+    }
+    for(i = 0; i < RS_TEST_LENGTH; i++) {
+        in[i] = 1.0;
+    }
+    /* In one call, then again in uneven calls after a reset */
+    n[0] = resample_process(rs, in, RS_TEST_LENGTH, out[0]);
+    resample_reset(rs);
+    for(done = 0; done < RS_TEST_LENGTH; done += len) {
+        seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+        len = 1 + (seed >> 8) % 700;
+        if(len > RS_TEST_LENGTH - done) {
+            len = RS_TEST_LENGTH - done;
+        }
+        CHECK(resample_pending(rs, len) <= 2 * RS_TEST_LENGTH - n[1], "%lu -> %lu: output overrun", inrate, outrate);
+        n[1] += resample_process(rs, in + done, len, out[1] + n[1]);
+    }
+    CHECK(n[0] == n[1], "%lu -> %lu: %lu outputs in one call, %lu in pieces", inrate, outrate, n[0], n[1]);
+    CHECK(n[0] + 1 >= RS_TEST_LENGTH * outrate / inrate && n[0] <= RS_TEST_LENGTH * outrate / inrate + 1,
+          "%lu -> %lu: %lu outputs for %d inputs", inrate, outrate, n[0], RS_TEST_LENGTH);
+    for(i = 0; i < n[0] && i < n[1]; i++) {
+        CHECK_NEAR(out[1][i], out[0][i], 1e-12, "split input changed the output");
+    }
+    /* Once the filter is full of input the output holds the constant */
+    settle = (unsigned long) (2.0 * resample_delay(rs) * outrate / inrate) + 1;
+    for(i = settle; i < n[0]; i++) {
+        CHECK_NEAR(out[0][i], 1.0, dcTolerance[quality], "constant input");
+    }
+    clear_RESAMPLER(&rs);
+}
+
+int main(void) {
+    int quality;
+    printf("resample kernel: %s\n", resample_kernelname());
+    for(quality = RESAMPLE_FAST; quality <= RESAMPLE_BEST; quality++) {
+        testImpulse(quality);
+        testConstant(4, 1, quality);
+        testConstant(44100, 48000, quality);
+    }
+    return CHECK_RESULT();
+}
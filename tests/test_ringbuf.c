@@ -0,0 +1,202 @@
+/*
+ ringbuf: single-threaded wraparound of the copying and in-place paths, then a two-thread SPSC run checking
+ that every element arrives once and in order while the indices wrap the storage many times.
+ */
+#include "ringbuf.h"
+#include "check.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Elements pushed through the ring by the threaded test.
+ */
+#define SPSC_COUNT 2000000UL
+
+/**
+ * Capacity of the threaded test's ring: small, so the indices wrap often and both sides hit full and empty.
+ */
+#define SPSC_CAPACITY 64
+
+/**
+ * Shared state of the threaded test.
+ * @param ring - the ring under test
+ * @param maxchunk - the largest number of elements either side moves per call
+ * @param mismatches - the number of out of order elements the consumer saw
+ * @param received - the number of elements the consumer popped
+ */
+typedef struct spscstate {
+    RINGBUF * ring;
+    size_t maxchunk;
+    unsigned long mismatches;
+    unsigned long received;
+} SPSCSTATE;
+
+/**
+ * Next pseudo-random chunk length between 1 and max.
+ */
+static size_t chunkLength(unsigned long * seed, size_t max) {
+    *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return 1 + (size_t) (*seed >> 8) % max;
+}
+
+static void * producer(void * arg) {
+    SPSCSTATE * s = (SPSCSTATE *) arg;
+    uint32_t items[SPSC_CAPACITY], next = 0;
+    unsigned long seed = 1;
+    size_t n, i, got;
+    void * region;
+
+    while(next < SPSC_COUNT) {
+        n = chunkLength(&seed, s->maxchunk);
+        if(n > SPSC_COUNT - next) {
+            n = SPSC_COUNT - next;
+        }
+        if(seed & 0x100) {
+            /* Copying path */
+            for(i = 0; i < n; i++) {
+                items[i] = next + (uint32_t) i;
+            }
+            n = ring_push(s->ring, items, n);
+            next += (uint32_t) n;
+        }
+        else {
+            /* In-place path */
+            got = ring_reserve(s->ring, &region, n);
+            for(i = 0; i < got; i++) {
+                ((uint32_t *) region)[i] = next++;
+            }
+            ring_commit(s->ring, got);
+            n = got;
+        }
+        /* Let the consumer run when the ring is full, so the test stays quick on a single core */
+        if(!n) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void * consumer(void * arg) {
+    SPSCSTATE * s = (SPSCSTATE *) arg;
+    uint32_t items[SPSC_CAPACITY], expect = 0;
+    unsigned long seed = 2;
+    size_t n, i, got;
+    const void * region;
+
+    while(expect < SPSC_COUNT) {
+        n = chunkLength(&seed, s->maxchunk);
+        if(seed & 0x100) {
+            got = ring_pop(s->ring, items, n);
+            for(i = 0; i < got; i++) {
+                s->mismatches += items[i] != expect++;
+            }
+        }
+        else {
+            got = ring_peek(s->ring, &region, n);
+            for(i = 0; i < got; i++) {
+                s->mismatches += ((const uint32_t *) region)[i] != expect++;
+            }
+            ring_release(s->ring, got);
+        }
+        s->received += got;
+        if(!got) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void testWraparound(void) {
+    RINGBUF * ring = ring_new(5, sizeof(int));
+    int in[8], out[8], i, round;
+    void * region;
+    const void * cregion;
+    size_t got;
+
+    CHECK(ring != NULL, "ring_new failed");
+    if(!ring) {
+        return;
+    }
+    CHECK(ring->capacity == 8, "capacity %zu, expected 5 rounded up to 8", ring->capacity);
+    CHECK(ring_writable(ring) == 8 && ring_readable(ring) == 0, "new ring is not empty");
+
+    /* Three elements per round walk the indices around the 8-element storage, straddling the end */
+    for(round = 0; round < 20; round++) {
+        for(i = 0; i < 3; i++) {
+            in[i] = round * 3 + i;
+        }
+        CHECK(ring_push(ring, in, 3) == 3, "round %d: push", round);
+        CHECK(ring_readable(ring) == 3, "round %d: readable %zu", round, ring_readable(ring));
+        CHECK(ring_pop(ring, out, 8) == 3, "round %d: pop", round);
+        for(i = 0; i < 3; i++) {
+            CHECK(out[i] == in[i], "round %d: element %d is %d, expected %d", round, i, out[i], in[i]);
+        }
+    }
+
+    /* A full ring refuses more, and an empty one yields nothing */
+    for(i = 0; i < 8; i++) {
+        in[i] = 100 + i;
+    }
+    CHECK(ring_push(ring, in, 8) == 8, "fill");
+    CHECK(ring_push(ring, in, 1) == 0 && ring_writable(ring) == 0, "push into a full ring");
+    CHECK(ring_pop(ring, out, 8) == 8, "drain");
+    for(i = 0; i < 8; i++) {
+        CHECK(out[i] == 100 + i, "drained element %d is %d", i, out[i]);
+    }
+    CHECK(ring_pop(ring, out, 1) == 0, "pop from an empty ring");
+
+    /* Reserve and peek stop at the end of the storage (both indices are at 68, 4 slots before the end) */
+    got = ring_reserve(ring, &region, 8);
+    CHECK(got == 4, "reserve across the end gave %zu, expected 4", got);
+    for(i = 0; i < (int) got; i++) {
+        ((int *) region)[i] = 200 + i;
+    }
+    ring_commit(ring, got);
+    got = ring_reserve(ring, &region, 8);
+    CHECK(got == 4, "second reserve gave %zu, expected the 4 wrapped slots", got);
+    for(i = 0; i < (int) got; i++) {
+        ((int *) region)[i] = 204 + i;
+    }
+    ring_commit(ring, got);
+    got = ring_peek(ring, &cregion, 8);
+    CHECK(got == 4, "peek across the end gave %zu, expected 4", got);
+    ring_release(ring, got);
+    got = ring_peek(ring, &cregion, 8);
+    CHECK(got == 4 && ((const int *) cregion)[0] == 204 && ((const int *) cregion)[3] == 207,
+          "wrapped peek gave %zu elements starting %d", got, got ? ((const int *) cregion)[0] : -1);
+    ring_release(ring, got);
+    CHECK(ring_readable(ring) == 0, "ring not empty after release");
+    ring_free(&ring);
+    CHECK(ring == NULL, "ring_free did not clear the pointer");
+}
+
+static void testSPSC(size_t maxchunk) {
+    SPSCSTATE s;
+    pthread_t threads[2];
+
+    s.ring = ring_new(SPSC_CAPACITY, sizeof(uint32_t));
+    s.maxchunk = maxchunk;
+    s.mismatches = s.received = 0;
+    CHECK(s.ring != NULL, "ring_new failed");
+    if(!s.ring) {
+        return;
+    }
+    CHECK(pthread_create(&threads[0], NULL, producer, &s) == 0, "producer thread");
+    CHECK(pthread_create(&threads[1], NULL, consumer, &s) == 0, "consumer thread");
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    CHECK(s.received == SPSC_COUNT, "received %lu of %lu elements", s.received, SPSC_COUNT);
+    CHECK(s.mismatches == 0, "%lu elements out of order", s.mismatches);
+    CHECK(ring_readable(s.ring) == 0, "ring not empty at the end");
+    ring_free(&s.ring);
+}
+
+int main(void) {
+    testWraparound();
+    /* Bulk and in-place transfers of mixed sizes, then one element at a time */
+    testSPSC(SPSC_CAPACITY);
+    testSPSC(1);
+    return CHECK_RESULT();
+}
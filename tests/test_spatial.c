@@ -0,0 +1,241 @@
+/*
+ spatial: VBAP gains are non-negative, power normalised, exact on a speaker and confined to the enclosing pair,
+ and a gap of 180 degrees or more between speakers forms no pair. The ambisonic encoder's SN3D coefficients have
+ unit power per order and the closed-form values on the axes. spat_render ramps each source from its previous
+ gains and accumulates into the bus.
+ */
+#include "spatial.h"
+#include "check.h"
+#include <string.h>
+
+/**
+ * Agreement required for gains computed in double precision.
+ */
+#define SPAT_TEST_TOL 1e-12
+
+/**
+ * Frames per spat_render block.
+ */
+#define SPAT_TEST_FRAMES 64
+
+/**
+ * Check that VBAP gains are non-negative, power normalised and use at most maxnonzero speakers.
+ */
+static void checkVBAP(const SPATPAN * pan, const double * gains, unsigned int maxnonzero, const char * what) {
+    unsigned int i, nonzero = 0;
+    double power = 0.0;
+    for(i = 0; i < pan->nchans; i++) {
+        CHECK(gains[i] >= 0.0, "%s: negative gain %g on speaker %u", what, gains[i], i);
+        power += gains[i] * gains[i];
+        nonzero += gains[i] != 0.0;
+    }
+    CHECK_NEAR(power, 1.0, SPAT_TEST_TOL, what);
+    CHECK(nonzero <= maxnonzero, "%s: %u speakers sound", what, nonzero);
+}
+
+static void testVBAP2D(void) {
+    /* ITU 5.0, deliberately out of ring order */
+    static const double azimuths[] = {30.0, -30.0, 0.0, 110.0, -110.0};
+    double gains[5], az;
+    unsigned int i;
+    SPATPAN * pan = newVBAP2D(azimuths, 5);
+
+    CHECK(pan != NULL, "newVBAP2D failed");
+    if(!pan) {
+        return;
+    }
+    CHECK(pan->nsets == 5, "a ring of 5 has %u pairs", pan->nsets);
+    for(az = -180.0; az < 180.0; az += 0.7) {
+        spat_gains(pan, az, 0.0, gains);
+        checkVBAP(pan, gains, 2, "2D VBAP");
+    }
+    for(i = 0; i < 5; i++) {
+        spat_gains(pan, azimuths[i], 0.0, gains);
+        CHECK_NEAR(gains[i], 1.0, SPAT_TEST_TOL, "2D VBAP on a speaker");
+    }
+    /* Between the centre and the left front speaker, equal gains */
+    spat_gains(pan, 15.0, 0.0, gains);
+    CHECK_NEAR(gains[0], sqrt(0.5), SPAT_TEST_TOL, "2D VBAP half way, left");
+    CHECK_NEAR(gains[2], sqrt(0.5), SPAT_TEST_TOL, "2D VBAP half way, centre");
+    clearSpatPan(&pan);
+
+    /* A quarter circle: the 270 degree gap back round forms no pair */
+    {
+        static const double quarter[] = {0.0, 90.0};
+        pan = newVBAP2D(quarter, 2);
+        CHECK(pan != NULL && pan->nsets == 1, "a quarter circle has one pair");
+        if(pan) {
+            spat_gains(pan, 45.0, 0.0, gains);
+            CHECK_NEAR(gains[0], sqrt(0.5), SPAT_TEST_TOL, "quarter circle half way");
+            spat_gains(pan, 180.0, 0.0, gains);
+            checkVBAP(pan, gains, 1, "direction in the uncovered gap");
+            clearSpatPan(&pan);
+        }
+    }
+    /* Three speakers in a quarter circle: the wide gap from the last back to the first is not a pair */
+    {
+        static const double narrow[] = {0.0, 100.0, 90.0};
+        pan = newVBAP2D(narrow, 3);
+        CHECK(pan != NULL && pan->nsets == 2, "three speakers in 100 degrees form %u pairs", pan ? pan->nsets : 0);
+        if(pan) {
+            for(az = -180.0; az < 180.0; az += 0.7) {
+                spat_gains(pan, az, 0.0, gains);
+                checkVBAP(pan, gains, 2, "three speakers in 100 degrees");
+            }
+            clearSpatPan(&pan);
+        }
+    }
+    /* Two opposite speakers cannot form a pair at all */
+    {
+        static const double opposite[] = {90.0, -90.0};
+        pan = newVBAP2D(opposite, 2);
+        CHECK(pan == NULL, "opposite speakers formed a pair");
+        clearSpatPan(&pan);
+    }
+}
+
+static void testVBAP3D(void) {
+    /* Octahedron */
+    static const double azimuths[] = {0.0, 90.0, 180.0, -90.0, 0.0, 0.0};
+    static const double elevations[] = {0.0, 0.0, 0.0, 0.0, 90.0, -90.0};
+    double gains[6], az, el;
+    unsigned int i;
+    SPATPAN * pan = newVBAP3D(azimuths, elevations, 6);
+
+    CHECK(pan != NULL, "newVBAP3D failed");
+    if(!pan) {
+        return;
+    }
+    for(el = -90.0; el <= 90.0; el += 7.3) {
+        for(az = -180.0; az < 180.0; az += 11.9) {
+            spat_gains(pan, az, el, gains);
+            checkVBAP(pan, gains, 3, "3D VBAP");
+        }
+    }
+    for(i = 0; i < 6; i++) {
+        spat_gains(pan, azimuths[i], elevations[i], gains);
+        CHECK_NEAR(gains[i], 1.0, SPAT_TEST_TOL, "3D VBAP on a speaker");
+    }
+    /* The centre of a face: equal gains on its three speakers */
+    spat_gains(pan, 45.0, asin(1.0 / sqrt(3.0)) * 180.0 / M_PI, gains);
+    CHECK_NEAR(gains[0], sqrt(1.0 / 3.0), SPAT_TEST_TOL, "face centre, front");
+    CHECK_NEAR(gains[1], sqrt(1.0 / 3.0), SPAT_TEST_TOL, "face centre, left");
+    CHECK_NEAR(gains[4], sqrt(1.0 / 3.0), SPAT_TEST_TOL, "face centre, top");
+    clearSpatPan(&pan);
+}
+
+static void testAmbisonic(void) {
+    double gains[(SPAT_MAXORDER + 1) * (SPAT_MAXORDER + 1)], power, az, el;
+    unsigned int order, n, m;
+    SPATPAN * pan = newAmbiEncoder(SPAT_MAXORDER);
+
+    CHECK(pan != NULL && pan->nchans == 16, "newAmbiEncoder failed");
+    CHECK(newAmbiEncoder(0) == NULL && newAmbiEncoder(SPAT_MAXORDER + 1) == NULL, "unsupported order accepted");
+    if(!pan) {
+        return;
+    }
+    /* SN3D: the harmonics of each degree n (ACN n^2 to n^2 + 2n) have unit total power in every direction */
+    for(el = -90.0; el <= 90.0; el += 13.0) {
+        for(az = -180.0; az < 180.0; az += 17.0) {
+            spat_gains(pan, az, el, gains);
+            for(n = 0; n <= SPAT_MAXORDER; n++) {
+                for(m = 0, power = 0.0; m <= 2 * n; m++) {
+                    power += gains[n * n + m] * gains[n * n + m];
+                }
+                CHECK_NEAR(power, 1.0, SPAT_TEST_TOL, "SN3D power of one degree");
+            }
+        }
+    }
+    /* Front: X = 1, V = 0, U = sqrt(3)/2, P = sqrt(5/8) */
+    spat_gains(pan, 0.0, 0.0, gains);
+    CHECK_NEAR(gains[3], 1.0, SPAT_TEST_TOL, "X at the front");
+    CHECK_NEAR(gains[4], 0.0, SPAT_TEST_TOL, "V at the front");
+    CHECK_NEAR(gains[6], -0.5, SPAT_TEST_TOL, "R at the front");
+    CHECK_NEAR(gains[8], sqrt(3.0) / 2.0, SPAT_TEST_TOL, "U at the front");
+    CHECK_NEAR(gains[15], sqrt(5.0 / 8.0), SPAT_TEST_TOL, "P at the front");
+    /* Left: Y = 1, X = 0 */
+    spat_gains(pan, 90.0, 0.0, gains);
+    CHECK_NEAR(gains[1], 1.0, SPAT_TEST_TOL, "Y at the left");
+    CHECK_NEAR(gains[3], 0.0, SPAT_TEST_TOL, "X at the left");
+    /* Top: every zonal harmonic (m = 0) is 1, the rest 0 */
+    spat_gains(pan, 0.0, 90.0, gains);
+    for(n = 0; n <= SPAT_MAXORDER; n++) {
+        for(m = 0; m <= 2 * n; m++) {
+            CHECK_NEAR(gains[n * n + m], m == n ? 1.0 : 0.0, SPAT_TEST_TOL, "harmonic at the top");
+        }
+    }
+    /* Lower orders are a prefix of the higher ones */
+    order = 1;
+    clearSpatPan(&pan);
+    pan = newAmbiEncoder(order);
+    if(pan) {
+        double low[4];
+        spat_gains(pan, 33.0, 21.0, low);
+        clearSpatPan(&pan);
+        pan = newAmbiEncoder(SPAT_MAXORDER);
+        spat_gains(pan, 33.0, 21.0, gains);
+        CHECK(!memcmp(low, gains, sizeof(low)), "first order channels differ between orders");
+    }
+    clearSpatPan(&pan);
+}
+
+static void testRender(void) {
+    static const double azimuths[] = {30.0, -30.0, 0.0, 110.0, -110.0};
+    static float source[SPAT_TEST_FRAMES], channels[5][SPAT_TEST_FRAMES];
+    float * bus[5];
+    const float * sources[2];
+    double lastgains[2 * 5], start[5], end[5], az[2], expect;
+    unsigned int ch, i;
+    SPATPAN * pan = newVBAP2D(azimuths, 5);
+
+    CHECK(pan != NULL, "newVBAP2D failed");
+    if(!pan) {
+        return;
+    }
+    for(i = 0; i < SPAT_TEST_FRAMES; i++) {
+        source[i] = 1.0f;
+    }
+    for(ch = 0; ch < 5; ch++) {
+        bus[ch] = channels[ch];
+        for(i = 0; i < SPAT_TEST_FRAMES; i++) {
+            channels[ch][i] = 0.25f;
+        }
+    }
+    /* Source 0 moves from the centre to 20 degrees left; source 1 fades in at the right surround */
+    sources[0] = sources[1] = source;
+    spat_gains(pan, 0.0, 0.0, lastgains);
+    memset(lastgains + 5, 0, 5 * sizeof(double));
+    az[0] = 20.0;
+    az[1] = -110.0;
+    memcpy(start, lastgains, sizeof(start));
+    spat_gains(pan, az[0], 0.0, end);
+    spat_render(pan, sources, az, NULL, 2, bus, SPAT_TEST_FRAMES, lastgains);
+    for(ch = 0; ch < 5; ch++) {
+        for(i = 0; i < SPAT_TEST_FRAMES; i++) {
+            expect = 0.25 + start[ch] + (end[ch] - start[ch]) * i / SPAT_TEST_FRAMES +
+                     (ch == 4 ? (double) i / SPAT_TEST_FRAMES : 0.0);
+            CHECK_NEAR(channels[ch][i], expect, 1e-6, "ramped render");
+        }
+        CHECK_NEAR(lastgains[ch], end[ch], 0.0, "moving source's gains after the block");
+        CHECK_NEAR(lastgains[5 + ch], ch == 4 ? 1.0 : 0.0, SPAT_TEST_TOL, "faded-in source's gains after the block");
+    }
+    /* Without lastgains the new gains hold for the whole block */
+    for(ch = 0; ch < 5; ch++) {
+        memset(channels[ch], 0, sizeof(channels[ch]));
+    }
+    spat_render(pan, sources, az, NULL, 1, bus, SPAT_TEST_FRAMES, NULL);
+    for(ch = 0; ch < 5; ch++) {
+        for(i = 0; i < SPAT_TEST_FRAMES; i++) {
+            CHECK_NEAR(channels[ch][i], end[ch], 1e-6, "fixed-gain render");
+        }
+    }
+    clearSpatPan(&pan);
+}
+
+int main(void) {
+    testVBAP2D();
+    testVBAP3D();
+    testAmbisonic();
+    testRender();
+    return CHECK_RESULT();
+}
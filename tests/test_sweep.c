@@ -0,0 +1,114 @@
+/*
+ sweep: essgen_forward and essgen_inverse, called in uneven blocks that straddle the ESS_RESYNC points, must follow
+ the closed forms x[n] = sin(K (exp(n / (L fs)) - 1)) and inverse[n] = exp(n Ka / (T fs)) x[size - 1 - n] across
+ the whole sweep, up and down. The float outputs, essgen_reset and newSweep must give the same samples.
+ */
+#include "sweep.h"
+#include "check.h"
+#include <stdlib.h>
+
+/**
+ * Sample rate and duration of the test sweeps: 24000 samples, nearly 94 resynchronisation intervals.
+ */
+#define SWEEP_TEST_FS 48000.0
+#define SWEEP_TEST_T 0.5
+
+/**
+ * Agreement required with the closed form, relative to the inverse filter's envelope (which rises by about 50dB
+ * in a down-sweep). The phase reaches several thousand radians, so evaluating the closed form itself loses
+ * about 1e-12.
+ */
+#define SWEEP_TEST_TOL 1e-10
+
+/**
+ * Next pseudo-random integer between 1 and max.
+ */
+static unsigned long nextLength(unsigned long * seed, unsigned long max) {
+    *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return 1 + (*seed >> 8) % max;
+}
+
+/**
+ * Fill a buffer from a generator in uneven blocks, returning the number of samples generated.
+ */
+static unsigned long generateBlocks(ESSGEN * gen, int inverse, double * out, unsigned long size, unsigned long seed) {
+    unsigned long done = 0, n, got;
+
+    do {
+        n = nextLength(&seed, 3 * ESS_RESYNC / 2);
+        got = inverse ? essgen_inverse(gen, out + done, n) : essgen_forward(gen, out + done, n);
+        done += got;
+    } while(got == n && done < size);
+    return done;
+}
+
+static void testSweep(double startFreq, double endFreq, const char * what) {
+    ESSGEN * gen = newSweepGen(SWEEP_TEST_T, SWEEP_TEST_FS, startFreq, endFreq);
+    ESS * sweep = newSweep(SWEEP_TEST_T, SWEEP_TEST_FS, startFreq, endFreq);
+    double * forward, * inverse, expect, env, err, worst = 0.0, iworst = 0.0;
+    float * single;
+    unsigned long i, size, at = 0, iat = 0;
+
+    CHECK(gen && sweep, "%s: could not create the sweep", what);
+    if(!gen || !sweep) {
+        clearSweepGen(&gen);
+        clearSweep(&sweep);
+        return;
+    }
+    size = gen->size;
+    forward = (double *) malloc(size * sizeof(double));
+    inverse = (double *) malloc(size * sizeof(double));
+    single = (float *) malloc(size * sizeof(float));
+    CHECK(forward && inverse && single, "%s: could not allocate %lu samples", what, size);
+    if(!forward || !inverse || !single) {
+        goto done;
+    }
+    CHECK(size == (unsigned long) (SWEEP_TEST_T * SWEEP_TEST_FS) && size > 50 * ESS_RESYNC, "%s: size %lu", what,
+          size);
+    CHECK(generateBlocks(gen, 0, forward, size, 1) == size, "%s: short forward sweep", what);
+    CHECK(generateBlocks(gen, 1, inverse, size, 2) == size, "%s: short inverse filter", what);
+    CHECK(essgen_forward(gen, forward, 1) == 0 && essgen_inverse(gen, inverse, 1) == 0,
+          "%s: samples generated past the end", what);
+
+    for(i = 0; i < size; i++) {
+        expect = sin(gen->K * (exp(i / (gen->L * SWEEP_TEST_FS)) - 1.0));
+        if((err = fabs(forward[i] - expect)) > worst) {
+            worst = err;
+            at = i;
+        }
+        env = exp(i * gen->Ka / (SWEEP_TEST_T * SWEEP_TEST_FS));
+        expect = env * sin(gen->K * (exp((size - 1 - i) / (gen->L * SWEEP_TEST_FS)) - 1.0));
+        if((err = fabs(inverse[i] - expect) / (env > 1.0 ? env : 1.0)) > iworst) {
+            iworst = err;
+            iat = i;
+        }
+    }
+    CHECK(worst <= SWEEP_TEST_TOL, "%s: forward sample %lu is %g off the closed form", what, at, worst);
+    CHECK(iworst <= SWEEP_TEST_TOL, "%s: inverse sample %lu is %g off the closed form", what, iat, iworst);
+
+    /* The whole sweep in one block, and the float path, after a reset */
+    essgen_reset(gen);
+    CHECK(essgen_forwardf(gen, single, size) == size, "%s: short float sweep", what);
+    for(i = 0; i < size; i++) {
+        CHECK(single[i] == (float) forward[i] && sweep->forward[i] == forward[i], "%s: forward sample %lu differs",
+              what, i);
+    }
+    CHECK(essgen_inversef(gen, single, size) == size, "%s: short float inverse", what);
+    for(i = 0; i < size; i++) {
+        CHECK(single[i] == (float) inverse[i] && sweep->inverse[i] == inverse[i], "%s: inverse sample %lu differs",
+              what, i);
+    }
+done:
+    free(forward);
+    free(inverse);
+    free(single);
+    clearSweepGen(&gen);
+    clearSweep(&sweep);
+}
+
+int main(void) {
+    testSweep(20.0, 20000.0, "up-sweep");
+    testSweep(16000.0, 50.0, "down-sweep");
+    CHECK(newSweepGen(SWEEP_TEST_T, SWEEP_TEST_FS, 100.0, 100.0) == NULL, "a sweep of one frequency was accepted");
+    return CHECK_RESULT();
+}
@@ -0,0 +1,218 @@
+/*
+ tabextract: tab_period must find the period of synthetic harmonic tones, including fractional periods, a weak
+ fundamental and an offset past a noisy attack, within TABEXTRACT_TEST_PERIODTOL samples, and fail cleanly on
+ silence and on recordings too short for the search range. tab_extract must rebuild the tone's harmonic
+ amplitudes with the fundamental in sine phase, no DC and a peak of 1. tab_mipmap's first table must be that
+ table, each band must hold only harmonics below fs / 2 and tab_batch must report its failed jobs.
+ */
+#include "tabextract.h"
+#include "check.h"
+#include <stdlib.h>
+
+/**
+ * Sample rate and length of the test recordings.
+ */
+#define TABEXTRACT_TEST_FS 44100.0
+#define TABEXTRACT_TEST_LENGTH 8192
+
+/**
+ * Accuracy claimed for the period estimate (samples).
+ */
+#define TABEXTRACT_TEST_PERIODTOL 0.003
+
+/**
+ * Accuracy required of the table's harmonic amplitudes, relative to the fundamental.
+ */
+#define TABEXTRACT_TEST_HARMTOL 1e-3
+
+/**
+ * Length of the extracted tables.
+ */
+#define TABEXTRACT_TEST_TABLEN 1024
+
+/**
+ * Defines the schema for a synthetic tone: a fundamental and harmonics with arbitrary phases.
+ */
+typedef struct testtone {
+    double freq;
+    unsigned int nharms;
+    double amps[4];
+    double phases[4];
+    const char * what;
+} TESTTONE;
+
+static const TESTTONE tones[] = {
+    {261.63, 1, {1.0}, {0.3}, "sine"},
+    {97.3, 4, {1.0, 0.5, 0.25, 0.125}, {0.0, 1.0, 2.0, 3.0}, "low tone"},
+    {1000.7, 3, {0.8, 0.4, 0.3}, {2.5, -1.0, 0.7}, "high tone"},
+    {440.0, 2, {0.5, 1.0}, {0.0, 0.0}, "weak fundamental"}
+};
+
+/**
+ * Next pseudo-random value in [-1, 1).
+ */
+static double nextValue(unsigned long * seed) {
+    *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return (double) (*seed >> 8) / 4194304.0 - 1.0;
+}
+
+/**
+ * Render a tone into a buffer.
+ */
+static void renderTone(const TESTTONE * tone, double * out, unsigned long n) {
+    unsigned long i;
+    unsigned int k;
+    for(i = 0; i < n; i++) {
+        out[i] = 0.0;
+        for(k = 0; k < tone->nharms; k++) {
+            out[i] += tone->amps[k] * sin(2.0 * M_PI * (k + 1) * tone->freq * i / TABEXTRACT_TEST_FS +
+                                          tone->phases[k]);
+        }
+    }
+}
+
+/**
+ * Harmonic k of a table as a complex amplitude (re = cosine, im = sine part), by direct transform.
+ */
+static void tableHarmonic(const GTABLE * table, unsigned int k, double * re, double * im) {
+    unsigned long i;
+    double phase;
+    *re = *im = 0.0;
+    for(i = 0; i < table->length; i++) {
+        phase = 2.0 * M_PI * k * (double) i / (double) table->length;
+        *re += table->samples[i] * cos(phase);
+        *im += table->samples[i] * sin(phase);
+    }
+    *re *= 2.0 / (double) table->length;
+    *im *= 2.0 / (double) table->length;
+}
+
+static void testPeriods(double * recording) {
+    TABSPEC spec = {TABEXTRACT_TEST_TABLEN, TABEXTRACT_TEST_FS, 50.0, 2000.0, 0.0, 0, 1, 0.0};
+    unsigned long i, seed = 3;
+    unsigned int t;
+    double period, expect;
+    char * errMsg = NULL;
+
+    for(t = 0; t < sizeof(tones) / sizeof(tones[0]); t++) {
+        renderTone(&tones[t], recording, TABEXTRACT_TEST_LENGTH);
+        period = tab_period(recording, TABEXTRACT_TEST_LENGTH, &spec, &errMsg);
+        expect = TABEXTRACT_TEST_FS / tones[t].freq;
+        CHECK(fabs(period - expect) <= TABEXTRACT_TEST_PERIODTOL, "%s: period %.6f, not %.6f (%s)", tones[t].what,
+              period, expect, period ? "" : errMsg);
+    }
+
+    /* A noisy attack before the offset is not analysed */
+    renderTone(&tones[1], recording, TABEXTRACT_TEST_LENGTH);
+    for(i = 0; i < 1000; i++) {
+        recording[i] = nextValue(&seed);
+    }
+    spec.offset = 1000;
+    period = tab_period(recording, TABEXTRACT_TEST_LENGTH, &spec, &errMsg);
+    CHECK(fabs(period - TABEXTRACT_TEST_FS / tones[1].freq) <= TABEXTRACT_TEST_PERIODTOL,
+          "period %.6f past a noisy attack", period);
+    spec.offset = 0;
+
+    errMsg = NULL;
+    CHECK(tab_period(recording, 1000, &spec, &errMsg) == 0.0 && errMsg, "a recording too short was accepted");
+    for(i = 0; i < TABEXTRACT_TEST_LENGTH; i++) {
+        recording[i] = 0.0;
+    }
+    errMsg = NULL;
+    CHECK(tab_period(recording, TABEXTRACT_TEST_LENGTH, &spec, &errMsg) == 0.0 && errMsg,
+          "a silent recording was given a period");
+}
+
+static void testTables(double * recording) {
+    TABSPEC spec = {TABEXTRACT_TEST_TABLEN, TABEXTRACT_TEST_FS, 50.0, 2000.0, 0.0, 0, 4, 0.0};
+    const TESTTONE * tone = &tones[1];
+    GTABLE * table = NULL, * band;
+    TABMIPMAP * mipmap = NULL;
+    double period, re, im, fund, peak = 0.0, top;
+    unsigned long i;
+    unsigned int k;
+    char * errMsg = NULL;
+
+    renderTone(tone, recording, TABEXTRACT_TEST_LENGTH);
+    table = tab_extract(recording, TABEXTRACT_TEST_LENGTH, &spec, &period, &errMsg);
+    CHECK(table != NULL, "tab_extract: %s", errMsg);
+    if(!table) {
+        return;
+    }
+    CHECK(table->length == TABEXTRACT_TEST_TABLEN, "table of %lu samples", table->length);
+    CHECK(fabs(period - TABEXTRACT_TEST_FS / tone->freq) <= TABEXTRACT_TEST_PERIODTOL, "tab_extract period %.6f",
+          period);
+    for(i = 0; i < table->length; i++) {
+        peak = fabs(table->samples[i]) > peak ? fabs(table->samples[i]) : peak;
+    }
+    CHECK_NEAR(peak, 1.0, 1e-12, "table peak");
+    tableHarmonic(table, 0, &re, &im);
+    CHECK_NEAR(re, 0.0, 1e-9, "table DC");
+    tableHarmonic(table, 1, &re, &im);
+    fund = im;
+    CHECK(fund > 0.0 && fabs(re) < TABEXTRACT_TEST_HARMTOL * fund, "fundamental is %g cos + %g sin", re, im);
+    for(k = 2; k <= 8; k++) {
+        tableHarmonic(table, k, &re, &im);
+        CHECK_NEAR(sqrt(re * re + im * im) / fund, k <= tone->nharms ? tone->amps[k - 1] / tone->amps[0] : 0.0,
+                   TABEXTRACT_TEST_HARMTOL, "relative harmonic amplitude");
+    }
+
+    mipmap = tab_mipmap(recording, TABEXTRACT_TEST_LENGTH, &spec, &errMsg);
+    CHECK(mipmap != NULL, "tab_mipmap: %s", errMsg);
+    if(mipmap) {
+        CHECK(mipmap->ntables > 1 && mipmap->nharms[mipmap->ntables - 1] == 1, "%u tables, the last with %lu",
+              mipmap->ntables, mipmap->nharms[mipmap->ntables - 1]);
+        for(i = 0; i <= table->length; i++) {
+            CHECK_NEAR(mipmap->tables[0]->samples[i], table->samples[i], 1e-12, "full-band table");
+        }
+        top = 2.0 * mipmap->basefreq;
+        for(k = 0; k < mipmap->ntables; k++, top *= 2.0) {
+            band = mipmap_table(mipmap, 0.75 * top);
+            CHECK(band == mipmap->tables[k], "%g Hz does not play table %u", 0.75 * top, k);
+            CHECK(k + 1 == mipmap->ntables || mipmap->nharms[k] * top < 0.5 * TABEXTRACT_TEST_FS,
+                  "table %u has %lu harmonics up to %g Hz", k, mipmap->nharms[k], top);
+            /* The shared gain keeps the fundamental's level */
+            tableHarmonic(mipmap->tables[k], 1, &re, &im);
+            CHECK_NEAR(im, fund, 1e-9, "fundamental level across the tables");
+        }
+    }
+    clear_TABMIPMAP(&mipmap);
+    freeTable(&table);
+}
+
+static void testBatch(double * recording) {
+    TABSPEC spec = {TABEXTRACT_TEST_TABLEN, TABEXTRACT_TEST_FS, 50.0, 2000.0, 0.0, 0, 1, 0.0};
+    double * silence = (double *) calloc(TABEXTRACT_TEST_LENGTH, sizeof(double));
+    TABJOB jobs[3];
+    unsigned int j;
+
+    CHECK(silence != NULL, "could not allocate the silent recording");
+    if(!silence) {
+        return;
+    }
+    renderTone(&tones[2], recording, TABEXTRACT_TEST_LENGTH);
+    for(j = 0; j < 3; j++) {
+        jobs[j].samples = j == 1 ? silence : recording;
+        jobs[j].length = TABEXTRACT_TEST_LENGTH;
+        jobs[j].spec = &spec;
+    }
+    CHECK(tab_batch(jobs, 3, 2) == 2, "tab_batch did not run two of its three jobs");
+    CHECK(jobs[0].mipmap && jobs[2].mipmap && !jobs[1].mipmap && jobs[1].errMsg, "tab_batch job results");
+    for(j = 0; j < 3; j++) {
+        clear_TABMIPMAP(&jobs[j].mipmap);
+    }
+    free(silence);
+}
+
+int main(void) {
+    double * recording = (double *) malloc(TABEXTRACT_TEST_LENGTH * sizeof(double));
+
+    CHECK(recording != NULL, "could not allocate the recording");
+    if(recording) {
+        testPeriods(recording);
+        testTables(recording);
+        testBatch(recording);
+    }
+    free(recording);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,220 @@
+/*
+ wavfile: every sample format is written through a small staging buffer (so it flushes many times), read back
+ through each decoder and compared within the format's quantisation step. Also checks the header the writer
+ lays down and the reader's handling of WAVE_FORMAT_EXTENSIBLE fmt chunks.
+ */
+#include "wavfile.h"
+#include "check.h"
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Frames written per file: the double frames are followed by as many float frames.
+ */
+#define WAV_TEST_FRAMES 1000
+
+/**
+ * Path of the scratch file, in the test's working directory.
+ */
+#define WAV_TEST_PATH "test_wavfile.wav"
+
+static const char * formatNames[] = {"PCM16", "PCM24", "PCM32", "FLOAT32", "FLOAT64"};
+
+/**
+ * Largest round-trip error of a sample within [-1, 1] in a given format.
+ */
+static double formatTolerance(int format) {
+    switch(format) {
+        case WAV_PCM16:
+            return 1.5 / 32768.0;
+        case WAV_PCM24:
+            return 1.5 / 8388608.0;
+        case WAV_PCM32:
+            return 1.5 / 2147483648.0;
+        case WAV_FLOAT32:
+            return 1e-7;
+        default:
+            return 0.0;
+    }
+}
+
+/**
+ * The test signal: a sweep of values covering [-1, 1), different for each channel, with the two channel
+ * extremes clipped by the integer formats at frames 10 and 11.
+ */
+static double testSample(unsigned long frame, unsigned int chan) {
+    if(frame == 10) {
+        return chan ? -1.5 : 1.5;
+    }
+    if(frame == 11) {
+        return chan ? 1.0 : -1.0;
+    }
+    return (double) ((frame * 7919UL + chan * 104729UL) % 2000UL) / 1000.0 - 1.0;
+}
+
+/**
+ * The value a sample should read back as, after clipping by the integer formats.
+ */
+static double expectedSample(unsigned long frame, unsigned int chan, int format) {
+    double val = testSample(frame, chan);
+    if(format <= WAV_PCM32) {
+        val = val > 1.0 ? 1.0 : val < -1.0 ? -1.0 : val;
+    }
+    return val;
+}
+
+static void testRoundTrip(int format, unsigned int nchans) {
+    static double frames[2 * WAV_TEST_FRAMES], readback[2 * 2 * WAV_TEST_FRAMES];
+    static float framesf[2 * WAV_TEST_FRAMES], channelf[2 * WAV_TEST_FRAMES];
+    double tol = formatTolerance(format), ftol = tol > 1e-7 ? tol : 1e-7;
+    const char * name = formatNames[format];
+    char * errMsg = NULL;
+    WAVWRITER * writer;
+    WAVFILE * wav;
+    unsigned long i, got;
+    unsigned int c;
+
+    for(i = 0; i < WAV_TEST_FRAMES; i++) {
+        for(c = 0; c < nchans; c++) {
+            frames[i * nchans + c] = testSample(i, c);
+            framesf[i * nchans + c] = (float) testSample(i + WAV_TEST_FRAMES, c);
+        }
+    }
+
+    /* A 100 byte staging buffer holds a few frames at most, so both write paths flush repeatedly */
+    writer = wav_create(WAV_TEST_PATH, 48000, nchans, format, 100, &errMsg);
+    CHECK(writer != NULL, "%s: wav_create: %s", name, errMsg);
+    if(!writer) {
+        return;
+    }
+    CHECK(wav_writeframes(writer, frames, WAV_TEST_FRAMES), "%s: wav_writeframes", name);
+    CHECK(wav_writeframesf(writer, framesf, WAV_TEST_FRAMES), "%s: wav_writeframesf", name);
+    CHECK(wav_finish(&writer) && writer == NULL, "%s: wav_finish", name);
+
+    wav = wav_open(WAV_TEST_PATH, &errMsg);
+    CHECK(wav != NULL, "%s: wav_open: %s", name, errMsg);
+    if(!wav) {
+        unlink(WAV_TEST_PATH);
+        return;
+    }
+    CHECK(wav->format == format && wav->nchans == nchans && wav->fs == 48000 && !wav->rf64,
+          "%s: read back as format %d, %u channels, %lu Hz, rf64 %d", name, wav->format, wav->nchans, wav->fs,
+          wav->rf64);
+    CHECK(wav->nframes == 2 * WAV_TEST_FRAMES, "%s: %llu frames", name, (unsigned long long) wav->nframes);
+
+    /* Interleaved frames, asking for more than the file holds */
+    got = wav_readframes(wav, 0, readback, 2 * WAV_TEST_FRAMES);
+    CHECK(got == 2 * WAV_TEST_FRAMES, "%s: wav_readframes gave %lu frames", name, got);
+    for(i = 0; i < WAV_TEST_FRAMES; i++) {
+        for(c = 0; c < nchans; c++) {
+            CHECK_NEAR(readback[i * nchans + c], expectedSample(i, c, format), tol, name);
+            CHECK_NEAR(readback[(i + WAV_TEST_FRAMES) * nchans + c], framesf[i * nchans + c], ftol, name);
+        }
+    }
+
+    /* Each channel alone, from an offset and running off the end */
+    for(c = 0; c < nchans; c++) {
+        got = wav_readchannel(wav, c, 5, readback, 2 * WAV_TEST_FRAMES);
+        CHECK(got == 2 * WAV_TEST_FRAMES - 5, "%s: wav_readchannel gave %lu frames", name, got);
+        for(i = 0; i + 5 < WAV_TEST_FRAMES; i++) {
+            CHECK_NEAR(readback[i], expectedSample(i + 5, c, format), tol, name);
+        }
+        got = wav_readchannelf(wav, c, 0, channelf, WAV_TEST_FRAMES);
+        CHECK(got == WAV_TEST_FRAMES, "%s: wav_readchannelf gave %lu frames", name, got);
+        for(i = 0; i < WAV_TEST_FRAMES; i++) {
+            CHECK_NEAR(channelf[i], expectedSample(i, c, format), ftol, name);
+        }
+    }
+    CHECK(wav_readchannel(wav, nchans, 0, readback, 1) == 0, "%s: read of a missing channel", name);
+    wav_close(&wav);
+    CHECK(wav == NULL, "%s: wav_close did not clear the pointer", name);
+    unlink(WAV_TEST_PATH);
+}
+
+static void testFloatHeader(void) {
+    unsigned char header[82];
+    char * errMsg = NULL;
+    WAVWRITER * writer = wav_create(WAV_TEST_PATH, 44100, 1, WAV_FLOAT32, 0, &errMsg);
+    FILE * fp;
+
+    CHECK(writer != NULL, "wav_create: %s", errMsg);
+    if(!writer) {
+        return;
+    }
+    wav_finish(&writer);
+    fp = fopen(WAV_TEST_PATH, "rb");
+    CHECK(fp != NULL && fread(header, 1, sizeof(header), fp) == sizeof(header), "could not read the header back");
+    if(fp) {
+        CHECK(fgetc(fp) == EOF, "empty float file is longer than its 82 byte header");
+        fclose(fp);
+    }
+    CHECK(!memcmp(header + 48, "fmt ", 4) && header[52] == 18, "float fmt chunk is not 18 bytes");
+    CHECK(header[72] == 0 && header[73] == 0, "float fmt cbSize is %u", header[72] | (header[73] << 8));
+    CHECK(!memcmp(header + 74, "data", 4), "float data chunk does not follow the fmt body");
+    unlink(WAV_TEST_PATH);
+}
+
+/**
+ * Write a minimal RIFF file around a given fmt chunk body and four bytes of sample data.
+ */
+static int writeWithFmt(const unsigned char * fmt, unsigned int fmtSize) {
+    unsigned char riff[12] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E'};
+    unsigned char chunk[8] = {'f', 'm', 't', ' ', 0, 0, 0, 0};
+    unsigned char data[12] = {'d', 'a', 't', 'a', 4, 0, 0, 0, 0x00, 0x40, 0x00, 0xc0};
+    unsigned long riffSize = 4 + 8 + fmtSize + sizeof(data);
+    FILE * fp = fopen(WAV_TEST_PATH, "wb");
+    int ok;
+
+    if(!fp) {
+        return 0;
+    }
+    riff[4] = riffSize & 0xff;
+    riff[5] = (riffSize >> 8) & 0xff;
+    chunk[4] = fmtSize & 0xff;
+    ok = fwrite(riff, 1, sizeof(riff), fp) == sizeof(riff) && fwrite(chunk, 1, sizeof(chunk), fp) == sizeof(chunk) &&
+         fwrite(fmt, 1, fmtSize, fp) == fmtSize && fwrite(data, 1, sizeof(data), fp) == sizeof(data);
+    return fclose(fp) == 0 && ok;
+}
+
+static void testExtensible(void) {
+    /* Mono 16-bit PCM at 8kHz as WAVE_FORMAT_EXTENSIBLE, with the PCM SubFormat GUID */
+    unsigned char fmt[40] = {
+        0xfe, 0xff, 1, 0, 0x40, 0x1f, 0, 0, 0x80, 0x3e, 0, 0, 2, 0, 16, 0,
+        22, 0, 16, 0, 4, 0, 0, 0,
+        0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71
+    };
+    char * errMsg = NULL;
+    double samples[2];
+    WAVFILE * wav;
+
+    /* Claiming the extensible tag in a 16 byte fmt chunk leaves no SubFormat to read */
+    CHECK(writeWithFmt(fmt, 16), "could not write the truncated extensible file");
+    wav = wav_open(WAV_TEST_PATH, &errMsg);
+    CHECK(wav == NULL && errMsg != NULL, "16 byte extensible fmt chunk was accepted");
+    wav_close(&wav);
+
+    errMsg = NULL;
+    CHECK(writeWithFmt(fmt, sizeof(fmt)), "could not write the extensible file");
+    wav = wav_open(WAV_TEST_PATH, &errMsg);
+    CHECK(wav != NULL, "40 byte extensible fmt chunk was rejected: %s", errMsg);
+    if(wav) {
+        CHECK(wav->format == WAV_PCM16 && wav->nchans == 1 && wav->fs == 8000 && wav->nframes == 2,
+              "extensible file read as format %d, %u channels, %lu Hz, %llu frames", wav->format, wav->nchans,
+              wav->fs, (unsigned long long) wav->nframes);
+        CHECK(wav_readframes(wav, 0, samples, 2) == 2 && samples[0] == 0.5 && samples[1] == -0.5,
+              "extensible samples read as %g, %g", samples[0], samples[1]);
+        wav_close(&wav);
+    }
+    unlink(WAV_TEST_PATH);
+}
+
+int main(void) {
+    int format;
+    for(format = WAV_PCM16; format <= WAV_FLOAT64; format++) {
+        testRoundTrip(format, 1);
+        testRoundTrip(format, 2);
+    }
+    testFloatHeader();
+    testExtensible();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,26 @@
+/*
+ brkconv - convert a text breakpoint file into the binary breakpoint format.
+
+ usage: brkconv infile.txt outfile.brk
+ */
+#include "breakpoint.h"
+#include "helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char ** argv) {
+    BRKFILE * file;
+    if(argc != 3) {
+        quit("usage: brkconv infile.txt outfile.brk");
+    }
+    if(!(file = bps_load(argv[1]))) {
+        quit("Could not read breakpoint file");
+    }
+    if(!bps_writebinary(argv[2], file->points, file->curves, file->npoints)) {
+        bps_unload(&file);
+        quit("Could not write binary breakpoint file");
+    }
+    fprintf(stdout, "Converted %lu breakpoints\n", file->npoints);
+    bps_unload(&file);
+    return EXIT_SUCCESS;
+}
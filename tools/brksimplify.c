@@ -0,0 +1,112 @@
+/*
+ brksimplify - reduce a text breakpoint file to the fewest points within an error bound.
+
+ usage: brksimplify [-t tolerance] infile outfile
+
+ The input is streamed line by line, so files larger than memory can be processed. The output is linear, so
+ input with curve columns ("exp k" or "pow p") is rejected rather than flattened. As with getBreakpoints, reading
+ stops at the first line with non-numeric data, an incomplete breakpoint or a decreasing time. The reduction ratio
+ and error bound are reported on stderr.
+ */
+#include "breakpoint.h"
+#include "helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int fileSink(const BREAKPOINT * point, void * userdata) {
+    return fprintf((FILE *) userdata, "%.17g\t%.17g\n", point->time, point->value) > 0;
+}
+
+int main(int argc, char ** argv) {
+    char ** argend = argv + argc - 1;
+    char key, * value, * end;
+    double tolerance = 1e-4, lasttime = 0.0;
+    char * line = NULL;
+    size_t linesize = 0;
+    unsigned long nline = 0;
+    int curved = 0;
+    FILE * in, * out;
+    BRKSIMPLIFY * simp;
+    BREAKPOINT point;
+
+    argv++;
+    while(argParse(&argv, argend, &key, &value)) {
+        switch(key) {
+            case 't':
+                argCheck(value, key);
+                tolerance = strtod(value, &end);
+                if(end == value || *end || !(tolerance >= 0.0)) {
+                    quit("Tolerance must be a non-negative number");
+                }
+                break;
+            default:
+                quit("usage: brksimplify [-t tolerance] infile outfile");
+        }
+    }
+    if(argv + 1 != argend) {
+        quit("usage: brksimplify [-t tolerance] infile outfile");
+    }
+    if(!(in = fopen(argv[0], "r"))) {
+        quit("Could not open input file");
+    }
+    if(!(out = fopen(argv[1], "w"))) {
+        quit("Could not open output file");
+    }
+    if(!(simp = bps_simplify_new(tolerance, fileSink, out))) {
+        quit("Could not allocate simplifier");
+    }
+
+    /* getline grows the buffer, so a long line is never split into two breakpoints */
+    while(getline(&line, &linesize, in) > 0) {
+        char * cont, * next;
+        nline++;
+        point.time = strtod(line, &cont);
+        if(cont == line) {
+            /* Skip blank lines, stop at anything else */
+            for(; *cont == ' ' || *cont == '\t' || *cont == '\r'; cont++)
+                ;
+            if(*cont == '\n' || !*cont) {
+                continue;
+            }
+            fprintf(stderr, "Line %lu has non-numeric data\n", nline);
+            break;
+        }
+        point.value = strtod(cont, &next);
+        if(next == cont) {
+            fprintf(stderr, "Incomplete breakpoint found at line %lu\n", nline);
+            break;
+        }
+        if(point.time < lasttime) {
+            fprintf(stderr, "Data error at line %lu: time not increasing\n", nline);
+            break;
+        }
+        for(cont = next; *cont == ' ' || *cont == '\t'; cont++)
+            ;
+        if(!strncmp(cont, "exp", 3) || !strncmp(cont, "pow", 3)) {
+            fprintf(stderr, "Line %lu has a curve column - only linear breakpoint files can be simplified\n", nline);
+            curved = 1;
+            break;
+        }
+        lasttime = point.time;
+        if(!bps_simplify_push(simp, point)) {
+            break;
+        }
+    }
+    free(line);
+    fclose(in);
+    if(curved) {
+        bps_simplify_free(&simp);
+        fclose(out);
+        remove(argv[1]);
+        quit("Could not simplify input with curves");
+    }
+    if(!bps_simplify_finish(simp) || fclose(out)) {
+        quit("Could not write output file");
+    }
+
+    fprintf(stderr, "%lu -> %lu breakpoints (ratio %.2f), error bound %g\n", simp->nin, simp->nout,
+            simp->nout ? (double) simp->nin / simp->nout : 0.0, simp->maxerror);
+    bps_simplify_free(&simp);
+    return EXIT_SUCCESS;
+}
@@ -1,11 +1,21 @@
 #include "wave.h"
+#include "instrument.h"
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
 
+/**
+ * Downward sawtooth tick without instrumentation, shared by the sawtooth and triangle ticks.
+ */
+static double sawdown(OSCIL * oscil, double freq);
+
 /* Constructor */
 OSCIL * oscil( double fs, double phase) {
-    OSCIL * osc = (OSCIL *) malloc(sizeof(OSCIL));
+    return oscil_a(fs, phase, NULL);
+}
+
+OSCIL * oscil_a(double fs, double phase, const DSPALLOC * alloc) {
+    OSCIL * osc = (OSCIL *) dsp_alloc(alloc, sizeof(OSCIL));
     if(!osc) {
         return NULL;
     }
@@ -17,7 +27,15 @@ OSCIL * oscil( double fs, double phase) {
     return osc;
 }
 
+void freeOscil_a(OSCIL ** osc, const DSPALLOC * alloc) {
+    if(osc && *osc) {
+        dsp_free(alloc, *osc);
+        *osc = NULL;
+    }
+}
+
 double sinetick(OSCIL * oscil, double freq) {
+    DSP_PROBE_BEGIN(start);
     double val = sin(oscil->curPhase);
     // Update oscil object.
     if(freq != oscil->curFreq) {
@@ -25,12 +43,14 @@ double sinetick(OSCIL * oscil, double freq) {
         oscil->curFreq = freq;
     }
     oscil->curPhase += oscil->incr;
+    DSP_PROBE_END(DSP_PROBE_OSCIL, start, 1);
     return val;
 }
 
 double squaretick(OSCIL * oscil, double freq) {
     /* */
     double val;
+    DSP_PROBE_BEGIN(start);
     // Update oscil object.
     if(freq != oscil->curFreq) {
         oscil->incr = oscil->twopiovrsr * freq;
@@ -44,10 +64,11 @@ double squaretick(OSCIL * oscil, double freq) {
     }
     val = (oscil->curPhase <= 2 * PI * oscil->mod) ? 1.0 : -1.0;
     oscil->curPhase += oscil->incr;
+    DSP_PROBE_END(DSP_PROBE_OSCIL, start, 1);
     return val;
 }
 
-double sawdtick(OSCIL * oscil, double freq) {
+static double sawdown(OSCIL * oscil, double freq) {
     double val;
     // Update oscil object.
     if(freq != oscil->curFreq) {
@@ -66,12 +87,25 @@ double sawdtick(OSCIL * oscil, double freq) {
     return val;
 }
 
+double sawdtick(OSCIL * oscil, double freq) {
+    double val;
+    DSP_PROBE_BEGIN(start);
+    val = sawdown(oscil, freq);
+    DSP_PROBE_END(DSP_PROBE_OSCIL, start, 1);
+    return val;
+}
+
 double sawutick(OSCIL * oscil, double freq) {
-    return -1.0*sawdtick(oscil, freq);
+    double val;
+    DSP_PROBE_BEGIN(start);
+    val = -1.0*sawdown(oscil, freq);
+    DSP_PROBE_END(DSP_PROBE_OSCIL, start, 1);
+    return val;
 }
 
 double tritick(OSCIL * oscil, double freq) {
     double val;
+    DSP_PROBE_BEGIN(start);
     // Update oscil object.
     freq *= .5;
     if(freq != oscil->curFreq) {
@@ -85,12 +119,13 @@ double tritick(OSCIL * oscil, double freq) {
         oscil->curPhase += 2 * PI;
     }
     /* rectified sawtooth */
-    val = sawutick(oscil, freq);
+    val = -1.0*sawdown(oscil, freq);
     if(val < 0.0) {
         val *= -1;
     }
     val = 2.0 * (val - 0.5);
     oscil->curPhase += oscil->incr;
+    DSP_PROBE_END(DSP_PROBE_OSCIL, start, 1);
     return val;
 }
 
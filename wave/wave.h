@@ -1,5 +1,6 @@
 #ifndef _WAVE_H_
 #define _WAVE_H_
+#include "dspalloc.h"
 #define PI (4.0 * atan(1.0))
 
 /**
@@ -50,6 +51,24 @@ typedef double (*tickfunc) (OSCIL * oscil, double freq);
  */
 OSCIL * oscil(double fs, double phase);
 
+/**
+ * Create and initialise an OSCIL object with a given allocator.
+ *
+ * @param fs - The sample rate for the oscillator.
+ * @param phase - The initial phase (radians)
+ * @param alloc - pointer to the allocator, or NULL for the system heap
+ * @return a pointer to an initialised OSCIL object, or NULL if unsuccessful.
+ */
+OSCIL * oscil_a(double fs, double phase, const DSPALLOC * alloc);
+
+/**
+ * Destroy an OSCIL object created by oscil_a.
+ *
+ * @param osc - pointer to a pointer for the OSCIL object, set to NULL on return
+ * @param alloc - the allocator the object was created with
+ */
+void freeOscil_a(OSCIL ** osc, const DSPALLOC * alloc);
+
 /**
  * Perform a sinusoidal tick for a given oscillator and instantaneous frequency.
  *
@@ -0,0 +1,616 @@
+#include "wavfile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ Layout notes:
+
+ RIFF/WAVE stores 32-bit chunk sizes, limiting files to 4GB. RF64 (EBU Tech 3306) and BW64 (ITU-R BS.2088)
+ replace the RIFF id, set the 32-bit sizes to 0xFFFFFFFF and carry the real sizes in a "ds64" chunk which must
+ directly follow the WAVE id.
+
+ The writer reserves room for a ds64 chunk by emitting a 28-byte "JUNK" chunk in its place. On close the JUNK
+ chunk is rewritten as ds64 only if the data outgrew the RIFF limit, so short files remain plain WAVs.
+ */
+
+#define WAV_FORMAT_PCM 0x0001
+#define WAV_FORMAT_FLOAT 0x0003
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+#define WAV_DS64_SIZE 28
+#define WAV_RIFF_LIMIT 0xFFFFFFFFUL
+#define WAV_FMT_PCM_SIZE 16
+#define WAV_FMT_FLOAT_SIZE 18
+#define WAV_FMT_EXTENSIBLE_SIZE 40
+
+/* RIFF header + JUNK/ds64 reservation + fmt chunk + data chunk header */
+#define WAV_HEADER_SIZE(fmtsize) (12 + (8 + WAV_DS64_SIZE) + (8 + (fmtsize)) + 8)
+#define WAV_MAX_HEADER WAV_HEADER_SIZE(WAV_FMT_FLOAT_SIZE)
+
+_Static_assert(WAV_MAX_HEADER >= WAV_HEADER_SIZE(WAV_FMT_PCM_SIZE), "writer header buffer must hold every format");
+
+/* The float fast paths copy raw file bytes, which only works when the host is little-endian like the file.
+   Other hosts go through decodeSample/encodeSample, which assemble the bytes explicitly. */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define WAV_NATIVE_FLOAT 1
+#else
+#define WAV_NATIVE_FLOAT 0
+#endif
+
+/**
+ * Read an unsigned little-endian integer of a given byte width.
+ * @param p - pointer to the first byte
+ * @param nbytes - the width of the integer (up to 8 bytes)
+ * @return the decoded integer
+ */
+static uint64_t readLE(const unsigned char * p, int nbytes);
+
+/**
+ * Write an unsigned little-endian integer of a given byte width.
+ * @param p - pointer to the destination bytes
+ * @param val - the integer to encode
+ * @param nbytes - the width of the integer (up to 8 bytes)
+ */
+static void writeLE(unsigned char * p, uint64_t val, int nbytes);
+
+/**
+ * Decode a single sample to double precision.
+ * @param p - pointer to the encoded sample
+ * @param format - the sample encoding
+ * @return the sample value (nominally between -1 and 1)
+ */
+static double decodeSample(const unsigned char * p, int format);
+
+/**
+ * Encode a single sample from double precision, clipping integer formats.
+ * @param p - pointer to the destination bytes
+ * @param val - the sample value
+ * @param format - the sample encoding
+ */
+static void encodeSample(unsigned char * p, double val, int format);
+
+/**
+ * Size in bytes of a sample for a given encoding (0 if unsupported).
+ */
+static unsigned int formatSize(int format);
+
+/**
+ * Write a complete byte range, retrying on short writes.
+ * @return boolean integer specifying whether all bytes were written
+ */
+static int writeAll(int fd, const unsigned char * buf, size_t len);
+
+/**
+ * Flush the staging buffer of a writer to disk.
+ */
+static int flushWriter(WAVWRITER * writer);
+
+/**
+ * Length of the header emitted by the writer for a given encoding.
+ */
+static size_t headerSize(int format);
+
+static uint64_t readLE(const unsigned char * p, int nbytes) {
+    uint64_t val = 0;
+    int i;
+    for(i = nbytes - 1; i >= 0; i--) {
+        val = (val << 8) | p[i];
+    }
+    return val;
+}
+
+static void writeLE(unsigned char * p, uint64_t val, int nbytes) {
+    int i;
+    for(i = 0; i < nbytes; i++) {
+        p[i] = (unsigned char) (val & 0xFF);
+        val >>= 8;
+    }
+}
+
+static unsigned int formatSize(int format) {
+    switch(format) {
+        case WAV_PCM16: return 2;
+        case WAV_PCM24: return 3;
+        case WAV_PCM32: return 4;
+        case WAV_FLOAT32: return 4;
+        case WAV_FLOAT64: return 8;
+        default: return 0;
+    }
+}
+
+static double decodeSample(const unsigned char * p, int format) {
+    int32_t ival;
+    float fval;
+    double dval;
+    switch(format) {
+        case WAV_PCM16:
+            return (int16_t) (p[0] | (p[1] << 8)) / 32768.0;
+        case WAV_PCM24:
+            /* Place the 3 bytes in the top of a 32-bit word so the sign extends naturally */
+            ival = (int32_t) (((uint32_t) p[0] << 8) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 24));
+            return (ival >> 8) / 8388608.0;
+        case WAV_PCM32:
+            ival = (int32_t) readLE(p, 4);
+            return ival / 2147483648.0;
+        case WAV_FLOAT32:
+            ival = (int32_t) readLE(p, 4);
+            memcpy(&fval, &ival, sizeof(fval));
+            return fval;
+        case WAV_FLOAT64:
+            {
+                uint64_t bits = readLE(p, 8);
+                memcpy(&dval, &bits, sizeof(dval));
+            }
+            return dval;
+        default:
+            return 0.0;
+    }
+}
+
+static void encodeSample(unsigned char * p, double val, int format) {
+    float fval;
+    uint32_t bits32;
+    uint64_t bits64;
+    if(format <= WAV_PCM32) {
+        if(val > 1.0) {
+            val = 1.0;
+        }
+        if(val < -1.0) {
+            val = -1.0;
+        }
+    }
+    switch(format) {
+        case WAV_PCM16:
+            writeLE(p, (uint64_t) (int64_t) lrint(val * 32767.0), 2);
+            break;
+        case WAV_PCM24:
+            writeLE(p, (uint64_t) (int64_t) lrint(val * 8388607.0), 3);
+            break;
+        case WAV_PCM32:
+            writeLE(p, (uint64_t) (int64_t) llrint(val * 2147483647.0), 4);
+            break;
+        case WAV_FLOAT32:
+            fval = (float) val;
+            memcpy(&bits32, &fval, sizeof(bits32));
+            writeLE(p, bits32, 4);
+            break;
+        case WAV_FLOAT64:
+            memcpy(&bits64, &val, sizeof(bits64));
+            writeLE(p, bits64, 8);
+            break;
+    }
+}
+
+WAVFILE * wav_open(const char * path, char ** errMsg) {
+    int fd;
+    struct stat st;
+    const unsigned char * base, * p, * end;
+    const unsigned char * fmt = NULL;
+    uint64_t dataSize = 0, ds64DataSize = 0, fmtSize = 0;
+    unsigned int tag, bits;
+    WAVFILE * wav;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        *errMsg = "Could not open audio file";
+        return NULL;
+    }
+    if(fstat(fd, &st) < 0 || st.st_size < 12) {
+        close(fd);
+        *errMsg = "Audio file is too small to be a WAV file";
+        return NULL;
+    }
+    wav = (WAVFILE *) malloc(sizeof(WAVFILE));
+    if(!wav) {
+        close(fd);
+        *errMsg = "Could not allocate memory for WAVFILE structure.";
+        return NULL;
+    }
+    wav->maplen = (size_t) st.st_size;
+    wav->map = mmap(NULL, wav->maplen, PROT_READ, MAP_SHARED, fd, 0);
+    /* The mapping holds its own reference to the file */
+    close(fd);
+    if(wav->map == MAP_FAILED) {
+        free(wav);
+        *errMsg = "Could not memory-map audio file";
+        return NULL;
+    }
+    base = (const unsigned char *) wav->map;
+    end = base + wav->maplen;
+    wav->data = NULL;
+
+    if(memcmp(base + 8, "WAVE", 4)) {
+        *errMsg = "Not a WAVE file";
+        wav_close(&wav);
+        return NULL;
+    }
+    if(!memcmp(base, "RIFF", 4)) {
+        wav->rf64 = 0;
+    }
+    else if(!memcmp(base, "RF64", 4) || !memcmp(base, "BW64", 4)) {
+        wav->rf64 = 1;
+    }
+    else {
+        *errMsg = "Not a RIFF, RF64 or BW64 file";
+        wav_close(&wav);
+        return NULL;
+    }
+
+    /* Walk the chunk list - chunks are padded to even sizes */
+    for(p = base + 12; p + 8 <= end; ) {
+        uint64_t size = readLE(p + 4, 4);
+        if(!memcmp(p, "ds64", 4) && p + 8 + 16 <= end) {
+            ds64DataSize = readLE(p + 16, 8);
+        }
+        else if(!memcmp(p, "fmt ", 4) && size >= 16 && p + 8 + 16 <= end) {
+            fmt = p + 8;
+            fmtSize = size;
+        }
+        else if(!memcmp(p, "data", 4)) {
+            wav->data = p + 8;
+            dataSize = (wav->rf64 && size == WAV_RIFF_LIMIT) ? ds64DataSize : size;
+            break;
+        }
+        p += 8 + size + (size & 1);
+    }
+    if(!fmt || !wav->data) {
+        *errMsg = "Missing fmt or data chunk";
+        wav_close(&wav);
+        return NULL;
+    }
+
+    tag = (unsigned int) readLE(fmt, 2);
+    wav->nchans = (unsigned int) readLE(fmt + 2, 2);
+    wav->fs = (unsigned long) readLE(fmt + 4, 4);
+    wav->framesize = (unsigned int) readLE(fmt + 12, 2);
+    bits = (unsigned int) readLE(fmt + 14, 2);
+    if(tag == WAV_FORMAT_EXTENSIBLE) {
+        if(fmtSize < WAV_FMT_EXTENSIBLE_SIZE || fmt + WAV_FMT_EXTENSIBLE_SIZE > end) {
+            *errMsg = "Truncated WAVE_FORMAT_EXTENSIBLE fmt chunk";
+            wav_close(&wav);
+            return NULL;
+        }
+        /* The first two bytes of the SubFormat GUID hold the real format tag */
+        tag = (unsigned int) readLE(fmt + 24, 2);
+    }
+    if(tag == WAV_FORMAT_PCM && bits == 16) {
+        wav->format = WAV_PCM16;
+    }
+    else if(tag == WAV_FORMAT_PCM && bits == 24) {
+        wav->format = WAV_PCM24;
+    }
+    else if(tag == WAV_FORMAT_PCM && bits == 32) {
+        wav->format = WAV_PCM32;
+    }
+    else if(tag == WAV_FORMAT_FLOAT && bits == 32) {
+        wav->format = WAV_FLOAT32;
+    }
+    else if(tag == WAV_FORMAT_FLOAT && bits == 64) {
+        wav->format = WAV_FLOAT64;
+    }
+    else {
+        *errMsg = "Unsupported WAV sample format";
+        wav_close(&wav);
+        return NULL;
+    }
+    wav->samplesize = formatSize(wav->format);
+    if(!wav->nchans || wav->framesize != wav->nchans * wav->samplesize) {
+        *errMsg = "Inconsistent WAV block alignment";
+        wav_close(&wav);
+        return NULL;
+    }
+    /* Tolerate truncated files by clamping the data chunk to the mapping */
+    if(dataSize > (uint64_t) (end - wav->data)) {
+        dataSize = (uint64_t) (end - wav->data);
+    }
+    wav->nframes = dataSize / wav->framesize;
+
+    /* Typical access is a linear sweep through the data */
+    madvise(wav->map, wav->maplen, MADV_SEQUENTIAL);
+    return wav;
+}
+
+void wav_close(WAVFILE ** wav) {
+    if(wav && *wav) {
+        munmap((*wav)->map, (*wav)->maplen);
+        free(*wav);
+        *wav = NULL;
+    }
+}
+
+const void * wav_frameptr(const WAVFILE * wav, uint64_t frame) {
+    if(frame >= wav->nframes) {
+        return NULL;
+    }
+    return wav->data + frame * wav->framesize;
+}
+
+void wav_prefetch(const WAVFILE * wav, uint64_t start, uint64_t nframes) {
+    uintptr_t first, last;
+    long pagesize = sysconf(_SC_PAGESIZE);
+    if(start >= wav->nframes) {
+        return;
+    }
+    if(nframes > wav->nframes - start) {
+        nframes = wav->nframes - start;
+    }
+    /* madvise requires a page-aligned start address */
+    first = (uintptr_t) (wav->data + start * wav->framesize);
+    last = first + nframes * wav->framesize;
+    first &= ~((uintptr_t) pagesize - 1);
+    madvise((void *) first, last - first, MADV_WILLNEED);
+}
+
+unsigned long wav_readchannel(const WAVFILE * wav, unsigned int chan, uint64_t start,
+                              double * out, unsigned long nframes) {
+    unsigned long i;
+    const unsigned char * p;
+    if(chan >= wav->nchans || start >= wav->nframes) {
+        return 0;
+    }
+    if(nframes > wav->nframes - start) {
+        nframes = (unsigned long) (wav->nframes - start);
+    }
+    p = wav->data + start * wav->framesize + chan * wav->samplesize;
+    /* Specialise the common formats so the loops stay free of the format switch */
+    if(wav->format == WAV_PCM16) {
+        for(i = 0; i < nframes; i++, p += wav->framesize) {
+            out[i] = (int16_t) (p[0] | (p[1] << 8)) * (1.0 / 32768.0);
+        }
+    }
+    else if(WAV_NATIVE_FLOAT && wav->format == WAV_FLOAT32) {
+        float val;
+        for(i = 0; i < nframes; i++, p += wav->framesize) {
+            memcpy(&val, p, sizeof(val));
+            out[i] = val;
+        }
+    }
+    else {
+        for(i = 0; i < nframes; i++, p += wav->framesize) {
+            out[i] = decodeSample(p, wav->format);
+        }
+    }
+    return nframes;
+}
+
+unsigned long wav_readchannelf(const WAVFILE * wav, unsigned int chan, uint64_t start,
+                               float * out, unsigned long nframes) {
+    unsigned long i;
+    const unsigned char * p;
+    if(chan >= wav->nchans || start >= wav->nframes) {
+        return 0;
+    }
+    if(nframes > wav->nframes - start) {
+        nframes = (unsigned long) (wav->nframes - start);
+    }
+    p = wav->data + start * wav->framesize + chan * wav->samplesize;
+    if(WAV_NATIVE_FLOAT && wav->format == WAV_FLOAT32) {
+        if(wav->nchans == 1) {
+            /* Mono float data is already in the requested layout */
+            memcpy(out, p, nframes * sizeof(float));
+            return nframes;
+        }
+        for(i = 0; i < nframes; i++, p += wav->framesize) {
+            memcpy(&out[i], p, sizeof(float));
+        }
+    }
+    else {
+        for(i = 0; i < nframes; i++, p += wav->framesize) {
+            out[i] = (float) decodeSample(p, wav->format);
+        }
+    }
+    return nframes;
+}
+
+unsigned long wav_readframes(const WAVFILE * wav, uint64_t start, double * out, unsigned long nframes) {
+    unsigned long i, nsamps;
+    const unsigned char * p;
+    if(start >= wav->nframes) {
+        return 0;
+    }
+    if(nframes > wav->nframes - start) {
+        nframes = (unsigned long) (wav->nframes - start);
+    }
+    p = wav->data + start * wav->framesize;
+    nsamps = nframes * wav->nchans;
+    for(i = 0; i < nsamps; i++, p += wav->samplesize) {
+        out[i] = decodeSample(p, wav->format);
+    }
+    return nframes;
+}
+
+static size_t headerSize(int format) {
+    return WAV_HEADER_SIZE(format >= WAV_FLOAT32 ? WAV_FMT_FLOAT_SIZE : WAV_FMT_PCM_SIZE);
+}
+
+static int writeAll(int fd, const unsigned char * buf, size_t len) {
+    while(len) {
+        ssize_t got = write(fd, buf, len);
+        if(got <= 0) {
+            return 0;
+        }
+        buf += got;
+        len -= (size_t) got;
+    }
+    return 1;
+}
+
+static int flushWriter(WAVWRITER * writer) {
+    if(writer->buffill) {
+        if(!writeAll(writer->fd, writer->buffer, writer->buffill)) {
+            return 0;
+        }
+        writer->buffill = 0;
+    }
+    return 1;
+}
+
+WAVWRITER * wav_create(const char * path, unsigned long fs, unsigned int nchans, int format,
+                       size_t bufsize, char ** errMsg) {
+    WAVWRITER * writer;
+    unsigned char header[WAV_MAX_HEADER];
+
+    if(!formatSize(format)) {
+        *errMsg = "Unsupported WAV sample format";
+        return NULL;
+    }
+    if(!nchans || !fs) {
+        *errMsg = "Channel count and sample rate must be positive";
+        return NULL;
+    }
+    writer = (WAVWRITER *) malloc(sizeof(WAVWRITER));
+    if(!writer) {
+        *errMsg = "Could not allocate memory for WAVWRITER structure.";
+        return NULL;
+    }
+    writer->fs = fs;
+    writer->nchans = nchans;
+    writer->format = format;
+    writer->samplesize = formatSize(format);
+    writer->framesize = nchans * writer->samplesize;
+    writer->nframes = 0;
+    writer->buffill = 0;
+    if(!bufsize) {
+        bufsize = WAV_DEFAULT_BUFSIZE;
+    }
+    /* Only ever stage whole frames */
+    writer->bufsize = (bufsize / writer->framesize) * writer->framesize;
+    if(!writer->bufsize) {
+        writer->bufsize = writer->framesize;
+    }
+    writer->buffer = (unsigned char *) malloc(writer->bufsize);
+    if(!writer->buffer) {
+        free(writer);
+        *errMsg = "Could not allocate WAV staging buffer";
+        return NULL;
+    }
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(writer->fd < 0) {
+        free(writer->buffer);
+        free(writer);
+        *errMsg = "Could not create audio file";
+        return NULL;
+    }
+
+    /* Provisional header - sizes are patched by wav_finish */
+    memset(header, 0, sizeof(header));
+    memcpy(header, "RIFF", 4);
+    memcpy(header + 8, "WAVE", 4);
+    memcpy(header + 12, "JUNK", 4);
+    writeLE(header + 16, WAV_DS64_SIZE, 4);
+    memcpy(header + 48, "fmt ", 4);
+    if(format >= WAV_FLOAT32) {
+        writeLE(header + 52, WAV_FMT_FLOAT_SIZE, 4);
+        writeLE(header + 56, WAV_FORMAT_FLOAT, 2);
+    }
+    else {
+        writeLE(header + 52, WAV_FMT_PCM_SIZE, 4);
+        writeLE(header + 56, WAV_FORMAT_PCM, 2);
+    }
+    writeLE(header + 58, nchans, 2);
+    writeLE(header + 60, fs, 4);
+    writeLE(header + 64, (uint64_t) fs * writer->framesize, 4);
+    writeLE(header + 68, writer->framesize, 2);
+    writeLE(header + 70, writer->samplesize * 8, 2);
+    /* cbSize (float only) is left as zero; the data chunk id follows the fmt body */
+    memcpy(header + headerSize(format) - 8, "data", 4);
+
+    if(!writeAll(writer->fd, header, headerSize(format))) {
+        close(writer->fd);
+        free(writer->buffer);
+        free(writer);
+        *errMsg = "Could not write WAV header";
+        return NULL;
+    }
+    return writer;
+}
+
+int wav_writeframes(WAVWRITER * writer, const double * frames, unsigned long nframes) {
+    unsigned long i;
+    unsigned int c;
+    for(i = 0; i < nframes; i++) {
+        /* The buffer holds whole frames, so one check per frame suffices */
+        if(writer->buffill == writer->bufsize && !flushWriter(writer)) {
+            return 0;
+        }
+        for(c = 0; c < writer->nchans; c++) {
+            encodeSample(writer->buffer + writer->buffill, *frames++, writer->format);
+            writer->buffill += writer->samplesize;
+        }
+    }
+    writer->nframes += nframes;
+    return 1;
+}
+
+int wav_writeframesf(WAVWRITER * writer, const float * frames, unsigned long nframes) {
+    unsigned long i;
+    unsigned int c;
+    for(i = 0; i < nframes; i++) {
+        if(writer->buffill == writer->bufsize && !flushWriter(writer)) {
+            return 0;
+        }
+        if(WAV_NATIVE_FLOAT && writer->format == WAV_FLOAT32) {
+            /* On a little-endian host float frames are already in file order */
+            memcpy(writer->buffer + writer->buffill, frames, writer->framesize);
+            writer->buffill += writer->framesize;
+            frames += writer->nchans;
+            continue;
+        }
+        for(c = 0; c < writer->nchans; c++) {
+            encodeSample(writer->buffer + writer->buffill, *frames++, writer->format);
+            writer->buffill += writer->samplesize;
+        }
+    }
+    writer->nframes += nframes;
+    return 1;
+}
+
+int wav_finish(WAVWRITER ** writer) {
+    WAVWRITER * w;
+    uint64_t dataSize, riffSize;
+    unsigned char patch[WAV_DS64_SIZE + 8];
+    int ok = 1;
+    if(!writer || !*writer) {
+        return 0;
+    }
+    w = *writer;
+    ok = flushWriter(w);
+    dataSize = w->nframes * w->framesize;
+    if(ok && (dataSize & 1)) {
+        /* Chunks are word aligned */
+        unsigned char pad = 0;
+        ok = writeAll(w->fd, &pad, 1);
+    }
+    riffSize = headerSize(w->format) - 8 + dataSize + (dataSize & 1);
+
+    if(ok && riffSize > WAV_RIFF_LIMIT) {
+        /* Promote to RF64 - the JUNK reservation becomes the ds64 chunk */
+        memcpy(patch, "ds64", 4);
+        writeLE(patch + 4, WAV_DS64_SIZE, 4);
+        writeLE(patch + 8, riffSize, 8);
+        writeLE(patch + 16, dataSize, 8);
+        writeLE(patch + 24, w->nframes, 8);
+        writeLE(patch + 32, 0, 4);
+        ok = pwrite(w->fd, "RF64\xFF\xFF\xFF\xFF", 8, 0) == 8 &&
+             pwrite(w->fd, patch, sizeof(patch), 12) == (ssize_t) sizeof(patch) &&
+             pwrite(w->fd, "\xFF\xFF\xFF\xFF", 4, (off_t) headerSize(w->format) - 4) == 4;
+    }
+    else if(ok) {
+        writeLE(patch, riffSize, 4);
+        writeLE(patch + 4, dataSize, 4);
+        ok = pwrite(w->fd, patch, 4, 4) == 4 &&
+             pwrite(w->fd, patch + 4, 4, (off_t) headerSize(w->format) - 4) == 4;
+    }
+    if(close(w->fd) < 0) {
+        ok = 0;
+    }
+    free(w->buffer);
+    free(w);
+    *writer = NULL;
+    return ok;
+}
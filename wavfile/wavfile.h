@@ -0,0 +1,184 @@
+#ifndef _WAVFILE_H_
+#define _WAVFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Sample encoding enumeration for the supported WAV/RF64 data formats.
+ * The integer formats correspond to the BIT16, BIT24 and BIT32 depths in wave.h.
+ */
+enum {WAV_PCM16, WAV_PCM24, WAV_PCM32, WAV_FLOAT32, WAV_FLOAT64};
+
+/**
+ * Default size (bytes) of the WAVWRITER staging buffer.
+ */
+#define WAV_DEFAULT_BUFSIZE (4UL * 1024UL * 1024UL)
+
+/**
+ * Defines the schema for a memory-mapped WAV/RF64 file.
+ *
+ * The sample data is never copied: data points straight into the mapping, and frames are
+ * interleaved exactly as stored on disk.
+ *
+ * @param map - base address of the file mapping
+ * @param maplen - length of the mapping in bytes
+ * @param data - address of the first sample frame within the mapping
+ * @param nframes - the number of sample frames in the data chunk
+ * @param fs - the sample rate of the file
+ * @param nchans - the number of interleaved channels
+ * @param format - the sample encoding (WAV_PCM16, WAV_PCM24, WAV_PCM32, WAV_FLOAT32, WAV_FLOAT64)
+ * @param samplesize - the size of one sample in bytes
+ * @param framesize - the size of one interleaved frame in bytes (block alignment)
+ * @param rf64 - boolean integer specifying whether the file uses the 64-bit RF64/BW64 layout
+ */
+typedef struct wavfile {
+    void * map;
+    size_t maplen;
+    const unsigned char * data;
+    uint64_t nframes;
+    unsigned long fs;
+    unsigned int nchans;
+    int format;
+    unsigned int samplesize;
+    unsigned int framesize;
+    int rf64;
+} WAVFILE;
+
+/**
+ * Defines the schema for a streaming WAV/RF64 writer.
+ *
+ * Frames are encoded into a large staging buffer which is flushed with a single write() call once full.
+ * The header is patched on close, switching to the RF64 layout if the data exceeds the 4GB RIFF limit.
+ *
+ * @param fd - file descriptor of the output file
+ * @param buffer - staging buffer for encoded frames
+ * @param bufsize - capacity of the staging buffer in bytes (a multiple of framesize)
+ * @param buffill - number of bytes currently held in the staging buffer
+ * @param nframes - total number of frames written so far
+ * @param fs - the sample rate of the file
+ * @param nchans - the number of interleaved channels
+ * @param format - the sample encoding
+ * @param samplesize - the size of one sample in bytes
+ * @param framesize - the size of one interleaved frame in bytes
+ */
+typedef struct wavwriter {
+    int fd;
+    unsigned char * buffer;
+    size_t bufsize;
+    size_t buffill;
+    uint64_t nframes;
+    unsigned long fs;
+    unsigned int nchans;
+    int format;
+    unsigned int samplesize;
+    unsigned int framesize;
+} WAVWRITER;
+
+/**
+ * Memory-map a WAV, RF64 or BW64 file for reading. Returns NULL if unsuccessful.
+ * @param path - path to the audio file
+ * @param errMsg - pointer to a string which is set to an error description on failure
+ * @return pointer to a dynamically allocated WAVFILE object
+ */
+WAVFILE * wav_open(const char * path, char ** errMsg);
+
+/**
+ * Unmap and destroy a WAVFILE object.
+ * @param wav - pointer to a pointer for the WAVFILE object, set to NULL on return
+ */
+void wav_close(WAVFILE ** wav);
+
+/**
+ * Obtain the address of a given frame within the mapping (zero-copy access).
+ *
+ * The returned memory holds wav->nframes - frame interleaved frames in the on-disk encoding. For WAV_FLOAT32
+ * files on little-endian hosts it may be read directly as a float array.
+ *
+ * @param wav - pointer to an open WAVFILE object
+ * @param frame - the frame index
+ * @return pointer to the frame, or NULL if the index is out of range
+ */
+const void * wav_frameptr(const WAVFILE * wav, uint64_t frame);
+
+/**
+ * Hint the kernel to prefetch a range of frames ahead of sequential reading.
+ * @param wav - pointer to an open WAVFILE object
+ * @param start - the first frame of the range
+ * @param nframes - the number of frames in the range
+ */
+void wav_prefetch(const WAVFILE * wav, uint64_t start, uint64_t nframes);
+
+/**
+ * Decode a single channel into a double buffer, eg. as an input block for fft_convolve or an oscillator modulator.
+ * @param wav - pointer to an open WAVFILE object
+ * @param chan - the channel index (0-indexed)
+ * @param start - the first frame to read
+ * @param out - the output buffer
+ * @param nframes - the number of frames to read
+ * @return the number of frames decoded (less than nframes at the end of the file)
+ */
+unsigned long wav_readchannel(const WAVFILE * wav, unsigned int chan, uint64_t start,
+                              double * out, unsigned long nframes);
+
+/**
+ * Decode a single channel into a float buffer, eg. as the mono input for stereoPan.
+ * @param wav - pointer to an open WAVFILE object
+ * @param chan - the channel index (0-indexed)
+ * @param start - the first frame to read
+ * @param out - the output buffer
+ * @param nframes - the number of frames to read
+ * @return the number of frames decoded (less than nframes at the end of the file)
+ */
+unsigned long wav_readchannelf(const WAVFILE * wav, unsigned int chan, uint64_t start,
+                               float * out, unsigned long nframes);
+
+/**
+ * Decode interleaved frames into a double buffer of nframes * nchans samples.
+ * @param wav - pointer to an open WAVFILE object
+ * @param start - the first frame to read
+ * @param out - the interleaved output buffer
+ * @param nframes - the number of frames to read
+ * @return the number of frames decoded
+ */
+unsigned long wav_readframes(const WAVFILE * wav, uint64_t start, double * out, unsigned long nframes);
+
+/**
+ * Create a WAV file for streaming output. Returns NULL if unsuccessful.
+ * @param path - path to the output file (truncated if it exists)
+ * @param fs - the sample rate
+ * @param nchans - the number of interleaved channels
+ * @param format - the sample encoding (WAV_PCM16, WAV_PCM24, WAV_PCM32, WAV_FLOAT32, WAV_FLOAT64)
+ * @param bufsize - staging buffer size in bytes; 0 selects WAV_DEFAULT_BUFSIZE
+ * @param errMsg - pointer to a string which is set to an error description on failure
+ * @return pointer to a dynamically allocated WAVWRITER object
+ */
+WAVWRITER * wav_create(const char * path, unsigned long fs, unsigned int nchans, int format,
+                       size_t bufsize, char ** errMsg);
+
+/**
+ * Encode and write interleaved double frames (eg. fft_convolve or oscillator output). Values are clipped to [-1, 1] for integer formats.
+ * @param writer - pointer to an open WAVWRITER object
+ * @param frames - interleaved input frames
+ * @param nframes - the number of frames to write
+ * @return boolean integer specifying whether the write succeeded
+ */
+int wav_writeframes(WAVWRITER * writer, const double * frames, unsigned long nframes);
+
+/**
+ * Encode and write interleaved float frames (eg. stereoPan output).
+ * @param writer - pointer to an open WAVWRITER object
+ * @param frames - interleaved input frames
+ * @param nframes - the number of frames to write
+ * @return boolean integer specifying whether the write succeeded
+ */
+int wav_writeframesf(WAVWRITER * writer, const float * frames, unsigned long nframes);
+
+/**
+ * Flush pending frames, finalise the header and close the file.
+ * @param writer - pointer to a pointer for the WAVWRITER object, set to NULL on return
+ * @return boolean integer specifying whether the file was finalised successfully
+ */
+int wav_finish(WAVWRITER ** writer);
+
+#endif